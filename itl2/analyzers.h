@@ -6,6 +6,7 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <limits>
 
 #include "math/matrix2x2.h"
 #include "math/matrix3x3.h"
@@ -46,6 +47,49 @@ namespace itl2
 		*/
 		virtual std::vector<double> analyze(const std::vector<POINT>& points) const = 0;
 
+		/**
+		Gets count of values in the accumulator of this analyzer.
+		Analyzers that can process the particle one point at a time return a positive value, and implement
+		initAccumulator, accumulate, mergeAccumulators and finalize methods. Such analyzers do not require the point list of the particle.
+		Returns zero if the analyzer requires all the points of the particle at once.
+		*/
+		virtual size_t accumulatorSize() const
+		{
+			return 0;
+		}
+
+		/**
+		Initializes accumulator of an empty particle.
+		@param acc Pointer to accumulatorSize() values.
+		*/
+		virtual void initAccumulator(double* acc) const
+		{
+		}
+
+		/**
+		Adds a point to the accumulator.
+		*/
+		virtual void accumulate(double* acc, const POINT& p) const
+		{
+		}
+
+		/**
+		Adds the points accumulated in another accumulator to the given accumulator.
+		The two accumulators must not contain the same points.
+		*/
+		virtual void mergeAccumulators(double* acc, const double* other) const
+		{
+		}
+
+		/**
+		Calculates the results from the accumulator.
+		The results are the same as those returned by analyze for the accumulated points.
+		*/
+		virtual std::vector<double> finalize(const double* acc) const
+		{
+			throw ITLException(std::string("Analyzer ") + name() + " does not support accumulation.");
+		}
+
 		/**
 		Gets name of this analyzers.
 		*/
@@ -121,6 +165,87 @@ namespace itl2
 					resultLine.push_back(currentResults[m]);
 			}
 		}
+
+		/**
+		Tests if all the analyzers in this set support accumulation, i.e. if the particles can be analyzed without storing their points.
+		*/
+		bool canAccumulate() const
+		{
+			if (this->size() <= 0)
+				return false;
+
+			for (size_t n = 0; n < this->size(); n++)
+			{
+				if ((*this)[n]->accumulatorSize() <= 0)
+					return false;
+			}
+
+			return true;
+		}
+
+		/**
+		Initializes accumulator of an empty particle for all the analyzers in this set.
+		The accumulator contains values of all the analyzers one after another.
+		*/
+		void initAccumulator(std::vector<double>& acc) const
+		{
+			size_t total = 0;
+			for (size_t n = 0; n < this->size(); n++)
+				total += (*this)[n]->accumulatorSize();
+			acc.resize(total);
+
+			double* pAcc = acc.data();
+			for (size_t n = 0; n < this->size(); n++)
+			{
+				(*this)[n]->initAccumulator(pAcc);
+				pAcc += (*this)[n]->accumulatorSize();
+			}
+		}
+
+		/**
+		Adds a point to the accumulator initialized with initAccumulator.
+		*/
+		void accumulate(std::vector<double>& acc, const POINT& p) const
+		{
+			double* pAcc = acc.data();
+			for (size_t n = 0; n < this->size(); n++)
+			{
+				(*this)[n]->accumulate(pAcc, p);
+				pAcc += (*this)[n]->accumulatorSize();
+			}
+		}
+
+		/**
+		Adds the points accumulated in another accumulator to the given accumulator.
+		The two accumulators must not contain the same points.
+		*/
+		void mergeAccumulators(std::vector<double>& acc, const std::vector<double>& other) const
+		{
+			double* pAcc = acc.data();
+			const double* pOther = other.data();
+			for (size_t n = 0; n < this->size(); n++)
+			{
+				(*this)[n]->mergeAccumulators(pAcc, pOther);
+				pAcc += (*this)[n]->accumulatorSize();
+				pOther += (*this)[n]->accumulatorSize();
+			}
+		}
+
+		/**
+		Calculates results of all the analyzers in this vector from the accumulator.
+		@param acc Accumulator that contains at least one point.
+		@param resultLine Results will be added to this array.
+		*/
+		void finalize(const std::vector<double>& acc, std::vector<double>& resultLine) const
+		{
+			const double* pAcc = acc.data();
+			for (size_t n = 0; n < this->size(); n++)
+			{
+				std::vector<double> currentResults = (*this)[n]->finalize(pAcc);
+				resultLine.insert(resultLine.end(), currentResults.begin(), currentResults.end());
+				pAcc += (*this)[n]->accumulatorSize();
+			}
+		}
 	};
 
 
@@ -246,6 +371,46 @@ namespace itl2
 				return results;
 			}
 
+			virtual size_t accumulatorSize() const override
+			{
+				return 3;
+			}
+
+			virtual void initAccumulator(double* acc) const override
+			{
+				acc[0] = acc[1] = acc[2] = std::numeric_limits<double>::max();
+			}
+
+			virtual void accumulate(double* acc, const POINT& p) const override
+			{
+				double x = (double)p[0];
+				double y = (double)p[1];
+				double z = (double)p[2];
+
+				// Keep the smallest point in the order of vecComparer.
+				if (z < acc[2] || (z == acc[2] && (y < acc[1] || (y == acc[1] && x < acc[0]))))
+				{
+					acc[0] = x;
+					acc[1] = y;
+					acc[2] = z;
+				}
+			}
+
+			virtual void mergeAccumulators(double* acc, const double* other) const override
+			{
+				if (other[2] < acc[2] || (other[2] == acc[2] && (other[1] < acc[1] || (other[1] == acc[1] && other[0] < acc[0]))))
+				{
+					acc[0] = other[0];
+					acc[1] = other[1];
+					acc[2] = other[2];
+				}
+			}
+
+			virtual std::vector<double> finalize(const double* acc) const override
+			{
+				return { acc[0], acc[1], acc[2] };
+			}
+
 			virtual std::string name() const override
 			{
 				return "coordinates";
@@ -317,6 +482,31 @@ namespace itl2
 				return results;
 			}
 
+			virtual size_t accumulatorSize() const override
+			{
+				return 1;
+			}
+
+			virtual void initAccumulator(double* acc) const override
+			{
+				acc[0] = 0;
+			}
+
+			virtual void accumulate(double* acc, const POINT& p) const override
+			{
+				acc[0]++;
+			}
+
+			virtual void mergeAccumulators(double* acc, const double* other) const override
+			{
+				acc[0] += other[0];
+			}
+
+			virtual std::vector<double> finalize(const double* acc) const override
+			{
+				return { acc[0] };
+			}
+
 			virtual std::string name() const override
 			{
 				return "volume";
@@ -539,6 +729,35 @@ namespace itl2
 				return results;
 			}
 
+			virtual size_t accumulatorSize() const override
+			{
+				return 1;
+			}
+
+			virtual void initAccumulator(double* acc) const override
+			{
+				acc[0] = 0;
+			}
+
+			virtual void accumulate(double* acc, const POINT& p) const override
+			{
+				for (size_t dimension = 0; dimension < p.size(); dimension++)
+				{
+					if (p[dimension] <= 0 || p[dimension] >= dimensions[dimension] - 1)
+						acc[0] = 1;
+				}
+			}
+
+			virtual void mergeAccumulators(double* acc, const double* other) const override
+			{
+				acc[0] = std::max(acc[0], other[0]);
+			}
+
+			virtual std::vector<double> finalize(const double* acc) const override
+			{
+				return { acc[0] };
+			}
+
 			virtual std::string name() const override
 			{
 				return "isonedge";
@@ -976,6 +1195,45 @@ namespace itl2
 				return results;
 			}
 
+			virtual size_t accumulatorSize() const override
+			{
+				return 6;
+			}
+
+			virtual void initAccumulator(double* acc) const override
+			{
+				// The accumulator is in the same order as the results.
+				for (size_t n = 0; n < 6; n += 2)
+				{
+					acc[n] = std::numeric_limits<double>::max();
+					acc[n + 1] = std::numeric_limits<double>::lowest();
+				}
+			}
+
+			virtual void accumulate(double* acc, const POINT& p) const override
+			{
+				acc[0] = std::min(acc[0], (double)p.x);
+				acc[1] = std::max(acc[1], (double)p.x);
+				acc[2] = std::min(acc[2], (double)p.y);
+				acc[3] = std::max(acc[3], (double)p.y);
+				acc[4] = std::min(acc[4], (double)p.z);
+				acc[5] = std::max(acc[5], (double)p.z);
+			}
+
+			virtual void mergeAccumulators(double* acc, const double* other) const override
+			{
+				for (size_t n = 0; n < 6; n += 2)
+				{
+					acc[n] = std::min(acc[n], other[n]);
+					acc[n + 1] = std::max(acc[n + 1], other[n + 1]);
+				}
+			}
+
+			virtual std::vector<double> finalize(const double* acc) const override
+			{
+				return std::vector<double>(acc, acc + 6);
+			}
+
 			virtual std::string name() const override
 			{
 				return "bounds";
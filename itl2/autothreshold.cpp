@@ -1,6 +1,11 @@
 
 #include "autothreshold.h"
 #include "pointprocess.h"
+#include "generation.h"
+#include "noise.h"
+#include "testutils.h"
+#include "timer.h"
+#include "transform.h"
 #include "io/raw.h"
 
 #include <iostream>
@@ -1170,5 +1175,116 @@ namespace itl2
 
 			raw::writed(out, "./autothreshold/local_otsu");
 		}
+
+		/**
+		Compares localThreshold to the straightforward implementation that calculates the threshold separately for each neighbourhood.
+		@param maxDifferentFraction Maximum fraction of pixels that may differ for moment-based methods. The sliding sums of floating point pixels are not exactly
+		the same than sums calculated from scratch, so pixels very close to the threshold might be classified differently.
+		*/
+		template<typename pixel_t> void checkLocalThreshold(const Image<pixel_t>& img, const Vec3c& radius, double rangeMax, double maxDifferentFraction)
+		{
+			// Intermodes and Minimum are not tested as they throw an exception if the histogram of some neighbourhood does not smooth into bimodal shape.
+			const AutoThresholdMethod methods[] = {
+				AutoThresholdMethod::Otsu, AutoThresholdMethod::Huang, AutoThresholdMethod::IsoData,
+				AutoThresholdMethod::Li, AutoThresholdMethod::MaxEntropy, AutoThresholdMethod::Mean, AutoThresholdMethod::MinError,
+				AutoThresholdMethod::Moments, AutoThresholdMethod::Percentile, AutoThresholdMethod::RenyiEntropy,
+				AutoThresholdMethod::Shanbhag, AutoThresholdMethod::Triangle, AutoThresholdMethod::Yen, AutoThresholdMethod::Median,
+				AutoThresholdMethod::MidGrey, AutoThresholdMethod::Niblack, AutoThresholdMethod::Phansalkar, AutoThresholdMethod::Sauvola,
+				AutoThresholdMethod::Bernsen };
+
+			for (BoundaryCondition bc : { BoundaryCondition::Nearest, BoundaryCondition::Zero })
+			{
+				for (AutoThresholdMethod method : methods)
+				{
+					double nan = numeric_limits<double>::quiet_NaN();
+					double arg0 = nan, arg1 = nan, arg2 = nan;
+					if (internals::isHistogramThresholdMethod(method))
+					{
+						arg0 = 0;
+						arg1 = rangeMax;
+						arg2 = 64;
+					}
+
+					Image<pixel_t> gt;
+					internals::LocalThresholdSettings settings = { method, arg0, arg1, arg2, nan };
+					filter<pixel_t, pixel_t, const internals::LocalThresholdSettings&, internals::localThresholdProcessNeighbourhood<pixel_t>>(img, gt, radius, settings, NeighbourhoodType::Rectangular, bc);
+
+					Image<pixel_t> out;
+					itl2::localThreshold(img, out, radius, method, arg0, arg1, arg2, nan, bc);
+
+					size_t different = 0;
+					for (coord_t n = 0; n < img.pixelCount(); n++)
+					{
+						if (out(n) != gt(n))
+							different++;
+					}
+
+					string desc = string("local threshold, ") + toString(method) + ", " + toString(bc) + ", " + toString(imageDataType<pixel_t>()) + ", radius " + toString(radius);
+					if (internals::isMomentThresholdMethod(method))
+						testAssert(different <= maxDifferentFraction * img.pixelCount(), desc);
+					else
+						testAssert(different == 0, desc);
+				}
+			}
+		}
+
+		void slidingLocalThreshold()
+		{
+			Image<uint16_t> img16(40, 35, 30);
+			ramp(img16, 0);
+			noise(img16, 60, 20, 17);
+			checkLocalThreshold(img16, Vec3c(3, 4, 2), 180, 0.0);
+
+			Image<float32_t> img32(40, 35, 30);
+			noise(img32, 0.5, 0.2, 19);
+			checkLocalThreshold(img32, Vec3c(2, 3, 4), 1, 1e-4);
+
+			Image<uint8_t> img2d(120, 100);
+			noise(img2d, 100, 30, 23);
+			checkLocalThreshold(img2d, Vec3c(5, 7, 5), 255, 0.0);
+
+			// Non-finite values affect only the neighbourhoods that contain them, also when a large region is masked with NaNs.
+			Image<float32_t> nanImg(30, 20, 10);
+			noise(nanImg, 0.5, 0.2, 37);
+			nanImg(15, 10, 5) = numeric_limits<float32_t>::quiet_NaN();
+			nanImg(10, 3, 3) = numeric_limits<float32_t>::infinity();
+			nanImg(27, 2, 8) = -numeric_limits<float32_t>::infinity();
+			for (coord_t z = 0; z < nanImg.depth(); z++)
+				for (coord_t y = 0; y < nanImg.height(); y++)
+					for (coord_t x = 0; x < 6; x++)
+						nanImg(x, y, z) = numeric_limits<float32_t>::quiet_NaN();
+			for (AutoThresholdMethod method : { AutoThresholdMethod::Mean, AutoThresholdMethod::Niblack, AutoThresholdMethod::Phansalkar, AutoThresholdMethod::Sauvola })
+			{
+				double nan = numeric_limits<double>::quiet_NaN();
+				Vec3c radius(2, 2, 2);
+				Image<float32_t> gt, out;
+				internals::LocalThresholdSettings settings = { method, nan, nan, nan, nan };
+				filter<float32_t, float32_t, const internals::LocalThresholdSettings&, internals::localThresholdProcessNeighbourhood<float32_t>>(nanImg, gt, radius, settings, NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+				itl2::localThreshold(nanImg, out, radius, method, nan, nan, nan, nan, BoundaryCondition::Nearest);
+				checkDifference(gt, out, string("local threshold with non-finite values, ") + toString(method));
+			}
+
+			// Timing
+			Image<uint16_t> big(150, 150, 150);
+			ramp(big, 0);
+			noise(big, 50, 20, 29);
+			Vec3c radius(15, 15, 15);
+
+			Timer timer;
+			timer.start();
+			Image<uint16_t> out;
+			itl2::localThreshold(big, out, radius, AutoThresholdMethod::Otsu, 0, 250, 64);
+			timer.stop();
+			cout << "Sliding local Otsu threshold took " << timer.getSeconds() << " s" << endl;
+
+			Image<uint16_t> slab(150, 150, 4);
+			crop(big, slab, Vec3c(0, 0, 0));
+			internals::LocalThresholdSettings settings = { AutoThresholdMethod::Otsu, 0, 250, 64, numeric_limits<double>::quiet_NaN() };
+			Image<uint16_t> gt;
+			timer.start();
+			filter<uint16_t, uint16_t, const internals::LocalThresholdSettings&, internals::localThresholdProcessNeighbourhood<uint16_t>>(slab, gt, radius, settings, NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			timer.stop();
+			cout << "Neighbourhood-wise local Otsu threshold of " << slab.depth() << " slices took " << timer.getSeconds() << " s, estimated time for the full image " << timer.getSeconds() / slab.depth() * big.depth() << " s" << endl;
+		}
 	}
 }
\ No newline at end of file
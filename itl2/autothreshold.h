@@ -638,7 +638,7 @@ namespace itl2
 
 
 
-		inline double histogramAutoThreshold(Image<double>& hist, AutoThresholdMethod method, double arg)
+		inline double histogramAutoThreshold(const Image<double>& hist, AutoThresholdMethod method, double arg)
 		{
 			double bin;
 			switch (method)
@@ -681,20 +681,11 @@ namespace itl2
 		}
 
 		/**
-		Calculates threshold value for given image/neighbourhood automatically.
-		arg* parameters are documented in AutoThresholdMethod enum docs.
+		Tests if the given method calculates the threshold from histogram of the image/neighbourhood.
 		*/
-		template<typename pixel_t> double autoThresholdValue(const Image<pixel_t>& img,
-			AutoThresholdMethod method,
-			double arg0,
-			double arg1,
-			double arg2,
-			double arg3,
-			bool showProgressInfo)
+		inline bool isHistogramThresholdMethod(AutoThresholdMethod method)
 		{
-			double th;
-
-			if (method == AutoThresholdMethod::Otsu
+			return method == AutoThresholdMethod::Otsu
 				|| method == AutoThresholdMethod::Huang
 				|| method == AutoThresholdMethod::Intermodes
 				|| method == AutoThresholdMethod::IsoData
@@ -708,56 +699,123 @@ namespace itl2
 				|| method == AutoThresholdMethod::Triangle
 				|| method == AutoThresholdMethod::Yen
 				|| method == AutoThresholdMethod::Median
-				|| method == AutoThresholdMethod::Percentile)
-			{
-				double rangeMin = arg0;
-				double rangeMax = arg1;
-				double binCount = arg2;
-				double arg = arg3;
+				|| method == AutoThresholdMethod::Percentile;
+		}
 
-				internals::autothreshold::setDefault(rangeMin, internals::ThresholdDefaults<pixel_t>::range().x);
-				internals::autothreshold::setDefault(rangeMax, internals::ThresholdDefaults<pixel_t>::range().y);
-				internals::autothreshold::setDefault(binCount, (double)internals::ThresholdDefaults<pixel_t>::binCount());
+		/**
+		Tests if the given method calculates the threshold from mean and standard deviation of the image/neighbourhood.
+		*/
+		inline bool isMomentThresholdMethod(AutoThresholdMethod method)
+		{
+			return method == AutoThresholdMethod::Mean
+				|| method == AutoThresholdMethod::Niblack
+				|| method == AutoThresholdMethod::Phansalkar
+				|| method == AutoThresholdMethod::Sauvola;
+		}
 
-				size_t count = pixelRound<size_t>(binCount);
+		/**
+		Tests if the given method calculates the threshold from minimum and maximum of the image/neighbourhood.
+		*/
+		inline bool isRangeThresholdMethod(AutoThresholdMethod method)
+		{
+			return method == AutoThresholdMethod::MidGrey
+				|| method == AutoThresholdMethod::Bernsen;
+		}
 
-				Image<double> hist(count);
-				histogram<pixel_t, double, double>(img, hist, Vec2d(rangeMin, rangeMax), 0, nullptr, showProgressInfo);
+		/**
+		Histogram range, bin count and method-specific argument of histogram-based thresholding methods.
+		*/
+		struct HistogramThresholdSettings
+		{
+			double rangeMin;
+			double rangeMax;
+			size_t binCount;
+			double arg;
 
-				double bin = internals::histogramAutoThreshold(hist, method, arg);
-				th = bin / count * (rangeMax - rangeMin) + rangeMin;
-			}
-			else if (method == AutoThresholdMethod::Mean)
+			/**
+			Converts threshold bin to threshold value.
+			*/
+			double binToValue(double bin) const
 			{
-				double mu = mean(img);
-				th = internals::autothreshold::mean(mu, arg0);
+				return bin / binCount * (rangeMax - rangeMin) + rangeMin;
 			}
-			else if (method == AutoThresholdMethod::MidGrey)
+		};
+
+		/**
+		Parses histogram range, bin count and the method-specific argument from arg0, arg1, arg2 and arg3, and fills in defaults.
+		*/
+		template<typename pixel_t> HistogramThresholdSettings histogramThresholdSettings(double arg0, double arg1, double arg2, double arg3)
+		{
+			double rangeMin = arg0;
+			double rangeMax = arg1;
+			double binCount = arg2;
+
+			internals::autothreshold::setDefault(rangeMin, internals::ThresholdDefaults<pixel_t>::range().x);
+			internals::autothreshold::setDefault(rangeMax, internals::ThresholdDefaults<pixel_t>::range().y);
+			internals::autothreshold::setDefault(binCount, (double)internals::ThresholdDefaults<pixel_t>::binCount());
+
+			return HistogramThresholdSettings{ rangeMin, rangeMax, pixelRound<size_t>(binCount), arg3 };
+		}
+
+		/**
+		Calculates threshold value of a moment-based method (see isMomentThresholdMethod).
+		*/
+		inline double momentThreshold(AutoThresholdMethod method, const Vec2d& meanAndStdDev, double arg0, double arg1, double arg2, double arg3)
+		{
+			switch (method)
 			{
-				double m = (double)min(img);
-				double M = (double)max(img);
-				th = internals::autothreshold::midgrey(m, M, arg0);
+			case AutoThresholdMethod::Mean: return internals::autothreshold::mean(meanAndStdDev[0], arg0);
+			case AutoThresholdMethod::Niblack: return internals::autothreshold::niblack(meanAndStdDev[0], meanAndStdDev[1], arg0, arg1);
+			case AutoThresholdMethod::Phansalkar: return internals::autothreshold::phansalkar(meanAndStdDev[0], meanAndStdDev[1], arg0, arg1, arg2, arg3);
+			case AutoThresholdMethod::Sauvola: return internals::autothreshold::sauvola(meanAndStdDev[0], meanAndStdDev[1], arg0, arg1, arg2);
+			default: throw std::logic_error("Invalid auto threshold mode passed to helper function.");
 			}
-			else if (method == AutoThresholdMethod::Niblack)
+		}
+
+		/**
+		Calculates threshold value of a range-based method (see isRangeThresholdMethod).
+		*/
+		inline double rangeThreshold(AutoThresholdMethod method, double m, double M, double arg0)
+		{
+			switch (method)
 			{
-				Vec2d stats = meanAndStdDev(img);
-				th = internals::autothreshold::niblack(stats[0], stats[1], arg0, arg1);
+			case AutoThresholdMethod::MidGrey: return internals::autothreshold::midgrey(m, M, arg0);
+			case AutoThresholdMethod::Bernsen: return internals::autothreshold::bernsen(m, M, arg0, (m + M) / 2.0);
+			default: throw std::logic_error("Invalid auto threshold mode passed to helper function.");
 			}
-			else if (method == AutoThresholdMethod::Phansalkar)
+		}
+
+		/**
+		Calculates threshold value for given image/neighbourhood automatically.
+		arg* parameters are documented in AutoThresholdMethod enum docs.
+		*/
+		template<typename pixel_t> double autoThresholdValue(const Image<pixel_t>& img,
+			AutoThresholdMethod method,
+			double arg0,
+			double arg1,
+			double arg2,
+			double arg3,
+			bool showProgressInfo)
+		{
+			double th;
+
+			if (isHistogramThresholdMethod(method))
 			{
-				Vec2d stats = meanAndStdDev(img);
-				th = internals::autothreshold::phansalkar(stats[0], stats[1], arg0, arg1, arg2, arg3);
+				HistogramThresholdSettings settings = histogramThresholdSettings<pixel_t>(arg0, arg1, arg2, arg3);
+
+				Image<double> hist(settings.binCount);
+				histogram<pixel_t, double, double>(img, hist, Vec2d(settings.rangeMin, settings.rangeMax), 0, nullptr, showProgressInfo);
+
+				double bin = internals::histogramAutoThreshold(hist, method, settings.arg);
+				th = settings.binToValue(bin);
 			}
-			else if (method == AutoThresholdMethod::Sauvola)
+			else if (isMomentThresholdMethod(method))
 			{
-				Vec2d stats = meanAndStdDev(img);
-				th = internals::autothreshold::sauvola(stats[0], stats[1], arg0, arg1, arg2);
+				th = momentThreshold(method, meanAndStdDev(img), arg0, arg1, arg2, arg3);
 			}
-			else if (method == AutoThresholdMethod::Bernsen)
+			else if (isRangeThresholdMethod(method))
 			{
-				double m = (double)min(img);
-				double M = (double)max(img);
-				th = internals::autothreshold::bernsen(m, M, arg0, (m + M) / 2.0);
+				th = rangeThreshold(method, (double)min(img), (double)max(img), arg0);
 			}
 			else
 			{
@@ -802,6 +860,8 @@ namespace itl2
 
 		/**
 		Processes single neighbourhood in local thresholding.
+		This is the straightforward implementation that calculates the threshold from scratch for each neighbourhood.
+		It is used as a reference in testing localThreshold.
 		NOTE: This function supports only rectangular neighbourhoods.
 		*/
 		template<typename pixel_t> typename NumberUtils<pixel_t>::FloatType localThresholdProcessNeighbourhood(const Image<pixel_t>& nb, const Image<pixel_t>& mask, const LocalThresholdSettings& settings)
@@ -812,12 +872,232 @@ namespace itl2
 			else
 				return (typename NumberUtils<pixel_t>::FloatType)0;
 		}
+
+		/**
+		Calls f(value) for each pixel in the yz-plane x of a rectangular neighbourhood whose center is at (x, y, z).
+		Pixels outside of the image are handled according to the boundary condition like in getNeighbourhood.
+		*/
+		template<typename pixel_t, typename F> void forNeighbourhoodPlane(const Image<pixel_t>& img, coord_t x, coord_t y, coord_t z, const Vec3c& radius, BoundaryCondition bc, F&& f)
+		{
+			if (bc == BoundaryCondition::Zero)
+			{
+				bool xInside = x >= 0 && x < img.width();
+				for (coord_t zz = z - radius.z; zz <= z + radius.z; zz++)
+				{
+					bool zInside = xInside && zz >= 0 && zz < img.depth();
+					for (coord_t yy = y - radius.y; yy <= y + radius.y; yy++)
+					{
+						if (zInside && yy >= 0 && yy < img.height())
+							f(img(x, yy, zz));
+						else
+							f((pixel_t)0);
+					}
+				}
+			}
+			else // if bc == Nearest
+			{
+				coord_t xx = x;
+				clamp<coord_t>(xx, 0, img.width() - 1);
+				for (coord_t zz = z - radius.z; zz <= z + radius.z; zz++)
+				{
+					coord_t zc = zz;
+					clamp<coord_t>(zc, 0, img.depth() - 1);
+					for (coord_t yy = y - radius.y; yy <= y + radius.y; yy++)
+					{
+						coord_t yc = yy;
+						clamp<coord_t>(yc, 0, img.height() - 1);
+						f(img(xx, yc, zc));
+					}
+				}
+			}
+		}
+
+		/**
+		Filters image with a rectangular neighbourhood whose statistics are updated incrementally as the neighbourhood slides in the x-direction.
+		When the neighbourhood moves one pixel forward, the yz-plane leaving the neighbourhood is removed from the statistics and
+		the plane entering it is added, so the cost per pixel is proportional to the area of the plane instead of the volume of the neighbourhood.
+		@param img Input image.
+		@param out Output image.
+		@param radius Radius of the neighbourhood.
+		@param bc Boundary condition.
+		@param createAccumulator Function that creates the neighbourhood statistics object. It is called once for each thread.
+		The object must have methods clear(), add(pixel_t) and remove(pixel_t).
+		@param process Function that calculates value of output pixel given the neighbourhood statistics, value of the center pixel, and position of the center pixel.
+		*/
+		template<typename pixel_t, typename out_t, typename create_t, typename process_t> void slidingNeighbourhoodFilter(const Image<pixel_t>& img, Image<out_t>& out, Vec3c radius, BoundaryCondition bc, create_t createAccumulator, process_t process, bool showProgressInfo = true)
+		{
+			img.mustNotBe(out);
+			out.ensureSize(img);
+
+			// Zero radius in those dimensions that are not in use
+			for (size_t n = img.dimensionality(); n < radius.size(); n++)
+				radius[n] = 0;
+
+			coord_t rowCount = img.height() * img.depth();
+			size_t counter = 0;
+
+			#pragma omp parallel if(!omp_in_parallel() && img.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				auto acc = createAccumulator();
+				auto add = [&](pixel_t v) { acc.add(v); };
+				auto remove = [&](pixel_t v) { acc.remove(v); };
+
+				#pragma omp for schedule(dynamic)
+				for (coord_t row = 0; row < rowCount; row++)
+				{
+					coord_t y = row % img.height();
+					coord_t z = row / img.height();
+
+					acc.clear();
+					for (coord_t x = -radius.x; x < radius.x; x++)
+						forNeighbourhoodPlane(img, x, y, z, radius, bc, add);
+
+					for (coord_t x = 0; x < img.width(); x++)
+					{
+						forNeighbourhoodPlane(img, x + radius.x, y, z, radius, bc, add);
+						out(x, y, z) = process(acc, img(x, y, z), Vec3c(x, y, z));
+						forNeighbourhoodPlane(img, x - radius.x, y, z, radius, bc, remove);
+					}
+
+					showThreadProgress(counter, rowCount, showProgressInfo);
+				}
+			}
+		}
+
+		/**
+		Histogram of a sliding neighbourhood.
+		*/
+		template<typename pixel_t> class SlidingHistogram
+		{
+		public:
+			/**
+			Constructor
+			@param binner Bin calculator. The binner must stay alive during the lifetime of this object. It can be shared between threads.
+			@param binCount Count of bins in the histogram.
+			*/
+			SlidingHistogram(const HistogramBinner<pixel_t>& binner, size_t binCount) :
+				binner(binner),
+				hist(binCount)
+			{
+			}
+
+			void clear()
+			{
+				setValue(hist, 0.0);
+			}
+
+			void add(pixel_t v)
+			{
+				hist(binner(v))++;
+			}
+
+			void remove(pixel_t v)
+			{
+				hist(binner(v))--;
+			}
+
+			/**
+			Gets the histogram.
+			*/
+			const Image<double>& histogram() const
+			{
+				return hist;
+			}
+
+		private:
+			const HistogramBinner<pixel_t>& binner;
+			Image<double> hist;
+		};
+
+		/**
+		Sum and sum of squares of pixel values in a sliding neighbourhood.
+		Integer pixels are accumulated to integer variables, so adding and removing pixels does not accumulate round-off errors.
+		Non-finite pixels are only counted, as adding them to the sums would make the sums non-finite
+		even after the pixels have been removed.
+		*/
+		template<typename pixel_t> class SlidingMoments
+		{
+		public:
+			void clear()
+			{
+				sum = 0;
+				sum2 = 0;
+				nonFinite = 0;
+			}
+
+			void add(pixel_t v)
+			{
+				if (!isFinite(v))
+				{
+					nonFinite++;
+					return;
+				}
+				sum += (sum_t)v;
+				sum2 += (sum_t)v * (sum_t)v;
+			}
+
+			void remove(pixel_t v)
+			{
+				if (!isFinite(v))
+				{
+					nonFinite--;
+					return;
+				}
+				sum -= (sum_t)v;
+				sum2 -= (sum_t)v * (sum_t)v;
+			}
+
+			/**
+			Gets count of non-finite pixels in the neighbourhood.
+			If the count is nonzero, meanAndStdDev does not take the non-finite pixels into account.
+			*/
+			size_t nonFiniteCount() const
+			{
+				return nonFinite;
+			}
+
+			/**
+			Calculates mean and standard deviation of the pixels in the neighbourhood.
+			@param count Count of pixels in the neighbourhood.
+			*/
+			Vec2d meanAndStdDev(double count) const
+			{
+				return sumAndSquareSumToMeanAndStdDev(Vec2d((double)sum, (double)sum2), count);
+			}
+
+		private:
+			using sum_t = typename sum_intermediate_type<pixel_t>::type;
+			sum_t sum = 0;
+			sum_t sum2 = 0;
+			size_t nonFinite = 0;
+
+			static bool isFinite(pixel_t v)
+			{
+				if constexpr (std::is_floating_point_v<pixel_t>)
+					return std::isfinite(v);
+				else
+					return true;
+			}
+		};
+
+		/**
+		Converts result of comparison of a pixel and its local threshold to the value of output pixel.
+		*/
+		template<typename pixel_t> pixel_t localThresholdResult(pixel_t p, double th)
+		{
+			return intuitive::gt(p, th) ? (pixel_t)1 : (pixel_t)0;
+		}
 	}
 
 	/**
 	Applies local thresholding to the image.
+	The threshold is calculated separately for each pixel from its rectangular neighbourhood.
+	Histogram- and moment-based methods update the statistics of the neighbourhood incrementally as the neighbourhood slides along the image rows,
+	and minimum- and maximum-based methods use separable minimum and maximum filters.
+	Moment-based methods calculate the threshold from scratch for those pixels whose neighbourhood contains non-finite values.
 	@param img Input image.
 	@param out Output image. This will store the binarized image.
+	@param radius Radius of the neighbourhood.
 	@param method Thesholding method.
 	@param arg0, arg1, arg2, arg3 Arguments for the thresholding method. These are documented in docs of AutoThresholdMethod enumeration.
 	@param bc Boundary condition.
@@ -835,17 +1115,84 @@ namespace itl2
 		img.mustNotBe(out);
 		out.ensureSize(img);
 
-		internals::LocalThresholdSettings settings = {method, arg0, arg1, arg2, arg3};
+		if (internals::isHistogramThresholdMethod(method))
+		{
+			internals::HistogramThresholdSettings settings = internals::histogramThresholdSettings<pixel_t>(arg0, arg1, arg2, arg3);
+			internals::HistogramBinner<pixel_t> binner(Vec2d(settings.rangeMin, settings.rangeMax), (coord_t)settings.binCount);
+
+			internals::slidingNeighbourhoodFilter(img, out, radius, bc,
+				[&]()
+				{
+					return internals::SlidingHistogram<pixel_t>(binner, settings.binCount);
+				},
+				[&](const internals::SlidingHistogram<pixel_t>& hist, pixel_t p, const Vec3c& pos)
+				{
+					double bin = internals::histogramAutoThreshold(hist.histogram(), method, settings.arg);
+					return internals::localThresholdResult(p, settings.binToValue(bin));
+				});
+		}
+		else if (internals::isMomentThresholdMethod(method))
+		{
+			Vec3c r = radius;
+			for (size_t n = img.dimensionality(); n < r.size(); n++)
+				r[n] = 0;
+			double count = (double)(2 * r + Vec3c(1, 1, 1)).product();
+
+			internals::LocalThresholdSettings settings = { method, arg0, arg1, arg2, arg3 };
+
+			// Sliding moments and storage for neighbourhoods that contain non-finite values.
+			struct Accumulator : public internals::SlidingMoments<pixel_t>
+			{
+				Image<pixel_t> nb;
+
+				Accumulator(const Vec3c& nbSize) : nb(nbSize)
+				{
+				}
+			};
 
-		// TODO: This can be done faster (using separable filtering) for non-histogram-based auto threshold methods.
+			internals::slidingNeighbourhoodFilter(img, out, r, bc,
+				[&]()
+				{
+					return Accumulator(2 * r + Vec3c(1, 1, 1));
+				},
+				[&](Accumulator& moments, pixel_t p, const Vec3c& pos)
+				{
+					if (moments.nonFiniteCount() > 0)
+					{
+						// The non-finite values are not in the sliding sums, so calculate the threshold from the whole neighbourhood.
+						getNeighbourhood(img, pos, r, moments.nb, bc);
+						return pixelRound<pixel_t>(internals::localThresholdProcessNeighbourhood(moments.nb, moments.nb, settings));
+					}
+
+					double th = internals::momentThreshold(method, moments.meanAndStdDev(count), arg0, arg1, arg2, arg3);
+					return internals::localThresholdResult(p, th);
+				});
+		}
+		else if (internals::isRangeThresholdMethod(method))
+		{
+			// Minimum goes to the output image, maximum to a temporary image.
+			Image<pixel_t> maxImg;
+			minFilter<pixel_t, pixel_t>(img, out, radius, NeighbourhoodType::Rectangular, bc);
+			maxFilter<pixel_t, pixel_t>(img, maxImg, radius, NeighbourhoodType::Rectangular, bc);
 
-		filter<pixel_t, pixel_t, const internals::LocalThresholdSettings&, internals::localThresholdProcessNeighbourhood<pixel_t>>(img, out, radius, settings, NeighbourhoodType::Rectangular, bc);
+			#pragma omp parallel for if(!omp_in_parallel() && img.pixelCount() > PARALLELIZATION_THRESHOLD)
+			for (coord_t n = 0; n < img.pixelCount(); n++)
+			{
+				double th = internals::rangeThreshold(method, (double)out(n), (double)maxImg(n), arg0);
+				out(n) = internals::localThresholdResult(img(n), th);
+			}
+		}
+		else
+		{
+			throw ITLException(string("Unsupported auto-thresholding method: ") + toString(method));
+		}
 	}
 
 	namespace tests
 	{
 		void autothreshold();
 		void localThreshold();
+		void slidingLocalThreshold();
 	}
 
 }
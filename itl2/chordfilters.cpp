@@ -0,0 +1,127 @@
+
+#include "chordfilters.h"
+
+#include "filters.h"
+#include "generation.h"
+#include "conversions.h"
+#include "noise.h"
+#include "pointprocess.h"
+#include "stringutils.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
+
+namespace itl2
+{
+	namespace tests
+	{
+		template<typename pixel_t> void chordCase(const Vec3c& size, const Vec3c& r, NeighbourhoodType nbType, BoundaryCondition bc, double mean, double stddev)
+		{
+			Image<pixel_t> img(size);
+			add(img, mean);
+			noise(img, 0, stddev, 11);
+
+			string desc = string(" ") + toString(size) + ", r = " + toString(r) + ", " + toString(nbType) + ", " + toString(bc) + ", " + toString(img.dataType());
+
+			Image<pixel_t> gt, res;
+			filter<pixel_t, pixel_t, internals::minOp<pixel_t> >(img, gt, r, nbType, bc);
+			minFilter(img, res, r, nbType, bc, false);
+			checkDifference(gt, res, "min" + desc);
+
+			filter<pixel_t, pixel_t, internals::maxOp<pixel_t> >(img, gt, r, nbType, bc);
+			maxFilter(img, res, r, nbType, bc, false);
+			checkDifference(gt, res, "max" + desc);
+		}
+
+		void chordFilters()
+		{
+			for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+			{
+				chordCase<uint8_t>(Vec3c(40, 30, 20), Vec3c(3, 3, 3), NeighbourhoodType::Ellipsoidal, bc, 100, 30);
+				chordCase<uint16_t>(Vec3c(40, 30, 20), Vec3c(5, 2, 4), NeighbourhoodType::Ellipsoidal, bc, 1000, 300);
+				chordCase<float32_t>(Vec3c(25, 31, 17), Vec3c(7, 6, 5), NeighbourhoodType::Ellipsoidal, bc, 100, 30);
+				chordCase<int16_t>(Vec3c(7, 30, 20), Vec3c(9, 1, 2), NeighbourhoodType::Ellipsoidal, bc, 0, 300);
+				chordCase<float32_t>(Vec3c(60, 50, 1), Vec3c(6, 4, 4), NeighbourhoodType::Ellipsoidal, bc, 100, 10);
+				chordCase<float32_t>(Vec3c(60, 1, 1), Vec3c(4, 4, 4), NeighbourhoodType::Ellipsoidal, bc, 100, 10);
+				chordCase<uint8_t>(Vec3c(20, 20, 20), Vec3c(1, 1, 1), NeighbourhoodType::Ellipsoidal, bc, 100, 30);
+			}
+
+			// NaN values are ignored, also in neighbourhoods that contain only NaNs.
+			for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+			{
+				Image<float32_t> img(40, 33, 21);
+				add(img, 100);
+				noise(img, 0, 30, 13);
+				for (coord_t n = 0; n < img.pixelCount(); n += 7)
+					img(n) = numeric_limits<float32_t>::quiet_NaN();
+				draw(img, AABoxc::fromPosSize(Vec3c(10, 10, 5), Vec3c(12, 11, 9)), numeric_limits<float32_t>::quiet_NaN());
+
+				string desc = string(" with NaNs, ") + toString(bc);
+				Vec3c r(3, 2, 2);
+
+				Image<float32_t> gt, res;
+				filter<float32_t, float32_t, internals::minOp<float32_t> >(img, gt, r, NeighbourhoodType::Ellipsoidal, bc);
+				minFilter(img, res, r, NeighbourhoodType::Ellipsoidal, bc, false);
+				testAssert(equals(gt, res), "min" + desc);
+
+				filter<float32_t, float32_t, internals::maxOp<float32_t> >(img, gt, r, NeighbourhoodType::Ellipsoidal, bc);
+				maxFilter(img, res, r, NeighbourhoodType::Ellipsoidal, bc, false);
+				testAssert(equals(gt, res), "max" + desc);
+			}
+
+			// Arbitrary structuring element with multiple chords per row and center not in the structuring element.
+			Image<uint8_t> se(9, 5, 3);
+			noise(se, 0, 1, 5);
+			threshold(se, 0);
+			se(4, 2, 1) = 0;
+			se(0, 0, 0) = 1;
+
+			Image<uint16_t> img(35, 28, 19);
+			add(img, 1000);
+			noise(img, 0, 300, 7);
+
+			Image<uint16_t> res;
+			Image<float32_t> gt(img.dimensions());
+			Image<uint16_t> nb(se.dimensions());
+			Image<uint16_t> mask;
+			convert(se, mask);
+			for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+			{
+				for (coord_t z = 0; z < img.depth(); z++)
+					for (coord_t y = 0; y < img.height(); y++)
+						for (coord_t x = 0; x < img.width(); x++)
+						{
+							getNeighbourhood(img, Vec3c(x, y, z), Vec3c(4, 2, 1), nb, bc);
+							gt(x, y, z) = internals::minOp(nb, mask);
+						}
+				minFilter(img, res, se, bc);
+				checkDifference(gt, res, string("arbitrary structuring element, ") + toString(bc));
+			}
+		}
+
+		void chordFiltersSpeed()
+		{
+			Image<float32_t> img(80, 80, 80);
+			add(img, 1000);
+			noise(img, 0, 100, 1);
+
+			Image<float32_t> gt, res;
+			coord_t r = 8;
+
+			Timer timer;
+			timer.start();
+			filter<float32_t, float32_t, internals::minOp<float32_t> >(img, gt, Vec3c(r, r, r), NeighbourhoodType::Ellipsoidal, BoundaryCondition::Nearest);
+			timer.stop();
+			cout << "Generic minimum filter took " << timer.getTime() << " ms" << endl;
+
+			timer.start();
+			minFilter(img, res, r, NeighbourhoodType::Ellipsoidal, BoundaryCondition::Nearest, false);
+			timer.stop();
+			cout << "Chord decomposition minimum filter took " << timer.getTime() << " ms" << endl;
+
+			checkDifference(gt, res, "chord decomposition minimum filter");
+		}
+	}
+}
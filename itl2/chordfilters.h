@@ -0,0 +1,294 @@
+#pragma once
+
+#include "image.h"
+#include "boundarycondition.h"
+#include "utilities.h"
+#include "math/vec3.h"
+#include "math/numberutils.h"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
+
+namespace itl2
+{
+	namespace internals
+	{
+		/**
+		Tests if minimum and maximum filters of pixel type pixel_t can be calculated using chord decomposition.
+		*/
+		template<typename pixel_t> constexpr bool supportsChordFilter()
+		{
+			return std::is_arithmetic_v<pixel_t>;
+		}
+
+		/**
+		Horizontal run of pixels in a structuring element.
+		*/
+		struct Chord
+		{
+			/**
+			Position of the first pixel of the chord relative to the center of the structuring element.
+			*/
+			Vec3c start;
+
+			/**
+			Count of pixels in the chord.
+			*/
+			coord_t length;
+
+			/**
+			Index of the largest power of two that is smaller than or equal to length.
+			*/
+			size_t level;
+
+			/**
+			Offset of the second power of two -sized run so that the two runs together cover the whole chord.
+			*/
+			coord_t secondOffset;
+		};
+
+		/**
+		Decomposes structuring element into chords, i.e. into x-directional runs of nonzero pixels.
+		The center of the structuring element is at (dimensions - 1) / 2.
+		The chords are ordered by their z-coordinate.
+		*/
+		template<typename mask_t> std::vector<Chord> decomposeToChords(const Image<mask_t>& se)
+		{
+			Vec3c center = (se.dimensions() - Vec3c(1, 1, 1)) / 2;
+
+			std::vector<Chord> chords;
+			for (coord_t z = 0; z < se.depth(); z++)
+			{
+				for (coord_t y = 0; y < se.height(); y++)
+				{
+					coord_t x = 0;
+					while (x < se.width())
+					{
+						if (se(x, y, z) == 0)
+						{
+							x++;
+							continue;
+						}
+
+						coord_t x0 = x;
+						while (x < se.width() && se(x, y, z) != 0)
+							x++;
+
+						Chord c;
+						c.start = Vec3c(x0, y, z) - center;
+						c.length = x - x0;
+						c.level = 0;
+						while (((coord_t)1 << (c.level + 1)) <= c.length)
+							c.level++;
+						c.secondOffset = c.length - ((coord_t)1 << c.level);
+						chords.push_back(c);
+					}
+				}
+			}
+
+			return chords;
+		}
+
+		/**
+		Minimum or maximum of two values.
+		NaN values are ignored similarly to minOp and maxOp, i.e. if one of the values is NaN, the other one is returned.
+		*/
+		template<typename pixel_t, bool isMax> inline pixel_t chordOp(pixel_t a, pixel_t b)
+		{
+			if constexpr (std::is_floating_point_v<pixel_t>)
+			{
+				if (std::isnan(a))
+					return b;
+				if (std::isnan(b))
+					return a;
+			}
+
+			if constexpr (isMax)
+				return a > b ? a : b;
+			else
+				return a < b ? a : b;
+		}
+
+		/**
+		Calculates minimum (isMax = false) or maximum (isMax = true) filtering with arbitrary structuring element.
+		The structuring element is decomposed into x-directional chords. For each input row, minima or maxima
+		over runs of length 1, 2, 4, 8, ... are calculated using the recursive doubling method, and the extremum over
+		any chord is the combination of two (possibly overlapping) runs whose length is a power of two.
+		The cost per pixel is proportional to the number of chords, i.e. O(r^2) for r-radius ellipsoid, instead of O(r^3) of the
+		generic filter.
+
+		The result is exactly the same than that of the generic filter function with minOp or maxOp.
+		@param se Structuring element. Nonzero pixels belong to the structuring element. The center of the element is at (dimensions - 1) / 2.
+		*/
+		template<typename pixel_t, typename out_t, bool isMax, typename mask_t> void chordFilter(const Image<pixel_t>& in, Image<out_t>& out, const Image<mask_t>& se, BoundaryCondition bc)
+		{
+			static_assert(supportsChordFilter<pixel_t>(), "Chord decomposition supports only real pixel data types.");
+
+			if (bc != BoundaryCondition::Zero && bc != BoundaryCondition::Nearest)
+				throw ITLException("Unsupported boundary condition.");
+
+			out.mustNotBe(in);
+			out.ensureSize(in);
+
+			std::vector<Chord> chords = decomposeToChords(se);
+			if (chords.size() <= 0)
+				throw ITLException("The structuring element is empty.");
+
+			const coord_t w = in.width();
+			const coord_t h = in.height();
+			const coord_t d = in.depth();
+			const Vec3c seRadius = (se.dimensions() - Vec3c(1, 1, 1)) / 2;
+			const coord_t rx = std::max(seRadius.x, se.width() - 1 - seRadius.x);
+			const coord_t ry = std::max(seRadius.y, se.height() - 1 - seRadius.y);
+
+			// Length of row padded with rx pixels at both ends, and count of power of two levels.
+			const coord_t paddedWidth = w + 2 * rx;
+			size_t levels = 0;
+			for (const Chord& c : chords)
+				levels = std::max(levels, c.level + 1);
+
+			// Group chords by their z-coordinate
+			std::vector<size_t> groupStart;
+			for (size_t n = 0; n < chords.size(); n++)
+			{
+				if (n == 0 || chords[n].start.z != chords[n - 1].start.z)
+					groupStart.push_back(n);
+			}
+			groupStart.push_back(chords.size());
+
+			const pixel_t identity = isMax ? std::numeric_limits<pixel_t>::lowest() : std::numeric_limits<pixel_t>::max();
+
+			// Divide the image into work items consisting of a range of rows in one plane.
+			// Multiple items per plane are needed for parallelism if there are only a few planes.
+			coord_t threadCount = omp_get_max_threads();
+			coord_t rowBlocks = d >= threadCount ? 1 : std::min(h, (4 * threadCount + d - 1) / d);
+			coord_t itemCount = d * rowBlocks;
+
+			size_t counter = 0;
+			#pragma omp parallel if(!omp_in_parallel() && in.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				// Ring buffer of power of two run extrema for rows of one input plane.
+				const coord_t ringSize = 2 * ry + 1;
+				std::vector<pixel_t> tables(ringSize * levels * paddedWidth);
+				std::vector<coord_t> tableRow(ringSize);
+
+				// Accumulated result for the rows of the current item.
+				std::vector<pixel_t> acc;
+
+				// Calculates power of two run extrema of row (y, z) of the input image to the ring buffer, if not calculated already.
+				auto rowTable = [&](coord_t y, coord_t z) -> const pixel_t*
+				{
+					coord_t slot = ((y % ringSize) + ringSize) % ringSize;
+					pixel_t* t = &tables[slot * levels * paddedWidth];
+					if (tableRow[slot] == y)
+						return t;
+					tableRow[slot] = y;
+
+					bool outside = y < 0 || y >= h || z < 0 || z >= d;
+					if (outside && bc == BoundaryCondition::Zero)
+					{
+						std::fill(t, t + levels * paddedWidth, pixel_t());
+						return t;
+					}
+
+					const pixel_t* p = &in(0, std::clamp<coord_t>(y, 0, h - 1), std::clamp<coord_t>(z, 0, d - 1));
+					pixel_t left = bc == BoundaryCondition::Zero ? pixel_t() : p[0];
+					pixel_t right = bc == BoundaryCondition::Zero ? pixel_t() : p[w - 1];
+					std::fill(t, t + rx, left);
+					std::copy(p, p + w, t + rx);
+					std::fill(t + rx + w, t + paddedWidth, right);
+
+					for (size_t level = 1; level < levels; level++)
+					{
+						const pixel_t* prev = t + (level - 1) * paddedWidth;
+						pixel_t* curr = t + level * paddedWidth;
+						coord_t step = (coord_t)1 << (level - 1);
+						for (coord_t x = 0; x < paddedWidth - step; x++)
+							curr[x] = chordOp<pixel_t, isMax>(prev[x], prev[x + step]);
+					}
+
+					return t;
+				};
+
+				#pragma omp for schedule(dynamic)
+				for (coord_t item = 0; item < itemCount; item++)
+				{
+					coord_t z = item / rowBlocks;
+					coord_t block = item % rowBlocks;
+					coord_t y0 = block * h / rowBlocks;
+					coord_t y1 = (block + 1) * h / rowBlocks;
+
+					acc.resize((y1 - y0) * w);
+					std::fill(acc.begin(), acc.end(), identity);
+
+					for (size_t g = 0; g < groupStart.size() - 1; g++)
+					{
+						coord_t zz = z + chords[groupStart[g]].start.z;
+
+						for (coord_t slot = 0; slot < ringSize; slot++)
+							tableRow[slot] = std::numeric_limits<coord_t>::min();
+
+						for (coord_t y = y0; y < y1; y++)
+						{
+							pixel_t* accLine = &acc[(y - y0) * w];
+
+							for (size_t n = groupStart[g]; n < groupStart[g + 1]; n++)
+							{
+								const Chord& c = chords[n];
+								const pixel_t* t = rowTable(y + c.start.y, zz) + c.level * paddedWidth + rx + c.start.x;
+								const pixel_t* t2 = t + c.secondOffset;
+								for (coord_t x = 0; x < w; x++)
+									accLine[x] = chordOp<pixel_t, isMax>(accLine[x], chordOp<pixel_t, isMax>(t[x], t2[x]));
+							}
+						}
+					}
+
+					for (coord_t y = y0; y < y1; y++)
+					{
+						const pixel_t* accLine = &acc[(y - y0) * w];
+						out_t* outLine = &out(0, y, z);
+						for (coord_t x = 0; x < w; x++)
+							outLine[x] = pixelRound<out_t>(accLine[x]);
+					}
+
+					showThreadProgress(counter, itemCount);
+				}
+			}
+		}
+	}
+
+	/**
+	Calculates minimum filtering (erosion) with arbitrary structuring element.
+	The structuring element is decomposed into x-directional chords, and the cost of the filtering is proportional to the number of chords.
+	@param in Input image.
+	@param out Output image.
+	@param structuringElement Image where nonzero pixels define the structuring element. The center of the structuring element is at (dimensions - 1) / 2.
+	@param bc Boundary condition (Zero or Nearest).
+	*/
+	template<typename pixel_t, typename out_t, typename mask_t> void minFilter(const Image<pixel_t>& in, Image<out_t>& out, const Image<mask_t>& structuringElement, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		internals::chordFilter<pixel_t, out_t, false>(in, out, structuringElement, bc);
+	}
+
+	/**
+	Calculates maximum filtering (dilation) with arbitrary structuring element.
+	The structuring element is decomposed into x-directional chords, and the cost of the filtering is proportional to the number of chords.
+	@param in Input image.
+	@param out Output image.
+	@param structuringElement Image where nonzero pixels define the structuring element. The center of the structuring element is at (dimensions - 1) / 2.
+	@param bc Boundary condition (Zero or Nearest).
+	*/
+	template<typename pixel_t, typename out_t, typename mask_t> void maxFilter(const Image<pixel_t>& in, Image<out_t>& out, const Image<mask_t>& structuringElement, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		internals::chordFilter<pixel_t, out_t, true>(in, out, structuringElement, bc);
+	}
+
+	namespace tests
+	{
+		void chordFilters();
+		void chordFiltersSpeed();
+	}
+}
@@ -6,7 +6,9 @@
 #include "pointprocess.h"
 #include "projections.h"
 #include "neighbourhood.h"
+#include "noise.h"
 #include "testutils.h"
+#include "timer.h"
 
 using namespace std;
 
@@ -50,6 +52,78 @@ namespace itl2
 			dmap<uint32_t>("./input_data/test_piece_bin_256x256x256.raw", "./dmap/test_piece_result", "./input_data/test_piece_dmap_GT_256x256x256.raw", 0.5);
 			dmap<uint32_t>("./input_data/test_piece_bin_512x512x512.raw", "./dmap/test_piece_result", "./input_data/test_piece_dmap_GT_512x512x512.raw", 0.5);
 		}
+
+		/**
+		Compares squared distance map and nearest object points to brute-force calculation.
+		*/
+		template<typename dmap_t> void checkDmapBruteForce(const Vec3c& dimensions)
+		{
+			Image<uint8_t> geom(dimensions);
+			noise(geom, 128, 40, (unsigned int)dimensions.x);
+			threshold(geom, 40);
+
+			vector<Vec3c> background;
+			for (coord_t z = 0; z < geom.depth(); z++)
+				for (coord_t y = 0; y < geom.height(); y++)
+					for (coord_t x = 0; x < geom.width(); x++)
+						if (geom(x, y, z) == 0)
+							background.push_back(Vec3c(x, y, z));
+
+			Image<dmap_t> dmap2;
+			Image<Vec3c> nearest;
+			distanceTransform2(geom, dmap2, &nearest);
+
+			Image<dmap_t> dmap2NoNearest;
+			distanceTransform2(geom, dmap2NoNearest);
+
+			bool distancesOk = true;
+			bool pointsOk = true;
+			for (coord_t z = 0; z < geom.depth(); z++)
+			{
+				for (coord_t y = 0; y < geom.height(); y++)
+				{
+					for (coord_t x = 0; x < geom.width(); x++)
+					{
+						Vec3c p(x, y, z);
+						coord_t minDist = numeric_limits<coord_t>::max();
+						for (const Vec3c& b : background)
+							minDist = std::min(minDist, (p - b).normSquared<coord_t>());
+
+						if ((coord_t)dmap2(p) != minDist || (coord_t)dmap2NoNearest(p) != minDist)
+							distancesOk = false;
+
+						if ((nearest(p) - p).normSquared<coord_t>() != minDist || geom(nearest(p)) != 0)
+							pointsOk = false;
+					}
+				}
+			}
+
+			string desc = toString(imageDataType<dmap_t>()) + ", " + toString(dimensions);
+			testAssert(distancesOk, "squared distance map, " + desc);
+			testAssert(pointsOk, "nearest object points, " + desc);
+		}
+
+		void dmapBundles()
+		{
+			// Widths that are smaller than, equal to, and not multiples of the bundle size.
+			for (const Vec3c& dimensions : { Vec3c(20, 17, 15), Vec3c(internals::DMAP_BUNDLE_SIZE, 9, 21), Vec3c(77, 23, 12), Vec3c(70, 45, 1) })
+			{
+				checkDmapBruteForce<float32_t>(dimensions);
+				checkDmapBruteForce<int32_t>(dimensions);
+				checkDmapBruteForce<uint32_t>(dimensions);
+			}
+
+			// Timing
+			Image<uint8_t> geom(400, 400, 400);
+			noise(geom, 128, 40, 3);
+			threshold(geom, 40);
+			Image<float32_t> dmap;
+			Timer timer;
+			timer.start();
+			distanceTransform(geom, dmap);
+			timer.stop();
+			cout << "Distance map of " << geom.dimensions() << " image took " << timer.getSeconds() << " s" << endl;
+		}
 		
 	}
 
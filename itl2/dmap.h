@@ -52,16 +52,14 @@ namespace itl2
 
 		/*
 		Helper for distance map calculation.
-		Processes one row in dimension d whose start point is idx.
+		Processes one row of nd pixels stored contiguously in memory.
 		Optimized version that does not store nearest object point for each dmap point.
-		g and h are temporary images whose size must be output.dimension(d) x 1 x 1
+		g and h are temporary buffers whose size must be at least nd.
 		*/
-		template<typename pixel_t> void voronoi(size_t d, Vec3c idx, Image<pixel_t>& output, Image<pixel_t>& g, Image<pixel_t>& h)
+		template<typename pixel_t> void voronoi(coord_t nd, pixel_t* line, pixel_t* g, pixel_t* h)
 		{
 			using signed_t = typename NumberUtils<pixel_t>::SignedType;
 
-			coord_t nd = output.dimension(d);
-
 			//Image<float32_t> g(nd);
 			//Image<float32_t> h(nd);
 
@@ -69,9 +67,7 @@ namespace itl2
 
 			for (coord_t i = 0; i < nd; i++)
 			{
-				idx[d] = i;
-
-				pixel_t di = output(idx);
+				pixel_t di = line[i];
 
 				pixel_t iw = static_cast<pixel_t>(i);
 
@@ -80,18 +76,18 @@ namespace itl2
 					if (l < 1)
 					{
 						l++;
-						g(l) = di;
-						h(l) = iw;
+						g[l] = di;
+						h[l] = iw;
 					}
 					else
 					{
-						while ((l >= 1) && remove(g(l - 1), g(l), di, h(l - 1), h(l), iw))
+						while ((l >= 1) && remove(g[l - 1], g[l], di, h[l - 1], h[l], iw))
 						{
 							l--;
 						}
 						l++;
-						g(l) = di;
-						h(l) = iw;
+						g[l] = di;
+						h[l] = iw;
 					}
 				}
 			}
@@ -109,24 +105,24 @@ namespace itl2
 			{
 				pixel_t iw = static_cast<pixel_t>(i);
 
-				//pixel_t d1 = ::abs(g(l)) + (h(l) - iw) * (h(l) - iw);
-				//pixel_t d1 = g(l) + (pixel_t)(((signed_t)h(l) - (signed_t)iw) * ((signed_t)h(l) - (signed_t)iw));
-				//signed_t d1_tmp = (signed_t)g(l) + ((signed_t)h(l) - (signed_t)iw) * ((signed_t)h(l) - (signed_t)iw);
+				//pixel_t d1 = ::abs(g[l]) + (h[l] - iw) * (h[l] - iw);
+				//pixel_t d1 = g[l] + (pixel_t)(((signed_t)h[l] - (signed_t)iw) * ((signed_t)h[l] - (signed_t)iw));
+				//signed_t d1_tmp = (signed_t)g[l] + ((signed_t)h[l] - (signed_t)iw) * ((signed_t)h[l] - (signed_t)iw);
 				//if (d1_tmp >= std::numeric_limits<pixel_t>::max())
 				//	throw ITLException("Pixel data type cannot contain large enough values for calculating the distance map.");
 				//pixel_t d1 = (pixel_t)d1_tmp;
-				pixel_t d1 = calcD<pixel_t, signed_t>(g(l), h(l), iw);
+				pixel_t d1 = calcD<pixel_t, signed_t>(g[l], h[l], iw);
 
 				while (l < ns)
 				{
 					// be sure to compute d2 *only* if l < ns
-					//pixel_t d2 = ::abs(g(l + 1)) + (h(l + 1) - iw) * (h(l + 1) - iw);
-					//pixel_t d2 = g(l + 1) + (pixel_t)(((signed_t)h(l + 1) - (signed_t)iw) * ((signed_t)h(l + 1) - (signed_t)iw));
-					//signed_t d2_tmp = (signed_t)g(l + 1) + ((signed_t)h(l + 1) - (signed_t)iw) * ((signed_t)h(l + 1) - (signed_t)iw);
+					//pixel_t d2 = ::abs(g[l + 1]) + (h[l + 1] - iw) * (h[l + 1] - iw);
+					//pixel_t d2 = g[l + 1] + (pixel_t)(((signed_t)h[l + 1] - (signed_t)iw) * ((signed_t)h[l + 1] - (signed_t)iw));
+					//signed_t d2_tmp = (signed_t)g[l + 1] + ((signed_t)h[l + 1] - (signed_t)iw) * ((signed_t)h[l + 1] - (signed_t)iw);
 					//if (d2_tmp >= std::numeric_limits<pixel_t>::max())
 					//	throw ITLException("Pixel data type cannot contain large enough values for calculating the distance map.");
 					//pixel_t d2 = (pixel_t)d2_tmp;
-					pixel_t d2 = calcD<pixel_t, signed_t>(g(l + 1), h(l + 1), iw);
+					pixel_t d2 = calcD<pixel_t, signed_t>(g[l + 1], h[l + 1], iw);
 
 					// then compare d1 and d2
 					if (d1 <= d2)
@@ -136,25 +132,21 @@ namespace itl2
 					l++;
 					d1 = d2;
 				}
-				idx[d] = i;
-
-				output(idx) = d1;
+				line[i] = d1;
 			}
 
 		}
 
 		/*
 		Helper for distance map calculation.
-		Processes one row in dimension d whose start point is idx.
+		Processes one row of nd pixels stored contiguously in memory.
 		Fills also nearestObjectPoint image by locations of nearest object point for each dmap point.
-		g, P, and h are temporary images whose size must be output.dimension(d) x 1 x 1
+		g, P, and h are temporary buffers whose size must be at least nd.
 		*/
-		template<typename pixel_t> void voronoi(size_t d, Vec3c idx, Image<pixel_t>& output, Image<Vec3c>& nearestObjectPoint, Image<pixel_t>& g, Image<Vec3c>& P, Image<pixel_t>& h)
+		template<typename pixel_t> void voronoi(coord_t nd, pixel_t* line, Vec3c* nearestObjectPoint, pixel_t* g, Vec3c* P, pixel_t* h)
 		{
 			using signed_t = typename NumberUtils<pixel_t>::SignedType;
 
-			coord_t nd = output.dimension(d);
-
 			//Image<float32_t> g(nd);
 			//Image<Vec3c> P(nd);
 			//Image<float32_t> h(nd);
@@ -163,9 +155,7 @@ namespace itl2
 
 			for (coord_t i = 0; i < nd; i++)
 			{
-				idx[d] = i;
-
-				pixel_t di = output(idx);
+				pixel_t di = line[i];
 
 				pixel_t iw = static_cast<pixel_t>(i);
 				
@@ -174,20 +164,20 @@ namespace itl2
 					if (l < 1)
 					{
 						l++;
-						g(l) = di;
-						h(l) = iw;
-						P(l) = nearestObjectPoint(idx);
+						g[l] = di;
+						h[l] = iw;
+						P[l] = nearestObjectPoint[i];
 					}
 					else
 					{
-						while ((l >= 1)	&& remove(g(l - 1), g(l), di, h(l - 1), h(l), iw))
+						while ((l >= 1)	&& remove(g[l - 1], g[l], di, h[l - 1], h[l], iw))
 						{
 							l--;
 						}
 						l++;
-						g(l) = di;
-						h(l) = iw;
-						P(l) = nearestObjectPoint(idx);
+						g[l] = di;
+						h[l] = iw;
+						P[l] = nearestObjectPoint[i];
 					}
 				}
 			}
@@ -205,17 +195,17 @@ namespace itl2
 			{
 				pixel_t iw = static_cast<pixel_t>(i);
 
-				//pixel_t d1 = ::abs(g(l)) + (h(l) - iw) * (h(l) - iw);
-				//pixel_t d1 = g(l) + (pixel_t)(((signed_t)h(l) - (signed_t)iw) * ((signed_t)h(l) - (signed_t)iw));
-				pixel_t d1 = calcD<pixel_t, signed_t>(g(l), h(l), iw);
-				Vec3c Pc = P(l);
+				//pixel_t d1 = ::abs(g[l]) + (h[l] - iw) * (h[l] - iw);
+				//pixel_t d1 = g[l] + (pixel_t)(((signed_t)h[l] - (signed_t)iw) * ((signed_t)h[l] - (signed_t)iw));
+				pixel_t d1 = calcD<pixel_t, signed_t>(g[l], h[l], iw);
+				Vec3c Pc = P[l];
 
 				while (l < ns)
 				{
 					// be sure to compute d2 *only* if l < ns
-					//pixel_t d2 = ::abs(g(l + 1)) + (h(l + 1) - iw) * (h(l + 1) - iw);
-					//pixel_t d2 = g(l + 1) + (pixel_t)(((signed_t)h(l + 1) - (signed_t)iw) * ((signed_t)h(l + 1) - (signed_t)iw));
-					pixel_t d2 = calcD<pixel_t, signed_t>(g(l + 1), h(l + 1), iw);
+					//pixel_t d2 = ::abs(g[l + 1]) + (h[l + 1] - iw) * (h[l + 1] - iw);
+					//pixel_t d2 = g[l + 1] + (pixel_t)(((signed_t)h[l + 1] - (signed_t)iw) * ((signed_t)h[l + 1] - (signed_t)iw));
+					pixel_t d2 = calcD<pixel_t, signed_t>(g[l + 1], h[l + 1], iw);
 
 					// then compare d1 and d2
 					if (d1 <= d2)
@@ -224,57 +214,122 @@ namespace itl2
 					}
 					l++;
 					d1 = d2;
-					Pc = P(l);
+					Pc = P[l];
 				}
-				idx[d] = i;
-
-				output(idx) = d1;
+				line[i] = d1;
 
-				nearestObjectPoint(idx) = Pc;
+				nearestObjectPoint[i] = Pc;
 			}
 
 		}
 
 
+		/**
+		Count of adjacent rows that are processed together in processDimension when the rows are not parallel to the x-direction.
+		*/
+		constexpr coord_t DMAP_BUNDLE_SIZE = 32;
+
+		/**
+		Processes all rows of the image in the given dimension.
+		Rows parallel to the x-direction are contiguous in memory and they are processed in place.
+		Rows in the other dimensions are processed in bundles of DMAP_BUNDLE_SIZE rows that are adjacent in the x-direction.
+		The pixels of the bundle are copied to a buffer where each row is contiguous, processed, and copied back.
+		This way the image is accessed in runs of DMAP_BUNDLE_SIZE pixels instead of one pixel at a time.
+		*/
 		template<typename pixel_t>  void processDimension(Image<pixel_t>& output, size_t currentDimension, Image<Vec3c>* nearestObjectPoint, bool showProgressInfo = false)
 		{
-			// Determine count of pixels to process
+			coord_t nd = output.dimension(currentDimension);
+			coord_t bundleSize = currentDimension == 0 ? 1 : std::min(DMAP_BUNDLE_SIZE, output.width());
+			coord_t stride = currentDimension == 0 ? 1 : (currentDimension == 1 ? output.width() : output.width() * output.height());
+
+			// Determine count of bundles to process
 			Vec3c reducedDimensions = output.dimensions();
 			reducedDimensions[currentDimension] = 1;
-			coord_t rowCount = reducedDimensions.x * reducedDimensions.y * reducedDimensions.z;
+			reducedDimensions.x = (reducedDimensions.x + bundleSize - 1) / bundleSize;
+			coord_t bundleCount = reducedDimensions.x * reducedDimensions.y * reducedDimensions.z;
 
 			bool failed = false;
 			ITLException error("");
 			size_t counter = 0;
 			#pragma omp parallel if(!omp_in_parallel() && output.pixelCount() > PARALLELIZATION_THRESHOLD)
 			{
-				// Temporary buffer
-				coord_t nd = output.dimension(currentDimension);
-				Image<pixel_t> g(nd);
-				Image<Vec3c> P;
+				// Temporary buffers
+				std::vector<pixel_t> g(nd);
+				std::vector<Vec3c> P;
 				if (nearestObjectPoint)
-					P.ensureSize(nd);
-				Image<pixel_t> h(nd);
+					P.resize(nd);
+				std::vector<pixel_t> h(nd);
+
+				std::vector<pixel_t> rows;
+				std::vector<Vec3c> rowPoints;
+				if (bundleSize > 1)
+				{
+					rows.resize(nd * bundleSize);
+					if (nearestObjectPoint)
+						rowPoints.resize(nd * bundleSize);
+				}
 
-				// Determine start points of pixel rows and process each row
+				auto processRow = [&](pixel_t* row, Vec3c* points)
+					{
+						if (!nearestObjectPoint)
+							voronoi(nd, row, g.data(), h.data());
+						else
+							voronoi(nd, row, points, g.data(), P.data(), h.data());
+					};
+
+				// Determine start points of bundles and process each bundle
 				#pragma omp for
-				for (coord_t n = 0; n < rowCount; n++)
+				for (coord_t n = 0; n < bundleCount; n++)
 				{
 				    if(!failed)
 				    {
 					    try
 					    {
 						    Vec3c start = indexToCoords(n, reducedDimensions);
-
-						    // Process the current row
-						    if (!nearestObjectPoint)
-						    {
-							    voronoi(currentDimension, start, output, g, h);
-						    }
-						    else
-						    {
-							    voronoi(currentDimension, start, output, *nearestObjectPoint, g, P, h);
-						    }
+							start.x *= bundleSize;
+
+							pixel_t* pixels = &output(start);
+							Vec3c* points = nearestObjectPoint ? &(*nearestObjectPoint)(start) : nullptr;
+
+							if (bundleSize <= 1)
+							{
+								processRow(pixels, points);
+							}
+							else
+							{
+								coord_t count = std::min(bundleSize, output.width() - start.x);
+
+								for (coord_t i = 0; i < nd; i++)
+								{
+									for (coord_t b = 0; b < count; b++)
+										rows[b * nd + i] = pixels[i * stride + b];
+								}
+								if (points)
+								{
+									for (coord_t i = 0; i < nd; i++)
+									{
+										for (coord_t b = 0; b < count; b++)
+											rowPoints[b * nd + i] = points[i * stride + b];
+									}
+								}
+
+								for (coord_t b = 0; b < count; b++)
+									processRow(&rows[b * nd], points ? &rowPoints[b * nd] : nullptr);
+
+								for (coord_t i = 0; i < nd; i++)
+								{
+									for (coord_t b = 0; b < count; b++)
+										pixels[i * stride + b] = rows[b * nd + i];
+								}
+								if (points)
+								{
+									for (coord_t i = 0; i < nd; i++)
+									{
+										for (coord_t b = 0; b < count; b++)
+											points[i * stride + b] = rowPoints[b * nd + i];
+									}
+								}
+							}
 					    }
 					    catch (ITLException ex)
 					    {
@@ -282,7 +337,7 @@ namespace itl2
 						    failed = true;
 					    }
                     }
-					showThreadProgress(counter, rowCount, showProgressInfo);
+					showThreadProgress(counter, bundleCount, showProgressInfo);
 				}
 			}
 
@@ -457,6 +512,7 @@ namespace itl2
 	namespace tests
 	{
 		void dmap1();
+		void dmapBundles();
 	}
 
 }
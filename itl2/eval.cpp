@@ -1,9 +1,659 @@
 
 #include "eval.h"
 #include "testutils.h"
+#include "noise.h"
+#include "pointprocess.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <limits>
+#include <map>
 
 namespace itl2
 {
+	namespace internals
+	{
+		namespace
+		{
+			/**
+			Thrown by the expression compiler if the expression contains unsupported constructs.
+			*/
+			struct UnsupportedExpression
+			{
+			};
+
+			/**
+			Node of expression DAG built by the compiler.
+			*/
+			struct ExpressionNode
+			{
+				EvalOp op;
+				std::vector<size_t> args;
+				bool isConstant;
+				double value;
+				coord_t index;
+			};
+
+			template<typename F> void apply1(F f, const EvalOperand& a, double* regs, double* out, coord_t count)
+			{
+				if (a.isConstant)
+				{
+					double av = f(a.value);
+					for (coord_t i = 0; i < count; i++)
+						out[i] = av;
+				}
+				else
+				{
+					const double* ap = regs + a.reg * CompiledExpression::SPAN_SIZE;
+					for (coord_t i = 0; i < count; i++)
+						out[i] = f(ap[i]);
+				}
+			}
+
+			template<typename F> void apply2(F f, const EvalOperand& a, const EvalOperand& b, double* regs, double* out, coord_t count)
+			{
+				const double* ap = regs + a.reg * CompiledExpression::SPAN_SIZE;
+				const double* bp = regs + b.reg * CompiledExpression::SPAN_SIZE;
+				double av = a.value;
+				double bv = b.value;
+
+				if (!a.isConstant && !b.isConstant)
+				{
+					for (coord_t i = 0; i < count; i++)
+						out[i] = f(ap[i], bp[i]);
+				}
+				else if (!a.isConstant)
+				{
+					for (coord_t i = 0; i < count; i++)
+						out[i] = f(ap[i], bv);
+				}
+				else if (!b.isConstant)
+				{
+					for (coord_t i = 0; i < count; i++)
+						out[i] = f(av, bp[i]);
+				}
+				else
+				{
+					double v = f(av, bv);
+					for (coord_t i = 0; i < count; i++)
+						out[i] = v;
+				}
+			}
+
+			/**
+			Calculates v^N using the same sequence of multiplications than exprtk uses for constant integer exponents.
+			*/
+			inline double intPow(double v, coord_t N)
+			{
+				switch (N)
+				{
+				case 0: return 1.0;
+				case 1: return v;
+				case 2: return v * v;
+				case 3: return v * v * v;
+				case 4: { double v2 = v * v; return v2 * v2; }
+				case 5: { double v2 = v * v; return (v2 * v2) * v; }
+				case 6: { double v3 = v * v * v; return v3 * v3; }
+				case 7: { double v3 = v * v * v; return (v3 * v3) * v; }
+				case 8: { double v2 = v * v; double v4 = v2 * v2; return v4 * v4; }
+				case 9: { double v2 = v * v; double v4 = v2 * v2; return (v4 * v4) * v; }
+				case 10: { double v2 = v * v; double v5 = (v2 * v2) * v; return v5 * v5; }
+				default:
+				{
+					double l = 1.0;
+					while (N)
+					{
+						if (N % 2 == 1)
+						{
+							l *= v;
+							N--;
+						}
+						v *= v;
+						N /= 2;
+					}
+					return l;
+				}
+				}
+			}
+
+			inline bool isTrue(double v)
+			{
+				return v != 0.0;
+			}
+
+			/**
+			Executes one instruction for count pixels.
+			Register r is stored at regs + r * SPAN_SIZE.
+			*/
+			void execute(const EvalInstruction& ins, double* regs, coord_t count)
+			{
+				double* out = regs + ins.out * CompiledExpression::SPAN_SIZE;
+				const EvalOperand& a = ins.a;
+				const EvalOperand& b = ins.b;
+
+				switch (ins.op)
+				{
+				case EvalOp::Fill: apply1([](double x) { return x; }, a, regs, out, count); break;
+				case EvalOp::Neg: apply1([](double x) { return -x; }, a, regs, out, count); break;
+				case EvalOp::Not: apply1([](double x) { return isTrue(x) ? 0.0 : 1.0; }, a, regs, out, count); break;
+				case EvalOp::Abs: apply1([](double x) { return x < 0.0 ? -x : x; }, a, regs, out, count); break;
+				case EvalOp::Acos: apply1([](double x) { return std::acos(x); }, a, regs, out, count); break;
+				case EvalOp::Asin: apply1([](double x) { return std::asin(x); }, a, regs, out, count); break;
+				case EvalOp::Atan: apply1([](double x) { return std::atan(x); }, a, regs, out, count); break;
+				case EvalOp::Ceil: apply1([](double x) { return std::ceil(x); }, a, regs, out, count); break;
+				case EvalOp::Cos: apply1([](double x) { return std::cos(x); }, a, regs, out, count); break;
+				case EvalOp::Cosh: apply1([](double x) { return std::cosh(x); }, a, regs, out, count); break;
+				case EvalOp::Exp: apply1([](double x) { return std::exp(x); }, a, regs, out, count); break;
+				case EvalOp::Floor: apply1([](double x) { return std::floor(x); }, a, regs, out, count); break;
+				case EvalOp::Log: apply1([](double x) { return std::log(x); }, a, regs, out, count); break;
+				case EvalOp::Log10: apply1([](double x) { return std::log10(x); }, a, regs, out, count); break;
+				case EvalOp::Round: apply1([](double x) { return x < 0.0 ? std::ceil(x - 0.5) : std::floor(x + 0.5); }, a, regs, out, count); break;
+				case EvalOp::Sgn: apply1([](double x) { return x > 0.0 ? 1.0 : (x < 0.0 ? -1.0 : 0.0); }, a, regs, out, count); break;
+				case EvalOp::Sin: apply1([](double x) { return std::sin(x); }, a, regs, out, count); break;
+				case EvalOp::Sinh: apply1([](double x) { return std::sinh(x); }, a, regs, out, count); break;
+				case EvalOp::Sqrt: apply1([](double x) { return std::sqrt(x); }, a, regs, out, count); break;
+				case EvalOp::Tan: apply1([](double x) { return std::tan(x); }, a, regs, out, count); break;
+				case EvalOp::Tanh: apply1([](double x) { return std::tanh(x); }, a, regs, out, count); break;
+				case EvalOp::Trunc: apply1([](double x) { return (double)(long long)x; }, a, regs, out, count); break;
+				case EvalOp::IntPow:
+				{
+					coord_t N = ins.index < 0 ? -ins.index : ins.index;
+					if (ins.index >= 0)
+						apply1([=](double x) { return intPow(x, N); }, a, regs, out, count);
+					else
+						apply1([=](double x) { return 1.0 / intPow(x, N); }, a, regs, out, count);
+					break;
+				}
+				case EvalOp::Add: apply2([](double x, double y) { return x + y; }, a, b, regs, out, count); break;
+				case EvalOp::Sub: apply2([](double x, double y) { return x - y; }, a, b, regs, out, count); break;
+				case EvalOp::Mul: apply2([](double x, double y) { return x * y; }, a, b, regs, out, count); break;
+				case EvalOp::Div: apply2([](double x, double y) { return x / y; }, a, b, regs, out, count); break;
+				case EvalOp::Mod: apply2([](double x, double y) { return std::fmod(x, y); }, a, b, regs, out, count); break;
+				case EvalOp::Pow: apply2([](double x, double y) { return std::pow(x, y); }, a, b, regs, out, count); break;
+				case EvalOp::Atan2: apply2([](double x, double y) { return std::atan2(x, y); }, a, b, regs, out, count); break;
+				case EvalOp::Hypot: apply2([](double x, double y) { return std::sqrt(x * x + y * y); }, a, b, regs, out, count); break;
+				case EvalOp::Min: apply2([](double x, double y) { return y < x ? y : x; }, a, b, regs, out, count); break;
+				case EvalOp::Max: apply2([](double x, double y) { return x < y ? y : x; }, a, b, regs, out, count); break;
+				case EvalOp::Lt: apply2([](double x, double y) { return x < y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::Lte: apply2([](double x, double y) { return x <= y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::Gt: apply2([](double x, double y) { return x > y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::Gte: apply2([](double x, double y) { return x >= y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				// exprtk compares exactly in the == and != operators (eq_op and ne_op), the tolerance of equal_impl is used only in the equal and not_equal functions.
+				case EvalOp::Eq: apply2([](double x, double y) { return x == y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::Ne: apply2([](double x, double y) { return x != y ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::And: apply2([](double x, double y) { return isTrue(x) && isTrue(y) ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::Or: apply2([](double x, double y) { return isTrue(x) || isTrue(y) ? 1.0 : 0.0; }, a, b, regs, out, count); break;
+				case EvalOp::If:
+				{
+					// The condition is evaluated per pixel, but both branches have already been evaluated for the whole span.
+					const EvalOperand& c = ins.c;
+					const double* ap = regs + a.reg * CompiledExpression::SPAN_SIZE;
+					const double* bp = regs + b.reg * CompiledExpression::SPAN_SIZE;
+					const double* cp = regs + c.reg * CompiledExpression::SPAN_SIZE;
+					for (coord_t i = 0; i < count; i++)
+					{
+						double av = a.isConstant ? a.value : ap[i];
+						double bv = b.isConstant ? b.value : bp[i];
+						double cv = c.isConstant ? c.value : cp[i];
+						out[i] = isTrue(av) ? bv : cv;
+					}
+					break;
+				}
+				default:
+					throw ITLException("Invalid compiled expression instruction.");
+				}
+			}
+
+			/**
+			Recursive descent parser that converts a subset of exprtk syntax to expression DAG.
+			Operator precedences and associativity are the same than in exprtk.
+			*/
+			class ExpressionCompiler
+			{
+			private:
+				enum class TokenType
+				{
+					Number,
+					Name,
+					Symbol,
+					End
+				};
+
+				std::string str;
+				size_t pos;
+				TokenType tokenType;
+				std::string token;
+				double tokenValue;
+
+				size_t paramCount;
+				std::map<coord_t, size_t> paramNodes;
+
+			public:
+				std::vector<ExpressionNode> nodes;
+
+			private:
+
+				void next()
+				{
+					while (pos < str.length() && std::isspace((unsigned char)str[pos]))
+						pos++;
+
+					token.clear();
+
+					if (pos >= str.length())
+					{
+						tokenType = TokenType::End;
+						return;
+					}
+
+					char ch = str[pos];
+					if (std::isdigit((unsigned char)ch) || (ch == '.' && pos + 1 < str.length() && std::isdigit((unsigned char)str[pos + 1])))
+					{
+						const char* begin = str.c_str() + pos;
+						char* end;
+						tokenValue = std::strtod(begin, &end);
+						pos += end - begin;
+
+						// Implicit multiplication (e.g. 2x0) and other constructs are not supported.
+						if (pos < str.length() && (std::isalnum((unsigned char)str[pos]) || str[pos] == '_' || str[pos] == '.'))
+							throw UnsupportedExpression();
+
+						tokenType = TokenType::Number;
+					}
+					else if (std::isalpha((unsigned char)ch) || ch == '_')
+					{
+						while (pos < str.length() && (std::isalnum((unsigned char)str[pos]) || str[pos] == '_'))
+						{
+							token += (char)std::tolower((unsigned char)str[pos]);
+							pos++;
+						}
+						tokenType = TokenType::Name;
+					}
+					else
+					{
+						static const char* twoChar[] = { "<=", ">=", "==", "!=", "<>" };
+						for (const char* op : twoChar)
+						{
+							if (str.compare(pos, 2, op) == 0)
+							{
+								token = op;
+								pos += 2;
+								tokenType = TokenType::Symbol;
+								return;
+							}
+						}
+
+						static const std::string oneChar = "+-*/%^<>=&|,()";
+						if (oneChar.find(ch) == std::string::npos)
+							throw UnsupportedExpression();
+
+						token = ch;
+						pos++;
+						tokenType = TokenType::Symbol;
+					}
+				}
+
+				bool isSymbol(const char* s) const
+				{
+					return tokenType == TokenType::Symbol && token == s;
+				}
+
+				void expect(const char* s)
+				{
+					if (!isSymbol(s))
+						throw UnsupportedExpression();
+					next();
+				}
+
+				size_t constant(double value)
+				{
+					nodes.push_back(ExpressionNode{ EvalOp::Fill, {}, true, value, 0 });
+					return nodes.size() - 1;
+				}
+
+				/**
+				Adds new node to the DAG. Evaluates the node immediately if all its arguments are constants.
+				*/
+				size_t node(EvalOp op, const std::vector<size_t>& args)
+				{
+					// Constant integer exponents are calculated by repeated multiplication as in exprtk.
+					if (op == EvalOp::Pow && !nodes[args[0]].isConstant && nodes[args[1]].isConstant)
+					{
+						double c = nodes[args[1]].value;
+						if (std::abs(c) <= 60 && c == std::trunc(c))
+						{
+							nodes.push_back(ExpressionNode{ EvalOp::IntPow, { args[0] }, false, 0, (coord_t)c });
+							return nodes.size() - 1;
+						}
+					}
+
+					nodes.push_back(ExpressionNode{ op, args, false, 0, 0 });
+
+					bool allConstant = true;
+					for (size_t arg : args)
+						allConstant = allConstant && nodes[arg].isConstant;
+
+					if (allConstant)
+					{
+						EvalInstruction ins;
+						ins.op = op;
+						ins.out = 0;
+						ins.index = 0;
+						EvalOperand* ops[] = { &ins.a, &ins.b, &ins.c };
+						for (size_t n = 0; n < args.size(); n++)
+						{
+							ops[n]->isConstant = true;
+							ops[n]->value = nodes[args[n]].value;
+						}
+
+						double result;
+						execute(ins, &result, 1);
+
+						nodes.back().isConstant = true;
+						nodes.back().value = result;
+						nodes.back().args.clear();
+					}
+
+					return nodes.size() - 1;
+				}
+
+				/**
+				Gets left and right precedence of binary operator in the current token.
+				Returns false if the current token is not a binary operator.
+				*/
+				bool binaryOperator(int& left, int& right, EvalOp& op) const
+				{
+					if (tokenType == TokenType::Name)
+					{
+						if (token == "or") { left = 1; right = 2; op = EvalOp::Or; return true; }
+						if (token == "and") { left = 3; right = 4; op = EvalOp::And; return true; }
+						return false;
+					}
+
+					if (tokenType != TokenType::Symbol)
+						return false;
+
+					if (token == "|") { left = 1; right = 2; op = EvalOp::Or; return true; }
+					if (token == "&") { left = 3; right = 4; op = EvalOp::And; return true; }
+					if (token == "<") { left = 5; right = 6; op = EvalOp::Lt; return true; }
+					if (token == "<=") { left = 5; right = 6; op = EvalOp::Lte; return true; }
+					if (token == ">") { left = 5; right = 6; op = EvalOp::Gt; return true; }
+					if (token == ">=") { left = 5; right = 6; op = EvalOp::Gte; return true; }
+					if (token == "=" || token == "==") { left = 5; right = 6; op = EvalOp::Eq; return true; }
+					if (token == "!=" || token == "<>") { left = 5; right = 6; op = EvalOp::Ne; return true; }
+					if (token == "+") { left = 7; right = 8; op = EvalOp::Add; return true; }
+					if (token == "-") { left = 7; right = 8; op = EvalOp::Sub; return true; }
+					if (token == "*") { left = 10; right = 11; op = EvalOp::Mul; return true; }
+					if (token == "/") { left = 10; right = 11; op = EvalOp::Div; return true; }
+					if (token == "%") { left = 10; right = 11; op = EvalOp::Mod; return true; }
+					if (token == "^") { left = 12; right = 12; op = EvalOp::Pow; return true; }
+					return false;
+				}
+
+				size_t parseExpression(int precedence)
+				{
+					size_t expr = parseBranch();
+
+					int left, right;
+					EvalOp op;
+					while (binaryOperator(left, right, op) && left >= precedence)
+					{
+						next();
+						size_t rightExpr = parseExpression(right);
+						expr = node(op, { expr, rightExpr });
+					}
+
+					return expr;
+				}
+
+				size_t parseFunction(const std::string& name)
+				{
+					std::vector<size_t> args;
+					expect("(");
+					args.push_back(parseExpression(0));
+					while (isSymbol(","))
+					{
+						next();
+						args.push_back(parseExpression(0));
+					}
+					expect(")");
+
+					static const std::map<std::string, EvalOp> unary =
+					{
+						{ "abs", EvalOp::Abs }, { "acos", EvalOp::Acos }, { "asin", EvalOp::Asin }, { "atan", EvalOp::Atan },
+						{ "ceil", EvalOp::Ceil }, { "cos", EvalOp::Cos }, { "cosh", EvalOp::Cosh }, { "exp", EvalOp::Exp },
+						{ "floor", EvalOp::Floor }, { "log", EvalOp::Log }, { "log10", EvalOp::Log10 }, { "not", EvalOp::Not },
+						{ "round", EvalOp::Round }, { "sgn", EvalOp::Sgn }, { "sin", EvalOp::Sin }, { "sinh", EvalOp::Sinh },
+						{ "sqrt", EvalOp::Sqrt }, { "tan", EvalOp::Tan }, { "tanh", EvalOp::Tanh }, { "trunc", EvalOp::Trunc },
+					};
+
+					static const std::map<std::string, EvalOp> binary =
+					{
+						{ "atan2", EvalOp::Atan2 }, { "hypot", EvalOp::Hypot }, { "pow", EvalOp::Pow },
+					};
+
+					if (auto it = unary.find(name); it != unary.end() && args.size() == 1)
+						return node(it->second, args);
+
+					if (auto it = binary.find(name); it != binary.end() && args.size() == 2)
+						return node(it->second, args);
+
+					if (name == "min" || name == "max")
+					{
+						size_t result = args[0];
+						for (size_t n = 1; n < args.size(); n++)
+							result = node(name == "min" ? EvalOp::Min : EvalOp::Max, { result, args[n] });
+						return result;
+					}
+
+					if (name == "if" && args.size() == 3)
+						return node(EvalOp::If, args);
+
+					throw UnsupportedExpression();
+				}
+
+				size_t parseBranch()
+				{
+					if (tokenType == TokenType::Number)
+					{
+						double value = tokenValue;
+						next();
+						return constant(value);
+					}
+
+					if (isSymbol("("))
+					{
+						next();
+						size_t expr = parseExpression(0);
+						expect(")");
+						return expr;
+					}
+
+					if (isSymbol("-"))
+					{
+						next();
+						return node(EvalOp::Neg, { parseExpression(11) });
+					}
+
+					if (isSymbol("+"))
+					{
+						next();
+						return parseExpression(13);
+					}
+
+					if (tokenType == TokenType::Name)
+					{
+						std::string name = token;
+						next();
+
+						if (isSymbol("("))
+							return parseFunction(name);
+
+						if (name == "pi")
+							return constant(3.14159265358979323846264338327950288419716939937510);
+						if (name == "epsilon")
+							return constant(0.000000000100);
+						if (name == "inf")
+							return constant(std::numeric_limits<double>::infinity());
+
+						if (name.length() >= 2 && name[0] == 'x' && name.find_first_not_of("0123456789", 1) == std::string::npos && name.length() < 10)
+						{
+							coord_t index = std::stoll(name.substr(1));
+							if (index < (coord_t)paramCount)
+							{
+								if (auto it = paramNodes.find(index); it != paramNodes.end())
+									return it->second;
+
+								nodes.push_back(ExpressionNode{ EvalOp::Param, {}, false, 0, index });
+								paramNodes[index] = nodes.size() - 1;
+								return nodes.size() - 1;
+							}
+						}
+					}
+
+					throw UnsupportedExpression();
+				}
+
+			public:
+
+				ExpressionCompiler(const std::string& expression, size_t paramCount) :
+					str(expression),
+					pos(0),
+					tokenType(TokenType::End),
+					tokenValue(0),
+					paramCount(paramCount)
+				{
+				}
+
+				/**
+				Parses the expression and returns index of the root node.
+				*/
+				size_t parse()
+				{
+					next();
+					size_t root = parseExpression(0);
+					if (tokenType != TokenType::End)
+						throw UnsupportedExpression();
+					return root;
+				}
+			};
+		}
+
+		bool CompiledExpression::compile(const std::string& expression, size_t paramCount)
+		{
+			program.clear();
+			registerCount = 0;
+			resultRegister = 0;
+
+			ExpressionCompiler compiler(expression, paramCount);
+			size_t root;
+			try
+			{
+				root = compiler.parse();
+			}
+			catch (const UnsupportedExpression&)
+			{
+				return false;
+			}
+
+			const std::vector<ExpressionNode>& nodes = compiler.nodes;
+
+			if (nodes[root].isConstant)
+			{
+				EvalInstruction ins;
+				ins.op = EvalOp::Fill;
+				ins.a.value = nodes[root].value;
+				ins.out = 0;
+				ins.index = 0;
+				program.push_back(ins);
+				registerCount = 1;
+				return true;
+			}
+
+			// Find the last node that uses output of each node.
+			std::vector<size_t> lastUse(nodes.size(), 0);
+			for (size_t n = 0; n < nodes.size(); n++)
+			{
+				if (!nodes[n].isConstant)
+				{
+					for (size_t arg : nodes[n].args)
+						lastUse[arg] = n;
+				}
+			}
+			lastUse[root] = nodes.size();
+
+			// Convert nodes to instructions, re-using registers whose values are not needed anymore.
+			std::vector<size_t> nodeRegister(nodes.size(), 0);
+			std::vector<size_t> freeRegisters;
+			for (size_t n = 0; n <= root; n++)
+			{
+				const ExpressionNode& node = nodes[n];
+				if (node.isConstant)
+					continue;
+
+				EvalInstruction ins;
+				ins.op = node.op;
+				ins.index = node.index;
+				EvalOperand* ops[] = { &ins.a, &ins.b, &ins.c };
+				for (size_t i = 0; i < node.args.size(); i++)
+				{
+					const ExpressionNode& arg = nodes[node.args[i]];
+					ops[i]->isConstant = arg.isConstant;
+					ops[i]->value = arg.value;
+					ops[i]->reg = arg.isConstant ? 0 : nodeRegister[node.args[i]];
+				}
+
+				// Release argument registers before allocating output register as the output may overwrite an input.
+				for (size_t i = 0; i < node.args.size(); i++)
+				{
+					size_t arg = node.args[i];
+					if (!nodes[arg].isConstant && lastUse[arg] == n && std::find(node.args.begin(), node.args.begin() + i, arg) == node.args.begin() + i)
+						freeRegisters.push_back(nodeRegister[arg]);
+				}
+
+				if (freeRegisters.empty())
+				{
+					ins.out = registerCount;
+					registerCount++;
+				}
+				else
+				{
+					ins.out = freeRegisters.back();
+					freeRegisters.pop_back();
+				}
+
+				nodeRegister[n] = ins.out;
+				program.push_back(ins);
+			}
+
+			resultRegister = nodeRegister[root];
+			return true;
+		}
+
+		const double* CompiledExpression::evaluate(const std::vector<ImageBase*>& params, coord_t start, coord_t count, std::vector<double>& workspace) const
+		{
+			if (count > SPAN_SIZE)
+				throw ITLException("Too many pixels for a single compiled expression evaluation.");
+
+			if (workspace.size() < registerCount * SPAN_SIZE)
+				workspace.resize(registerCount * SPAN_SIZE);
+
+			double* regs = workspace.data();
+			for (const EvalInstruction& ins : program)
+			{
+				if (ins.op == EvalOp::Param)
+					params[ins.index]->getfRange(start, count, regs + ins.out * SPAN_SIZE);
+				else
+					execute(ins, regs, count);
+			}
+
+			return regs + resultRegister * SPAN_SIZE;
+		}
+	}
+
 	namespace tests
 	{
 		void eval()
@@ -24,5 +674,155 @@ namespace itl2
 			itl2::eval("x0 + 2 * x1", out, std::vector<ImageBase*>{&param1, & param2});
 			checkDifference(out, ans, "eval result");
 		}
+
+		/**
+		Evaluates expression using exprtk for each pixel.
+		*/
+		template<typename target_t> void evalExprtk(const std::string& expression, Image<target_t>& target, const std::vector<ImageBase*>& params)
+		{
+			std::vector<double> varValues;
+			internals::symbol_table_t symbols;
+			internals::expression_t expr;
+			std::tie(symbols, expr) = internals::parse(expression, params, varValues);
+			for (coord_t n = 0; n < target.pixelCount(); n++)
+			{
+				for (size_t m = 0; m < params.size(); m++)
+					varValues[m] = params[m]->getf(n);
+				target(n) = pixelRound<target_t>(expr.value());
+			}
+		}
+
+		void evalCompiled()
+		{
+			Image<float32_t> x0(70, 60, 50);
+			Image<uint16_t> x1(70, 60, 50);
+			Image<float32_t> x2(70, 60, 50);
+			noise(x0, 0, 10, 1);
+			add(x1, 1000);
+			noise(x1, 0, 300, 2);
+			add(x2, 2);
+			noise(x2, 0, 1, 3);
+
+			std::vector<ImageBase*> params = { &x0, &x1, &x2 };
+
+			const std::vector<std::string> supported =
+			{
+				"x0 + 2 * x1",
+				"x0 - x1 - x2",
+				"2 ^ 3 ^ 2 + x0",
+				"-x0 ^ 2 + x2 ^ -3 + x2 ^ 0.5 + x0 ^ 13",
+				"x0 / 3 + x1 % 7 - x2 * pi",
+				"sqrt(abs(x0)) + exp(-x2) + log(x1) + log10(x1 + 1)",
+				"sin(x0) * cos(x2) + tan(x2) + atan2(x0, x2) + hypot(x0, x2) + atan(x0)",
+				"min(x0, x2) + max(x0, x2, x1) + min(x0)",
+				"round(x0) + floor(x2) + ceil(x0) + trunc(x2) + sgn(x0)",
+				"x0 > 0 and x2 < 2 or x1 >= 1000",
+				"x0 = x0 & not(x0 != x0) | x1 <> 5 & x2 <= 2",
+				"if(x0 > 0, x1, -x1) + if(1, 2, 3)",
+				"+x0 * -(x2 + 1) - -x1",
+				"X0 + Pi * 2.5e-1 + .5 + epsilon",
+				"sinh(x2 / 10) + cosh(x2 / 10) + tanh(x0) + asin(x2 / 10) + acos(x2 / 10)",
+				"pow(x0, 2) + pow(x2, 1.5)",
+				"1 + 2 * 3",
+				"x1",
+			};
+
+			for (const std::string& expression : supported)
+			{
+				internals::CompiledExpression program;
+				testAssert(program.compile(expression, params.size()), std::string("compile ") + expression);
+
+				Image<float32_t> gt(x0.dimensions());
+				Image<float32_t> res(x0.dimensions());
+				evalExprtk(expression, gt, params);
+				itl2::eval(expression, res, params);
+				checkDifference(gt, res, expression, 1e-4);
+			}
+
+			// Equality comparisons of values that differ only by rounding errors.
+			{
+				Image<uint16_t> ones(x0.dimensions());
+				setValue(ones, 1);
+				std::vector<ImageBase*> oneParams = { &ones };
+
+				const std::vector<std::string> comparisons =
+				{
+					"0.1 + 0.2 == 0.3",
+					"0.1 + 0.2 != 0.3",
+					"x0 / 10 + 0.2 == 0.3",
+					"x0 / 10 + 0.2 = 0.3",
+					"x0 / 10 + 0.2 != 0.3",
+					"x0 / 10 + 0.2 <> 0.3",
+					"x0 * 0.3 == 0.1 * 3",
+				};
+
+				for (const std::string& expression : comparisons)
+				{
+					internals::CompiledExpression program;
+					testAssert(program.compile(expression, oneParams.size()), std::string("compile ") + expression);
+
+					Image<float32_t> gt(ones.dimensions());
+					Image<float32_t> res(ones.dimensions());
+					evalExprtk(expression, gt, oneParams);
+					itl2::eval(expression, res, oneParams);
+					testAssert(equals(gt, res), expression);
+				}
+			}
+
+			// These expressions must fall back to exprtk.
+			const std::vector<std::string> unsupported =
+			{
+				"2x0",
+				"x0 > 0 ? 1 : 2",
+				"var y := x0 * 2; y + 1",
+				"erf(x0)",
+				"x0 + 1 // comment",
+			};
+
+			for (const std::string& expression : unsupported)
+			{
+				internals::CompiledExpression program;
+				testAssert(!program.compile(expression, params.size()), std::string("compile ") + expression);
+
+				Image<float32_t> gt(x0.dimensions());
+				Image<float32_t> res(x0.dimensions());
+				evalExprtk(expression, gt, params);
+				itl2::eval(expression, res, params);
+				checkDifference(gt, res, expression);
+			}
+
+			// In-place evaluation, integer output
+			Image<uint16_t> gt(x1.dimensions());
+			evalExprtk("x0 * 2 + 10", gt, std::vector<ImageBase*>{ &x1 });
+			itl2::eval("x0 * 2 + 10", x1, std::vector<ImageBase*>{ &x1 });
+			checkDifference(gt, x1, "in-place eval");
+		}
+
+		void evalSpeed()
+		{
+			Image<float32_t> x0(300, 300, 300);
+			Image<float32_t> x1(300, 300, 300);
+			noise(x0, 100, 10, 1);
+			noise(x1, 100, 10, 2);
+
+			std::string expression = "x0 * 2 + sqrt(abs(x1)) - 3 * x0 * x1 + max(x0, x1)";
+			std::vector<ImageBase*> params = { &x0, &x1 };
+
+			Image<float32_t> gt(x0.dimensions());
+			Image<float32_t> res(x0.dimensions());
+
+			Timer timer;
+			timer.start();
+			evalExprtk(expression, gt, params);
+			timer.stop();
+			std::cout << "exprtk evaluation took " << timer.getTime() << " ms" << std::endl;
+
+			timer.start();
+			itl2::eval(expression, res, params);
+			timer.stop();
+			std::cout << "Compiled evaluation took " << timer.getTime() << " ms" << std::endl;
+
+			checkDifference(gt, res, "compiled eval");
+		}
 	}
-}
\ No newline at end of file
+}
@@ -40,6 +40,86 @@ namespace itl2
 
 			return std::make_tuple(symbol_table, expr);
 		}
+
+		/**
+		Operations of compiled expression.
+		*/
+		enum class EvalOp
+		{
+			Param, Fill,
+			Neg, Not, Abs, Acos, Asin, Atan, Ceil, Cos, Cosh, Exp, Floor, Log, Log10, Round, Sgn, Sin, Sinh, Sqrt, Tan, Tanh, Trunc, IntPow,
+			Add, Sub, Mul, Div, Mod, Pow, Atan2, Hypot, Min, Max, Lt, Lte, Gt, Gte, Eq, Ne, And, Or,
+			If
+		};
+
+		/**
+		Operand of compiled expression instruction.
+		The operand is either a constant or a register that contains one value for each pixel in the span being evaluated.
+		*/
+		struct EvalOperand
+		{
+			bool isConstant = true;
+			double value = 0;
+			size_t reg = 0;
+		};
+
+		/**
+		One instruction of compiled expression.
+		*/
+		struct EvalInstruction
+		{
+			EvalOp op;
+			EvalOperand a, b, c;
+
+			/**
+			Index of the output register.
+			*/
+			size_t out;
+
+			/**
+			Index of parameter image for Param operation, or exponent for IntPow operation.
+			*/
+			coord_t index;
+		};
+
+		/**
+		Mathematical expression compiled to a list of instructions that operate on spans of pixels.
+		This avoids evaluating expression tree and calling virtual functions for each pixel separately.
+		Only a subset of exprtk syntax is supported: arithmetic, comparison and logical operators, common mathematical functions,
+		if(condition, a, b), and constants pi, epsilon and inf.
+		*/
+		class CompiledExpression
+		{
+		private:
+			std::vector<EvalInstruction> program;
+			size_t registerCount;
+			size_t resultRegister;
+
+		public:
+			/**
+			Count of pixels processed by one call to evaluate.
+			*/
+			static constexpr coord_t SPAN_SIZE = 1024;
+
+			CompiledExpression() : registerCount(0), resultRegister(0)
+			{
+			}
+
+			/**
+			Compiles expression where parameter images are referenced by names x0, x1, ..., x(paramCount - 1).
+			Returns false if the expression contains constructs that are not supported by the compiler.
+			In that case the expression should be evaluated using exprtk.
+			*/
+			bool compile(const std::string& expression, size_t paramCount);
+
+			/**
+			Evaluates the expression for pixels start, start + 1, ..., start + count - 1 of parameter images.
+			@param count Count of pixels to process, must be less than or equal to SPAN_SIZE.
+			@param workspace Temporary storage. Use separate workspace in each thread.
+			@return Pointer to count evaluation results. The pointer points to workspace.
+			*/
+			const double* evaluate(const std::vector<ImageBase*>& params, coord_t start, coord_t count, std::vector<double>& workspace) const;
+		};
 	}
 
 	/**
@@ -59,6 +139,33 @@ namespace itl2
 			target.checkSize(*params[n]);
 		}
 
+		internals::CompiledExpression program;
+		if (program.compile(expression, params.size()))
+		{
+			coord_t spanCount = (target.pixelCount() + internals::CompiledExpression::SPAN_SIZE - 1) / internals::CompiledExpression::SPAN_SIZE;
+
+			#pragma omp parallel if(target.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				std::vector<double> workspace;
+
+				#pragma omp for
+				for (coord_t s = 0; s < spanCount; s++)
+				{
+					coord_t start = s * internals::CompiledExpression::SPAN_SIZE;
+					coord_t count = std::min(internals::CompiledExpression::SPAN_SIZE, target.pixelCount() - start);
+					const double* result = program.evaluate(params, start, count, workspace);
+
+					target_t* p = target.getData() + start;
+					for (coord_t n = 0; n < count; n++)
+						p[n] = pixelRound<target_t>(result[n]);
+				}
+			}
+
+			return;
+		}
+
+		// The expression contains constructs not supported by the compiler, so evaluate it using exprtk.
+
 		#pragma omp parallel if(target.pixelCount() > PARALLELIZATION_THRESHOLD)
 		{
 			// Parse again to make separate expression object for each thread.
@@ -84,5 +191,7 @@ namespace itl2
 	namespace tests
 	{
 		void eval();
+		void evalCompiled();
+		void evalSpeed();
 	}
 }
\ No newline at end of file
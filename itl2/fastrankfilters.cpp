@@ -0,0 +1,94 @@
+
+#include "fastrankfilters.h"
+
+#include "filters.h"
+#include "noise.h"
+#include "pointprocess.h"
+#include "stringutils.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
+
+namespace itl2
+{
+	namespace tests
+	{
+		template<typename pixel_t> void histogramMedianCase(const Vec3c& size, const Vec3c& r, NeighbourhoodType nbType, BoundaryCondition bc, double stddev)
+		{
+			Image<pixel_t> img(size);
+			add(img, NumberUtils<pixel_t>::scale() / 4);
+			noise(img, 0, stddev, 123);
+
+			string desc = string("median ") + toString(size) + ", r = " + toString(r) + ", " + toString(nbType) + ", " + toString(bc);
+
+			Image<pixel_t> gt, res;
+			filter<pixel_t, pixel_t, internals::medianOp<pixel_t> >(img, gt, r, nbType, bc);
+			internals::histogramMedianFilter<pixel_t, pixel_t>(img, res, r, nbType, bc, nullptr);
+			checkDifference(gt, res, desc);
+
+			// Float output retains the fractional part of the median of even number of values.
+			Image<float32_t> gtf, resf;
+			filter<pixel_t, float32_t, internals::medianOp<pixel_t> >(img, gtf, r, nbType, bc);
+			internals::histogramMedianFilter<pixel_t, float32_t>(img, resf, r, nbType, bc, nullptr);
+			checkDifference(gtf, resf, desc + ", float32 output");
+
+			// Masked median
+			pixel_t badValue = img(size.x / 2, size.y / 2, size.z / 2);
+			filter<pixel_t, pixel_t, pixel_t, internals::maskedMedianOp<pixel_t> >(img, gt, r, badValue, nbType, bc);
+			internals::histogramMedianFilter<pixel_t, pixel_t>(img, res, r, nbType, bc, &badValue);
+			checkDifference(gt, res, "masked " + desc);
+		}
+
+		void histogramMedian()
+		{
+			for (NeighbourhoodType nbType : { NeighbourhoodType::Rectangular, NeighbourhoodType::Ellipsoidal })
+			{
+				for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+				{
+					// Small stddev makes masked values and ties common.
+					histogramMedianCase<uint8_t>(Vec3c(40, 30, 20), Vec3c(2, 2, 2), nbType, bc, 3);
+					histogramMedianCase<uint8_t>(Vec3c(40, 30, 20), Vec3c(4, 1, 3), nbType, bc, 30);
+					histogramMedianCase<uint16_t>(Vec3c(40, 30, 20), Vec3c(3, 3, 3), nbType, bc, 5000);
+					histogramMedianCase<uint16_t>(Vec3c(7, 30, 20), Vec3c(5, 2, 1), nbType, bc, 100);
+					histogramMedianCase<uint16_t>(Vec3c(60, 50, 1), Vec3c(4, 4, 4), nbType, bc, 5000);
+				}
+			}
+
+			// Check that the public filters select the fast version and produce correct result.
+			Image<uint16_t> img(50, 40, 30);
+			add(img, 1000);
+			noise(img, 0, 300, 321);
+			Image<uint16_t> gt, res;
+			filter<uint16_t, uint16_t, internals::medianOp<uint16_t> >(img, gt, Vec3c(3, 3, 3), NeighbourhoodType::Ellipsoidal, BoundaryCondition::Nearest);
+			medianFilter(img, res, 3);
+			checkDifference(gt, res, "medianFilter");
+			nanMedianFilter(img, res, 3);
+			checkDifference(gt, res, "nanMedianFilter");
+		}
+
+		void histogramMedianSpeed()
+		{
+			Image<uint16_t> img(200, 200, 200);
+			add(img, 10000);
+			noise(img, 0, 3000, 1);
+
+			Image<uint16_t> gt, res;
+			coord_t r = 5;
+
+			Timer timer;
+			timer.start();
+			filter<uint16_t, uint16_t, internals::medianOp<uint16_t> >(img, gt, Vec3c(r, r, r), NeighbourhoodType::Ellipsoidal, BoundaryCondition::Nearest);
+			timer.stop();
+			cout << "Generic median filter took " << timer.getTime() << " ms" << endl;
+
+			timer.start();
+			medianFilter(img, res, r);
+			timer.stop();
+			cout << "Histogram median filter took " << timer.getTime() << " ms" << endl;
+
+			checkDifference(gt, res, "histogram median");
+		}
+	}
+}
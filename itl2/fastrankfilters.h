@@ -0,0 +1,300 @@
+#pragma once
+
+#include "image.h"
+#include "boundarycondition.h"
+#include "neighbourhood.h"
+#include "utilities.h"
+#include "math/vec3.h"
+#include "math/numberutils.h"
+
+#include <vector>
+#include <limits>
+#include <type_traits>
+
+namespace itl2
+{
+	namespace internals
+	{
+		/**
+		Tests if rank filters of pixel type pixel_t can be calculated using the sliding histogram algorithm.
+		*/
+		template<typename pixel_t> constexpr bool supportsHistogramRankFilter()
+		{
+			return std::is_same_v<pixel_t, uint8_t> || std::is_same_v<pixel_t, uint16_t>;
+		}
+
+		/**
+		Two-level histogram of integer pixel values.
+		The coarse level stores the sum of each group of fine bins so that the value at given rank
+		can be found by scanning at most sqrt(bin count) coarse and sqrt(bin count) fine bins.
+		*/
+		template<typename pixel_t> class RankHistogram
+		{
+		private:
+			static_assert(supportsHistogramRankFilter<pixel_t>(), "Only 8- and 16-bit unsigned integer pixels are supported by the histogram rank filter.");
+
+			/**
+			log2 of the number of fine bins per coarse bin.
+			*/
+			static constexpr size_t SHIFT = sizeof(pixel_t) * 4;
+
+			/**
+			Number of fine bins in each coarse bin, and number of coarse bins.
+			*/
+			static constexpr size_t GROUP = (size_t)1 << SHIFT;
+
+			std::vector<uint32_t> fine;
+			std::vector<uint32_t> coarse;
+			size_t total;
+
+		public:
+			RankHistogram() :
+				fine(GROUP * GROUP, 0),
+				coarse(GROUP, 0),
+				total(0)
+			{
+			}
+
+			/**
+			Removes all values from the histogram.
+			*/
+			void clear()
+			{
+				std::fill(fine.begin(), fine.end(), 0);
+				std::fill(coarse.begin(), coarse.end(), 0);
+				total = 0;
+			}
+
+			void add(pixel_t value)
+			{
+				fine[value]++;
+				coarse[value >> SHIFT]++;
+				total++;
+			}
+
+			void remove(pixel_t value)
+			{
+				fine[value]--;
+				coarse[value >> SHIFT]--;
+				total--;
+			}
+
+			/**
+			Gets count of values in the histogram.
+			*/
+			size_t count() const
+			{
+				return total;
+			}
+
+			/**
+			Finds value at given rank, i.e. the value that would be at index rank if the values in the histogram were sorted.
+			The rank must be less than count().
+			*/
+			pixel_t valueAtRank(size_t rank) const
+			{
+				size_t c = 0;
+				while (rank >= coarse[c])
+				{
+					rank -= coarse[c];
+					c++;
+				}
+
+				size_t f = c << SHIFT;
+				while (rank >= fine[f])
+				{
+					rank -= fine[f];
+					f++;
+				}
+
+				return (pixel_t)f;
+			}
+
+			/**
+			Calculates median of the values in the histogram.
+			The result equals to that of calcMedian function for the same values.
+			*/
+			typename NumberUtils<pixel_t>::FloatType median() const
+			{
+				if (total <= 0)
+					return pixel_t();
+
+				size_t n = total / 2;
+				pixel_t vn = valueAtRank(n);
+				if (total % 2 == 1)
+					return (typename NumberUtils<pixel_t>::FloatType)vn;
+
+				return (vn + valueAtRank(n - 1)) / (typename NumberUtils<pixel_t>::RealFloatType)2;
+			}
+		};
+
+		/**
+		Contiguous run of neighbourhood mask pixels in x-direction.
+		*/
+		struct MaskRun
+		{
+			/**
+			Offset of the row from the neighbourhood center.
+			*/
+			coord_t dy, dz;
+
+			/**
+			First and last x offset of the run, relative to neighbourhood center.
+			*/
+			coord_t dx0, dx1;
+		};
+
+		/**
+		Converts neighbourhood mask to a list of x-directional runs.
+		*/
+		template<typename mask_t> std::vector<MaskRun> maskRuns(const Image<mask_t>& mask, const Vec3c& nbRadius)
+		{
+			std::vector<MaskRun> runs;
+			for (coord_t z = 0; z < mask.depth(); z++)
+			{
+				for (coord_t y = 0; y < mask.height(); y++)
+				{
+					coord_t x = 0;
+					while (x < mask.width())
+					{
+						if (mask(x, y, z) != 0)
+						{
+							coord_t x0 = x;
+							while (x < mask.width() && mask(x, y, z) != 0)
+								x++;
+							runs.push_back(MaskRun{ y - nbRadius.y, z - nbRadius.z, x0 - nbRadius.x, x - 1 - nbRadius.x });
+						}
+						else
+						{
+							x++;
+						}
+					}
+				}
+			}
+			return runs;
+		}
+
+		/**
+		Calculates median filtering of an integer image by sliding a histogram of neighbourhood values along image rows
+		(Huang - A fast two-dimensional median filtering algorithm, extended to arbitrary 3D neighbourhoods).
+		When the neighbourhood moves one pixel in x-direction, one pixel is removed from and one added to the histogram for each
+		x-directional run of the neighbourhood mask, so the cost per pixel is proportional to r^2 instead of r^3.
+		The result is the same than that of the generic filter function with medianOp or maskedMedianOp.
+		@param skipValue Pointer to value that should not be considered when calculating the median, or nullptr if all values should be considered.
+		*/
+		template<typename pixel_t, typename out_t> void histogramMedianFilter(const Image<pixel_t>& in, Image<out_t>& out, Vec3c nbRadius, NeighbourhoodType nbType, BoundaryCondition bc, const pixel_t* skipValue)
+		{
+			if (bc != BoundaryCondition::Zero && bc != BoundaryCondition::Nearest)
+				throw ITLException("Unsupported boundary condition.");
+
+			out.mustNotBe(in);
+			out.ensureSize(in);
+
+			// Zero radius in those dimensions that are not in use
+			for (size_t n = in.dimensionality(); n < nbRadius.size(); n++)
+				nbRadius[n] = 0;
+
+			Image<uint8_t> mask;
+			createNeighbourhoodMask(nbType, nbRadius, mask);
+			const std::vector<MaskRun> runs = maskRuns(mask, nbRadius);
+
+			const coord_t w = in.width();
+			const coord_t h = in.height();
+			const coord_t d = in.depth();
+			const bool useSkip = skipValue != nullptr;
+			const pixel_t skip = useSkip ? *skipValue : pixel_t();
+
+			size_t totalProcessed = 0;
+			#pragma omp parallel if(!omp_in_parallel() && in.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				RankHistogram<pixel_t> hist;
+
+				// Pointer to the start of image row corresponding to each run, or nullptr if the row is outside of the image
+				// and the boundary condition is Zero.
+				std::vector<const pixel_t*> lines(runs.size());
+
+				// Gets pixel at x-coordinate xi of the row of run i, taking boundary condition into account.
+				auto pixel = [&](size_t i, coord_t xi)
+				{
+					const pixel_t* line = lines[i];
+					if (!line)
+						return pixel_t();
+					if (xi < 0 || xi >= w)
+					{
+						if (bc == BoundaryCondition::Zero)
+							return pixel_t();
+						xi = xi < 0 ? 0 : w - 1;
+					}
+					return line[xi];
+				};
+
+				auto add = [&](pixel_t val)
+				{
+					if (!useSkip || val != skip)
+						hist.add(val);
+				};
+
+				auto remove = [&](pixel_t val)
+				{
+					if (!useSkip || val != skip)
+						hist.remove(val);
+				};
+
+				#pragma omp for schedule(dynamic)
+				for (coord_t row = 0; row < h * d; row++)
+				{
+					coord_t y = row % h;
+					coord_t z = row / h;
+
+					for (size_t i = 0; i < runs.size(); i++)
+					{
+						coord_t yy = y + runs[i].dy;
+						coord_t zz = z + runs[i].dz;
+						if (yy < 0 || yy >= h || zz < 0 || zz >= d)
+						{
+							if (bc == BoundaryCondition::Zero)
+							{
+								lines[i] = nullptr;
+								continue;
+							}
+							clamp<coord_t>(yy, 0, h - 1);
+							clamp<coord_t>(zz, 0, d - 1);
+						}
+						lines[i] = &in(0, yy, zz);
+					}
+
+					// Build histogram of the first neighbourhood on this row.
+					hist.clear();
+					for (size_t i = 0; i < runs.size(); i++)
+					{
+						for (coord_t xi = runs[i].dx0; xi <= runs[i].dx1; xi++)
+							add(pixel(i, xi));
+					}
+
+					out(0, y, z) = pixelRound<out_t>(hist.median());
+
+					// Slide the neighbourhood along the row.
+					for (coord_t x = 1; x < w; x++)
+					{
+						for (size_t i = 0; i < runs.size(); i++)
+						{
+							remove(pixel(i, x - 1 + runs[i].dx0));
+							add(pixel(i, x + runs[i].dx1));
+						}
+
+						out(x, y, z) = pixelRound<out_t>(hist.median());
+					}
+
+					if (y == h - 1)
+						showThreadProgress(totalProcessed, d);
+				}
+			}
+		}
+	}
+
+	namespace tests
+	{
+		void histogramMedian();
+		void histogramMedianSpeed();
+	}
+}
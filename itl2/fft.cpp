@@ -3,6 +3,12 @@
 #include <random>
 #include <cmath>
 #include <iomanip>
+#include <mutex>
+#include <map>
+#include <deque>
+#include <tuple>
+#include <cstdlib>
+#include <sstream>
 
 #include "ompatomic.h"
 #include "io/raw.h"
@@ -14,320 +20,429 @@
 #include "transform.h"
 #include "noise.h"
 #include "math/mathutils.h"
+#include "stringutils.h"
+#include "testutils.h"
+#include "filesystem.h"
 
 using namespace std;
 
 namespace itl2
 {
-	void initFFTW()
+	namespace internals
 	{
-		static OmpAtomic<bool> isFFTWInit(false);
+		/**
+		Key identifying a plan in the FFTW plan cache.
+		*/
+		struct FFTWPlanKey
+		{
+			FFTWTransform kind;
+			size_t dimensionality;
+			Vec3c dimensions;
+			bool inPlace;
+			bool aligned;
+			size_t howMany;
+
+			bool operator<(const FFTWPlanKey& r) const
+			{
+				return std::make_tuple(kind, dimensionality, dimensions.x, dimensions.y, dimensions.z, inPlace, aligned, howMany) <
+					std::make_tuple(r.kind, r.dimensionality, r.dimensions.x, r.dimensions.y, r.dimensions.z, r.inPlace, r.aligned, r.howMany);
+			}
+		};
 
-		if (!isFFTWInit)
+		/**
+		Cache of FFTW plans and wisdom settings.
+		The FFTW planner is not thread-safe, so all planner calls (including plan destruction and wisdom import and export) are made while holding the lock.
+		*/
+		class FFTWPlanCache
 		{
-			#pragma omp critical
+		public:
+			/**
+			Maximum number of plans in the cache.
+			If there are more plans, the oldest ones are removed from the cache.
+			*/
+			static constexpr size_t MAX_PLANS = 100;
+
+			/**
+			Lock protecting all fields and all calls to the FFTW planner.
+			Recursive as releasing a plan from the cache may destroy it, which requires the lock again.
+			*/
+			std::recursive_mutex lock;
+
+			/**
+			Cached plans.
+			*/
+			std::map<FFTWPlanKey, FFTWPlan> plans;
+
+			/**
+			Keys of the cached plans in the order of creation.
+			*/
+			std::deque<FFTWPlanKey> creationOrder;
+
+			/**
+			Name of wisdom file, or empty string if wisdom is not saved.
+			*/
+			string wisdomFile;
+
+			/**
+			Set to true when new plans have been created since the wisdom was last saved.
+			*/
+			bool wisdomChanged = false;
+
+			/**
+			Planner flags.
+			*/
+			unsigned int plannerFlags = FFTW_ESTIMATE;
+
+			~FFTWPlanCache()
 			{
-				if (!isFFTWInit)
+				saveWisdom();
+				creationOrder.clear();
+				plans.clear();
+			}
+
+			/**
+			Saves wisdom to the wisdom file.
+			The wisdom file may be shared by many processes, so the wisdom is first merged with the current contents of the file,
+			then written to a uniquely named temporary file in the same directory, and finally the temporary file is renamed over the wisdom file.
+			This way readers never see a partially written file.
+			*/
+			void saveWisdom()
+			{
+				std::lock_guard<std::recursive_mutex> guard(lock);
+				if (wisdomFile.length() > 0 && wisdomChanged)
 				{
-					isFFTWInit = true;
-					fftwf_import_system_wisdom();
+					// Keep the wisdom accumulated by other processes since the file was last read.
+					if (fs::exists(wisdomFile))
+						fftwf_import_wisdom_from_filename(wisdomFile.c_str());
+
+					std::random_device rd;
+					std::stringstream tempName;
+					tempName << wisdomFile << "." << std::hex << rd() << rd() << ".tmp";
+					string tempFile = tempName.str();
+
+					bool ok = fftwf_export_wisdom_to_filename(tempFile.c_str()) != 0;
+					if (ok)
+					{
+						std::error_code ec;
+						fs::rename(tempFile, wisdomFile, ec);
+						ok = !ec;
+					}
+
+					if (!ok)
+					{
+						std::error_code ec;
+						fs::remove(tempFile, ec);
+						std::cerr << "Warning: Unable to save FFTW wisdom to " << wisdomFile << std::endl;
+					}
+
+					wisdomChanged = false;
 				}
 			}
-		}
-
-		//#pragma omp critical
-		//{
-		//	if (!isFFTWInit)
-		//	{
-		//		isFFTWInit = true;
-		//		// NOTE: Enabling threading here makes things REALLY slow.
-		//		//fftwf_init_threads();
-		//		fftwf_import_system_wisdom();
-		//	}
-		//}
-	}
+		};
 
-	void setThreads()
-	{
-		//if (omp_in_parallel())
-		//	fftwf_plan_with_nthreads(1);
-		//else
-		//	fftwf_plan_with_nthreads(omp_get_num_threads());
-	}
+		FFTWPlanCache& planCache()
+		{
+			static FFTWPlanCache cache;
+			return cache;
+		}
 
-	void dct(Image<float32_t>& img)
-	{
-		initFFTW();
+		/**
+		Converts PI2_FFTW_PLANNER environment variable value to FFTW planner flags.
+		*/
+		unsigned int parsePlannerFlags(string value)
+		{
+			toLower(value);
+			trim(value);
+			if (value == "estimate")
+				return FFTW_ESTIMATE;
+			if (value == "measure")
+				return FFTW_MEASURE;
+			if (value == "patient")
+				return FFTW_PATIENT;
+			if (value == "exhaustive")
+				return FFTW_EXHAUSTIVE;
+			throw ITLException(string("Invalid FFTW planner: ") + value + ". Valid values are estimate, measure, patient, and exhaustive.");
+		}
 
-		if (img.dimensionality() == 1)
+		/**
+		Creates new FFTW plan that calculates howMany transforms of consecutive arrays. Must be called while holding the plan cache lock.
+		*/
+		fftwf_plan createManyPlan(FFTWTransform kind, int rank, const int* n, int howMany, float* in, float* out, unsigned int flags)
 		{
-			coord_t w = img.dimension(0);
+			int realCount = 1;
+			for (int i = 0; i < rank; i++)
+				realCount *= n[i];
+			int complexCount = realCount / n[rank - 1] * (n[rank - 1] / 2 + 1);
 
-			fftwf_plan p;
-			#pragma omp critical
+			switch (kind)
+			{
+			case FFTWTransform::DCT:
 			{
-				setThreads();
-				p = fftwf_plan_r2r_1d((int)w, img.getData(), img.getData(), FFTW_REDFT10, FFTW_ESTIMATE);
+				fftwf_r2r_kind kinds[3] = { FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10 };
+				return fftwf_plan_many_r2r(rank, n, howMany, in, nullptr, 1, realCount, out, nullptr, 1, realCount, kinds, flags);
 			}
-			fftwf_execute(p);
-			#pragma omp critical
+			case FFTWTransform::IDCT:
 			{
-				fftwf_destroy_plan(p);
+				fftwf_r2r_kind kinds[3] = { FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01 };
+				return fftwf_plan_many_r2r(rank, n, howMany, in, nullptr, 1, realCount, out, nullptr, 1, realCount, kinds, flags);
+			}
+			case FFTWTransform::RealToComplex:
+				return fftwf_plan_many_dft_r2c(rank, n, howMany, in, nullptr, 1, realCount, (fftwf_complex*)out, nullptr, 1, complexCount, flags);
+			case FFTWTransform::ComplexToReal:
+				return fftwf_plan_many_dft_c2r(rank, n, howMany, (fftwf_complex*)in, nullptr, 1, complexCount, out, nullptr, 1, realCount, flags);
+			case FFTWTransform::Forward:
+				return fftwf_plan_many_dft(rank, n, howMany, (fftwf_complex*)in, nullptr, 1, realCount, (fftwf_complex*)out, nullptr, 1, realCount, FFTW_FORWARD, flags);
+			case FFTWTransform::Backward:
+				return fftwf_plan_many_dft(rank, n, howMany, (fftwf_complex*)in, nullptr, 1, realCount, (fftwf_complex*)out, nullptr, 1, realCount, FFTW_BACKWARD, flags);
+			default:
+				throw ITLException("Unsupported FFTW transform kind.");
 			}
 		}
-		else if (img.dimensionality() == 2)
+
+		/**
+		Creates new FFTW plan. Must be called while holding the plan cache lock.
+		*/
+		fftwf_plan createPlan(FFTWTransform kind, int rank, const int* n, size_t howMany, float* in, float* out, unsigned int flags)
 		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
+			if (howMany > 1)
+				return createManyPlan(kind, rank, n, (int)howMany, in, out, flags);
 
-			fftwf_plan p;
-			#pragma omp critical
+			switch (kind)
+			{
+			case FFTWTransform::DCT:
 			{
-				setThreads();
-				p = fftwf_plan_r2r_2d((int)h, (int)w, img.getData(), img.getData(), FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE);
+				fftwf_r2r_kind kinds[3] = { FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10 };
+				return fftwf_plan_r2r(rank, n, in, out, kinds, flags);
 			}
-			fftwf_execute(p);
-			#pragma omp critical
+			case FFTWTransform::IDCT:
 			{
-				fftwf_destroy_plan(p);
+				fftwf_r2r_kind kinds[3] = { FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01 };
+				return fftwf_plan_r2r(rank, n, in, out, kinds, flags);
+			}
+			case FFTWTransform::RealToComplex:
+				return fftwf_plan_dft_r2c(rank, n, in, (fftwf_complex*)out, flags);
+			case FFTWTransform::ComplexToReal:
+				return fftwf_plan_dft_c2r(rank, n, (fftwf_complex*)in, out, flags);
+			case FFTWTransform::Forward:
+				return fftwf_plan_dft(rank, n, (fftwf_complex*)in, (fftwf_complex*)out, FFTW_FORWARD, flags);
+			case FFTWTransform::Backward:
+				return fftwf_plan_dft(rank, n, (fftwf_complex*)in, (fftwf_complex*)out, FFTW_BACKWARD, flags);
+			default:
+				throw ITLException("Unsupported FFTW transform kind.");
 			}
 		}
-		else if (img.dimensionality() == 3)
-		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
-			coord_t d = img.dimension(2);
 
-			fftwf_plan p;
-			#pragma omp critical
+		FFTWPlan fftwPlan(FFTWTransform kind, const Vec3c& dimensions, size_t dimensionality, void* in, void* out, size_t howMany)
+		{
+			if (dimensionality < 1 || dimensionality > 3)
+				throw ITLException("Unsupported dimensionality.");
+			if (howMany < 1)
+				throw ITLException("Count of transforms must be at least one.");
+
+			initFFTW();
+
+			FFTWPlanKey key;
+			key.kind = kind;
+			key.dimensionality = dimensionality;
+			key.dimensions = dimensions;
+			key.inPlace = in == out;
+			key.aligned = fftwf_alignment_of((float*)in) == 0 && fftwf_alignment_of((float*)out) == 0;
+			key.howMany = howMany;
+
+			FFTWPlanCache& cache = planCache();
+			std::lock_guard<std::recursive_mutex> guard(cache.lock);
+
+			auto it = cache.plans.find(key);
+			if (it != cache.plans.end())
+				return it->second;
+
+			// FFTW uses row-major order, i.e. the last dimension changes fastest.
+			int n[3];
+			for (size_t i = 0; i < dimensionality; i++)
+				n[i] = (int)dimensions[dimensionality - 1 - i];
+
+			unsigned int flags = cache.plannerFlags;
+			if (!key.aligned)
+				flags |= FFTW_UNALIGNED;
+
+			fftwf_plan plan;
+			if (flags & FFTW_ESTIMATE)
 			{
-				setThreads();
-				p = fftwf_plan_r2r_3d((int)d, (int)h, (int)w, img.getData(), img.getData(), FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10, FFTW_ESTIMATE);
+				// Estimating planner does not touch the arrays.
+				plan = createPlan(kind, (int)dimensionality, n, howMany, (float*)in, (float*)out, flags);
 			}
-			fftwf_execute(p);
-			#pragma omp critical
+			else
 			{
-				fftwf_destroy_plan(p);
+				// Other planners overwrite the arrays, so plan using temporary arrays.
+				size_t realCount = dimensions.x * dimensions.y * dimensions.z * howMany;
+				size_t complexCount = (dimensions.x / 2 + 1) * dimensions.y * dimensions.z * howMany;
+				size_t inCount, outCount;
+				switch (kind)
+				{
+				case FFTWTransform::RealToComplex: inCount = realCount; outCount = 2 * complexCount; break;
+				case FFTWTransform::ComplexToReal: inCount = 2 * complexCount; outCount = realCount; break;
+				case FFTWTransform::Forward:
+				case FFTWTransform::Backward: inCount = 2 * realCount; outCount = 2 * realCount; break;
+				default: inCount = realCount; outCount = realCount; break;
+				}
+
+				float* tmpIn = fftwf_alloc_real(key.inPlace ? std::max(inCount, outCount) : inCount);
+				float* tmpOut = key.inPlace ? tmpIn : fftwf_alloc_real(outCount);
+				if (!tmpIn || !tmpOut)
+				{
+					fftwf_free(tmpIn);
+					if (!key.inPlace)
+						fftwf_free(tmpOut);
+					throw ITLException("Out of memory while creating FFTW plan.");
+				}
+
+				plan = createPlan(kind, (int)dimensionality, n, howMany, tmpIn, tmpOut, flags);
+
+				if (!key.inPlace)
+					fftwf_free(tmpOut);
+				fftwf_free(tmpIn);
 			}
-		}
-		else
-		{
-			throw ITLException("Unsupported dimensionality.");
-		}
 
-		// Normalize the output image
-		multiply(img, 1 / sqrt(::pow(2, img.dimensionality()) * img.pixelCount()));
-	}
+			if (!plan)
+				throw ITLException("Unable to create FFTW plan.");
 
-	void idct(Image<float32_t>& img)
-	{
-		initFFTW();
+			FFTWPlan result(plan, [](fftwf_plan p)
+				{
+					std::lock_guard<std::recursive_mutex> guard(planCache().lock);
+					fftwf_destroy_plan(p);
+				});
 
-		if (img.dimensionality() == 1)
-		{
-			coord_t w = img.dimension(0);
+			cache.plans[key] = result;
+			cache.creationOrder.push_back(key);
+			cache.wisdomChanged = true;
 
-			fftwf_plan p;
-			#pragma omp critical
+			// Plans that are currently in use are destroyed when the last user releases them.
+			while (cache.creationOrder.size() > FFTWPlanCache::MAX_PLANS)
 			{
-				setThreads();
-				p = fftwf_plan_r2r_1d((int)w, img.getData(), img.getData(), FFTW_REDFT01, FFTW_ESTIMATE);
+				cache.plans.erase(cache.creationOrder.front());
+				cache.creationOrder.pop_front();
 			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else if (img.dimensionality() == 2)
-		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
 
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_r2r_2d((int)h, (int)w, img.getData(), img.getData(), FFTW_REDFT01, FFTW_REDFT01, FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
+			return result;
 		}
-		else if (img.dimensionality() == 3)
+	}
+
+	void initFFTW()
+	{
+		static OmpAtomic<bool> isFFTWInit(false);
+
+		if (!isFFTWInit)
 		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
-			coord_t d = img.dimension(2);
+			internals::FFTWPlanCache& cache = internals::planCache();
+			std::lock_guard<std::recursive_mutex> guard(cache.lock);
 
-			fftwf_plan p;
-			#pragma omp critical
+			if (!isFFTWInit)
 			{
-				setThreads();
-				p = fftwf_plan_r2r_3d((int)d, (int)h, (int)w, img.getData(), img.getData(), FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01, FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
+				fftwf_import_system_wisdom();
+
+				const char* planner = std::getenv("PI2_FFTW_PLANNER");
+				if (planner)
+					cache.plannerFlags = internals::parsePlannerFlags(planner);
+
+				const char* wisdomFile = std::getenv("PI2_FFTW_WISDOM");
+				if (wisdomFile && cache.wisdomFile.length() <= 0)
+				{
+					cache.wisdomFile = wisdomFile;
+					fftwf_import_wisdom_from_filename(wisdomFile);
+				}
+
+				isFFTWInit = true;
 			}
 		}
-		else
+	}
+
+	void setFFTWWisdomFile(const string& filename)
+	{
+		initFFTW();
+
+		internals::FFTWPlanCache& cache = internals::planCache();
+		std::lock_guard<std::recursive_mutex> guard(cache.lock);
+
+		cache.saveWisdom();
+
+		cache.wisdomFile = filename;
+		if (filename.length() > 0 && fs::exists(filename))
 		{
-			throw ITLException("Unsupported dimensionality.");
+			if (!fftwf_import_wisdom_from_filename(filename.c_str()))
+				throw ITLException(string("Unable to read FFTW wisdom from ") + filename);
 		}
-
-		// Normalize the output image
-		multiply(img, 1 / sqrt(::pow(2, img.dimensionality()) * img.pixelCount()));
 	}
 
+	void saveFFTWWisdom()
+	{
+		internals::planCache().saveWisdom();
+	}
 
-	void fft(Image<float32_t>& img, Image<complex32_t>& out)
+	void setFFTWPlannerFlags(unsigned int flags)
 	{
 		initFFTW();
 
-		if (img.dimensionality() == 1)
-		{
-			coord_t w = img.dimension(0);
+		internals::FFTWPlanCache& cache = internals::planCache();
+		std::lock_guard<std::recursive_mutex> guard(cache.lock);
+		cache.plannerFlags = flags;
+	}
 
-			out.ensureSize(w / 2 + 1);
+	/**
+	Checks that image dimensionality is supported by FFT functions.
+	*/
+	void checkFFTDimensionality(size_t dimensionality)
+	{
+		if (dimensionality < 1 || dimensionality > 3)
+			throw ITLException("Unsupported dimensionality.");
+	}
 
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_r2c_1d((int)w, img.getData(), (fftwf_complex*)out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else if (img.dimensionality() == 2)
-		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
+	void dct(Image<float32_t>& img)
+	{
+		checkFFTDimensionality(img.dimensionality());
 
-			out.ensureSize(w / 2 + 1, h);
+		internals::FFTWPlan p = internals::fftwPlan(internals::FFTWTransform::DCT, img.dimensions(), img.dimensionality(), img.getData(), img.getData());
+		fftwf_execute_r2r(p.get(), img.getData(), img.getData());
 
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_r2c_2d((int)h, (int)w, img.getData(), (fftwf_complex*)out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else if (img.dimensionality() == 3)
-		{
-			coord_t w = img.dimension(0);
-			coord_t h = img.dimension(1);
-			coord_t d = img.dimension(2);
+		// Normalize the output image
+		multiply(img, 1 / sqrt(::pow(2, img.dimensionality()) * img.pixelCount()));
+	}
 
-			out.ensureSize(w / 2 + 1, h, d);
+	void idct(Image<float32_t>& img)
+	{
+		checkFFTDimensionality(img.dimensionality());
 
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_r2c_3d((int)d, (int)h, (int)w, img.getData(), (fftwf_complex*)out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else
-		{
-			throw ITLException("Unsupported dimensionality.");
-		}
+		internals::FFTWPlan p = internals::fftwPlan(internals::FFTWTransform::IDCT, img.dimensions(), img.dimensionality(), img.getData(), img.getData());
+		fftwf_execute_r2r(p.get(), img.getData(), img.getData());
+
+		// Normalize the output image
+		multiply(img, 1 / sqrt(::pow(2, img.dimensionality()) * img.pixelCount()));
 	}
 
-	void ifft(Image<complex32_t>& img, Image<float32_t>& out)
+
+	void fft(Image<float32_t>& img, Image<complex32_t>& out)
 	{
-		initFFTW();
+		checkFFTDimensionality(img.dimensionality());
+
+		Vec3c outSize = img.dimensions();
+		outSize.x = outSize.x / 2 + 1;
+		out.ensureSize(outSize);
+
+		internals::FFTWPlan p = internals::fftwPlan(internals::FFTWTransform::RealToComplex, img.dimensions(), img.dimensionality(), img.getData(), out.getData());
+		fftwf_execute_dft_r2c(p.get(), img.getData(), (fftwf_complex*)out.getData());
+	}
 
+	void ifft(Image<complex32_t>& img, Image<float32_t>& out)
+	{
 		if (img.dimensionality() != out.dimensionality() ||
 			out.width() < img.width() ||
 			out.height() < img.height() ||
 			out.depth() < img.depth())
 			throw ITLException("Size and dimensionality of the output image is not set correctly.");
 
-		if (img.dimensionality() == 1)
-		{
-			//coord_t w = (img.dimension(0) - 1) * 2;
-			coord_t w = out.dimension(0);
-
-			//out.ensureSize(w);
+		checkFFTDimensionality(img.dimensionality());
 
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_c2r_1d((int)w, (fftwf_complex*)img.getData(), out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else if (img.dimensionality() == 2)
-		{
-			//coord_t w = (img.dimension(0) - 1) * 2;
-			//coord_t h = img.dimension(1);
-			coord_t w = out.dimension(0);
-			coord_t h = out.dimension(1);
-
-			//out.ensureSize(w, h);
-
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_c2r_2d((int)h, (int)w, (fftwf_complex*)img.getData(), out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else if (img.dimensionality() == 3)
-		{
-			//coord_t w = (img.dimension(0) - 1) * 2;
-			//coord_t h = img.dimension(1);
-			//coord_t d = img.dimension(2);
-			coord_t w = out.dimension(0);
-			coord_t h = out.dimension(1);
-			coord_t d = out.dimension(2);
-
-			//out.ensureSize(w, h, d);
-
-			fftwf_plan p;
-			#pragma omp critical
-			{
-				setThreads();
-				p = fftwf_plan_dft_c2r_3d((int)d, (int)h, (int)w, (fftwf_complex*)img.getData(), out.getData(), FFTW_ESTIMATE);
-			}
-			fftwf_execute(p);
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(p);
-			}
-		}
-		else
-		{
-			throw ITLException("Unsupported dimensionality.");
-		}
+		internals::FFTWPlan p = internals::fftwPlan(internals::FFTWTransform::ComplexToReal, out.dimensions(), out.dimensionality(), img.getData(), out.getData());
+		fftwf_execute_dft_c2r(p.get(), (fftwf_complex*)img.getData(), out.getData());
 
 		// Normalize the output image
 		divide(out, (double)out.pixelCount());
@@ -686,6 +801,78 @@ namespace itl2
 		return shift;
 	}
 
+	PhaseCorrelationBatch::PhaseCorrelationBatch(const Vec3c& dimensions, size_t capacity) :
+		dims(dimensions),
+		size(capacity)
+	{
+		if (capacity < 1)
+			throw ITLException("Batch capacity must be at least one.");
+
+		images.ensureSize(dims.x, dims.y, dims.z * 2 * size);
+		transforms.ensureSize(dims.x / 2 + 1, dims.y, dims.z * 2 * size);
+		for (size_t n = 0; n < 2 * size; n++)
+		{
+			imageViews.push_back(std::make_unique<Image<float32_t> >(images, n * dims.z, (n + 1) * dims.z - 1));
+			transformViews.push_back(std::make_unique<Image<complex32_t> >(transforms, n * dims.z, (n + 1) * dims.z - 1));
+		}
+
+		dimensionality = imageViews[0]->dimensionality();
+		checkFFTDimensionality(dimensionality);
+
+		referencePlan = internals::fftwPlan(internals::FFTWTransform::RealToComplex, dims, dimensionality, reference(0).getData(), transformViews[0]->getData(), size);
+		shiftedPlan = internals::fftwPlan(internals::FFTWTransform::RealToComplex, dims, dimensionality, shifted(0).getData(), transformViews[size]->getData(), size);
+		inversePlan = internals::fftwPlan(internals::FFTWTransform::ComplexToReal, dims, dimensionality, transformViews[0]->getData(), reference(0).getData(), size);
+	}
+
+	void PhaseCorrelationBatch::correlate(size_t count, const Vec3c& maxShift, Vec3d* shifts, double* goodness)
+	{
+		if (count > size)
+			throw ITLException("Too many image pairs in phase correlation batch.");
+
+		if (count <= 0)
+			return;
+
+		float32_t* referenceData = reference(0).getData();
+		float32_t* shiftedData = shifted(0).getData();
+		complex32_t* referenceFFT = transformViews[0]->getData();
+		complex32_t* shiftedFFT = transformViews[size]->getData();
+
+		internals::FFTWPlan pRef = referencePlan;
+		internals::FFTWPlan pShifted = shiftedPlan;
+		internals::FFTWPlan pInverse = inversePlan;
+		if (count < size)
+		{
+			// Partial batches are rare, so their plans are taken from the plan cache.
+			pRef = internals::fftwPlan(internals::FFTWTransform::RealToComplex, dims, dimensionality, referenceData, referenceFFT, count);
+			pShifted = internals::fftwPlan(internals::FFTWTransform::RealToComplex, dims, dimensionality, shiftedData, shiftedFFT, count);
+			pInverse = internals::fftwPlan(internals::FFTWTransform::ComplexToReal, dims, dimensionality, referenceFFT, referenceData, count);
+		}
+
+		fftwf_execute_dft_r2c(pRef.get(), referenceData, (fftwf_complex*)referenceFFT);
+		fftwf_execute_dft_r2c(pShifted.get(), shiftedData, (fftwf_complex*)shiftedFFT);
+
+		for (size_t n = 0; n < count; n++)
+		{
+			Image<complex32_t>& f1 = *transformViews[n];
+			Image<complex32_t>& f2 = *transformViews[size + n];
+			conjugate(f2);
+			multiply(f1, f2);
+			normalize(f1);
+		}
+
+		fftwf_execute_dft_c2r(pInverse.get(), (fftwf_complex*)referenceFFT, referenceData);
+
+		for (size_t n = 0; n < count; n++)
+		{
+			Image<float32_t>& correlation = reference(n);
+			divide(correlation, (double)correlation.pixelCount());
+
+			float32_t maxVal;
+			shifts[n] = internals::findPeak(correlation, maxShift, maxVal);
+			goodness[n] = maxVal > 0 ? maxVal : 0;
+		}
+	}
+
 
 	namespace tests
 	{
@@ -847,5 +1034,112 @@ namespace itl2
 			}
 
 		}
+
+		void fftPlanCache()
+		{
+			auto checkComplex = [](const Image<complex32_t>& a, const Image<complex32_t>& b, const string& msg)
+			{
+				testAssert(a.dimensions() == b.dimensions(), msg + " (dimensions)");
+				float32_t maxDiff = 0;
+				for (coord_t n = 0; n < a.pixelCount(); n++)
+					maxDiff = std::max(maxDiff, std::abs(a(n) - b(n)));
+				testAssert(maxDiff == 0, msg);
+			};
+
+			for (const Vec3c& size : { Vec3c(37, 1, 1), Vec3c(64, 45, 1), Vec3c(30, 21, 16) })
+			{
+				Image<float32_t> img(size);
+				noise(img, 100, 20, 7);
+
+				// Transform pairs
+				Image<complex32_t> ft;
+				fft(img, ft);
+				Image<float32_t> comp(img.dimensions());
+				ifft(ft, comp);
+				checkDifference(img, comp, string("FFT - inverse FFT pair, ") + toString(size), 1e-3);
+
+				Image<float32_t> dctImg;
+				setValue(dctImg, img);
+				dct(dctImg);
+				idct(dctImg);
+				checkDifference(img, dctImg, string("DCT - inverse DCT pair, ") + toString(size), 1e-3);
+
+				// Cached plan must give the same result as the first one.
+				Image<complex32_t> ft2;
+				fft(img, ft2);
+				checkComplex(ft, ft2, string("repeated FFT, ") + toString(size));
+
+				// Plans are shared between images of the same size.
+				Image<complex32_t> ft3(ft.dimensions());
+				testAssert(internals::fftwPlan(internals::FFTWTransform::RealToComplex, img.dimensions(), img.dimensionality(), img.getData(), ft.getData()) ==
+					internals::fftwPlan(internals::FFTWTransform::RealToComplex, img.dimensions(), img.dimensionality(), img.getData(), ft3.getData()), "plan reuse");
+
+				// Simultaneous transforms in multiple threads.
+				const coord_t count = 8;
+				std::vector<Image<complex32_t> > results(count);
+				#pragma omp parallel for
+				for (coord_t n = 0; n < count; n++)
+				{
+					Image<float32_t> local;
+					setValue(local, img);
+					fft(local, results[n]);
+				}
+				for (coord_t n = 0; n < count; n++)
+					checkComplex(ft, results[n], string("parallel FFT, ") + toString(size));
+			}
+
+			// Wisdom is written through a temporary file that is renamed over the wisdom file.
+			fs::remove_all("./fft_wisdom");
+			fs::create_directories("./fft_wisdom");
+			string wisdomFile = "./fft_wisdom/wisdom";
+			setFFTWWisdomFile(wisdomFile);
+			for (coord_t n = 0; n < 2; n++)
+			{
+				Image<float32_t> img(23 + n, 19);
+				Image<complex32_t> ft;
+				fft(img, ft);
+				saveFFTWWisdom();
+				testAssert(fs::exists(wisdomFile), "wisdom file exists");
+				testAssert(std::distance(fs::directory_iterator("./fft_wisdom"), fs::directory_iterator()) == 1, "no temporary wisdom files left");
+			}
+			setFFTWWisdomFile("");
+		}
+
+		void phaseCorrelationBatch()
+		{
+			for (Vec3c size : { Vec3c(33, 1, 1), Vec3c(30, 25, 1), Vec3c(21, 20, 19) })
+			{
+				PhaseCorrelationBatch batch(size, 5);
+
+				// Full and partial batches.
+				for (size_t count : { 5, 3 })
+				{
+					Vec3c maxShift = size / 4;
+					std::vector<Vec3d> gtShifts(count);
+					std::vector<double> gtGoodness(count);
+					for (size_t n = 0; n < count; n++)
+					{
+						Image<float32_t> img(size);
+						noise(img, 100.0, 20.0, (unsigned int)(n + 1));
+						Image<float32_t> shifted(size);
+						translate(img, shifted, Vec3d(1.0 + n, -0.5 * n, 0.0), LinearInterpolator<float32_t, float32_t>(BoundaryCondition::Nearest));
+
+						setValue(batch.reference(n), img);
+						setValue(batch.shifted(n), shifted);
+						gtShifts[n] = phaseCorrelation(img, shifted, maxShift, gtGoodness[n]);
+					}
+
+					std::vector<Vec3d> shifts(count);
+					std::vector<double> goodness(count);
+					batch.correlate(count, maxShift, shifts.data(), goodness.data());
+
+					for (size_t n = 0; n < count; n++)
+					{
+						testAssert((shifts[n] - gtShifts[n]).abs().max() < 1e-4, string("batch phase correlation shift, ") + toString(size));
+						testAssert(std::abs(goodness[n] - gtGoodness[n]) < 1e-5, string("batch phase correlation goodness, ") + toString(size));
+					}
+				}
+			}
+		}
 	}
 }
@@ -2,8 +2,14 @@
 
 
 #include <complex>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include <omp.h>
 
+#include "fftw3.h"
+
 #include "image.h"
 #include "math/vec3.h"
 
@@ -15,6 +21,80 @@ namespace itl2
 	*/
 	void initFFTW();
 
+	/**
+	Sets the file where FFTW wisdom is loaded from and saved to.
+	Wisdom stored in the file is imported immediately. Wisdom accumulated while creating new plans is written to the file
+	when saveFFTWWisdom is called and when the program exits.
+	Set to empty string to disable loading and saving wisdom.
+	If this function is not called, the file name is read from PI2_FFTW_WISDOM environment variable, if it is set.
+	*/
+	void setFFTWWisdomFile(const std::string& filename);
+
+	/**
+	Writes current FFTW wisdom to the file set with setFFTWWisdomFile, if any.
+	*/
+	void saveFFTWWisdom();
+
+	/**
+	Sets FFTW planner flags used when creating new plans, e.g. FFTW_ESTIMATE (default), FFTW_MEASURE or FFTW_PATIENT.
+	Plans that are already in the plan cache are not affected.
+	If this function is not called, the planner is selected based on PI2_FFTW_PLANNER environment variable,
+	whose value can be 'estimate', 'measure', 'patient' or 'exhaustive'.
+	*/
+	void setFFTWPlannerFlags(unsigned int flags);
+
+	namespace internals
+	{
+		/**
+		Enumerates transform kinds supported by the plan cache.
+		*/
+		enum class FFTWTransform
+		{
+			/**
+			Discrete cosine transform (REDFT10), real to real.
+			*/
+			DCT,
+			/**
+			Inverse discrete cosine transform (REDFT01), real to real.
+			*/
+			IDCT,
+			/**
+			Real to complex forward transform.
+			*/
+			RealToComplex,
+			/**
+			Complex to real backward transform. Destroys input array.
+			*/
+			ComplexToReal,
+			/**
+			Complex to complex forward transform.
+			*/
+			Forward,
+			/**
+			Complex to complex backward transform.
+			*/
+			Backward
+		};
+
+		/**
+		Shared handle to cached FFTW plan.
+		*/
+		typedef std::shared_ptr<std::remove_pointer_t<fftwf_plan> > FFTWPlan;
+
+		/**
+		Gets FFTW plan suitable for transforming array in to array out.
+		Plans are cached by transform kind, dimensions, in-place flag, and alignment of the arrays, so the plan is created only on the first call
+		and subsequent calls with similar arrays return the same plan.
+		The plan must be executed with FFTW new-array execute functions (fftwf_execute_r2r, fftwf_execute_dft_r2c, fftwf_execute_dft_c2r or fftwf_execute_dft),
+		passing arrays that are similar to in and out. Execution can be done from multiple threads simultaneously.
+		This function can be called from multiple threads.
+		@param dimensions Logical size of the transform. For real to complex and complex to real transforms this is the size of the real array.
+		@param dimensionality Count of dimensions in the transform (1, 2 or 3).
+		@param howMany Count of transforms calculated by one execution of the plan. The arrays of the transforms must be stored consecutively in in and out.
+		*/
+		FFTWPlan fftwPlan(FFTWTransform kind, const Vec3c& dimensions, size_t dimensionality, void* in, void* out, size_t howMany = 1);
+	}
+
 	/**
 	Calculates Discrete Cosine Transform of the input image.
 	Calculates 1D DCT if img is 1-dimensional, 2D DCT if img is 2-dimensional etc.
@@ -90,6 +170,93 @@ namespace itl2
 	*/
 	Vec3d phaseCorrelation(Image<float32_t>& img1, Image<float32_t>& img2, const Vec3c& maxShift, double& goodness);
 
+	/**
+	Calculates phase correlation for a batch of image pairs of fixed size.
+	The pixel buffers and FFTW plans are allocated in the constructor and re-used for all the batches, and the Fourier transforms
+	of all the images in a batch are calculated with a single call to FFTW.
+	The object is not thread-safe; use one object per thread.
+	*/
+	class PhaseCorrelationBatch
+	{
+	private:
+		Vec3c dims;
+		size_t dimensionality;
+		size_t size;
+
+		/**
+		Reference images of the batch followed by the shifted images, and their Fourier transforms, stacked in the z-direction.
+		*/
+		Image<float32_t> images;
+		Image<complex32_t> transforms;
+
+		/**
+		Views to the images and transforms.
+		*/
+		std::vector<std::unique_ptr<Image<float32_t> > > imageViews;
+		std::vector<std::unique_ptr<Image<complex32_t> > > transformViews;
+
+		/**
+		Plans for transforming all the reference or all the shifted images of a full batch, and for the inverse transform of the correlations.
+		*/
+		internals::FFTWPlan referencePlan;
+		internals::FFTWPlan shiftedPlan;
+		internals::FFTWPlan inversePlan;
+
+	public:
+		/**
+		Constructor
+		@param dimensions Dimensions of the images.
+		@param capacity Maximum count of image pairs in one batch.
+		*/
+		PhaseCorrelationBatch(const Vec3c& dimensions, size_t capacity);
+
+		PhaseCorrelationBatch(const PhaseCorrelationBatch&) = delete;
+		PhaseCorrelationBatch& operator=(const PhaseCorrelationBatch&) = delete;
+
+		/**
+		Gets dimensions of the images.
+		*/
+		const Vec3c& dimensions() const
+		{
+			return dims;
+		}
+
+		/**
+		Gets maximum count of image pairs in one batch.
+		*/
+		size_t capacity() const
+		{
+			return size;
+		}
+
+		/**
+		Gets reference image of the n:th image pair.
+		*/
+		Image<float32_t>& reference(size_t n)
+		{
+			return *imageViews[n];
+		}
+
+		/**
+		Gets shifted image of the n:th image pair.
+		*/
+		Image<float32_t>& shifted(size_t n)
+		{
+			return *imageViews[size + n];
+		}
+
+		/**
+		Calculates shifts between the reference and shifted images of the first count image pairs.
+		The result is the same than calling phaseCorrelation(reference(n), shifted(n), maxShift, goodness[n]) for each pair.
+		The contents of the reference and shifted images are destroyed.
+		@param count Count of image pairs to process.
+		@param maxShift Maximal shift that is to be recognized.
+		@param shifts Shifts between the image pairs are stored here.
+		@param goodness Estimates of goodness of fit are stored here.
+		*/
+		void correlate(size_t count, const Vec3c& maxShift, Vec3d* shifts, double* goodness);
+	};
+
 	namespace tests
 	{
 		void fourierTransformPair();
@@ -98,5 +265,7 @@ namespace itl2
 		void phaseCorrelation();
 		void phaseCorrelation2();
 		void modulo();
+		void fftPlanCache();
+		void phaseCorrelationBatch();
 	}
 }
\ No newline at end of file
@@ -9,6 +9,9 @@
 #include "fft.h"
 #include "utilities.h"
 #include "fastmaxminfilters.h"
+#include "fastrankfilters.h"
+#include "runningsumfilters.h"
+#include "chordfilters.h"
 #include "median.h"
 
 namespace itl2
@@ -1381,6 +1384,16 @@ namespace itl2
 	*/
 	template<typename pixel_t> void nanMedianFilter(const Image<pixel_t> & in, Image<pixel_t> & out, const Vec3c & nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
+		if constexpr (internals::supportsHistogramRankFilter<pixel_t>())
+		{
+			// Integer images do not contain nan values.
+			if (bc == BoundaryCondition::Zero || bc == BoundaryCondition::Nearest)
+			{
+				internals::histogramMedianFilter<pixel_t, pixel_t>(in, out, nbRadius, nbType, bc, nullptr);
+				return;
+			}
+		}
+
 		filter<pixel_t, pixel_t, internals::nanMedianOp<pixel_t> >(in, out, nbRadius, nbType, bc);
 	}
 	
@@ -1423,6 +1436,7 @@ help \
 \
 Separable filtering is used for all pixel data types for rectangular neighbourhoods. \
 If allowOpt is true, spherical structuring elements larger in radius than 5 are approximated using periodic lines and van Herk algorithm. \
+Other neighbourhoods are processed exactly by decomposing them into x-directional chords. \
 @param in Input image. \
 @param out Output image. \
 @param nbRadius Radius of filtering neighbourhood. \
@@ -1443,6 +1457,15 @@ template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t
 		setValue<out_t, pixel_t>(out, in); \
 		name##FilterSphereApprox<out_t>(out, nbRadius.x, bc); \
 	} \
+	else if constexpr (internals::supportsChordFilter<pixel_t>()) \
+	{ \
+		Vec3c r = nbRadius; \
+		for (size_t n = in.dimensionality(); n < r.size(); n++) \
+			r[n] = 0; \
+		Image<uint8_t> se; \
+		createNeighbourhoodMask(nbType, r, se); \
+		name##Filter<pixel_t, out_t>(in, out, se, bc); \
+	} \
 	else \
 	{ \
 		filter<pixel_t, out_t, internals::name##Op<pixel_t> >(in, out, nbRadius, nbType, bc); \
@@ -1454,6 +1477,7 @@ help \
 \
 Separable filtering is used for all pixel data types for rectangular neighbourhoods. \
 If allowOpt is true, spherical structuring elements larger in radius than 5 are approximated using periodic lines and van Herk algorithm. \
+Other neighbourhoods are processed exactly by decomposing them into x-directional chords. \
 @param in Input image. \
 @param out Output image. \
 @param nbRadius Radius of filtering neighbourhood. \
@@ -1468,90 +1492,6 @@ template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t
 
 
 
-// This version includes separable filtering optimization for float types only.
-#define DEFINE_FILTER_SEP_FLOAT(name, help) \
-/** \
-help \
-\
-Separable filtering is used for floating point pixel data types for rectangular neighbourhoods. \
-@param in Input image. \
-@param out Output image. \
-@param nbRadius Radius of filtering neighbourhood. \
-@param nbType Neighbourhood type. \
-@param bc Boundary condition. \
-*/ \
-template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest) \
-{ \
-	filter<pixel_t, out_t, internals::name##Op<pixel_t> >(in, out, nbRadius, nbType, bc); \
-} \
- \
-/** \
-help \
-\
-Separable filtering is used for floating point pixel data types for rectangular neighbourhoods. \
-@param in Input image. \
-@param out Output image. \
-@param nbRadius Radius of filtering neighbourhood. \
-@param nbType Neighbourhood type. \
-@param bc Boundary condition. \
-*/ \
-template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest) \
-{ \
-	name##Filter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), nbType, bc); \
-} \
-/** \
-help \
-\
-In-place filtering supports only rectangular neighbourhood. \
-@param img Image to process. \
-@param nbRadius Radius of filtering neighbourhood. \
-@param nbType Neighbourhood type. \
-@param bc Boundary condition. \
-*/ \
-inline void name##Filter(Image<float32_t>& img, const Vec3c& nbRadius, BoundaryCondition bc = BoundaryCondition::Nearest) \
-{ \
-	sepFilter<float32_t, internals::name##Op<float32_t> >(img, nbRadius, bc); \
-} \
-/** \
-help \
-\
-In-place filtering supports only rectangular neighbourhood. \
-@param img Image to process. \
-@param nbRadius Radius of filtering neighbourhood. \
-@param nbType Neighbourhood type. \
-@param bc Boundary condition. \
-*/ \
-inline void name##Filter(Image<float32_t>& img, coord_t nbRadius, BoundaryCondition bc = BoundaryCondition::Nearest) \
-{ \
-	sepFilter<float32_t, internals::name##Op<float32_t> >(img, Vec3c(nbRadius, nbRadius, nbRadius), bc); \
-} \
-/** \
-help \
-\
-Separable filtering is used for floating point pixel data types for rectangular neighbourhoods. \
-@param in Input image. \
-@param out Output image. \
-@param nbRadius Radius of filtering neighbourhood. \
-@param nbType Neighbourhood type. \
-@param bc Boundary condition. \
-*/ \
-template<> inline void name##Filter(const Image<float32_t>& in, Image<float32_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType, BoundaryCondition bc) \
-{ \
-	if(nbType == NeighbourhoodType::Rectangular) \
-	{ \
-		out.ensureSize(in); \
-		setValue<float32_t>(out, in); \
-		name##Filter(out, nbRadius, bc); \
-	} \
-	else \
-	{ \
-		filter<float32_t, float32_t, internals::name##Op<float32_t> >(in, out, nbRadius, nbType, bc); \
-	} \
-}
-
-	
-
-
 // Version with no parameters and no separable optimization
 #define DEFINE_FILTER(name, help) \
 /** \
@@ -1616,86 +1556,207 @@ template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t
 	// Now define the filtering operations
 	DEFINE_FILTER_MINMAX(min, Calculates minimum filtering.)
 	DEFINE_FILTER_MINMAX(max, Calculates maximum filtering.)
-	DEFINE_FILTER_SEP_FLOAT(mean, Calculates mean filtering.)
-	DEFINE_FILTER(median, Calculates median filtering.)
-	DEFINE_FILTER_1PARAM(maskedMedian, pixel_t, Calculates masked median filtering., Image value that should not be considered when calculating median.)
+	/**
+	Calculates mean filtering.
 
-	#define COMMA ,
-	DEFINE_FILTER_1PARAM(vawe, double, Calculates variance weighted mean filtering., Standard deviation of noise. For a rough order of magnitude estimateCOMMA measure standard deviation from a region that does not contain any features.)
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition.
+	*/
+	template<typename pixel_t, typename out_t> void meanFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		if constexpr (internals::supportsRunningSumFilter<pixel_t>())
+		{
+			if (nbType == NeighbourhoodType::Rectangular)
+			{
+				if (internals::runningSumFilter<pixel_t, out_t>(in, out, nbRadius, bc, internals::RunningSumStatistic::Mean))
+					return;
+			}
+		}
 
+		filter<pixel_t, out_t, internals::meanOp<pixel_t> >(in, out, nbRadius, nbType, bc);
+	}
 
-	// Variance requires special handling
 	/**
-	Calculates variance filtering.
+	Calculates mean filtering.
 
-	Separable optimization is used for rectangular neighbourhoods.
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
 	@param in Input image.
 	@param out Output image.
 	@param nbRadius Radius of filtering neighbourhood.
 	@param nbType Neighbourhood type.
-	@param bc Boundary condition (BoundaryCondition::Zero or Nearest).
+	@param bc Boundary condition.
 	*/
-	template<typename pixel_t, typename out_t> void varianceFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	template<typename pixel_t, typename out_t> void meanFilter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
-		filter<pixel_t, out_t, internals::varianceOp<pixel_t> >(in, out, nbRadius, nbType, bc);
+		meanFilter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), nbType, bc);
 	}
-	
+
 	/**
-	Calculates variance filtering.
+	Calculates mean filtering.
 
-	Separable optimization is used for rectangular neighbourhoods.
+	In-place filtering supports only rectangular neighbourhood.
+	@param img Image to process.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param bc Boundary condition.
+	*/
+	inline void meanFilter(Image<float32_t>& img, const Vec3c& nbRadius, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		sepFilter<float32_t, internals::meanOp<float32_t> >(img, nbRadius, bc);
+	}
+
+	/**
+	Calculates mean filtering.
+
+	In-place filtering supports only rectangular neighbourhood.
+	@param img Image to process.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param bc Boundary condition.
+	*/
+	inline void meanFilter(Image<float32_t>& img, coord_t nbRadius, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		sepFilter<float32_t, internals::meanOp<float32_t> >(img, Vec3c(nbRadius, nbRadius, nbRadius), bc);
+	}
+
+	/**
+	Calculates median filtering.
+
+	For 8- and 16-bit unsigned integer images and Zero and Nearest boundary conditions, a sliding histogram algorithm is used.
+	Its cost per pixel is proportional to r^2 instead of r^3.
 	@param in Input image.
 	@param out Output image.
 	@param nbRadius Radius of filtering neighbourhood.
 	@param nbType Neighbourhood type.
-	@param bc Boundary condition (BoundaryCondition::Zero or Nearest).
+	@param bc Boundary condition.
 	*/
-	template<typename pixel_t, typename out_t> void varianceFilter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	template<typename pixel_t, typename out_t> void medianFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
-		varianceFilter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), nbType, bc);
+		if constexpr (internals::supportsHistogramRankFilter<pixel_t>())
+		{
+			if (bc == BoundaryCondition::Zero || bc == BoundaryCondition::Nearest)
+			{
+				internals::histogramMedianFilter<pixel_t, out_t>(in, out, nbRadius, nbType, bc, nullptr);
+				return;
+			}
+		}
+
+		filter<pixel_t, out_t, internals::medianOp<pixel_t> >(in, out, nbRadius, nbType, bc);
 	}
 
-	namespace internals
+	/**
+	Calculates median filtering.
+
+	For 8- and 16-bit unsigned integer images and Zero and Nearest boundary conditions, a sliding histogram algorithm is used.
+	Its cost per pixel is proportional to r^2 instead of r^3.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition.
+	*/
+	template<typename pixel_t, typename out_t> void medianFilter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
-		inline float32_t rectVarianceFinalization(float32_t out, float32_t tmp)
+		medianFilter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), nbType, bc);
+	}
+
+	/**
+	Calculates masked median filtering.
+
+	For 8- and 16-bit unsigned integer images and Zero and Nearest boundary conditions, a sliding histogram algorithm is used.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param parameter Image value that should not be considered when calculating median.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition.
+	*/
+	template<typename pixel_t, typename out_t> void maskedMedianFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, pixel_t parameter, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		if constexpr (internals::supportsHistogramRankFilter<pixel_t>())
 		{
-			return (float32_t)tmp - (float32_t)out * (float32_t)out;
+			if (bc == BoundaryCondition::Zero || bc == BoundaryCondition::Nearest)
+			{
+				internals::histogramMedianFilter<pixel_t, out_t>(in, out, nbRadius, nbType, bc, &parameter);
+				return;
+			}
 		}
+
+		filter<pixel_t, out_t, pixel_t, internals::maskedMedianOp<pixel_t> >(in, out, nbRadius, parameter, nbType, bc);
 	}
 
-	template<> inline void varianceFilter(const Image<float32_t>& in, Image<float32_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType, BoundaryCondition bc)
+	/**
+	Calculates masked median filtering.
+
+	For 8- and 16-bit unsigned integer images and Zero and Nearest boundary conditions, a sliding histogram algorithm is used.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param parameter Image value that should not be considered when calculating median.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition.
+	*/
+	template<typename pixel_t, typename out_t> void maskedMedianFilter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, pixel_t parameter, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
-		if(nbType == NeighbourhoodType::Rectangular)
-		{
-			out.ensureSize(in);
+		maskedMedianFilter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), parameter, nbType, bc);
+	}
 
-			// Calculate mean filtering of in. For now on, out = mean(in)
-			setValue(out, in);
-			sepFilter<float32_t, internals::meanOp<float32_t> >(out, nbRadius, bc);
 
-			// Calculate in^2. For now on, out contains in^2.
-			Image<float32_t> tmp;
-			tmp.ensureSize(in);
-			setValue<float32_t>(tmp, in);
-			multiply(tmp, tmp);
+	#define COMMA ,
+	DEFINE_FILTER_1PARAM(vawe, double, Calculates variance weighted mean filtering., Standard deviation of noise. For a rough order of magnitude estimateCOMMA measure standard deviation from a region that does not contain any features.)
 
-			// Calculate mean of orig^2. For now on, tmp = mean(in^2).
-			sepFilter<float32_t, internals::meanOp<float32_t> >(tmp, nbRadius, bc);
 
-			// Calculate variance with mean(in^2) - mean(in)^2 = tmp - out * out
-			pointProcessImageImage<float32_t, float32_t, float32_t, internals::rectVarianceFinalization>(out, tmp, false);
-		}
-		else
+	/**
+	Calculates variance filtering.
+
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition (BoundaryCondition::Zero or Nearest).
+	*/
+	template<typename pixel_t, typename out_t> void varianceFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		if constexpr (internals::supportsRunningSumFilter<pixel_t>())
 		{
-			filter<float32_t, float32_t, internals::varianceOp<float32_t> >(in, out, nbRadius, nbType, bc);
+			if (nbType == NeighbourhoodType::Rectangular)
+			{
+				if (internals::runningSumFilter<pixel_t, out_t>(in, out, nbRadius, bc, internals::RunningSumStatistic::Variance))
+					return;
+			}
 		}
+
+		filter<pixel_t, out_t, internals::varianceOp<pixel_t> >(in, out, nbRadius, nbType, bc);
+	}
+	
+	/**
+	Calculates variance filtering.
+
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
+	@param in Input image.
+	@param out Output image.
+	@param nbRadius Radius of filtering neighbourhood.
+	@param nbType Neighbourhood type.
+	@param bc Boundary condition (BoundaryCondition::Zero or Nearest).
+	*/
+	template<typename pixel_t, typename out_t> void varianceFilter(const Image<pixel_t>& in, Image<out_t>& out, coord_t nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
+	{
+		varianceFilter<pixel_t, out_t>(in, out, Vec3c(nbRadius, nbRadius, nbRadius), nbType, bc);
 	}
 
 
 	/**
 	Calculates standard deviation filtering.
 
-	Separable optimization is used for rectangular neighbourhoods.
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
 	@param in Input image.
 	@param out Output image.
 	@param nbRadius Radius of filtering neighbourhood.
@@ -1704,13 +1765,23 @@ template<typename pixel_t, typename out_t> void name##Filter(const Image<pixel_t
 	*/
 	template<typename pixel_t, typename out_t> void stddevFilter(const Image<pixel_t>& in, Image<out_t>& out, const Vec3c& nbRadius, NeighbourhoodType nbType = NeighbourhoodType::Ellipsoidal, BoundaryCondition bc = BoundaryCondition::Nearest)
 	{
+		if constexpr (internals::supportsRunningSumFilter<pixel_t>())
+		{
+			if (nbType == NeighbourhoodType::Rectangular)
+			{
+				if (internals::runningSumFilter<pixel_t, out_t>(in, out, nbRadius, bc, internals::RunningSumStatistic::StdDev))
+					return;
+			}
+		}
+
 		filter<pixel_t, out_t, internals::stddevOp<pixel_t> >(in, out, nbRadius, nbType, bc);
 	}
 
 	/**
 	Calculates standard deviation filtering.
 
-	Separable optimization is used for rectangular neighbourhoods.
+	For rectangular neighbourhoods and real pixel data types, running sums are used so that the cost per pixel
+	does not depend on the size of the neighbourhood.
 	@param in Input image.
 	@param out Output image.
 	@param nbRadius Radius of filtering neighbourhood.
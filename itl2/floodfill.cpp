@@ -7,6 +7,7 @@
 #include "generation.h"
 #include "dmap.h"
 #include "iteration.h"
+#include "io/nn5.h"
 
 #include "testutils.h"
 
@@ -996,6 +997,46 @@ namespace itl2
 		}
 
 
+		void floodfillNN5()
+		{
+			Image<uint8_t> img(100, 90, 80);
+			srand(5);
+			for (coord_t n = 0; n < img.pixelCount(); n++)
+				img(n) = rand() % 100 < 70 ? 255 : 0;
+
+			Vec3c start(50, 45, 40);
+			img(start) = 255;
+
+			for (Connectivity connectivity : { Connectivity::NearestNeighbours, Connectivity::AllNeighbours })
+			{
+				for (nn5::NN5Compression compression : { nn5::NN5Compression::Raw, nn5::NN5Compression::LZ4 })
+				{
+					string desc = toString(connectivity) + ", " + toString(compression);
+					string path = "./floodfill/nn5";
+
+					fs::remove_all(path);
+					nn5::write(img, path, Vec3c(16, 16, 16), compression);
+
+					Image<uint8_t> gt(img.dimensions());
+					setValue(gt, img);
+					size_t gtCount;
+					floodfillSingleThreaded(gt, start, (uint8_t)128, (uint8_t)128, connectivity, &gtCount);
+
+					// The cache is much smaller than the image so that the chunks are evicted and re-read during the fill.
+					size_t count;
+					{
+						NN5Accessor<uint8_t> accessor(path, false, 16 * 16 * 16 * 20);
+						floodfill(accessor, start, (uint8_t)128, (uint8_t)128, connectivity, &count);
+					}
+
+					Image<uint8_t> result;
+					nn5::read(result, path);
+					testAssert(equals(result, gt), "NN5 flood fill, " + desc);
+					testAssert(count == gtCount, "NN5 flood fill point count, " + desc);
+				}
+			}
+		}
+
 		void floodfillLeaks()
 		{
 			{
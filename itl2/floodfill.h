@@ -9,13 +9,30 @@
 #include "image.h"
 #include "math/vec3.h"
 #include "connectivity.h"
+#include "nn5accessor.h"
 
 namespace itl2
 {
 
 	namespace internals
 	{
-		template<typename pixel_t> bool processNeighbours(coord_t x, coord_t y, coord_t z, std::queue<Vec3sc>& points, std::vector<std::tuple<coord_t, coord_t, bool> >& nbs, const Image<pixel_t>& image, pixel_t fillColor, pixel_t origColor, pixel_t stopColor, std::set<pixel_t>* pNeighbouringColors)
+		/**
+		Sets value of a pixel in an image.
+		*/
+		template<typename pixel_t> void setPixel(Image<pixel_t>& image, coord_t x, coord_t y, coord_t z, pixel_t value)
+		{
+			image(x, y, z) = value;
+		}
+
+		/**
+		Sets value of a pixel in an NN5 dataset.
+		*/
+		template<typename pixel_t> void setPixel(NN5Accessor<pixel_t>& image, coord_t x, coord_t y, coord_t z, pixel_t value)
+		{
+			image.set(Vec3c(x, y, z), value);
+		}
+
+		template<typename image_t, typename pixel_t> bool processNeighbours(coord_t x, coord_t y, coord_t z, std::queue<Vec3sc>& points, std::vector<std::tuple<coord_t, coord_t, bool> >& nbs, image_t& image, pixel_t fillColor, pixel_t origColor, pixel_t stopColor, std::set<pixel_t>* pNeighbouringColors)
 		{
 			for (auto& nb : nbs)
 			{
@@ -53,21 +70,18 @@ namespace itl2
 	}
 
 	/**
-	Flood fill beginning from the given seed points.
+	Flood fill beginning from the given seed points, and call the given function for each filled point.
+	Use this version to process the filled points without storing them.
+	@param image Image containing the geometry to be filled. Can be an Image or an NN5Accessor.
 	@param origColor Original color that we are filling. (the color of the region where the fill is allowed to proceed)
 	@param fillColor Fill color. The filled pixels will be colored with this color.
 	@param stopColor Set to value different from fillColor to stop filling when a pixel of this color is encountered. This argument is used for efficient implementation of small region removal.
+	@param pointFilled Function that is called with the coordinates of each filled point as an argument.
 	@param pNeighbouringColors Pointer to a set that will contain colors neighbouring the filled region. Set to null not to collect this information. Values of seed points that are not origColor, fillColor, or stopColor are added to the set, too.
 	@return True if the fill was terminated naturally; false if the fill was terminated by reaching fillLimit in filled pixel count; by encountering pixel with stopColor value; or if the origColor is fillColor.
 	*/
-	template<typename pixel_t> bool floodfillSingleThreaded(Image<pixel_t>& image, const std::vector<Vec3sc>& seeds, pixel_t origColor, pixel_t fillColor, pixel_t stopColor, Connectivity connectivity = Connectivity::NearestNeighbours, size_t* pFilledPointCount = nullptr, std::vector<Vec3sc>* pFilledPoints = nullptr, size_t fillLimit = 0, std::set<pixel_t>* pNeighbouringColors = nullptr, bool showProgressInfo = true)
+	template<typename image_t, typename pixel_t, typename visitor_t> bool floodfillVisit(image_t& image, const std::vector<Vec3sc>& seeds, pixel_t origColor, pixel_t fillColor, pixel_t stopColor, Connectivity connectivity, visitor_t pointFilled, size_t fillLimit = 0, std::set<pixel_t>* pNeighbouringColors = nullptr, bool showProgressInfo = true)
 	{
-		if (pFilledPointCount)
-			*pFilledPointCount = 0;
-
-		if (pFilledPoints)
-			pFilledPoints->clear();
-
 		if (pNeighbouringColors)
 			pNeighbouringColors->clear();
 
@@ -93,8 +107,9 @@ namespace itl2
 		}
 
 		std::queue<Vec3sc> points;
-		for (const Vec3sc& v : seeds)
+		for (const Vec3sc& seed : seeds)
 		{
+			Vec3c v(seed);
 			if (image.isInImage(v))
 			{
 				pixel_t p = image(v);
@@ -104,15 +119,12 @@ namespace itl2
 				if (pNeighbouringColors != 0 && p != origColor && p != fillColor)
 					pNeighbouringColors->insert(p);
 
-				points.push(v);
+				points.push(seed);
 			}
 		}
 
 		size_t lastPrinted = 0;
-		size_t tmp = 0;
-		size_t* pCount = &tmp;
-		if (pFilledPointCount)
-			pCount = pFilledPointCount;
+		size_t count = 0;
 
 		while (!points.empty())
 		{
@@ -155,13 +167,12 @@ namespace itl2
 
 				while (xl < image.width() && image(xl, y, z) == origColor)
 				{
-					image(xl, y, z) = fillColor;
-					(*pCount)++;
-					if (pFilledPoints)
-						pFilledPoints->push_back(Vec3sc((int32_t)xl, (int32_t)y, (int32_t)z));
+					internals::setPixel(image, xl, y, z, fillColor);
+					count++;
+					pointFilled(Vec3sc((int32_t)xl, (int32_t)y, (int32_t)z));
 
 					// Fill volume limit check
-					if (*pCount >= fillLimit)
+					if (count >= fillLimit)
 						return false;
 
 					if(!internals::processNeighbours(xl, y, z, points, nbs, image, fillColor, origColor, stopColor, pNeighbouringColors))
@@ -212,6 +223,34 @@ namespace itl2
 		return true;
 	}
 
+	/**
+	Flood fill beginning from the given seed points.
+	@param origColor Original color that we are filling. (the color of the region where the fill is allowed to proceed)
+	@param fillColor Fill color. The filled pixels will be colored with this color.
+	@param stopColor Set to value different from fillColor to stop filling when a pixel of this color is encountered. This argument is used for efficient implementation of small region removal.
+	@param pNeighbouringColors Pointer to a set that will contain colors neighbouring the filled region. Set to null not to collect this information. Values of seed points that are not origColor, fillColor, or stopColor are added to the set, too.
+	@return True if the fill was terminated naturally; false if the fill was terminated by reaching fillLimit in filled pixel count; by encountering pixel with stopColor value; or if the origColor is fillColor.
+	*/
+	template<typename pixel_t> bool floodfillSingleThreaded(Image<pixel_t>& image, const std::vector<Vec3sc>& seeds, pixel_t origColor, pixel_t fillColor, pixel_t stopColor, Connectivity connectivity = Connectivity::NearestNeighbours, size_t* pFilledPointCount = nullptr, std::vector<Vec3sc>* pFilledPoints = nullptr, size_t fillLimit = 0, std::set<pixel_t>* pNeighbouringColors = nullptr, bool showProgressInfo = true)
+	{
+		size_t tmp = 0;
+		size_t* pCount = &tmp;
+		if (pFilledPointCount)
+			pCount = pFilledPointCount;
+
+		*pCount = 0;
+
+		if (pFilledPoints)
+			pFilledPoints->clear();
+
+		return floodfillVisit(image, seeds, origColor, fillColor, stopColor, connectivity, [=](const Vec3sc& p)
+			{
+				(*pCount)++;
+				if (pFilledPoints)
+					pFilledPoints->push_back(p);
+			}, fillLimit, pNeighbouringColors, showProgressInfo);
+	}
+
 	/**
 	Perform flood fill.
 	Uses single-threaded scanline fill algorithm.
@@ -550,6 +589,41 @@ namespace itl2
 			return floodfillBlocks(image, seeds, origColor, fillColor, stopColor, connectivity, pFilledPointCount, pFilledPoints, fillLimit, pNeighbouringColors, showProgressInfo);
 	}
 
+	/**
+	Perform flood fill in an NN5 dataset that does not need to fit into the memory.
+	The pixels are accessed through the chunk cache of the accessor, so the memory usage is bounded by the cache size and the count of pending seed points.
+	Uses single-threaded scanline fill algorithm.
+	@param image Accessor to the dataset containing the geometry to be filled.
+	@param start Starting position.
+	@param fillColor Fill color. The filled pixels will be colored with this color.
+	@param stopColor Set to value different from fillColor to stop filling when a pixel of this color is encountered.
+	@param connectivity Connectivity of the fill.
+	@param pFilledPointCount Pointer to variable that will receive the count of filled points. Set to zero if this information is not required.
+	@param fillLimit Set to value to limit count of filled points to that value. Set to zero to allow any number of filled points.
+	@return True if the fill was terminated naturally; false if the fill was terminated by reaching fillLimit in filled pixel count; by encountering pixel with stopColor value; or if the origColor is fillColor.
+	*/
+	template<typename pixel_t> bool floodfill(NN5Accessor<pixel_t>& image, const Vec3c& start, pixel_t fillColor, pixel_t stopColor, Connectivity connectivity = Connectivity::NearestNeighbours, size_t* pFilledPointCount = nullptr, size_t fillLimit = 0, bool showProgressInfo = true)
+	{
+		size_t tmp = 0;
+		size_t* pCount = &tmp;
+		if (pFilledPointCount)
+			pCount = pFilledPointCount;
+
+		*pCount = 0;
+
+		if (!image.isInImage(start))
+			return true;
+
+		pixel_t origColor = image(start);
+		std::vector<Vec3sc> seeds;
+		seeds.push_back(Vec3sc(start));
+
+		return floodfillVisit(image, seeds, origColor, fillColor, stopColor, connectivity, [=](const Vec3sc& p)
+			{
+				(*pCount)++;
+			}, fillLimit, (std::set<pixel_t>*)nullptr, showProgressInfo);
+	}
+
 	/**
 	Flood fill beginning from the given seed points.
 	Does not use scan line fill algorithm, may be faster than scan line fill for very small images.
@@ -1144,6 +1218,7 @@ namespace itl2
 		void floodfill();
 		void floodfillLeaks();
 		void floodfillThreading();
+		void floodfillNN5();
 		void growPriority();
 		void growAll();
 		void growComparison();
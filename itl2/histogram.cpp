@@ -7,6 +7,8 @@
 #include "test.h"
 #include "projections.h"
 #include "testutils.h"
+#include "generation.h"
+#include "timer.h"
 
 using namespace std;
 
@@ -25,6 +27,146 @@ namespace itl2
 			typeAssert<histogram_intermediate_type<uint64_t, int32_t>::type, uint64_t>();
 		}
 
+		/**
+		Straightforward histogram calculation, as implemented before the specialized versions.
+		*/
+		template<typename pixel_t> void referenceHistogram(const Image<pixel_t>& img, Image<double>& hist, const Vec2d& range, coord_t edgeSkip, const Image<float32_t>* pWeight)
+		{
+			coord_t dim = hist.pixelCount();
+			setValue(hist, 0.0);
+			for (coord_t z = 0; z < img.depth(); z++)
+			{
+				for (coord_t y = 0; y < img.height(); y++)
+				{
+					for (coord_t x = 0; x < img.width(); x++)
+					{
+						if (img.edgeDistance(Vec3c(x, y, z)) >= edgeSkip)
+						{
+							pixel_t pix = img(x, y, z);
+							coord_t bin = itl2::floor(((pix - range.x) / (range.y - range.x)) * (double)dim);
+							pixel_t binMin = pixelRound<pixel_t>(range.x + (double)bin / (double)dim * (range.y - range.x));
+							pixel_t binMax = pixelRound<pixel_t>(range.x + (double)(bin + 1) / (double)dim * (range.y - range.x));
+							if (pix < binMin)
+								bin--;
+							else if (pix >= binMax)
+								bin++;
+
+							if (bin < 0)
+								bin = 0;
+							else if (bin >= dim)
+								bin = dim - 1;
+
+							hist(bin) += pWeight ? (*pWeight)(x, y, z) : 1.0;
+						}
+					}
+				}
+			}
+		}
+
+		template<typename pixel_t> void checkHistogram(const Vec3c& dimensions, double minValue, double maxValue, const Vec2d& range, coord_t binCount)
+		{
+			Image<pixel_t> img(dimensions);
+			for (coord_t n = 0; n < img.pixelCount(); n++)
+				img(n) = pixelRound<pixel_t>(frand(minValue, maxValue));
+
+			Image<float32_t> weight(dimensions);
+			for (coord_t n = 0; n < weight.pixelCount(); n++)
+				weight(n) = (float32_t)(int)frand(0, 10);
+
+			for (coord_t edgeSkip : { 0, 3 })
+			{
+				string desc = string(typeid(pixel_t).name()) + ", dimensions " + toString(dimensions) + ", edge skip " + toString(edgeSkip);
+
+				Image<double> gt(binCount), hist(binCount);
+				referenceHistogram(img, gt, range, edgeSkip, (const Image<float32_t>*)nullptr);
+				itl2::histogram(img, hist, range, edgeSkip, (const Image<double>*)nullptr, false);
+				testAssert(equals(hist, gt), "histogram, " + desc);
+
+				referenceHistogram(img, gt, range, edgeSkip, &weight);
+				itl2::histogram(img, hist, range, edgeSkip, &weight, false);
+				testAssert(equals(hist, gt), "weighted histogram, " + desc);
+			}
+		}
+
+		void histogramFastPaths()
+		{
+			// Ranges that do not match the bins exactly, and values out of range.
+			checkHistogram<uint8_t>(Vec3c(50, 40, 30), 0, 255, Vec2d(10, 200), 7);
+			checkHistogram<int8_t>(Vec3c(50, 40, 30), -128, 127, Vec2d(-100, 100), 13);
+			checkHistogram<uint16_t>(Vec3c(50, 40, 30), 0, 65535, Vec2d(100, 60000), 100);
+			checkHistogram<int16_t>(Vec3c(50, 40, 1), -32768, 32767, Vec2d(-1000, 1000), 100);
+			checkHistogram<int32_t>(Vec3c(50, 40, 30), -100000, 100000, Vec2d(-50000, 50000), 99);
+			checkHistogram<float32_t>(Vec3c(50, 40, 30), -10, 10, Vec2d(-3.3, 7.7), 256);
+			checkHistogram<float32_t>(Vec3c(500, 1, 1), 0, 1, Vec2d(0, 1), 10);
+
+			// Multivariate histogram
+			Image<uint16_t> img1(60, 50, 40);
+			Image<float32_t> img2(img1.dimensions());
+			for (coord_t n = 0; n < img1.pixelCount(); n++)
+			{
+				img1(n) = pixelRound<uint16_t>(frand(0, 2000));
+				img2(n) = (float32_t)frand(0, 1);
+			}
+			Image<float32_t> hist(30, 20);
+			itl2::multiHistogram(hist, 2, ImageAndRange(img1, Vec2d(100, 1500), 30), ImageAndRange(img2, Vec2d(0.1, 0.9), 20));
+
+			Image<float32_t> gt(hist.dimensions());
+			for (coord_t z = 2; z < img1.depth() - 2; z++)
+			{
+				for (coord_t y = 2; y < img1.height() - 2; y++)
+				{
+					for (coord_t x = 2; x < img1.width() - 2; x++)
+					{
+						Image<double> h1(30), h2(20);
+						Image<uint16_t> p1(1);
+						Image<float32_t> p2(1);
+						p1(0) = img1(x, y, z);
+						p2(0) = img2(x, y, z);
+						referenceHistogram(p1, h1, Vec2d(100, 1500), 0, nullptr);
+						referenceHistogram(p2, h2, Vec2d(0.1, 0.9), 0, nullptr);
+						coord_t b1 = 0, b2 = 0;
+						for (coord_t n = 0; n < h1.pixelCount(); n++)
+							if (h1(n) != 0)
+								b1 = n;
+						for (coord_t n = 0; n < h2.pixelCount(); n++)
+							if (h2(n) != 0)
+								b2 = n;
+						gt(b1, b2)++;
+					}
+				}
+			}
+			testAssert(equals(hist, gt), "multivariate histogram");
+
+			// Timing
+			Image<uint16_t> big(256, 256, 256);
+			for (coord_t n = 0; n < big.pixelCount(); n++)
+				big(n) = (uint16_t)(rand() % 4096);
+			Image<float32_t> bigf(big.dimensions());
+			setValue(bigf, big);
+
+			Image<double> h(256), hgt(256);
+			Timer timer;
+			timer.start();
+			referenceHistogram(big, hgt, Vec2d(0, 4096), 0, nullptr);
+			timer.stop();
+			cout << "Reference uint16 histogram took " << timer.getSeconds() << " s" << endl;
+			timer.start();
+			itl2::histogram(big, h, Vec2d(0, 4096), 0, (const Image<double>*)nullptr, false);
+			timer.stop();
+			cout << "uint16 histogram took " << timer.getSeconds() << " s" << endl;
+			testAssert(equals(h, hgt), "large uint16 histogram");
+
+			timer.start();
+			referenceHistogram(bigf, hgt, Vec2d(0, 4096), 0, nullptr);
+			timer.stop();
+			cout << "Reference float32 histogram took " << timer.getSeconds() << " s" << endl;
+			timer.start();
+			itl2::histogram(bigf, h, Vec2d(0, 4096), 0, (const Image<double>*)nullptr, false);
+			timer.stop();
+			cout << "float32 histogram took " << timer.getSeconds() << " s" << endl;
+			testAssert(equals(h, hgt), "large float32 histogram");
+		}
+
 		void histogram()
 		{
 			Image<uint16_t> head(256, 256, 129);
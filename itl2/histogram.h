@@ -5,6 +5,8 @@
 #include <array>
 #include <tuple>
 #include <numeric>
+#include <limits>
+#include <vector>
 
 #include "image.h"
 #include "utilities.h"
@@ -27,6 +29,134 @@ namespace itl2
 		>::type;
 	};
 
+	namespace internals
+	{
+		/**
+		Calculates histogram bin of a pixel value.
+		Pixels out of range are placed in the first or the last bin.
+		The calculation does not contain branches so that it can be vectorized when called in a loop.
+		@param pix Pixel value.
+		@param range Gray value range of the histogram.
+		@param dim Count of bins in the histogram.
+		*/
+		template<typename pixel_t> coord_t histogramBin(pixel_t pix, const Vec2d& range, coord_t dim)
+		{
+			double d = (double)dim;
+			double bin = std::floor(((pix - range.x) / (range.y - range.x)) * d);
+
+			// Problem with above expression is that the terms inside floor() may give, e.g. 0.2899999998 for pixel
+			// that should go to bin 290-300. The floor makes it end in bin 280-290.
+			// Check that the pixel really belongs to the bin determined using above expression, and adjust if necessary.
+			// TODO: There is probably some numerically stable algorithm that does not need this check.
+			pixel_t binMin = pixelRound<pixel_t>(range.x + bin / d * (range.y - range.x));
+			pixel_t binMax = pixelRound<pixel_t>(range.x + (bin + 1) / d * (range.y - range.x));
+			bin = pix < binMin ? bin - 1 : (pix >= binMax ? bin + 1 : bin);
+
+			// NOTE: This form places NaNs to the first bin.
+			bin = bin >= 0 ? bin : 0;
+			bin = bin < d - 1 ? bin : d - 1;
+
+			return (coord_t)bin;
+		}
+
+		/**
+		Calculates histogram bins of a row of pixels.
+		This is equal to calling histogramBin for each pixel, but allows the compiler to vectorize the calculation.
+		*/
+		template<typename pixel_t> void histogramBins(const pixel_t* pixels, coord_t count, const Vec2d& range, coord_t dim, coord_t* bins)
+		{
+			for (coord_t n = 0; n < count; n++)
+				bins[n] = histogramBin(pixels[n], range, dim);
+		}
+
+		/**
+		Calculates the region of an image where edge distance (see itl2::edgeDistance) of all pixels is at least edgeSkip.
+		@param start At output, the first pixel of the region.
+		@param end At output, one past the last pixel of the region. If the region is empty, end equals start.
+		*/
+		inline void edgeSkipRegion(const Vec3c& dimensions, coord_t edgeSkip, Vec3c& start, Vec3c& end)
+		{
+			start = Vec3c(0, 0, 0);
+			end = dimensions;
+
+			if (edgeSkip > 0)
+			{
+				// Edge distance is calculated only in the dimensions of the image, but always in x-direction.
+				size_t dimensionality = std::max<size_t>(1, getDimensionality(dimensions));
+				for (size_t n = 0; n < dimensionality; n++)
+				{
+					start[n] = edgeSkip;
+					end[n] = dimensions[n] - edgeSkip;
+				}
+			}
+
+			if (end.x <= start.x || end.y <= start.y || end.z <= start.z)
+				end = start;
+		}
+
+		/**
+		Maps pixel values to histogram bins.
+		For 8- and 16-bit integer pixels the bins of all possible pixel values are stored in a lookup table.
+		*/
+		template<typename pixel_t> class HistogramBinner
+		{
+		public:
+			/**
+			Indicates if the bins are stored in a lookup table.
+			*/
+			static constexpr bool IS_TABULATED = std::is_integral_v<pixel_t> && sizeof(pixel_t) <= 2;
+
+			/**
+			Count of possible pixel values if the bins are stored in a lookup table.
+			*/
+			static constexpr size_t VALUE_COUNT = IS_TABULATED ? (size_t)1 << (8 * sizeof(pixel_t)) : 0;
+
+			/**
+			Converts pixel value to index to the lookup table.
+			*/
+			static size_t valueIndex(pixel_t pix)
+			{
+				return (size_t)((int32_t)pix - (int32_t)std::numeric_limits<pixel_t>::lowest());
+			}
+
+			/**
+			Converts lookup table index to pixel value.
+			*/
+			static pixel_t indexValue(size_t index)
+			{
+				return (pixel_t)((int32_t)index + (int32_t)std::numeric_limits<pixel_t>::lowest());
+			}
+
+			HistogramBinner(const Vec2d& range, coord_t dim) :
+				range(range),
+				dim(dim)
+			{
+				if constexpr (IS_TABULATED)
+				{
+					bins.resize(VALUE_COUNT);
+					for (size_t n = 0; n < VALUE_COUNT; n++)
+						bins[n] = histogramBin(indexValue(n), range, dim);
+				}
+			}
+
+			/**
+			Gets bin of the given pixel value.
+			*/
+			coord_t operator()(pixel_t pix) const
+			{
+				if constexpr (IS_TABULATED)
+					return bins[valueIndex(pix)];
+				else
+					return histogramBin(pix, range, dim);
+			}
+
+		private:
+			Vec2d range;
+			coord_t dim;
+			std::vector<coord_t> bins;
+		};
+	}
+
 	/**
 	Calculates unweighted or weighted histogram of input image.
 	@param img Image whose histogram is calculated.
@@ -46,95 +176,94 @@ namespace itl2
 		using sum_t = typename histogram_intermediate_type<hist_t, weight_t>::type;
 		Image<sum_t> sums(histogram.dimensions());
 
-		#pragma omp parallel if(img.pixelCount() > PARALLELIZATION_THRESHOLD)
+		Vec3c start, end;
+		internals::edgeSkipRegion(img.dimensions(), edgeSkip, start, end);
+
+		if constexpr (internals::HistogramBinner<pixel_t>::IS_TABULATED)
 		{
-			Image<sum_t> privateHist(sums.dimensions());
-			#pragma omp for nowait
-			for (coord_t z = 0; z < img.depth(); z++)
+			// Count each possible pixel value, and distribute the counts to the bins afterwards.
+			using binner_t = internals::HistogramBinner<pixel_t>;
+			std::vector<sum_t> counts(binner_t::VALUE_COUNT, 0);
+
+			#pragma omp parallel if(img.pixelCount() > PARALLELIZATION_THRESHOLD)
 			{
-				for (coord_t y = 0; y < img.height(); y++)
+				std::vector<sum_t> privateCounts(binner_t::VALUE_COUNT, 0);
+				#pragma omp for nowait
+				for (coord_t z = start.z; z < end.z; z++)
 				{
-					for (coord_t x = 0; x < img.width(); x++)
+					for (coord_t y = start.y; y < end.y; y++)
 					{
-						if (img.edgeDistance(Vec3c(x, y, z)) >= edgeSkip)
+						const pixel_t* row = &img(0, y, z);
+						if (!pWeight)
 						{
-							pixel_t pix = img(x, y, z);
-							coord_t bin = itl2::floor(((pix - range.x) / (range.y - range.x)) * (double)dim);
-
-							// Problem with above expression is that the terms inside floor() may give, e.g. 0.2899999998 for pixel
-							// that should go to bin 290-300. The floor makes it end in bin 280-290.
-							// Check that the pixel really belongs to the bin determined using above expression, and adjust if necessary.
-							// TODO: There is probably some numerically stable algorithm that does not need this check.
-							pixel_t binMin = pixelRound<pixel_t>(range.x + (double)bin / (double)dim * (range.y - range.x));
-							pixel_t binMax = pixelRound<pixel_t>(range.x + (double)(bin + 1) / (double)dim * (range.y - range.x));
-							if (pix < binMin)
-								bin--;
-							else if (pix >= binMax)
-								bin++;
-
-							if (bin < 0)
-								bin = 0;
-							else if (bin >= dim)
-								bin = dim - 1;
-
-							if (!pWeight)
-								privateHist(bin)++;
-							else
-								privateHist(bin) += (sum_t)(*pWeight)(x, y, z);
+							for (coord_t x = start.x; x < end.x; x++)
+								privateCounts[binner_t::valueIndex(row[x])]++;
+						}
+						else
+						{
+							const weight_t* weightRow = &(*pWeight)(0, y, z);
+							for (coord_t x = start.x; x < end.x; x++)
+								privateCounts[binner_t::valueIndex(row[x])] += (sum_t)weightRow[x];
 						}
 					}
+
+					showThreadProgress(counter, end.z - start.z, showProgressInfo);
 				}
 
-				showThreadProgress(counter, img.depth(), showProgressInfo);
+				#pragma omp critical(histogram_reduction)
+				{
+					for (size_t n = 0; n < counts.size(); n++)
+						counts[n] += privateCounts[n];
+				}
 			}
 
-			#pragma omp critical(histogram_reduction)
+			for (size_t n = 0; n < counts.size(); n++)
 			{
-				for (coord_t n = 0; n < privateHist.pixelCount(); n++)
+				if (counts[n] != 0)
+					sums(internals::histogramBin(binner_t::indexValue(n), range, dim)) += counts[n];
+			}
+		}
+		else
+		{
+			#pragma omp parallel if(img.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				Image<sum_t> privateHist(sums.dimensions());
+				std::vector<coord_t> bins(end.x - start.x);
+
+				#pragma omp for nowait
+				for (coord_t z = start.z; z < end.z; z++)
 				{
-					sums(n) += privateHist(n);
+					for (coord_t y = start.y; y < end.y; y++)
+					{
+						internals::histogramBins(&img(start.x, y, z), end.x - start.x, range, dim, bins.data());
+
+						if (!pWeight)
+						{
+							for (size_t n = 0; n < bins.size(); n++)
+								privateHist(bins[n])++;
+						}
+						else
+						{
+							const weight_t* weightRow = &(*pWeight)(start.x, y, z);
+							for (size_t n = 0; n < bins.size(); n++)
+								privateHist(bins[n]) += (sum_t)weightRow[n];
+						}
+					}
+
+					showThreadProgress(counter, end.z - start.z, showProgressInfo);
+				}
+
+				#pragma omp critical(histogram_reduction)
+				{
+					for (coord_t n = 0; n < privateHist.pixelCount(); n++)
+					{
+						sums(n) += privateHist(n);
+					}
 				}
 			}
 		}
 
 		setValue(histogram, sums);
-
-		//coord_t dim = histogram.pixelCount();
-		//size_t counter = 0;
-		//for (coord_t z = 0; z < img.depth(); z++)
-		//{
-		//	for (coord_t y = 0; y < img.height(); y++)
-		//	{
-		//		for (coord_t x = 0; x < img.width(); x++)
-		//		{
-		//			if (edgeDistance(Vec3c(x, y, z), img.dimensions()) >= edgeSkip)
-		//			{
-		//				pixel_t pix = img(x, y, z);
-		//				coord_t bin = (coord_t)floor(((pix - range.min) / (range.max - range.min)) * (double)dim);
-
-		//				// Problem with above expression is that the terms inside floor() may give, e.g. 0.2899999998 for pixel
-		//				// that should go to bin 290-300. The floor makes it end in bin 280-290.
-		//				// Check that the pixel really belongs to the bin determined using above expression, and adjust if necessary.
-		//				// TODO: There is probably some numerically stable algorithm that does not need this check.
-		//				pixel_t binMin = pixelRound<pixel_t>(range.min + (double)bin / (double)dim * (range.max - range.min));
-		//				pixel_t binMax = pixelRound<pixel_t>(range.min + (double)(bin + 1) / (double)dim * (range.max - range.min));
-		//				if (pix < binMin)
-		//					bin--;
-		//				else if (pix >= binMax)
-		//					bin++;
-
-		//				if (bin < 0)
-		//					bin = 0;
-		//				else if (bin >= dim)
-		//					bin = dim - 1;
-
-		//				histogram(bin)++;
-		//			}
-		//		}
-		//	}
-
-		//	showThreadProgress(counter, img.depth());
-		//}
 	}
 
 	/**
@@ -173,6 +302,21 @@ namespace itl2
 		{
 			transform<From>(std::forward<T1>(s), t, f, std::make_index_sequence<To - From + 1>());
 		}
+
+		/**
+		Image and bin calculator for multivariate histogram.
+		*/
+		template<typename pixel_t> struct ImageBinner
+		{
+			const Image<pixel_t>& image;
+			HistogramBinner<pixel_t> binner;
+
+			ImageBinner(const ImageAndRange<pixel_t>& img) :
+				image(img.image),
+				binner(img.range, (coord_t)img.binCount)
+			{
+			}
+		};
 	}
 
 
@@ -225,6 +369,9 @@ namespace itl2
 		using sum_t = typename histogram_intermediate_type<hist_t, weight_t>::type;
 		Image<sum_t> sums(histogram.dimensions());
 
+		// Bin calculators for each input image.
+		std::tuple<internals::ImageBinner<pixel_t>...> binners{ internals::ImageBinner<pixel_t>(imgs)... };
+
 		size_t counter = 0;
 		#pragma omp parallel if(minDims.x * minDims.y * minDims.z > PARALLELIZATION_THRESHOLD)
 		{
@@ -238,31 +385,8 @@ namespace itl2
 					{
 						// Calculate bin for each input image
 						std::array<coord_t, N> ndbin;
-						internals::transform<0, N - 1>(t, ndbin, [&](auto i) {
-							auto& img = i.image;
-							Vec2d range = i.range;
-							double dim = (double)i.binCount;
-
-							auto pix = img(x, y, z);
-							coord_t bin = (coord_t)floor((((double)pix - range.x) / (range.y - range.x)) * dim);
-
-							// Problem with above expression is that the terms inside floor() may give, e.g. 0.2899999998 for pixel
-							// that should go to bin 290-300. The floor makes it end in bin 280-290.
-							// Check that the pixel really belongs to the bin determined using above expression, and adjust if necessary.
-							// TODO: There is probably some numerically stable algorithm that does not need this check.
-							auto binMin = pixelRound<decltype(pix)>(range.x + (double)bin / dim * (range.y - range.x));
-							auto binMax = pixelRound<decltype(pix)>(range.x + (double)(bin + 1) / dim * (range.y - range.x));
-							if (pix < binMin)
-								bin--;
-							else if (pix >= binMax)
-								bin++;
-
-							if (bin < 0)
-								bin = 0;
-							else if ((size_t)bin >= i.binCount)
-								bin = i.binCount - 1;
-
-							return bin;
+						internals::transform<0, N - 1>(binners, ndbin, [&](const auto& b) {
+							return b.binner(b.image(x, y, z));
 						});
 
 						Vec3c ndbinv;
@@ -302,6 +426,7 @@ namespace itl2
 		void histogram();
 		void histogram2d();
 		void histogramIntermediateType();
+		void histogramFastPaths();
 	}
 
 }
@@ -118,6 +118,13 @@ namespace itl2
 		*/
 		virtual double getf(coord_t n) const = 0;
 
+		/**
+		Get the values of pixels start, start + 1, ..., start + count - 1 converted to double.
+		Use this instead of getf(coord_t) in loops to avoid virtual function call per pixel.
+		If the pixel type cannot be converted to double (e.g. vector type or complex type), zeroes should be returned.
+		*/
+		virtual void getfRange(coord_t start, coord_t count, double* values) const = 0;
+
 		/**
 		Metadata of this image.
 		*/
@@ -872,6 +879,21 @@ namespace itl2
 				return 0.0;
 			}
 		}
+
+		virtual void getfRange(coord_t start, coord_t count, double* values) const override
+		{
+			if constexpr (std::is_arithmetic_v<pixel_t>)
+			{
+				const pixel_t* p = getData() + start;
+				for (coord_t n = 0; n < count; n++)
+					values[n] = (double)p[n];
+			}
+			else
+			{
+				for (coord_t n = 0; n < count; n++)
+					values[n] = 0.0;
+			}
+		}
 	};
 
 	extern template class Image<uint8_t>;
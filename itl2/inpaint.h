@@ -52,51 +52,64 @@ namespace itl2
 
 	/**
 	Replaces val in the img by nearest non-val value.
+	This version stores temporary data to the given images, so that their memory can be re-used when processing many small images of the same size.
 	@param image Image to process.
 	@param val Value that marks missing pixels.
+	@param distance, nearest Temporary images.
 	*/
-	template<typename pixel_t> void inpaintNearest(Image<pixel_t>& image, pixel_t val = 0)
+	template<typename pixel_t> void inpaintNearest(Image<pixel_t>& image, pixel_t val, Image<float32_t>& distance, Image<Vec3c>& nearest)
 	{
-		bool process = false;
+		coord_t flagCount = 0;
 		for (coord_t n = 0; n < image.pixelCount(); n++)
 		{
 			if (isFlag(image(n), val))
-			{
-				process = true;
-				break;
-			}
+				flagCount++;
 		}
 
-		if (process)
-		{
-
-			Image<float32_t> distance(image.dimensions());
-			Image<Vec3c> coords(image.dimensions());
+		// Nothing to fill, or no values to fill with.
+		if (flagCount <= 0 || flagCount >= image.pixelCount())
+			return;
 
-			for (coord_t n = 0; n < image.pixelCount(); n++)
+		distance.ensureSize(image.dimensions());
+		for (coord_t n = 0; n < image.pixelCount(); n++)
+		{
+			if (isFlag(image(n), val))
 			{
-				if (isFlag(image(n), val))
-				{
-					distance(n) = std::numeric_limits<float32_t>::max();
-				}
-				else
-				{
-					distance(n) = 0;
-				}
+				distance(n) = std::numeric_limits<float32_t>::max();
+			}
+			else
+			{
+				distance(n) = 0;
 			}
+		}
 
-			distanceTransform(distance, &coords);
+		// Only the nearest points are needed, so the square root of the distance map is not calculated.
+		distanceTransform2(distance, &nearest);
 
-			#pragma omp parallel for if(image.pixelCount() > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
-			for (coord_t n = 0; n < image.pixelCount(); n++)
+		#pragma omp parallel for if(image.pixelCount() > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
+		for (coord_t n = 0; n < image.pixelCount(); n++)
+		{
+			if (distance(n) != 0)
 			{
-				Vec3c p = coords(n);
+				Vec3c p = nearest(n);
 				if (image.isInImage(p))
 					image(n) = image(p);
 			}
 		}
 	}
 
+	/**
+	Replaces val in the img by nearest non-val value.
+	@param image Image to process.
+	@param val Value that marks missing pixels.
+	*/
+	template<typename pixel_t> void inpaintNearest(Image<pixel_t>& image, pixel_t val = 0)
+	{
+		Image<float32_t> distance;
+		Image<Vec3c> nearest;
+		inpaintNearest(image, val, distance, nearest);
+	}
+
 	/**
 	Replaces value val in the img by a value interpolated from nearby non-val pixels.
 
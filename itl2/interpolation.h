@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <type_traits>
+#include <vector>
 
 #include "image.h"
 #include "boundarycondition.h"
@@ -8,6 +10,7 @@
 #include "math/vec3.h"
 #include "math/numberutils.h"
 #include "interpolationmode.h"
+#include "progress.h"
 
 namespace itl2
 {
@@ -79,6 +82,17 @@ namespace itl2
 			return operator()(img, x.x, x.y, x.z);
 		}
 
+		/**
+		Interpolates given image at count locations (x[i], y[i], z[i]) and stores the results to out[i].
+		Use this instead of the single location version in loops, as the derived classes implement this without a virtual
+		function call per location.
+		*/
+		virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const
+		{
+			for (size_t n = 0; n < count; n++)
+				out[n] = operator()(img, x[n], y[n], z[n]);
+		}
+
 		/**
 		Returns boundary condition of this interpolator.
 		*/
@@ -88,18 +102,239 @@ namespace itl2
 		}
 	};
 
+	namespace internals
+	{
+		/**
+		Base class for interpolation functors.
+		The derived class implements interpolation at single location in non-virtual member function
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const,
+		and this class implements the virtual functions of Interpolator using it.
+		Calls through the concrete interpolator type are therefore not virtual, and interpolateRow makes only one virtual call per row.
+		*/
+		template<class derived_t, typename output_t, typename input_t, typename real_t> class InterpolatorBase : public Interpolator<output_t, input_t, real_t>
+		{
+		public:
+			InterpolatorBase(BoundaryCondition bc) : Interpolator<output_t, input_t, real_t>(bc)
+			{
+
+			}
+
+			using Interpolator<output_t, input_t, real_t>::operator();
+
+			virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+			{
+				return static_cast<const derived_t*>(this)->interpolate(img, x, y, z);
+			}
+
+			virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const override
+			{
+				const derived_t& derived = *static_cast<const derived_t*>(this);
+				for (size_t n = 0; n < count; n++)
+					out[n] = derived.interpolate(img, x[n], y[n], z[n]);
+			}
+		};
+
+		/**
+		Tests if the batch interpolation kernel interpolateSeparableRow supports the given pixel and intermediate value types.
+		*/
+		template<typename input_t, typename intermediate_t> constexpr bool isBatchInterpolable()
+		{
+			return std::is_arithmetic_v<input_t> && std::is_arithmetic_v<intermediate_t>;
+		}
+
+		/**
+		Count of locations processed together in interpolateSeparableRow.
+		*/
+		constexpr size_t INTERPOLATION_BATCH_SIZE = 64;
+
+		/**
+		Interpolates at most INTERPOLATION_BATCH_SIZE locations using separable interpolation kernel (see interpolateSeparableRow).
+		@param ZTAPS Count of taps in the z-direction that are read from the image. Set to 1 for two-dimensional images, and to TAPS otherwise.
+		*/
+		template<size_t TAPS, size_t ZTAPS, bool INVALID, typename output_t, typename input_t, typename real_t, typename intermediate_t, class weight_t, class single_t>
+		void interpolateSeparableBatch(const Image<input_t>& img, BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue,
+			const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count, weight_t weight, single_t interpolateOne)
+		{
+			constexpr size_t N = INTERPOLATION_BATCH_SIZE;
+
+			// Offset of the first tap from floor of the coordinate.
+			constexpr coord_t FIRST = 1 - (coord_t)TAPS / 2;
+
+			// Linear indices and weights of the taps in each dimension.
+			coord_t ix[TAPS][N], iy[TAPS][N], iz[TAPS][N];
+			real_t wx[TAPS][N], wy[TAPS][N], wz[TAPS][N];
+
+			// Nonzero for locations whose taps are all in the image, or outside of it with zero weight or nearest boundary condition.
+			uint8_t fast[N];
+
+			for (size_t n = 0; n < count; n++)
+				fast[n] = 1;
+
+			auto calcTaps = [&](const real_t* c, coord_t dim, coord_t stride, coord_t (&ind)[TAPS][N], real_t (&w)[TAPS][N])
+				{
+					bool zero = bc == BoundaryCondition::Zero;
+					for (size_t t = 0; t < TAPS; t++)
+					{
+						for (size_t n = 0; n < count; n++)
+						{
+							real_t f = c[n];
+							coord_t u = (coord_t)std::floor(f) + FIRST + (coord_t)t;
+							real_t ww = weight(f - u);
+							bool outside = u < 0 || u >= dim;
+							fast[n] &= (uint8_t)!(outside && zero && ww != 0);
+							ind[t][n] = std::max<coord_t>(0, std::min<coord_t>(u, dim - 1)) * stride;
+							w[t][n] = ww;
+						}
+					}
+				};
+
+			calcTaps(x, img.width(), 1, ix, wx);
+			calcTaps(y, img.height(), img.width(), iy, wy);
+			calcTaps(z, img.depth(), img.width() * img.height(), iz, wz);
+
+			// Count of z-weights accumulated for each z-tap that is read.
+			constexpr size_t ZWEIGHTS = ZTAPS == 1 ? TAPS : 1;
+
+			const input_t* data = img.getData();
+
+			// The taps are clamped to the image, so the loops below do not need any bounds checks.
+			// The innermost loops run over the locations so that the compiler can vectorize them.
+			intermediate_t p[N], q[N], r[N];
+			real_t wTotP[N], wTotQ[N], wTotR[N];
+			for (size_t n = 0; n < count; n++)
+			{
+				r[n] = intermediate_t();
+				wTotR[n] = 0;
+			}
+
+			for (size_t k = 0; k < ZTAPS; k++)
+			{
+				for (size_t n = 0; n < count; n++)
+				{
+					q[n] = intermediate_t();
+					wTotQ[n] = 0;
+				}
+
+				for (size_t j = 0; j < TAPS; j++)
+				{
+					for (size_t n = 0; n < count; n++)
+					{
+						p[n] = intermediate_t();
+						wTotP[n] = 0;
+					}
+
+					for (size_t i = 0; i < TAPS; i++)
+					{
+						for (size_t n = 0; n < count; n++)
+						{
+							input_t pixval = data[iz[k][n] + iy[j][n] + ix[i][n]];
+							if constexpr (INVALID)
+							{
+								real_t ww = pixval != invalidInputValue ? wx[i][n] : 0;
+								p[n] = p[n] + pixval * ww;
+								wTotP[n] += ww;
+							}
+							else
+							{
+								p[n] = p[n] + pixval * wx[i][n];
+							}
+						}
+					}
+
+					for (size_t n = 0; n < count; n++)
+					{
+						if constexpr (INVALID)
+						{
+							bool valid = wTotP[n] > 0;
+							real_t ww = valid ? wy[j][n] : 0;
+							q[n] = q[n] + (valid ? p[n] / wTotP[n] : intermediate_t()) * ww;
+							wTotQ[n] += ww;
+						}
+						else
+						{
+							q[n] = q[n] + p[n] * wy[j][n];
+						}
+					}
+				}
+
+				// If ZTAPS == 1, all the z-taps read the same slice and q is calculated only once, but it is still
+				// accumulated with each z-weight separately so that the result equals that of interpolating one location at a time.
+				for (size_t n = 0; n < count; n++)
+				{
+					for (size_t t = 0; t < ZWEIGHTS; t++)
+					{
+						if constexpr (INVALID)
+						{
+							bool valid = wTotQ[n] > 0;
+							real_t ww = valid ? wz[k + t][n] : 0;
+							r[n] = r[n] + (valid ? q[n] / wTotQ[n] : intermediate_t()) * ww;
+							wTotR[n] += ww;
+						}
+						else
+						{
+							r[n] = r[n] + q[n] * wz[k + t][n];
+						}
+					}
+				}
+			}
+
+			for (size_t n = 0; n < count; n++)
+			{
+				if constexpr (INVALID)
+					out[n] = wTotR[n] > 0 ? pixelRound<output_t>(r[n] / wTotR[n]) : invalidOutputValue;
+				else
+					out[n] = pixelRound<output_t>(r[n]);
+			}
+
+			// Locations near the edges of the image are processed one by one.
+			for (size_t n = 0; n < count; n++)
+			{
+				if (!fast[n])
+					out[n] = interpolateOne(x[n], y[n], z[n]);
+			}
+		}
+
+		/**
+		Interpolates given image at count locations (x[i], y[i], z[i]) using separable interpolation kernel.
+		The locations are processed in batches. For each batch, indices and weights of the taps are calculated first, and then
+		the interpolated values are calculated in a loop without bounds checks, that the compiler can vectorize.
+		Locations whose taps extend outside of the image (with nonzero weight and zero boundary condition) are interpolated
+		with interpolateOne.
+		@param TAPS Count of taps in each dimension. The taps of location x are at floor(x) + 1 - TAPS / 2 + i, i = 0, ..., TAPS - 1.
+		@param INVALID Set to true to exclude pixels whose value is invalidInputValue from the interpolation, see e.g. CubicInvalidValueInterpolator.
+		@param weight Function that returns weight of tap at location u for interpolation location x, given x - u.
+		@param interpolateOne Function that interpolates single location (x, y, z).
+		*/
+		template<size_t TAPS, bool INVALID, typename output_t, typename input_t, typename real_t, typename intermediate_t, class weight_t, class single_t>
+		void interpolateSeparableRow(const Image<input_t>& img, BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue,
+			const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count, weight_t weight, single_t interpolateOne)
+		{
+			for (size_t n = 0; n < count; n += INTERPOLATION_BATCH_SIZE)
+			{
+				size_t m = std::min(INTERPOLATION_BATCH_SIZE, count - n);
+				if (img.depth() == 1)
+					interpolateSeparableBatch<TAPS, 1, INVALID, output_t, input_t, real_t, intermediate_t>(img, bc, invalidInputValue, invalidOutputValue, x + n, y + n, z + n, out + n, m, weight, interpolateOne);
+				else
+					interpolateSeparableBatch<TAPS, TAPS, INVALID, output_t, input_t, real_t, intermediate_t>(img, bc, invalidInputValue, invalidOutputValue, x + n, y + n, z + n, out + n, m, weight, interpolateOne);
+			}
+		}
+	}
+
 	/**
 	Nearest neighbour interpolation functor.
 	*/
-	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType> class NearestNeighbourInterpolator : public Interpolator<output_t, input_t, real_t>
+	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType> class NearestNeighbourInterpolator final : public internals::InterpolatorBase<NearestNeighbourInterpolator<output_t, input_t, real_t>, output_t, input_t, real_t>
 	{
 	public:
-		NearestNeighbourInterpolator(BoundaryCondition bc) : Interpolator<output_t, input_t, real_t>(bc)
+		NearestNeighbourInterpolator(BoundaryCondition bc) : internals::InterpolatorBase<NearestNeighbourInterpolator<output_t, input_t, real_t>, output_t, input_t, real_t>(bc)
 		{
 
 		}
 
-		virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+		/**
+		Interpolates given image at the given location.
+		*/
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const
 		{
 			coord_t ix = (coord_t)::round(x);
 			coord_t iy = (coord_t)::round(y);
@@ -115,7 +350,7 @@ namespace itl2
 	@param real_t Scalar real number type, typically double.
 	@param intermediate_t Type of intermediate values, typically double or Vec3d etc.
 	*/
-	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType > class LinearInterpolator : public Interpolator<output_t, input_t, real_t>
+	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType > class LinearInterpolator final : public internals::InterpolatorBase<LinearInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>
 	{
 	private:
 		inline real_t w_lin(real_t dx) const
@@ -124,12 +359,29 @@ namespace itl2
 		}
 
 	public:
-		LinearInterpolator(BoundaryCondition bc) : Interpolator<output_t, input_t, real_t>(bc)
+		LinearInterpolator(BoundaryCondition bc) : internals::InterpolatorBase<LinearInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>(bc)
 		{
 
 		}
 
-		virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+		virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const override
+		{
+			if constexpr (internals::isBatchInterpolable<input_t, intermediate_t>())
+			{
+				internals::interpolateSeparableRow<2, false, output_t, input_t, real_t, intermediate_t>(img, this->boundaryCondition(), input_t(), output_t(), x, y, z, out, count,
+					[&](real_t dx) { return w_lin(dx); },
+					[&](real_t xx, real_t yy, real_t zz) { return interpolate(img, xx, yy, zz); });
+			}
+			else
+			{
+				internals::InterpolatorBase<LinearInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>::interpolateRow(img, x, y, z, out, count);
+			}
+		}
+
+		/**
+		Interpolates given image at the given location.
+		*/
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const
 		{
 			coord_t u0 = itl2::floor(x);
 			coord_t v0 = itl2::floor(y);
@@ -172,7 +424,7 @@ namespace itl2
 	@param real_t Scalar real number type, typically double.
 	@param intermediate_t Type of intermediate values, typically double or Vec3d etc.
 	*/
-	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class LinearInvalidValueInterpolator : public Interpolator<output_t, input_t, real_t>
+	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class LinearInvalidValueInterpolator final : public internals::InterpolatorBase<LinearInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>
 	{
 	private:
 		inline real_t w_lin(real_t dx) const
@@ -184,12 +436,29 @@ namespace itl2
 		output_t invalidOutputValue;
 
 	public:
-		LinearInvalidValueInterpolator(BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue) : Interpolator<output_t, input_t, real_t>(bc), invalidInputValue(invalidInputValue), invalidOutputValue(invalidOutputValue)
+		LinearInvalidValueInterpolator(BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue) : internals::InterpolatorBase<LinearInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>(bc), invalidInputValue(invalidInputValue), invalidOutputValue(invalidOutputValue)
 		{
 
 		}
 
-		virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+		virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const override
+		{
+			if constexpr (internals::isBatchInterpolable<input_t, intermediate_t>())
+			{
+				internals::interpolateSeparableRow<2, true, output_t, input_t, real_t, intermediate_t>(img, this->boundaryCondition(), invalidInputValue, invalidOutputValue, x, y, z, out, count,
+					[&](real_t dx) { return w_lin(dx); },
+					[&](real_t xx, real_t yy, real_t zz) { return interpolate(img, xx, yy, zz); });
+			}
+			else
+			{
+				internals::InterpolatorBase<LinearInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>::interpolateRow(img, x, y, z, out, count);
+			}
+		}
+
+		/**
+		Interpolates given image at the given location.
+		*/
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const
 		{
 			coord_t u0 = (coord_t)floor(x);
 			coord_t v0 = (coord_t)floor(y);
@@ -253,7 +522,7 @@ namespace itl2
 	https://github.com/imagingbook/imagingbook-common/blob/master/src/main/java/imagingbook/lib/interpolation/BicubicInterpolator.java
 	See http://imagingbook.com
 	*/
-	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class CubicInterpolator : public Interpolator<output_t, input_t, real_t>
+	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class CubicInterpolator final : public internals::InterpolatorBase<CubicInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>
 	{
 	private:
 		real_t a;
@@ -275,12 +544,29 @@ namespace itl2
 		}
 
 	public:
-		CubicInterpolator(BoundaryCondition bc, real_t sharpness = (real_t)0.5) : Interpolator<output_t, input_t, real_t>(bc), a(sharpness)
+		CubicInterpolator(BoundaryCondition bc, real_t sharpness = (real_t)0.5) : internals::InterpolatorBase<CubicInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>(bc), a(sharpness)
 		{
 
 		}
 
-		virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+		virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const override
+		{
+			if constexpr (internals::isBatchInterpolable<input_t, intermediate_t>())
+			{
+				internals::interpolateSeparableRow<4, false, output_t, input_t, real_t, intermediate_t>(img, this->boundaryCondition(), input_t(), output_t(), x, y, z, out, count,
+					[&](real_t dx) { return w_cub(dx); },
+					[&](real_t xx, real_t yy, real_t zz) { return interpolate(img, xx, yy, zz); });
+			}
+			else
+			{
+				internals::InterpolatorBase<CubicInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>::interpolateRow(img, x, y, z, out, count);
+			}
+		}
+
+		/**
+		Interpolates given image at the given location.
+		*/
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const
 		{
 			coord_t u0 = (coord_t)floor(x);
 			coord_t v0 = (coord_t)floor(y);
@@ -322,7 +608,7 @@ namespace itl2
 	https://github.com/imagingbook/imagingbook-common/blob/master/src/main/java/imagingbook/lib/interpolation/BicubicInterpolator.java
 	See http://imagingbook.com
 	*/
-	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class CubicInvalidValueInterpolator : public Interpolator<output_t, input_t, real_t>
+	template<typename output_t, typename input_t, typename real_t = typename NumberUtils<output_t>::RealFloatType, typename intermediate_t = typename NumberUtils<output_t>::FloatType> class CubicInvalidValueInterpolator final : public internals::InterpolatorBase<CubicInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>
 	{
 	private:
 		real_t a;
@@ -347,12 +633,29 @@ namespace itl2
 		output_t invalidOutputValue;
 
 	public:
-		CubicInvalidValueInterpolator(BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue, real_t sharpness = (real_t)0.5) : Interpolator<output_t, input_t, real_t>(bc), a(sharpness), invalidInputValue(invalidInputValue), invalidOutputValue(invalidOutputValue)
+		CubicInvalidValueInterpolator(BoundaryCondition bc, input_t invalidInputValue, output_t invalidOutputValue, real_t sharpness = (real_t)0.5) : internals::InterpolatorBase<CubicInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>(bc), a(sharpness), invalidInputValue(invalidInputValue), invalidOutputValue(invalidOutputValue)
 		{
 
 		}
 
-		virtual output_t operator()(const Image<input_t>& img, real_t x, real_t y, real_t z) const override
+		virtual void interpolateRow(const Image<input_t>& img, const real_t* x, const real_t* y, const real_t* z, output_t* out, size_t count) const override
+		{
+			if constexpr (internals::isBatchInterpolable<input_t, intermediate_t>())
+			{
+				internals::interpolateSeparableRow<4, true, output_t, input_t, real_t, intermediate_t>(img, this->boundaryCondition(), invalidInputValue, invalidOutputValue, x, y, z, out, count,
+					[&](real_t dx) { return w_cub(dx); },
+					[&](real_t xx, real_t yy, real_t zz) { return interpolate(img, xx, yy, zz); });
+			}
+			else
+			{
+				internals::InterpolatorBase<CubicInvalidValueInterpolator<output_t, input_t, real_t, intermediate_t>, output_t, input_t, real_t>::interpolateRow(img, x, y, z, out, count);
+			}
+		}
+
+		/**
+		Interpolates given image at the given location.
+		*/
+		output_t interpolate(const Image<input_t>& img, real_t x, real_t y, real_t z) const
 		{
 			coord_t u0 = (coord_t)floor(x);
 			coord_t v0 = (coord_t)floor(y);
@@ -423,4 +726,41 @@ namespace itl2
 		}
 		throw ITLException("Unsupported interpolation mode.");
 	}
+
+	/**
+	Sets out(x, y, z) = interpolator(img, position(x, y, z)) for all pixels (x, y, z) of the output image.
+	The positions are calculated and interpolated one output image row at a time, so the interpolator is called only once per row.
+	@param img Image that is interpolated.
+	@param out Output image.
+	@param interpolator Interpolator that is used.
+	@param position Function Vec3<real_t> position(coord_t x, coord_t y, coord_t z) that returns the location in img corresponding to output pixel (x, y, z).
+	@param showProgressIndicator Set to true to show a progress bar.
+	*/
+	template<typename output_t, typename input_t, typename real_t, typename F> void resample(const Image<input_t>& img, Image<output_t>& out, const Interpolator<output_t, input_t, real_t>& interpolator, F&& position, bool showProgressIndicator = false)
+	{
+		coord_t rowCount = out.height() * out.depth();
+		ProgressIndicator progress(rowCount, showProgressIndicator);
+		#pragma omp parallel if(out.pixelCount() > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
+		{
+			std::vector<real_t> xs(out.width()), ys(out.width()), zs(out.width());
+
+			#pragma omp for
+			for (coord_t row = 0; row < rowCount; row++)
+			{
+				coord_t y = row % out.height();
+				coord_t z = row / out.height();
+				for (coord_t x = 0; x < out.width(); x++)
+				{
+					Vec3<real_t> p = position(x, y, z);
+					xs[x] = p.x;
+					ys[x] = p.y;
+					zs[x] = p.z;
+				}
+
+				interpolator.interpolateRow(img, xs.data(), ys.data(), zs.data(), &out(0, y, z), out.width());
+
+				progress.step();
+			}
+		}
+	}
 }
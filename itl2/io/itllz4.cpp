@@ -10,23 +10,349 @@ namespace itl2
 	{
 		namespace internals
 		{
-			bool getInfo(std::ifstream& in, Vec3c& dimensions, ImageDataType& dataType, string& reason)
+			bool getInfo(std::ifstream& in, LZ4Header& header, string& reason)
 			{
 				coord_t w = internals::readSafe<coord_t>(in);
+				bool isSlabFormat = w == LZ4_SLAB_FORMAT_MARKER;
+				if (isSlabFormat)
+					w = internals::readSafe<coord_t>(in);
 				coord_t h = internals::readSafe<coord_t>(in);
 				coord_t d = internals::readSafe<coord_t>(in);
-				dimensions = Vec3c(w, h, d);
+				header.dimensions = Vec3c(w, h, d);
 
-				if (w <= 0 || h <= 0 || d <= 0)
+				if (!in || w <= 0 || h <= 0 || d <= 0)
 				{
 					reason = "Invalid image dimensions.";
 					return false;
 				}
 
-				dataType = (ImageDataType)internals::readSafe<int32_t>(in);
+				header.dataType = (ImageDataType)internals::readSafe<int32_t>(in);
+
+				header.slabDepth = 0;
+				header.slabOffsets.clear();
+				if (isSlabFormat)
+				{
+					header.slabDepth = internals::readSafe<coord_t>(in);
+					coord_t slabCount = internals::readSafe<coord_t>(in);
+
+					if (!in || header.slabDepth <= 0 || slabCount != (d + header.slabDepth - 1) / header.slabDepth)
+					{
+						reason = "Invalid LZ4 slab index.";
+						return false;
+					}
+
+					header.slabOffsets.resize(slabCount + 1);
+					for (coord_t n = 0; n <= slabCount; n++)
+						header.slabOffsets[n] = internals::readSafe<uint64_t>(in);
+
+					if (!in)
+					{
+						reason = "Invalid LZ4 slab index.";
+						return false;
+					}
+				}
+
+				return true;
+			}
+
+			bool getInfo(std::ifstream& in, Vec3c& dimensions, ImageDataType& dataType, string& reason)
+			{
+				LZ4Header header;
+				if (!getInfo(in, header, reason))
+					return false;
+
+				dimensions = header.dimensions;
+				dataType = header.dataType;
 				return true;
 			}
 
+			/**
+			Decompresses single LZ4 frame from memory buffer src to memory buffer dst.
+			Dst buffer size must equal the uncompressed size of the frame.
+			*/
+			void decompressFrame(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize, const string& filenameForErrorMessages)
+			{
+				LZ4F_dctx* dctx;
+				size_t err = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+				if (LZ4F_isError(err))
+					throw ITLException(string("Unable to create LZ4 decompression context: ") + LZ4F_getErrorName(err));
+				std::unique_ptr<LZ4F_dctx, decltype(LZ4F_freeDecompressionContext)*> pDctx(dctx, LZ4F_freeDecompressionContext);
+
+				size_t srcPos = 0;
+				size_t dstPos = 0;
+				size_t ret = 1;
+				while (srcPos < srcSize && ret != 0)
+				{
+					size_t dstAvailable = dstSize - dstPos;
+					size_t srcAvailable = srcSize - srcPos;
+					ret = LZ4F_decompress(dctx, dst + dstPos, &dstAvailable, src + srcPos, &srcAvailable, NULL);
+					if (LZ4F_isError(ret))
+						throw ITLException(string("LZ4 decompression error while reading ") + filenameForErrorMessages + string("; ") + LZ4F_getErrorName(ret));
+
+					dstPos += dstAvailable;
+					srcPos += srcAvailable;
+				}
+
+				if (ret != 0 || dstPos != dstSize)
+					throw ITLException(string("The LZ4 file did not contain enough data to fill the entire image: ") + filenameForErrorMessages);
+			}
+
+			void writeSlabs(const uint8_t* data, const Vec3c& dataDimensions, size_t pixelSize, ImageDataType dataType, const Vec3c& imagePosition, const Vec3c& blockDimensions, const std::string& filename)
+			{
+				createFoldersFor(filename);
+
+				std::ofstream out(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+				if (!out)
+					throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
+
+				size_t sliceBytes = blockDimensions.x * blockDimensions.y * pixelSize;
+				coord_t slabDepth = std::max<coord_t>(1, (coord_t)(LZ4_SLAB_SIZE / std::max<size_t>(1, sliceBytes)));
+				slabDepth = std::min(slabDepth, std::max<coord_t>(1, blockDimensions.z));
+				coord_t slabCount = (blockDimensions.z + slabDepth - 1) / slabDepth;
+
+				internals::writeSafe(out, LZ4_SLAB_FORMAT_MARKER);
+				internals::writeSafe(out, blockDimensions.x);
+				internals::writeSafe(out, blockDimensions.y);
+				internals::writeSafe(out, blockDimensions.z);
+				internals::writeSafe(out, (int32_t)dataType);
+				internals::writeSafe(out, slabDepth);
+				internals::writeSafe(out, slabCount);
+
+				// Reserve space for the slab index. It is filled in when the slab sizes are known.
+				std::streampos indexPos = out.tellp();
+				std::vector<uint64_t> offsets(slabCount + 1, 0);
+				for (coord_t n = 0; n <= slabCount; n++)
+					internals::writeSafe(out, offsets[n]);
+				offsets[0] = (uint64_t)out.tellp();
+
+				// The block is contiguous in memory if it spans entire xy-planes of the image.
+				bool isContiguous = blockDimensions.x == dataDimensions.x && blockDimensions.y == dataDimensions.y;
+
+				// Compress slabs in batches of one slab per thread, and write each batch in order.
+				coord_t batchSize = omp_in_parallel() ? 1 : omp_get_max_threads();
+				std::vector<std::vector<uint8_t> > compressed(batchSize);
+				string error;
+				for (coord_t batchStart = 0; batchStart < slabCount; batchStart += batchSize)
+				{
+					coord_t batchEnd = std::min(slabCount, batchStart + batchSize);
+
+					#pragma omp parallel if(!omp_in_parallel() && batchEnd - batchStart > 1)
+					{
+						std::vector<uint8_t> slabBuffer;
+
+						#pragma omp for schedule(dynamic)
+						for (coord_t slab = batchStart; slab < batchEnd; slab++)
+						{
+							coord_t z0 = slab * slabDepth;
+							coord_t currentDepth = std::min(slabDepth, blockDimensions.z - z0);
+							size_t slabBytes = sliceBytes * currentDepth;
+
+							const uint8_t* src;
+							if (isContiguous)
+							{
+								src = data + (imagePosition.z + z0) * sliceBytes;
+							}
+							else
+							{
+								slabBuffer.resize(slabBytes);
+								size_t rowBytes = blockDimensions.x * pixelSize;
+								uint8_t* p = slabBuffer.data();
+								for (coord_t z = 0; z < currentDepth; z++)
+								{
+									for (coord_t y = 0; y < blockDimensions.y; y++)
+									{
+										size_t index = imagePosition.x + (imagePosition.y + y) * dataDimensions.x + (imagePosition.z + z0 + z) * dataDimensions.x * dataDimensions.y;
+										memcpy(p, data + index * pixelSize, rowBytes);
+										p += rowBytes;
+									}
+								}
+								src = slabBuffer.data();
+							}
+
+							std::vector<uint8_t>& dst = compressed[slab - batchStart];
+							dst.resize(LZ4F_compressFrameBound(slabBytes, &lz4Prefs));
+							size_t compressedSize = LZ4F_compressFrame(dst.data(), dst.size(), src, slabBytes, &lz4Prefs);
+							if (LZ4F_isError(compressedSize))
+							{
+								#pragma omp critical(lz4_write_error)
+								error = string("Unable to perform LZ4 compression: ") + LZ4F_getErrorName(compressedSize);
+								compressedSize = 0;
+							}
+							dst.resize(compressedSize);
+						}
+					}
+
+					if (error.length() > 0)
+						throw ITLException(error);
+
+					for (coord_t slab = batchStart; slab < batchEnd; slab++)
+					{
+						const std::vector<uint8_t>& buffer = compressed[slab - batchStart];
+						out.write((const char*)buffer.data(), buffer.size());
+						offsets[slab + 1] = offsets[slab] + buffer.size();
+					}
+				}
+
+				out.seekp(indexPos);
+				for (coord_t n = 0; n <= slabCount; n++)
+					internals::writeSafe(out, offsets[n]);
+
+				if (!out)
+					throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
+			}
+
+			void writeFrame(const uint8_t* data, const Vec3c& dataDimensions, size_t pixelSize, ImageDataType dataType, const Vec3c& imagePosition, const Vec3c& blockDimensions, const std::string& filename)
+			{
+				createFoldersFor(filename);
+
+				std::ofstream out(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+
+				if (!out)
+					throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
+
+				internals::writeSafe(out, blockDimensions.x);
+				internals::writeSafe(out, blockDimensions.y);
+				internals::writeSafe(out, blockDimensions.z);
+				internals::writeSafe(out, (int32_t)dataType);
+
+				LZ4F_cctx* ctx;
+				LZ4F_errorCode_t err = LZ4F_createCompressionContext(&ctx, LZ4F_VERSION);
+				if (LZ4F_isError(err))
+					throw ITLException(string("Unable to create LZ4 compression context: ") + LZ4F_getErrorName(err));
+				std::unique_ptr<LZ4F_cctx, decltype(LZ4F_freeCompressionContext)*> pCtx(ctx, LZ4F_freeCompressionContext);
+
+				size_t rowBytes = blockDimensions.x * pixelSize;
+				size_t outputCapacity = LZ4F_compressBound(std::max(LZ4_CHUNK_SIZE, rowBytes), &lz4Prefs);
+				std::unique_ptr<uint8_t[]> pDest = std::make_unique<uint8_t[]>(outputCapacity);
+
+				// Frame header
+				{
+					size_t headerSize = LZ4F_compressBegin(ctx, pDest.get(), outputCapacity, &lz4Prefs);
+					if (LZ4F_isError(headerSize))
+						throw ITLException(string("Unable to init LZ4 compression: ") + LZ4F_getErrorName(headerSize));
+
+					out.write((char*)pDest.get(), headerSize);
+				}
+
+				// Compress data one x-directional scan line at time.
+				for (coord_t z = imagePosition.z; z < imagePosition.z + blockDimensions.z; z++)
+				{
+					for (coord_t y = imagePosition.y; y < imagePosition.y + blockDimensions.y; y++)
+					{
+						size_t index = imagePosition.x + y * dataDimensions.x + z * dataDimensions.x * dataDimensions.y;
+
+						size_t compressedSize = LZ4F_compressUpdate(ctx,
+							pDest.get(), outputCapacity,
+							data + index * pixelSize, rowBytes,
+							NULL);
+						if (LZ4F_isError(compressedSize))
+							throw ITLException(string("Unable to perform LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
+
+						out.write((char*)pDest.get(), compressedSize);
+					}
+				}
+
+				// Finalize compression
+				{
+					size_t const compressedSize = LZ4F_compressEnd(ctx, pDest.get(), outputCapacity, NULL);
+					if (LZ4F_isError(compressedSize))
+						throw ITLException(string("Unable to finalize LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
+
+					out.write((char*)pDest.get(), compressedSize);
+				}
+
+				if (!out)
+					throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
+			}
+
+			void readSlabs(const std::string& filename, const LZ4Header& header, size_t pixelSize, const Vec3c& blockStart, const Vec3c& blockDimensions, uint8_t* dst)
+			{
+				const Vec3c& dims = header.dimensions;
+
+				AABoxc blockBox = AABoxc::fromPosSize(blockStart, blockDimensions);
+				AABoxc readBox = blockBox.intersection(AABoxc::fromPosSize(Vec3c(0, 0, 0), dims));
+
+				if (readBox.minc != blockBox.minc || readBox.maxc != blockBox.maxc)
+					memset(dst, 0, blockDimensions.x * blockDimensions.y * blockDimensions.z * pixelSize);
+
+				if (readBox.maxc.x <= readBox.minc.x || readBox.maxc.y <= readBox.minc.y || readBox.maxc.z <= readBox.minc.z)
+					return;
+
+				coord_t firstSlab = readBox.minc.z / header.slabDepth;
+				coord_t lastSlab = (readBox.maxc.z - 1) / header.slabDepth;
+
+				// If the block spans entire xy-planes of the file, slabs that are inside the block can be decompressed directly to the output.
+				bool isFullPlanes = blockStart.x == 0 && blockStart.y == 0 && blockDimensions.x == dims.x && blockDimensions.y == dims.y;
+
+				size_t sliceBytes = dims.x * dims.y * pixelSize;
+
+				string error;
+				#pragma omp parallel if(!omp_in_parallel() && lastSlab > firstSlab)
+				{
+					std::ifstream in(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+					std::vector<uint8_t> compressed;
+					std::vector<uint8_t> slabBuffer;
+
+					#pragma omp for schedule(dynamic)
+					for (coord_t slab = firstSlab; slab <= lastSlab; slab++)
+					{
+						try
+						{
+							if (!in)
+								throw ITLException(std::string("Unable to open ") + filename + std::string(", ") + getStreamErrorMessage());
+
+							uint64_t start = header.slabOffsets[slab];
+							uint64_t end = header.slabOffsets[slab + 1];
+							if (end < start)
+								throw ITLException(string("Invalid LZ4 slab index in file ") + filename);
+
+							compressed.resize(end - start);
+							in.seekg(start);
+							in.read((char*)compressed.data(), compressed.size());
+							if (!in)
+								throw ITLException(string("Unable to read LZ4 compressed data from file ") + filename);
+
+							coord_t z0 = slab * header.slabDepth;
+							coord_t currentDepth = std::min(header.slabDepth, dims.z - z0);
+							size_t slabBytes = sliceBytes * currentDepth;
+
+							if (isFullPlanes && z0 >= blockStart.z && z0 + currentDepth <= blockStart.z + blockDimensions.z)
+							{
+								decompressFrame(compressed.data(), compressed.size(), dst + (z0 - blockStart.z) * sliceBytes, slabBytes, filename);
+							}
+							else
+							{
+								slabBuffer.resize(slabBytes);
+								decompressFrame(compressed.data(), compressed.size(), slabBuffer.data(), slabBytes, filename);
+
+								// Copy the part of the slab that is inside the block.
+								coord_t zStart = std::max(z0, readBox.minc.z);
+								coord_t zEnd = std::min(z0 + currentDepth, readBox.maxc.z);
+								size_t rowBytes = (readBox.maxc.x - readBox.minc.x) * pixelSize;
+								for (coord_t z = zStart; z < zEnd; z++)
+								{
+									for (coord_t y = readBox.minc.y; y < readBox.maxc.y; y++)
+									{
+										size_t srcIndex = readBox.minc.x + y * dims.x + (z - z0) * dims.x * dims.y;
+										size_t dstIndex = (readBox.minc.x - blockStart.x) + (y - blockStart.y) * blockDimensions.x + (z - blockStart.z) * blockDimensions.x * blockDimensions.y;
+										memcpy(dst + dstIndex * pixelSize, slabBuffer.data() + srcIndex * pixelSize, rowBytes);
+									}
+								}
+							}
+						}
+						catch (const ITLException& e)
+						{
+							#pragma omp critical(lz4_read_error)
+							error = e.message();
+						}
+					}
+				}
+
+				if (error.length() > 0)
+					throw ITLException(error);
+			}
+
 			void decompress(std::ifstream& in, uint8_t* dst, size_t dstSizeBytes, const string& filenameForErrorMessages)
 			{
 				std::unique_ptr<uint8_t[]> pSrc = std::make_unique<uint8_t[]>(internals::LZ4_CHUNK_SIZE);
@@ -226,6 +552,70 @@ namespace itl2
 
 				testAssert(equals(img, multiBlockResult), "LZ4 file written in multiple blocks compared to the original.");
 			}
+
+			void lz4slabIo()
+			{
+				Image<uint16_t> img(100, 200, 300);
+				ramp3(img);
+
+				lz4::write(img, "./lz4slab/image.lz4raw");
+				lz4::write(img, "./lz4slab/legacy.lz4raw", LZ4Format::SingleFrame);
+
+				std::ifstream in("./lz4slab/image.lz4raw", std::ios_base::in | std::ios_base::binary);
+				internals::LZ4Header header;
+				std::string reason;
+				testAssert(internals::getInfo(in, header, reason), "read slab header");
+				in.close();
+				testAssert(header.dimensions == img.dimensions(), "slab file dimensions");
+				testAssert(header.slabDepth > 0 && header.slabOffsets.size() > 3, "slab file contains multiple slabs");
+
+				in.open("./lz4slab/legacy.lz4raw", std::ios_base::in | std::ios_base::binary);
+				testAssert(internals::getInfo(in, header, reason), "read single-frame header");
+				in.close();
+				testAssert(header.dimensions == img.dimensions(), "single-frame file dimensions");
+				testAssert(header.slabDepth == 0, "single-frame file is in the legacy format");
+
+				for (string filename : { "./lz4slab/image.lz4raw", "./lz4slab/legacy.lz4raw" })
+				{
+					Image<uint16_t> fromDisk;
+					lz4::read(fromDisk, filename);
+					testAssert(equals(img, fromDisk), "entire image from " + filename);
+
+					// Blocks inside the image, spanning entire xy-planes, and extending outside of the image.
+					std::vector<std::tuple<Vec3c, Vec3c> > blocks =
+					{
+						{ Vec3c(10, 20, 30), Vec3c(50, 60, 70) },
+						{ Vec3c(0, 0, 0), Vec3c(100, 200, 1) },
+						{ Vec3c(0, 0, 7), Vec3c(100, 200, 150) },
+						{ Vec3c(0, 0, 299), Vec3c(100, 200, 1) },
+						{ Vec3c(90, 190, 290), Vec3c(20, 20, 20) },
+					};
+
+					for (const auto& block : blocks)
+					{
+						Vec3c blockStart = std::get<0>(block);
+						Vec3c blockSize = std::get<1>(block);
+
+						Image<uint16_t> gtBlock(blockSize);
+						crop(img, gtBlock, blockStart);
+
+						Image<uint16_t> fileBlock(blockSize);
+						setValue(fileBlock, 1);
+						lz4::readBlock(fileBlock, filename, blockStart);
+						testAssert(equals(fileBlock, gtBlock), "readBlock " + toString(blockStart) + ", " + toString(blockSize) + " from " + filename);
+					}
+				}
+
+				// Write block of an image that does not span entire xy-planes.
+				Vec3c blockStart(10, 20, 30);
+				Vec3c blockSize(50, 60, 70);
+				lz4::writeBlock(img, "./lz4slab/block.lz4raw", Vec3c(0, 0, 0), Vec3c(0, 0, 0), blockStart, blockSize);
+				Image<uint16_t> gtBlock(blockSize);
+				crop(img, gtBlock, blockStart);
+				Image<uint16_t> fileBlock;
+				lz4::read(fileBlock, "./lz4slab/block.lz4raw");
+				testAssert(equals(fileBlock, gtBlock), "slab writeBlock");
+			}
 		}
 	}
 }
@@ -54,11 +54,77 @@ namespace itl2
 				{ 0, 0, 0 },  // reserved, must be set to 0
 			};
 
+			/**
+			Value stored in place of image width at the beginning of .lz4raw files that contain independently compressed z-slabs.
+			Legacy .lz4raw files begin with (positive) image width and contain a single LZ4 frame.
+			*/
+			static const coord_t LZ4_SLAB_FORMAT_MARKER = -2;
+
+			/**
+			Approximate uncompressed size of one z-slab in bytes.
+			Slabs consist of whole xy-slices, so if one slice is larger than this, each slab will contain one slice.
+			*/
+			static const size_t LZ4_SLAB_SIZE = 1024 * 1024;
+
+			/**
+			Header of .lz4raw file.
+			*/
+			struct LZ4Header
+			{
+				Vec3c dimensions;
+				ImageDataType dataType = ImageDataType::Unknown;
+
+				/**
+				Count of z-slices in each slab, or zero for legacy single-frame files.
+				*/
+				coord_t slabDepth = 0;
+
+				/**
+				File position of the start of each slab, and the end of the last slab. Empty for legacy files.
+				*/
+				std::vector<uint64_t> slabOffsets;
+			};
+
+			/**
+			Get LZ4Raw header from file stream.
+			At output, the stream is positioned after the header.
+			*/
+			bool getInfo(std::ifstream& in, LZ4Header& header, string& reason);
+
 			/**
 			Get LZ4Raw info from file stream.
 			*/
 			bool getInfo(std::ifstream& in, Vec3c& dimensions, ImageDataType& dataType, string& reason);
 
+			/**
+			Writes block of an image to .lz4raw file such that the block is divided into z-slabs that are compressed in parallel.
+			@param data Pointer to the image data.
+			@param dataDimensions Dimensions of the image.
+			@param pixelSize Size of one pixel in bytes.
+			@param dataType Data type of the image.
+			@param imagePosition Position of the block in the image.
+			@param blockDimensions Size of the block.
+			*/
+			void writeSlabs(const uint8_t* data, const Vec3c& dataDimensions, size_t pixelSize, ImageDataType dataType, const Vec3c& imagePosition, const Vec3c& blockDimensions, const std::string& filename);
+
+			/**
+			Writes block of an image to .lz4raw file in the legacy format, where the whole block is a single LZ4 frame.
+			Parameters are the same than in writeSlabs.
+			*/
+			void writeFrame(const uint8_t* data, const Vec3c& dataDimensions, size_t pixelSize, ImageDataType dataType, const Vec3c& imagePosition, const Vec3c& blockDimensions, const std::string& filename);
+
+			/**
+			Reads a block of z-slab .lz4raw file into given buffer.
+			Only the slabs that intersect the block are decompressed, in parallel.
+			Pixels of the block that are outside of the file are set to zero.
+			@param header Header of the file.
+			@param pixelSize Size of one pixel in bytes.
+			@param blockStart Position of the block in the file.
+			@param blockDimensions Size of the block.
+			@param dst Buffer for the block, of size blockDimensions.x * blockDimensions.y * blockDimensions.z * pixelSize bytes.
+			*/
+			void readSlabs(const std::string& filename, const LZ4Header& header, size_t pixelSize, const Vec3c& blockStart, const Vec3c& blockDimensions, uint8_t* dst);
+
 			/**
 			Decompress LZ4 compressed bytes from given stream to the dst buffer.
 			Dst buffer size is dstSizeBytes.
@@ -66,6 +132,13 @@ namespace itl2
 			*/
 			void decompress(std::ifstream& in, uint8_t* dst, size_t dstSizeBytes, const string& filenameForErrorMessages);
 
+			/**
+			Decompresses single LZ4 frame from memory buffer src to memory buffer dst.
+			Dst buffer size must equal the uncompressed size of the frame.
+			File name is used only for error messages.
+			*/
+			void decompressFrame(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize, const string& filenameForErrorMessages);
+
 		}
 
 		/**
@@ -92,40 +165,59 @@ namespace itl2
 			if (!in)
 				throw ITLException(std::string("Unable to open ") + filename + std::string(", ") + getStreamErrorMessage());
 
-			Vec3c dimensions;
-			ImageDataType fileDT;
+			internals::LZ4Header header;
 			std::string reason;
-			if (!internals::getInfo(in, dimensions, fileDT, reason))
+			if (!internals::getInfo(in, header, reason))
 				throw ITLException(reason);
 
-			if (fileDT != target.dataType())
-				throw ITLException(std::string("Image data type is ") + toString(target.dataType()) + std::string(" but the file contains data of type ") + toString(fileDT));
+			if (header.dataType != target.dataType())
+				throw ITLException(std::string("Image data type is ") + toString(target.dataType()) + std::string(" but the file contains data of type ") + toString(header.dataType));
 
 			if (!in)
 				throw ITLException(std::string("Unable to read from ") + filename);
 
-			target.ensureSize(dimensions);
+			target.ensureSize(header.dimensions);
 
-			internals::decompress(in, (uint8_t*)target.getData(), target.pixelCount() * target.pixelSize(), filename);
+			if (header.slabDepth > 0)
+				internals::readSlabs(filename, header, target.pixelSize(), Vec3c(0, 0, 0), header.dimensions, (uint8_t*)target.getData());
+			else
+				internals::decompress(in, (uint8_t*)target.getData(), target.pixelCount() * target.pixelSize(), filename);
 		}
 
 		
 
 		/**
 		Reads a part of a .lz4raw file to the given image.
+		If the file consists of z-slabs, only the slabs that intersect the block are decompressed.
+		Legacy single-frame files must be decompressed entirely.
 		NOTE: Does not support out of bounds start position.
 		@param img Image where the data is placed. The size of the image defines the size of the block that is read.
 		@param filename The name of the file to read.
 		@param filePos Start location of the read. The size of the image defines the size of the block that is read.
-		@param temp Temporary image. If this image has the same dimensions than the file, no temporary memory allocations for image data are made. At output, this image will contain the entire decompressed file.
+		@param temp Temporary image used for legacy files. If this image has the same dimensions than the file, no temporary memory allocations for image data are made. At output, this image will contain the entire decompressed file.
 		*/
 		template<typename pixel_t> void readBlock(Image<pixel_t>& img, std::string filename, const Vec3c& filePos, Image<pixel_t>& temp)
 		{
-			Vec3c fileDimensions;
-			ImageDataType fileDT;
+			std::ifstream in(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+			if (!in)
+				throw ITLException(std::string("Unable to open ") + filename + std::string(", ") + getStreamErrorMessage());
+
+			internals::LZ4Header header;
 			std::string reason;
-			if (!getInfo(filename, fileDimensions, fileDT, reason))
+			if (!internals::getInfo(in, header, reason))
 				throw ITLException(reason);
+			in.close();
+
+			Vec3c fileDimensions = header.dimensions;
+
+			if (header.slabDepth > 0)
+			{
+				if (header.dataType != img.dataType())
+					throw ITLException(std::string("Image data type is ") + toString(img.dataType()) + std::string(" but the file contains data of type ") + toString(header.dataType));
+
+				internals::readSlabs(filename, header, img.pixelSize(), filePos, img.dimensions(), (uint8_t*)img.getData());
+				return;
+			}
 
 			if (filePos == Vec3c(0, 0, 0) && img.dimensions() == fileDimensions)
 			{
@@ -153,146 +245,46 @@ namespace itl2
 		}
 
 		/**
-		Writes an image to an .lz4raw file.
-		@param img Image to write.
-		@param filename Name of file to write.
+		Layout of compressed data in .lz4raw files.
 		*/
-		template<typename pixel_t> void write(const Image<pixel_t>& source, const std::string& filename)
+		enum class LZ4Format
 		{
-			createFoldersFor(filename);
-
-			std::ofstream out(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
-
-			if (!out)
-				throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
-
-			
-			internals::writeSafe(out, source.width());
-			internals::writeSafe(out, source.height());
-			internals::writeSafe(out, source.depth());
-			internals::writeSafe(out, (int32_t)source.dataType());
-
-			LZ4F_cctx* ctx;
-			LZ4F_errorCode_t err = LZ4F_createCompressionContext(&ctx, LZ4F_VERSION);
-			if (LZ4F_isError(err))
-				throw ITLException(string("Unable to create LZ4 compression context: ") + LZ4F_getErrorName(err));
-			std::unique_ptr<LZ4F_cctx, decltype(LZ4F_freeCompressionContext)*> pCtx(ctx, LZ4F_freeCompressionContext);
-			
-			size_t outputCapacity = LZ4F_compressBound(internals::LZ4_CHUNK_SIZE, &internals::lz4Prefs);
-			std::unique_ptr<uint8_t[]> pDest = std::make_unique<uint8_t[]>(outputCapacity);
-
-			// Frame header
-			{
-				size_t headerSize = LZ4F_compressBegin(ctx, pDest.get(), outputCapacity, &internals::lz4Prefs);
-				if (LZ4F_isError(headerSize))
-					throw ITLException(string("Unable to init LZ4 compression: ") + LZ4F_getErrorName(headerSize));
-
-				out.write((char*)pDest.get(), headerSize);
-			}
-
-			// Compress data
-			size_t pos = 0;
-			size_t imgBytes = source.pixelCount() * source.pixelSize();
-			while(pos < imgBytes)
-			{
-				size_t readSize = internals::LZ4_CHUNK_SIZE;
-				if (pos + readSize > imgBytes)
-					readSize = imgBytes - pos;
-				uint8_t* sourceAddr = (uint8_t*)source.getData() + pos;
-				pos += readSize;
-
-				size_t compressedSize = LZ4F_compressUpdate(ctx,
-					pDest.get(), outputCapacity,
-					sourceAddr, readSize,
-					NULL);
-				if (LZ4F_isError(compressedSize))
-					throw ITLException(string("Unable to perform LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
-				
-				out.write((char*)pDest.get(), compressedSize);
-			}
-
-			// Finalize compression
-			{   
-				size_t const compressedSize = LZ4F_compressEnd(ctx, pDest.get(), outputCapacity, NULL);
-				if (LZ4F_isError(compressedSize))
-					throw ITLException(string("Unable to finalize LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
-
-				out.write((char*)pDest.get(), compressedSize);
-			}
-
-		}
-
+			/**
+			The image is divided into independently compressed z-slabs that can be compressed and decompressed in parallel.
+			*/
+			Slabs,
+			/**
+			The whole image is a single LZ4 frame. This is the legacy format, used e.g. for NN5 chunks.
+			*/
+			SingleFrame
+		};
 
 		namespace internals
 		{
 			template<typename pixel_t> void writeBlockToFullFile(const Image<pixel_t>& img, const std::string& filename,
 				const Vec3c& imagePosition,
-				const Vec3c& blockDimensions)
+				const Vec3c& blockDimensions,
+				LZ4Format format)
 			{
-				createFoldersFor(filename);
-
-				std::ofstream out(filename, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
-
-				if (!out)
-					throw ITLException(std::string("Unable to write to ") + filename + std::string(", ") + getStreamErrorMessage());
-
-				internals::writeSafe(out, blockDimensions.x);
-				internals::writeSafe(out, blockDimensions.y);
-				internals::writeSafe(out, blockDimensions.z);
-				internals::writeSafe(out, (int32_t)img.dataType());
-
-				LZ4F_cctx* ctx;
-				LZ4F_errorCode_t err = LZ4F_createCompressionContext(&ctx, LZ4F_VERSION);
-				if (LZ4F_isError(err))
-					throw ITLException(string("Unable to create LZ4 compression context: ") + LZ4F_getErrorName(err));
-				std::unique_ptr<LZ4F_cctx, decltype(LZ4F_freeCompressionContext)*> pCtx(ctx, LZ4F_freeCompressionContext);
-
-				size_t lzChunkSize = internals::LZ4_CHUNK_SIZE;
-				if (lzChunkSize < (size_t)blockDimensions.x)
-					lzChunkSize = (size_t)blockDimensions.x;
-
-				size_t outputCapacity = LZ4F_compressBound(lzChunkSize, &internals::lz4Prefs);
-				std::unique_ptr<uint8_t[]> pDest = std::make_unique<uint8_t[]>(outputCapacity);
-
-				// Frame header
-				{
-					size_t headerSize = LZ4F_compressBegin(ctx, pDest.get(), outputCapacity, &internals::lz4Prefs);
-					if (LZ4F_isError(headerSize))
-						throw ITLException(string("Unable to init LZ4 compression: ") + LZ4F_getErrorName(headerSize));
-
-					out.write((char*)pDest.get(), headerSize);
-				}
-
-				// Compress data one x-directional scan line at time.
-				for (coord_t z = imagePosition.z; z < imagePosition.z + blockDimensions.z; z++)
-				{
-					for (coord_t y = imagePosition.y; y < imagePosition.y + blockDimensions.y; y++)
-					{
-						size_t readSize = blockDimensions.x * img.pixelSize();
-						uint8_t* sourceAddr = (uint8_t*)&img(imagePosition.x, y, z);
-
-						size_t compressedSize = LZ4F_compressUpdate(ctx,
-							pDest.get(), outputCapacity,
-							sourceAddr, readSize,
-							NULL);
-						if (LZ4F_isError(compressedSize))
-							throw ITLException(string("Unable to perform LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
-
-						out.write((char*)pDest.get(), compressedSize);
-					}
-				}
-
-				// Finalize compression
-				{
-					size_t const compressedSize = LZ4F_compressEnd(ctx, pDest.get(), outputCapacity, NULL);
-					if (LZ4F_isError(compressedSize))
-						throw ITLException(string("Unable to finalize LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
-
-					out.write((char*)pDest.get(), compressedSize);
-				}
+				if (format == LZ4Format::SingleFrame)
+					writeFrame((const uint8_t*)img.getData(), img.dimensions(), img.pixelSize(), img.dataType(), imagePosition, blockDimensions, filename);
+				else
+					writeSlabs((const uint8_t*)img.getData(), img.dimensions(), img.pixelSize(), img.dataType(), imagePosition, blockDimensions, filename);
 			}
 		}
 
+		/**
+		Writes an image to an .lz4raw file.
+		By default, the image is divided into z-slabs that are compressed in parallel.
+		@param img Image to write.
+		@param filename Name of file to write.
+		@param format Layout of the compressed data.
+		*/
+		template<typename pixel_t> void write(const Image<pixel_t>& source, const std::string& filename, LZ4Format format = LZ4Format::Slabs)
+		{
+			internals::writeBlockToFullFile(source, filename, Vec3c(0, 0, 0), source.dimensions(), format);
+		}
+
 		/**
 		Writes block of an image into a .lz4raw file.
 		Replaces existing file.
@@ -301,11 +293,13 @@ namespace itl2
 		@param filename Name of file to write.
 		@param filePosition Position in the file where the first pixel should be written.
 		@param fileDimensions Dimensions of the entire output file. If zero, 
+		@param format Layout of the compressed data.
 		*/
 		template<typename pixel_t> void writeBlock(const Image<pixel_t>& img, const std::string& filename,
 			const Vec3c& filePosition, const Vec3c& fileDimensions,
 			const Vec3c& imagePosition,
-			const Vec3c& blockDimensions)
+			const Vec3c& blockDimensions,
+			LZ4Format format = LZ4Format::Slabs)
 		{
 
 			if (!img.isInImage(imagePosition))
@@ -317,7 +311,7 @@ namespace itl2
 			if (filePosition == Vec3c(0, 0, 0) && (fileDimensions == blockDimensions || fileDimensions == Vec3c(0, 0, 0)))
 			{
 				// We are overwriting entire output file if it exists.
-				internals::writeBlockToFullFile(img, filename, imagePosition, blockDimensions);
+				internals::writeBlockToFullFile(img, filename, imagePosition, blockDimensions, format);
 			}
 			else
 			{
@@ -340,7 +334,7 @@ namespace itl2
 						temp.ensureSize(filePosition + blockDimensions);
 				}
 				copyValues(temp, img, filePosition, imagePosition, blockDimensions);
-				lz4::write(temp, filename);
+				lz4::write(temp, filename, format);
 			}
 
 			
@@ -378,6 +372,7 @@ namespace itl2
 		{
 			void lz4io();
 			void lz4blockIo();
+			void lz4slabIo();
 		}
 	}
 
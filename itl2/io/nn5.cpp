@@ -1,10 +1,19 @@
 
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "nn5.h"
 #include "json.h"
 #include "byteorder.h"
 #include "generation.h"
+#include "noise.h"
 
 using namespace std;
 
@@ -12,12 +21,30 @@ namespace itl2
 {
 	namespace nn5
 	{
-		bool getInfo(const std::string& path, Vec3c& dimensions, bool& isNativeByteOrder, ImageDataType& dataType, Vec3c& chunkSize, NN5Compression& compression, std::string& reason)
+		/**
+		Maximum number of chunks that are read or written concurrently, or zero to use the number of OpenMP threads.
+		*/
+		static size_t ioConcurrency = 0;
+
+		void setIOConcurrency(size_t maxThreads)
+		{
+			ioConcurrency = maxThreads;
+		}
+
+		size_t getIOConcurrency()
+		{
+			if (ioConcurrency > 0)
+				return ioConcurrency;
+			return (size_t)std::max(1, omp_get_max_threads());
+		}
+
+		bool getInfo(const std::string& path, Vec3c& dimensions, bool& isNativeByteOrder, ImageDataType& dataType, Vec3c& chunkSize, Vec3c& shardSize, NN5Compression& compression, std::string& reason)
 		{
 			dimensions = Vec3c();
 			isNativeByteOrder = true;
 			dataType = ImageDataType::Unknown;
 			chunkSize = Vec3c();
+			shardSize = Vec3c();
 			compression = NN5Compression::Raw;
 
 			// Check that metadata file exists.
@@ -128,6 +155,29 @@ namespace itl2
 			}
 
 
+			if (j.contains("Shard dimensions"))
+			{
+				auto shardDims = j["Shard dimensions"];
+				if (shardDims.size() != dims.size())
+				{
+					reason = "Shard dimensions and dataset dimensions contain different number of elements.";
+					return false;
+				}
+
+				shardSize = Vec3c(1, 1, 1);
+				shardSize[0] = shardDims[0].get<size_t>();
+				if (shardDims.size() >= 2)
+					shardSize[1] = shardDims[1].get<size_t>();
+				if (shardDims.size() >= 3)
+					shardSize[2] = shardDims[2].get<size_t>();
+
+				if (shardSize.min() <= 0)
+				{
+					reason = "Shard dimensions must be positive.";
+					return false;
+				}
+			}
+
 
 			if (!j.contains("Compression"))
 			{
@@ -154,7 +204,7 @@ namespace itl2
 
 		namespace internals
 		{
-			void writeMetadata(const std::string& path, const Vec3c& dimensions, ImageDataType dataType, const Vec3c& chunkSize, NN5Compression compression)
+			void writeMetadata(const std::string& path, const Vec3c& dimensions, ImageDataType dataType, const Vec3c& chunkSize, NN5Compression compression, const Vec3c& shardSize)
 			{
 				nlohmann::json j;
 				j["Dimensions"][0] = dimensions[0];
@@ -166,6 +216,12 @@ namespace itl2
 				j["Chunk dimensions"][1] = chunkSize[1];
 				j["Chunk dimensions"][2] = chunkSize[2];
 				j["Compression"] = toString(compression);
+				if (isSharded(shardSize))
+				{
+					j["Shard dimensions"][0] = shardSize[0];
+					j["Shard dimensions"][1] = shardSize[1];
+					j["Shard dimensions"][2] = shardSize[2];
+				}
 
 				string metadataFilename = internals::nn5MetadataFilename(path);
 				ofstream of(metadataFilename, ios_base::trunc | ios_base::out);
@@ -196,10 +252,275 @@ namespace itl2
 					throw ITLException(string("NN5 chunk size must be positive, but it is ") + toString(chunkSize));
 			}
 
-			void beginWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, bool deleteOldData)
+			void check(const Vec3c& chunkSize, const Vec3c& shardSize)
 			{
 				check(chunkSize);
 
+				if (isSharded(shardSize) && shardSize.min() <= 0)
+					throw ITLException(string("NN5 shard size must be positive or zero for non-sharded datasets, but it is ") + toString(shardSize));
+			}
+
+			Vec3c existingShardSize(const std::string& path, const Vec3c& chunkSize)
+			{
+				bool isNativeByteOrder;
+				Vec3c dimensions;
+				ImageDataType dataType;
+				Vec3c oldChunkSize;
+				Vec3c shardSize;
+				NN5Compression compression;
+				string reason;
+				if (nn5::getInfo(path, dimensions, isNativeByteOrder, dataType, oldChunkSize, shardSize, compression, reason) && oldChunkSize == chunkSize)
+					return shardSize;
+				return Vec3c(0, 0, 0);
+			}
+
+			/**
+			Identifies shard files.
+			The magic number, the header and the offset table of shard files are stored in the native byte order of the computer,
+			similarly to the pixel data. On a little endian computer the magic number reads "NNSHARD1".
+			*/
+			static const uint64_t SHARD_MAGIC = 0x3144524148534e4eull;
+
+			/**
+			Size of shard file header: magic number and count of chunks.
+			*/
+			static const uint64_t SHARD_HEADER_SIZE = 2 * sizeof(uint64_t);
+
+			/**
+			Size of one entry in the shard offset table: offset and size of the chunk data.
+			*/
+			static const uint64_t SHARD_ENTRY_SIZE = 2 * sizeof(uint64_t);
+
+			/**
+			Read-only shard file that supports reading from arbitrary positions.
+			*/
+			class ShardReader
+			{
+			private:
+				string filename;
+#if defined(__linux__) || defined(__APPLE__)
+				int fd;
+#else
+				ifstream in;
+#endif
+
+			public:
+				ShardReader(const string& filename) : filename(filename)
+				{
+#if defined(__linux__) || defined(__APPLE__)
+					fd = ::open(filename.c_str(), O_RDONLY);
+#else
+					in.open(filename, ios_base::in | ios_base::binary);
+#endif
+				}
+
+				~ShardReader()
+				{
+#if defined(__linux__) || defined(__APPLE__)
+					if (fd >= 0)
+						::close(fd);
+#endif
+				}
+
+				ShardReader(const ShardReader&) = delete;
+				ShardReader& operator=(const ShardReader&) = delete;
+
+				bool isOpen() const
+				{
+#if defined(__linux__) || defined(__APPLE__)
+					return fd >= 0;
+#else
+					return (bool)in;
+#endif
+				}
+
+				/**
+				Reads count bytes starting from the given position in the file.
+				*/
+				void readAt(uint64_t pos, void* dst, size_t count)
+				{
+#if defined(__linux__) || defined(__APPLE__)
+					uint8_t* p = (uint8_t*)dst;
+					while (count > 0)
+					{
+						ssize_t ret = ::pread(fd, p, count, (off_t)pos);
+						if (ret < 0 && errno == EINTR)
+							continue;
+						if (ret <= 0)
+							throw ITLException(string("Unable to read shard file ") + filename);
+						p += ret;
+						pos += ret;
+						count -= ret;
+					}
+#else
+					in.seekg(pos);
+					in.read((char*)dst, count);
+					if (!in)
+						throw ITLException(string("Unable to read shard file ") + filename);
+#endif
+				}
+			};
+
+			/**
+			Locks that protect shard files in this process.
+			Readers hold the lock in shared mode, and writers, which may overwrite chunk data in place, in exclusive mode.
+			A shard file is mapped to a lock by the hash of its name.
+			*/
+			static std::shared_mutex shardLocks[64];
+
+			static std::shared_mutex& shardLock(const std::string& shardFile)
+			{
+				return shardLocks[std::hash<string>()(shardFile) % std::size(shardLocks)];
+			}
+
+			bool readShardEntry(const std::string& shardFile, size_t slot, std::vector<uint8_t>& data)
+			{
+				std::shared_lock<std::shared_mutex> lock(shardLock(shardFile));
+
+				ShardReader reader(shardFile);
+				if (!reader.isOpen())
+					return false;
+
+				uint64_t header[2];
+				reader.readAt(0, header, sizeof(header));
+				if (header[0] != SHARD_MAGIC)
+					throw ITLException(string("Invalid shard file ") + shardFile);
+				if (slot >= header[1])
+					throw ITLException(string("Chunk index is out of bounds of the shard file ") + shardFile);
+
+				uint64_t entry[2];
+				reader.readAt(SHARD_HEADER_SIZE + slot * SHARD_ENTRY_SIZE, entry, sizeof(entry));
+
+				// Zero offset means that the chunk has not been written.
+				if (entry[0] == 0)
+					return false;
+
+				data.resize(entry[1]);
+				reader.readAt(entry[0], data.data(), data.size());
+				return true;
+			}
+
+			void writeShardEntry(const std::string& shardFile, size_t slotCount, size_t slot, const std::vector<uint8_t>& data)
+			{
+				if (slot >= slotCount)
+					throw ITLException(string("Chunk index is out of bounds of the shard file ") + shardFile);
+
+				std::unique_lock<std::shared_mutex> lock(shardLock(shardFile));
+
+				if (!fs::exists(shardFile))
+				{
+					// Create new shard with empty offset table.
+					createFoldersFor(shardFile);
+					ofstream out(shardFile, ios_base::out | ios_base::trunc | ios_base::binary);
+					uint64_t header[2] = { SHARD_MAGIC, (uint64_t)slotCount };
+					out.write((const char*)header, sizeof(header));
+					std::vector<uint64_t> table(2 * slotCount, 0);
+					out.write((const char*)table.data(), table.size() * sizeof(uint64_t));
+					if (!out)
+						throw ITLException(string("Unable to create shard file ") + shardFile);
+				}
+
+				fstream f(shardFile, ios_base::in | ios_base::out | ios_base::binary);
+				uint64_t header[2] = { 0, 0 };
+				f.read((char*)header, sizeof(header));
+				if (!f || header[0] != SHARD_MAGIC || header[1] != slotCount)
+					throw ITLException(string("Invalid shard file ") + shardFile);
+
+				uint64_t entryPos = SHARD_HEADER_SIZE + slot * SHARD_ENTRY_SIZE;
+				uint64_t entry[2];
+				f.seekg(entryPos);
+				f.read((char*)entry, sizeof(entry));
+
+				// Overwrite old data if the new data fits in its place, otherwise append to the end of the file.
+				if (entry[0] == 0 || data.size() > entry[1])
+				{
+					f.seekp(0, ios_base::end);
+					entry[0] = (uint64_t)f.tellp();
+				}
+				else
+				{
+					f.seekp(entry[0]);
+				}
+				entry[1] = data.size();
+
+				f.write((const char*)data.data(), data.size());
+				f.seekp(entryPos);
+				f.write((const char*)entry, sizeof(entry));
+				if (!f)
+					throw ITLException(string("Unable to write to shard file ") + shardFile);
+			}
+
+			void compactShard(const std::string& shardFile)
+			{
+				std::unique_lock<std::shared_mutex> lock(shardLock(shardFile));
+
+				if (!fs::exists(shardFile))
+					return;
+
+				string tempFile = shardFile + ".compact";
+				{
+					ifstream in(shardFile, ios_base::in | ios_base::binary);
+					uint64_t header[2] = { 0, 0 };
+					in.read((char*)header, sizeof(header));
+					if (!in || header[0] != SHARD_MAGIC)
+						throw ITLException(string("Invalid shard file ") + shardFile);
+
+					size_t slotCount = (size_t)header[1];
+					std::vector<uint64_t> table(2 * slotCount, 0);
+					in.read((char*)table.data(), table.size() * sizeof(uint64_t));
+					if (!in)
+						throw ITLException(string("Invalid shard file ") + shardFile);
+
+					uint64_t dataStart = SHARD_HEADER_SIZE + slotCount * SHARD_ENTRY_SIZE;
+					uint64_t usedSize = dataStart;
+					for (size_t slot = 0; slot < slotCount; slot++)
+					{
+						if (table[2 * slot] != 0)
+							usedSize += table[2 * slot + 1];
+					}
+
+					if (usedSize >= (uint64_t)fs::file_size(shardFile))
+						return;
+
+					// Copy the chunks in slot order to the temporary file.
+					ofstream out(tempFile, ios_base::out | ios_base::trunc | ios_base::binary);
+					std::vector<uint64_t> newTable(2 * slotCount, 0);
+					out.write((const char*)header, sizeof(header));
+					out.write((const char*)newTable.data(), newTable.size() * sizeof(uint64_t));
+
+					uint64_t pos = dataStart;
+					std::vector<uint8_t> data;
+					for (size_t slot = 0; slot < slotCount; slot++)
+					{
+						if (table[2 * slot] == 0)
+							continue;
+
+						data.resize(table[2 * slot + 1]);
+						in.seekg(table[2 * slot]);
+						in.read((char*)data.data(), data.size());
+						out.write((const char*)data.data(), data.size());
+
+						newTable[2 * slot] = pos;
+						newTable[2 * slot + 1] = data.size();
+						pos += data.size();
+					}
+
+					out.seekp(SHARD_HEADER_SIZE);
+					out.write((const char*)newTable.data(), newTable.size() * sizeof(uint64_t));
+
+					if (!in)
+						throw ITLException(string("Unable to read shard file ") + shardFile);
+					if (!out)
+						throw ITLException(string("Unable to write to ") + tempFile);
+				}
+
+				fs::rename(tempFile, shardFile);
+			}
+
+			void beginWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, bool deleteOldData)
+			{
+				check(chunkSize, shardSize);
+
 				// Delete old dataset if it exists.
 				if (fs::exists(path))
 				{
@@ -207,9 +528,10 @@ namespace itl2
 					Vec3c oldDimensions;
 					ImageDataType oldDataType;
 					Vec3c oldChunkSize;
+					Vec3c oldShardSize;
 					NN5Compression oldCompression;
 					string dummyReason;
-					if (!nn5::getInfo(path, oldDimensions, oldIsNativeByteOrder, oldDataType, oldChunkSize, oldCompression, dummyReason))
+					if (!nn5::getInfo(path, oldDimensions, oldIsNativeByteOrder, oldDataType, oldChunkSize, oldShardSize, oldCompression, dummyReason))
 					{
 						// The path does not contain an NN5 dataset.
 						// If it is no know image, do not delete it.
@@ -224,6 +546,7 @@ namespace itl2
 						oldIsNativeByteOrder == true &&
 						oldDataType == imageDataType &&
 						oldChunkSize == chunkSize &&
+						oldShardSize == shardSize &&
 						oldCompression == compression)
 					{
 						// The path contains a compatible NN5 dataset.
@@ -244,7 +567,18 @@ namespace itl2
 				fs::create_directories(path);
 
 				// Write metadata
-				internals::writeMetadata(path, imageDimensions, imageDataType, chunkSize, compression);
+				internals::writeMetadata(path, imageDimensions, imageDataType, chunkSize, compression, shardSize);
+			}
+
+			/**
+			Calculates size of the unit whose safety is determined in concurrent write, i.e. chunk size
+			for non-sharded datasets and shard size in pixels for sharded datasets.
+			*/
+			Vec3c concurrencyUnitSize(const Vec3c& chunkSize, const Vec3c& shardSize)
+			{
+				if (isSharded(shardSize))
+					return chunkSize.componentwiseMultiply(shardSize);
+				return chunkSize;
 			}
 		}
 
@@ -321,25 +655,32 @@ namespace itl2
 
 		size_t startConcurrentWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, const std::vector<NN5Process>& processes)
 		{
-			// Find chunks that are
+			return startConcurrentWrite(imageDimensions, imageDataType, path, chunkSize, Vec3c(0, 0, 0), compression, processes);
+		}
+
+		size_t startConcurrentWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, const std::vector<NN5Process>& processes)
+		{
+			// Find chunks (or shards in sharded datasets) that are
 			// * written to by separate processes, or
 			// * read from and written to by at least two separate processes,
 			// and tag those unsafe by creating writes folder into the chunk folder.
 
-			internals::beginWrite(imageDimensions, imageDataType, path, chunkSize, compression, false);
+			internals::beginWrite(imageDimensions, imageDataType, path, chunkSize, shardSize, compression, false);
 
 			// Tag the image as concurrently processed
 			ofstream out(internals::concurrentTagFile(path), ios_base::out | ios_base::trunc | ios_base::binary);
 
+			Vec3c unitSize = internals::concurrencyUnitSize(chunkSize, shardSize);
+
 			size_t unsafeChunkCount = 0;
-			internals::forAllChunks(imageDimensions, chunkSize, false, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+			internals::forAllChunks(imageDimensions, unitSize, false, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
 				{
 					string chunkFolder = internals::chunkFolder(path, getDimensionality(imageDimensions), chunkIndex);
 					fs::create_directories(chunkFolder);
 
 					string writesFolder = internals::writesFolder(chunkFolder);
 
-					AABoxc chunkBox = AABoxc::fromPosSize(chunkStart, chunkSize);
+					AABoxc chunkBox = AABoxc::fromPosSize(chunkStart, unitSize);
 
 					if (!isChunkSafe(chunkBox, processes))
 					{
@@ -378,14 +719,15 @@ namespace itl2
 			Vec3c imageDimensions;
 			ImageDataType dataType;
 			Vec3c chunkSize;
+			Vec3c shardSize;
 			NN5Compression compression;
 			string reason;
-			if (!getInfo(path, imageDimensions, isNativeByteOrder, dataType, chunkSize, compression, reason))
+			if (!getInfo(path, imageDimensions, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
 				throw ITLException(string("Unable to read nn5 dataset: ") + reason);
 
 			size_t dimensionality = getDimensionality(imageDimensions);
 			vector<Vec3c> result;
-			internals::forAllChunks(imageDimensions, chunkSize, false, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+			internals::forAllChunks(imageDimensions, internals::concurrencyUnitSize(chunkSize, shardSize), false, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
 				{
 					if (needsEndConcurrentWrite(path, dimensionality, chunkIndex))
 						result.push_back(chunkIndex);
@@ -480,7 +822,7 @@ namespace itl2
 								case NN5Compression::LZ4:
 								{
 									string filename = chunkFolder + "/chunk.lz4raw";
-									lz4::write(img, filename);
+									lz4::write(img, filename, lz4::LZ4Format::SingleFrame);
 									break;
 								}
 								default:
@@ -496,9 +838,61 @@ namespace itl2
 				}
 			};
 
-			void endConcurrentWrite(const std::string& path, const Vec3c& imageDimensions, ImageDataType dataType, const Vec3c& chunkSize, NN5Compression compression, const Vec3c& chunkIndex)
+			template<typename pixel_t> struct CombineShardWrites
 			{
-				pick<internals::CombineChunkWrites>(dataType, path, imageDimensions, chunkSize, compression, chunkIndex);
+			public:
+				static void run(const string& path, const Vec3c& datasetSize, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, const Vec3c& shardIndex)
+				{
+					string shardFolder = internals::chunkFolder(path, getDimensionality(datasetSize), shardIndex);
+					string writesFolder = internals::writesFolder(shardFolder);
+
+					if (fs::exists(writesFolder))
+					{
+						Image<pixel_t> img;
+						std::vector<uint8_t> buffer;
+
+						// Writes of each chunk are in a separate folder whose name is the chunk index.
+						for (auto& p : fs::directory_iterator(writesFolder))
+						{
+							if (!p.is_directory())
+								continue;
+
+							vector<string> parts = split(p.path().filename().string(), true, '-');
+							if (parts.size() != 3)
+								throw ITLException(string("Invalid chunk writes folder: ") + p.path().string());
+							Vec3c chunkIndex(fromString<coord_t>(parts[0]), fromString<coord_t>(parts[1]), fromString<coord_t>(parts[2]));
+
+							vector<string> writesFiles = buildFileList(p.path().string() + "/");
+							if (writesFiles.size() <= 0)
+								continue;
+
+							// TODO: No need to read if the written blocks overwrite the chunk completely.
+							readShardChunk(img, path, datasetSize, chunkSize, shardSize, chunkIndex, compression, buffer);
+
+							for (const string& file : writesFiles)
+							{
+								readAndAdd(img, file, compression);
+							}
+
+							encodeChunk(img, compression, buffer);
+							writeShardEntry(shardFile(shardFolder), (size_t)shardSize.product(), shardSlot(chunkIndex, shardSize), buffer);
+						}
+
+						// Rewritten chunks that did not fit into their old place were appended to the shard, so reclaim the old space.
+						compactShard(shardFile(shardFolder));
+
+						// Remove the writes folder in order to mark this shard processed.
+						fs::remove_all(writesFolder);
+					}
+				}
+			};
+
+			void endConcurrentWrite(const std::string& path, const Vec3c& imageDimensions, ImageDataType dataType, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, const Vec3c& chunkIndex)
+			{
+				if (isSharded(shardSize))
+					pick<internals::CombineShardWrites>(dataType, path, imageDimensions, chunkSize, shardSize, compression, chunkIndex);
+				else
+					pick<internals::CombineChunkWrites>(dataType, path, imageDimensions, chunkSize, compression, chunkIndex);
 			}
 		}
 
@@ -510,12 +904,13 @@ namespace itl2
 			Vec3c imageDimensions;
 			ImageDataType dataType;
 			Vec3c chunkSize;
+			Vec3c shardSize;
 			NN5Compression compression;
 			string reason;
-			if (!getInfo(path, imageDimensions, isNativeByteOrder, dataType, chunkSize, compression, reason))
+			if (!getInfo(path, imageDimensions, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
 				throw ITLException(string("Unable to read nn5 dataset: ") + reason);
 
-			internals::endConcurrentWrite(path, imageDimensions, dataType, chunkSize, compression, chunkIndex);
+			internals::endConcurrentWrite(path, imageDimensions, dataType, chunkSize, shardSize, compression, chunkIndex);
 		}
 
 		void endConcurrentWrite(const std::string& path, bool showProgressInfo)
@@ -524,16 +919,17 @@ namespace itl2
 			Vec3c fileDimensions;
 			ImageDataType dataType;
 			Vec3c chunkSize;
+			Vec3c shardSize;
 			NN5Compression compression;
 			string reason;
-			if (!getInfo(path, fileDimensions, isNativeByteOrder, dataType, chunkSize, compression, reason))
+			if (!getInfo(path, fileDimensions, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
 				throw ITLException(string("Unable to read nn5 dataset: ") + reason);
 			size_t dimensionality = getDimensionality(fileDimensions);
 
-			internals::forAllChunks(fileDimensions, chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+			internals::forAllChunksParallel(fileDimensions, internals::concurrencyUnitSize(chunkSize, shardSize), showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart, size_t threadIndex)
 				{
 					if(needsEndConcurrentWrite(path, dimensionality, chunkIndex))
-						internals::endConcurrentWrite(path, fileDimensions, dataType, chunkSize, compression, chunkIndex);
+						internals::endConcurrentWrite(path, fileDimensions, dataType, chunkSize, shardSize, compression, chunkIndex);
 				});
 			
 			// Remove concurrent tag file after all blocks are processed such that if exception is thrown during processing,
@@ -894,6 +1290,182 @@ namespace itl2
 					concurrencyOneTest(NN5Compression::LZ4, chunkSize);
 				}
 			}
+
+			void parallelIo()
+			{
+				Image<uint16_t> img(100, 90, 80);
+				ramp3(img);
+
+				for (NN5Compression compression : { NN5Compression::Raw, NN5Compression::LZ4 })
+				{
+					for (size_t threads : { 1, 3, 0 })
+					{
+						setIOConcurrency(threads);
+						string desc = toString(compression) + ", " + toString(threads) + " threads";
+
+						nn5::write(img, "./nn5_parallel/data", Vec3c(16, 32, 24), compression);
+
+						Image<uint16_t> fromDisk;
+						nn5::read(fromDisk, "./nn5_parallel/data");
+						testAssert(equals(img, fromDisk), "NN5 parallel read/write, " + desc);
+
+						// Block read and write that cross chunk boundaries
+						Image<uint16_t> block(37, 41, 29);
+						nn5::readBlock(block, "./nn5_parallel/data", Vec3c(5, 7, 11));
+						Image<uint16_t> gt(block.dimensions());
+						crop(img, gt, Vec3c(5, 7, 11));
+						testAssert(equals(block, gt), "NN5 parallel block read, " + desc);
+
+						add(block, 1);
+						nn5::writeBlock(block, "./nn5_parallel/data", Vec3c(16, 32, 24), compression, Vec3c(5, 7, 11), img.dimensions(), Vec3c(0, 0, 0), block.dimensions());
+						nn5::readBlock(gt, "./nn5_parallel/data", Vec3c(5, 7, 11));
+						testAssert(equals(block, gt), "NN5 parallel block write, " + desc);
+					}
+				}
+
+				// Errors in worker threads are passed to the caller.
+				setIOConcurrency(4);
+				fs::remove_all("./nn5_parallel/corrupted");
+				nn5::write(img, "./nn5_parallel/corrupted", Vec3c(16, 32, 24), NN5Compression::LZ4);
+				writeText("./nn5_parallel/corrupted/1/1/1/chunk.lz4raw", "not lz4 data");
+				bool thrown = false;
+				try
+				{
+					Image<uint16_t> fromDisk;
+					nn5::read(fromDisk, "./nn5_parallel/corrupted");
+				}
+				catch (ITLException&)
+				{
+					thrown = true;
+				}
+				testAssert(thrown, "NN5 error in parallel read");
+
+				setIOConcurrency(0);
+			}
+
+			/**
+			Calculates the count of bytes in all shard files of a dataset that are not used by the shard header, the offset table or the chunks.
+			*/
+			uint64_t unusedShardBytes(const string& path)
+			{
+				uint64_t unused = 0;
+				for (auto& p : fs::recursive_directory_iterator(path))
+				{
+					if (!p.is_regular_file() || p.path().filename() != "shard")
+						continue;
+
+					ifstream in(p.path().string(), ios_base::in | ios_base::binary);
+					uint64_t header[2];
+					in.read((char*)header, sizeof(header));
+					std::vector<uint64_t> table(2 * header[1]);
+					in.read((char*)table.data(), table.size() * sizeof(uint64_t));
+
+					uint64_t used = internals::SHARD_HEADER_SIZE + header[1] * internals::SHARD_ENTRY_SIZE;
+					for (size_t slot = 0; slot < header[1]; slot++)
+					{
+						if (table[2 * slot] != 0)
+							used += table[2 * slot + 1];
+					}
+					unused += (uint64_t)fs::file_size(p.path()) - used;
+				}
+				return unused;
+			}
+
+			void shardedIo()
+			{
+				Image<uint16_t> img(100, 90, 80);
+				ramp3(img);
+
+				Vec3c chunkSize(16, 32, 24);
+				Vec3c shardSize(4, 2, 2);
+
+				for (NN5Compression compression : { NN5Compression::Raw, NN5Compression::LZ4 })
+				{
+					string desc = toString(compression);
+					string path = "./nn5_sharded/data";
+
+					fs::remove_all(path);
+					nn5::write(img, path, chunkSize, shardSize, compression);
+
+					// Check metadata and that the chunks are packed into shard files.
+					Vec3c dims, readChunkSize, readShardSize;
+					bool isNative;
+					ImageDataType dt;
+					NN5Compression readCompression;
+					string reason;
+					testAssert(nn5::getInfo(path, dims, isNative, dt, readChunkSize, readShardSize, readCompression, reason), "sharded NN5 getInfo, " + desc);
+					testAssert(dims == img.dimensions() && readChunkSize == chunkSize && readShardSize == shardSize && readCompression == compression, "sharded NN5 metadata, " + desc);
+
+					size_t fileCount = 0;
+					for (auto& p : fs::recursive_directory_iterator(path))
+					{
+						if (p.is_regular_file() && p.path().filename() != "metadata.json")
+							fileCount++;
+					}
+					testAssert(fileCount == 2 * 2 * 2, "sharded NN5 file count, " + desc);
+
+					Image<uint16_t> fromDisk;
+					nn5::read(fromDisk, path);
+					testAssert(equals(img, fromDisk), "sharded NN5 read/write, " + desc);
+
+					// Block read and write that cross chunk and shard boundaries.
+					Image<uint16_t> block(70, 41, 29);
+					nn5::readBlock(block, path, Vec3c(5, 7, 11));
+					Image<uint16_t> gt(block.dimensions());
+					crop(img, gt, Vec3c(5, 7, 11));
+					testAssert(equals(block, gt), "sharded NN5 block read, " + desc);
+
+					// Sharding is preserved when writing blocks to an existing dataset.
+					add(block, 1);
+					nn5::writeBlock(block, path, chunkSize, compression, Vec3c(5, 7, 11), img.dimensions(), Vec3c(0, 0, 0), block.dimensions());
+					testAssert(internals::existingShardSize(path, chunkSize) == shardSize, "sharding preserved in writeBlock, " + desc);
+					nn5::readBlock(gt, path, Vec3c(5, 7, 11));
+					testAssert(equals(block, gt), "sharded NN5 block write, " + desc);
+
+					// Concurrent write in blocks that do not align with shards.
+					fs::remove_all(path);
+					vector<nn5::NN5Process> processes;
+					Vec3c processBlockSize(30, 31, 32);
+					nn5::internals::forAllChunks(img.dimensions(), processBlockSize, false, [&](const Vec3c& processBlockIndex, const Vec3c& processBlockStart)
+						{
+							processes.push_back(NN5Process{ AABoxc::fromPosSize(processBlockStart, processBlockSize + Vec3c(10, 10, 10)), AABoxc::fromPosSize(processBlockStart, processBlockSize) });
+						});
+
+					nn5::startConcurrentWrite(img.dimensions(), img.dataType(), path, chunkSize, shardSize, compression, processes);
+					nn5::internals::forAllChunks(img.dimensions(), processBlockSize, false, [&](const Vec3c& processBlockIndex, const Vec3c& processBlockStart)
+						{
+							nn5::writeBlock(img, path, chunkSize, compression, processBlockStart, img.dimensions(), processBlockStart, processBlockSize);
+						});
+					vector<Vec3c> shards = nn5::getChunksThatNeedEndConcurrentWrite(path);
+					testAssert(shards.size() == 2 * 2 * 2, "sharded NN5 unsafe shard count, " + desc);
+					for (const Vec3c& shard : shards)
+						nn5::endConcurrentWrite(path, shard);
+					nn5::endConcurrentWrite(path);
+
+					nn5::read(fromDisk, path);
+					testAssert(equals(img, fromDisk), "sharded NN5 concurrent write, " + desc);
+					testAssert(unusedShardBytes(path) == 0, "shards are compacted in endConcurrentWrite, " + desc);
+
+					// Rewriting chunks with data that compresses worse leaves unused space that compaction removes.
+					if (compression == NN5Compression::LZ4)
+					{
+						Image<uint16_t> noisy(img.dimensions());
+						noise(noisy, 1000, 300, 7);
+						nn5::writeBlock(noisy, path, chunkSize, compression, Vec3c(0, 0, 0), img.dimensions(), Vec3c(0, 0, 0), img.dimensions());
+						testAssert(unusedShardBytes(path) > 0, "rewritten chunks leave unused space in shards, " + desc);
+
+						for (auto& p : fs::recursive_directory_iterator(path))
+						{
+							if (p.is_regular_file() && p.path().filename() == "shard")
+								internals::compactShard(p.path().string());
+						}
+						testAssert(unusedShardBytes(path) == 0, "compactShard, " + desc);
+
+						nn5::read(fromDisk, path);
+						testAssert(equals(noisy, fromDisk), "sharded NN5 after compaction, " + desc);
+					}
+				}
+			}
 		}
 	}
-}
\ No newline at end of file
+}
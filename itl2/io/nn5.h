@@ -9,6 +9,9 @@
 #include "io/nn5compression.h"
 #include "generation.h"
 
+#include <exception>
+#include <omp.h>
+
 namespace itl2
 {
 	namespace io
@@ -19,6 +22,17 @@ namespace itl2
 
 	namespace nn5
 	{
+		/**
+		Sets the maximum number of chunks that are read or written concurrently.
+		Set to zero to use the number of OpenMP threads.
+		*/
+		void setIOConcurrency(size_t maxThreads);
+
+		/**
+		Gets the maximum number of chunks that are read or written concurrently.
+		*/
+		size_t getIOConcurrency();
+
 		namespace internals
 		{
 			/**
@@ -37,7 +51,7 @@ namespace itl2
 			/**
 			Writes NN5 metadata file.
 			*/
-			void writeMetadata(const std::string& path, const Vec3c& dimensions, ImageDataType dataType, const Vec3c& chunkSize, NN5Compression compression);
+			void writeMetadata(const std::string& path, const Vec3c& dimensions, ImageDataType dataType, const Vec3c& chunkSize, NN5Compression compression, const Vec3c& shardSize = Vec3c(0, 0, 0));
 
 			/**
 			Retrieve a list of all files in the given directory.
@@ -75,17 +89,251 @@ namespace itl2
 				return realChunkSize;
 			}
 
+			/**
+			Tests if the given shard size refers to a sharded dataset.
+			Shard size (0, 0, 0) is used for datasets where each chunk is stored in a separate file.
+			*/
+			inline bool isSharded(const Vec3c& shardSize)
+			{
+				return shardSize != Vec3c(0, 0, 0);
+			}
+
+			/**
+			Calculates index of the shard that contains the given chunk.
+			*/
+			inline Vec3c shardIndex(const Vec3c& chunkIndex, const Vec3c& shardSize)
+			{
+				return Vec3c(chunkIndex.x / shardSize.x, chunkIndex.y / shardSize.y, chunkIndex.z / shardSize.z);
+			}
+
+			/**
+			Calculates index of the given chunk in the offset table of its shard.
+			*/
+			inline size_t shardSlot(const Vec3c& chunkIndex, const Vec3c& shardSize)
+			{
+				Vec3c local = chunkIndex - shardIndex(chunkIndex, shardSize).componentwiseMultiply(shardSize);
+				return (size_t)(local.x + shardSize.x * (local.y + shardSize.y * local.z));
+			}
+
+			/**
+			Constructs name of the shard file in the given shard folder.
+			*/
+			inline std::string shardFile(const std::string& shardFolder)
+			{
+				return shardFolder + "/shard";
+			}
+
+			/**
+			Constructs name of the folder where writes to an unsafe chunk in a sharded dataset are stored during concurrent write.
+			@param shardWritesFolder Writes folder of the shard that contains the chunk.
+			*/
+			inline std::string shardChunkWritesFolder(const std::string& shardWritesFolder, const Vec3c& chunkIndex)
+			{
+				return shardWritesFolder + "/" + toString(chunkIndex.x) + "-" + toString(chunkIndex.y) + "-" + toString(chunkIndex.z);
+			}
+
+			/**
+			Reads the stored bytes of a chunk from a shard file.
+			Only the shard header, the offset table entry of the chunk, and the chunk data are read from the file.
+			The function can be called concurrently with writeShardEntry from multiple threads of the same process.
+			@param slot Index of the chunk in the offset table of the shard.
+			@param data The chunk data is placed here.
+			@return False if the shard file or the chunk does not exist.
+			*/
+			bool readShardEntry(const std::string& shardFile, size_t slot, std::vector<uint8_t>& data);
+
+			/**
+			Writes bytes of a chunk into a shard file, and creates the file if it does not exist.
+			If the new data fits into the space of the old data of the same chunk, it is overwritten. Otherwise the data is appended to the end of the file.
+			The function can be called concurrently from multiple threads, but not from multiple processes.
+			@param slotCount Count of chunks in the shard.
+			@param slot Index of the chunk in the offset table of the shard.
+			*/
+			void writeShardEntry(const std::string& shardFile, size_t slotCount, size_t slot, const std::vector<uint8_t>& data);
+
+			/**
+			Removes the space left unused in a shard file by chunks that have been rewritten.
+			If there is unused space, the chunks are copied to a temporary file that then replaces the shard file.
+			Does nothing if the shard file does not exist.
+			*/
+			void compactShard(const std::string& shardFile);
+
+			/**
+			Converts chunk image to bytes that are stored in a shard file.
+			*/
+			template<typename pixel_t> void encodeChunk(const Image<pixel_t>& chunk, NN5Compression compression, std::vector<uint8_t>& data)
+			{
+				const uint8_t* src = (const uint8_t*)chunk.getData();
+				size_t srcSize = chunk.pixelCount() * sizeof(pixel_t);
+
+				switch (compression)
+				{
+				case NN5Compression::Raw:
+				{
+					data.assign(src, src + srcSize);
+					break;
+				}
+				case NN5Compression::LZ4:
+				{
+					data.resize(LZ4F_compressFrameBound(srcSize, &lz4::internals::lz4Prefs));
+					size_t compressedSize = LZ4F_compressFrame(data.data(), data.size(), src, srcSize, &lz4::internals::lz4Prefs);
+					if (LZ4F_isError(compressedSize))
+						throw ITLException(string("Unable to perform LZ4 compression: ") + LZ4F_getErrorName(compressedSize));
+					data.resize(compressedSize);
+					break;
+				}
+				default:
+				{
+					throw ITLException(string("Unsupported nn5 compression algorithm: ") + toString(compression));
+				}
+				}
+			}
+
+			/**
+			Converts bytes read from a shard file to chunk image.
+			The chunk image must be allocated to the correct size before calling this function.
+			*/
+			template<typename pixel_t> void decodeChunk(const std::vector<uint8_t>& data, NN5Compression compression, Image<pixel_t>& chunk, const std::string& filenameForErrorMessages)
+			{
+				uint8_t* dst = (uint8_t*)chunk.getData();
+				size_t dstSize = chunk.pixelCount() * sizeof(pixel_t);
+
+				switch (compression)
+				{
+				case NN5Compression::Raw:
+				{
+					if (data.size() != dstSize)
+						throw ITLException(string("Chunk in shard file ") + filenameForErrorMessages + " has invalid size.");
+					std::copy(data.begin(), data.end(), dst);
+					break;
+				}
+				case NN5Compression::LZ4:
+				{
+					lz4::internals::decompressFrame(data.data(), data.size(), dst, dstSize, filenameForErrorMessages);
+					break;
+				}
+				default:
+				{
+					throw ITLException(string("Unsupported nn5 decompression algorithm: ") + toString(compression));
+				}
+				}
+			}
+
+			/**
+			Reads a chunk of a sharded dataset into the given image.
+			The image is resized to the size of the chunk, and if the chunk has not been written, it is filled with zeroes.
+			@param buffer Scratch buffer for the stored bytes of the chunk.
+			*/
+			template<typename pixel_t> void readShardChunk(Image<pixel_t>& chunk, const std::string& path, const Vec3c& datasetSize, const Vec3c& chunkSize, const Vec3c& shardSize, const Vec3c& chunkIndex, NN5Compression compression, std::vector<uint8_t>& buffer)
+			{
+				chunk.ensureSize(clampedChunkSize(chunkIndex, chunkSize, datasetSize));
+
+				string filename = shardFile(chunkFolder(path, getDimensionality(datasetSize), shardIndex(chunkIndex, shardSize)));
+				if (readShardEntry(filename, shardSlot(chunkIndex, shardSize), buffer))
+					decodeChunk(buffer, compression, chunk, filename);
+				else
+					setValue(chunk, (pixel_t)0);
+			}
+
+			/**
+			Writes a block of an image to a separate file in the writes folder of an unsafe chunk.
+			The written files are combined with the chunk data in endConcurrentWrite.
+			@param filename Name of the file to write, without dimensions or extension.
+			*/
+			template<typename pixel_t> void writeChunkWritesFile(const Image<pixel_t>& img, std::string filename, const Vec3c& startInImageCoords, const Vec3c& realWriteSize, NN5Compression compression)
+			{
+				switch (compression)
+				{
+				case NN5Compression::Raw:
+				{
+					filename = concatDimensions(filename, realWriteSize);
+					raw::writeBlock(img, filename, Vec3c(0, 0, 0), realWriteSize, startInImageCoords, realWriteSize, false);
+					break;
+				}
+				case NN5Compression::LZ4:
+				{
+					filename += ".lz4raw";
+					lz4::writeBlock(img, filename, Vec3c(0, 0, 0), realWriteSize, startInImageCoords, realWriteSize, lz4::LZ4Format::SingleFrame);
+					break;
+				}
+				default:
+				{
+					throw ITLException(string("Unsupported nn5 compression algorithm: ") + toString(compression));
+				}
+				}
+			}
+
+			/**
+			Clamps size of block to be written into a chunk such that the block does not extend outside of the image or the chunk.
+			*/
+			template<typename pixel_t> Vec3c clampedWriteSize(const Image<pixel_t>& img, const Vec3c& startInImageCoords, const Vec3c& writeSize, const Vec3c& realChunkSize)
+			{
+				Vec3c imageChunkEnd = startInImageCoords + writeSize;
+				for (size_t n = 0; n < imageChunkEnd.size(); n++)
+				{
+					if (imageChunkEnd[n] > img.dimension(n))
+						imageChunkEnd[n] = img.dimension(n);
+				}
+				Vec3c realWriteSize = imageChunkEnd - startInImageCoords;
+
+				return min(realWriteSize, realChunkSize);
+			}
+
+			/**
+			Writes single chunk of a sharded NN5 dataset.
+			Parameters are the same than in writeSingleChunk.
+			*/
+			template<typename pixel_t> void writeSingleShardChunk(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkIndex, const Vec3c& chunkSize, const Vec3c& shardSize, const Vec3c& datasetSize,
+				const Vec3c& startInChunkCoords, const Vec3c& startInImageCoords, const Vec3c& writeSize, NN5Compression compression)
+			{
+				string shardFolder = internals::chunkFolder(path, getDimensionality(datasetSize), shardIndex(chunkIndex, shardSize));
+
+				Vec3c realChunkSize = clampedChunkSize(chunkIndex, chunkSize, datasetSize);
+				Vec3c realWriteSize = clampedWriteSize(img, startInImageCoords, writeSize, realChunkSize);
+
+				// Unsafe shards are not modified during concurrent write, the writes are stored
+				// to the writes folder of the shard, separately for each chunk.
+				string writesFolder = internals::writesFolder(shardFolder);
+				if (fs::exists(writesFolder))
+				{
+					string chunkWritesFolder = shardChunkWritesFolder(writesFolder, chunkIndex);
+					fs::create_directories(chunkWritesFolder);
+					string filename = chunkWritesFolder + string("/chunk_") + toString(startInChunkCoords.x) + string("-") + toString(startInChunkCoords.y) + string("-") + toString(startInChunkCoords.z);
+					writeChunkWritesFile(img, filename, startInImageCoords, realWriteSize, compression);
+					return;
+				}
+
+				Image<pixel_t> chunk(realChunkSize);
+				std::vector<uint8_t> buffer;
+
+				// Read old data if the write does not cover the whole chunk.
+				if (realWriteSize != realChunkSize)
+					readShardChunk(chunk, path, datasetSize, chunkSize, shardSize, chunkIndex, compression, buffer);
+
+				copyValues(chunk, img, startInChunkCoords, startInImageCoords, realWriteSize);
+
+				encodeChunk(chunk, compression, buffer);
+				writeShardEntry(shardFile(shardFolder), (size_t)shardSize.product(), shardSlot(chunkIndex, shardSize), buffer);
+			}
+
 			/**
 			Writes single NN5 chunk file.
 			@param chunkIndex Index of the chunk to write. This is used to determine the correct output folder.
 			@param chunkSize Chunk size of the dataset.
+			@param shardSize Count of chunks in each shard, or (0, 0, 0) if the dataset is not sharded.
 			@param startInChunkCoords Start position of the block to be written in the coordinates of the chunk.
 			@param chunkStart Start position of the block to be written in the coordinates of image targetImg.
 			@param writeSize Size of block to be written.
 			*/
-			template<typename pixel_t> void writeSingleChunk(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkIndex, const Vec3c& chunkSize, const Vec3c& datasetSize,
+			template<typename pixel_t> void writeSingleChunk(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkIndex, const Vec3c& chunkSize, const Vec3c& shardSize, const Vec3c& datasetSize,
 				const Vec3c& startInChunkCoords, const Vec3c& startInImageCoords, const Vec3c& writeSize, NN5Compression compression)
 			{
+				if (isSharded(shardSize))
+				{
+					writeSingleShardChunk(img, path, chunkIndex, chunkSize, shardSize, datasetSize, startInChunkCoords, startInImageCoords, writeSize, compression);
+					return;
+				}
+
 				// Build path to chunk folder.
 				string filename = internals::chunkFolder(path, getDimensionality(datasetSize), chunkIndex);
 
@@ -106,27 +354,11 @@ namespace itl2
 					filename += "/chunk";
 				}
 
-				// Clamp write size to the size of the image.
-				Vec3c imageChunkEnd = startInImageCoords + writeSize;
-				for (size_t n = 0; n < imageChunkEnd.size(); n++)
-				{
-					if (imageChunkEnd[n] > img.dimension(n))
-						imageChunkEnd[n] = img.dimension(n);
-				}
-				Vec3c realWriteSize = imageChunkEnd - startInImageCoords;
-
 				// Determine if this is the last chunk, and reduce chunk size accordingly so that image size stays correct.
-				//Vec3c datasetChunkStart = chunkIndex.componentwiseMultiply(chunkSize);
-				//Vec3c datasetChunkEnd = datasetChunkStart + chunkSize;
-				//for (size_t n = 0; n < datasetChunkEnd.size(); n++)
-				//{
-				//	if (datasetChunkEnd[n] > datasetSize[n])
-				//		datasetChunkEnd[n] = datasetSize[n];
-				//}
-				//Vec3c realChunkSize = datasetChunkEnd - datasetChunkStart;
 				Vec3c realChunkSize = clampedChunkSize(chunkIndex, chunkSize, datasetSize);
 
-				realWriteSize = min(realWriteSize, realChunkSize);
+				// Clamp write size to the size of the image and the chunk.
+				Vec3c realWriteSize = clampedWriteSize(img, startInImageCoords, writeSize, realChunkSize);
 
 				if (!unsafe)
 				{
@@ -134,14 +366,14 @@ namespace itl2
 					{
 					case NN5Compression::Raw:
 					{
-						filename = concatDimensions(filename, realWriteSize);
+						filename = concatDimensions(filename, realChunkSize);
 						raw::writeBlock(img, filename, startInChunkCoords, realChunkSize, startInImageCoords, realWriteSize, false);
 						break;
 					}
 					case NN5Compression::LZ4:
 					{
 						filename += ".lz4raw";
-						lz4::writeBlock(img, filename, startInChunkCoords, realChunkSize, startInImageCoords, realWriteSize);
+						lz4::writeBlock(img, filename, startInChunkCoords, realChunkSize, startInImageCoords, realWriteSize, lz4::LZ4Format::SingleFrame);
 						break;
 					}
 					default:
@@ -152,25 +384,7 @@ namespace itl2
 				}
 				else
 				{
-					switch (compression)
-					{
-					case NN5Compression::Raw:
-					{
-						filename = concatDimensions(filename, realWriteSize);
-						raw::writeBlock(img, filename, Vec3c(0, 0, 0), realWriteSize, startInImageCoords, realWriteSize, false);
-						break;
-					}
-					case NN5Compression::LZ4:
-					{
-						filename += ".lz4raw";
-						lz4::writeBlock(img, filename, Vec3c(0, 0, 0), realWriteSize, startInImageCoords, realWriteSize);
-						break;
-					}
-					default:
-					{
-						throw ITLException(string("Unsupported nn5 compression algorithm: ") + toString(compression));
-					}
-					}
+					writeChunkWritesFile(img, filename, startInImageCoords, realWriteSize, compression);
 				}
 			}
 
@@ -237,18 +451,86 @@ namespace itl2
 				}
 			}
 
+			/**
+			Call lambda(chunkIndex, chunkStart, threadIndex) for all chunks in an image of given dimensions and chunk size.
+			The chunks are processed concurrently using at most getIOConcurrency() threads.
+			The thread index is in range [0, getIOConcurrency()[ and can be used to select per-thread scratch buffers.
+			If the lambda throws an exception, the remaining chunks are skipped and the first exception is re-thrown
+			after all the threads have finished.
+			Progress is shown for the chunks that have been finished in order, as in the sequential version.
+			*/
+			template<typename F>
+			void forAllChunksParallel(const Vec3c& imageDimensions, const Vec3c& chunkSize, bool showProgressInfo, F&& lambda)
+			{
+				std::vector<std::pair<Vec3c, Vec3c> > chunks;
+				forAllChunks(imageDimensions, chunkSize, false, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+					{
+						chunks.push_back(std::make_pair(chunkIndex, chunkStart));
+					});
+
+				ProgressIndicator progress(showProgressInfo ? chunks.size() : 0, showProgressInfo);
+
+				// Progress is reported for the contiguous prefix of finished chunks so that it advances in chunk order.
+				std::vector<bool> finished(chunks.size(), false);
+				size_t finishedPrefix = 0;
+
+				int threadCount = (int)std::max<size_t>(1, std::min(getIOConcurrency(), chunks.size()));
+				std::exception_ptr error = nullptr;
+				bool failed = false;
+
+				#pragma omp parallel for num_threads(threadCount) schedule(dynamic) if(!omp_in_parallel() && threadCount > 1)
+				for (coord_t n = 0; n < (coord_t)chunks.size(); n++)
+				{
+					bool skip;
+					#pragma omp atomic read
+					skip = failed;
+
+					if (!skip)
+					{
+						try
+						{
+							lambda(chunks[n].first, chunks[n].second, (size_t)omp_get_thread_num());
+						}
+						catch (...)
+						{
+							#pragma omp critical(nn5ChunkError)
+							{
+								if (!error)
+									error = std::current_exception();
+							}
+
+							#pragma omp atomic write
+							failed = true;
+						}
+					}
+
+					#pragma omp critical(nn5ChunkProgress)
+					{
+						finished[n] = true;
+						while (finishedPrefix < finished.size() && finished[finishedPrefix])
+						{
+							finishedPrefix++;
+							progress.step();
+						}
+					}
+				}
+
+				if (error)
+					std::rethrow_exception(error);
+			}
+
 			/**
 			Writes NN5 chunk files.
 			*/
-			template<typename pixel_t> void writeChunks(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, const Vec3c& datasetSize, bool showProgressInfo)
+			template<typename pixel_t> void writeChunks(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, const Vec3c& datasetSize, bool showProgressInfo)
 			{
-				internals::forAllChunks(img.dimensions(), chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+				internals::forAllChunksParallel(img.dimensions(), chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart, size_t threadIndex)
 				{
-					writeSingleChunk(img, path, chunkIndex, chunkSize, datasetSize, Vec3c(0, 0, 0), chunkStart, chunkSize, compression);
+					writeSingleChunk(img, path, chunkIndex, chunkSize, shardSize, datasetSize, Vec3c(0, 0, 0), chunkStart, chunkSize, compression);
 				});
 			}
 
-			template<typename pixel_t> void writeChunksInRange(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression,
+			template<typename pixel_t> void writeChunksInRange(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression,
 				const Vec3c& filePosition, const Vec3c& fileDimensions,
 				const Vec3c& imagePosition,
 				const Vec3c& blockDimensions,
@@ -261,7 +543,7 @@ namespace itl2
 
 				AABoxc fileTargetBlock = AABoxc::fromPosSize(filePosition, blockDimensions);
 
-				internals::forAllChunks(fileDimensions, chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+				internals::forAllChunksParallel(fileDimensions, chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart, size_t threadIndex)
 					{
 						// This is done for all chunks in the output file.
 						// We will need to update the chunk if the file block to be written (fileTargetBlock)
@@ -301,7 +583,7 @@ namespace itl2
 
 							// Write chunk data only if the update region is non-empty.
 							if(chunkUpdateRegion.size().min() > 0)
-								writeSingleChunk(img, path, chunkIndex, chunkSize, fileDimensions, chunkUpdateRegion.position(), imageUpdateRegion.position(), chunkUpdateRegion.size(), compression);
+								writeSingleChunk(img, path, chunkIndex, chunkSize, shardSize, fileDimensions, chunkUpdateRegion.position(), imageUpdateRegion.position(), chunkUpdateRegion.size(), compression);
 						}
 
 						//// We need to write the chunk only if the current output chunk overlaps with the region to be written = imageBlock
@@ -376,9 +658,17 @@ namespace itl2
 
 			/**
 			Reads single NN5 chunk file.
+			@param buffer Scratch buffer used for reading sharded datasets.
 			*/
-			template<typename pixel_t> void readSingleChunk(Image<pixel_t>& target, const std::string& path, const Vec3c& datasetDimensions, const Vec3c& chunkIndex, const Vec3c& chunkStartInTarget, const Vec3c& readSize, NN5Compression compression, Image<pixel_t>& temp)
+			template<typename pixel_t> void readSingleChunk(Image<pixel_t>& target, const std::string& path, const Vec3c& datasetDimensions, const Vec3c& chunkSize, const Vec3c& shardSize, const Vec3c& chunkIndex, const Vec3c& chunkStartInTarget, const Vec3c& readSize, NN5Compression compression, Image<pixel_t>& temp, std::vector<uint8_t>& buffer)
 			{
+				if (isSharded(shardSize))
+				{
+					readShardChunk(temp, path, datasetDimensions, chunkSize, shardSize, chunkIndex, compression, buffer);
+					copyValues(target, temp, chunkStartInTarget);
+					return;
+				}
+
 				string dir = chunkFolder(path, getDimensionality(datasetDimensions), chunkIndex);
 
 				//Vec3c chunkEnd = chunkStartInTarget + readSize;
@@ -412,13 +702,15 @@ namespace itl2
 			/**
 			Reads NN5 chunk files.
 			*/
-			template<typename pixel_t> void readChunks(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, bool showProgressInfo)
+			template<typename pixel_t> void readChunks(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, bool showProgressInfo)
 			{
-				Image<pixel_t> temp;
+				// Scratch buffers for each thread.
+				std::vector<Image<pixel_t> > temps(getIOConcurrency());
+				std::vector<std::vector<uint8_t> > buffers(getIOConcurrency());
 
-				internals::forAllChunks(img.dimensions(), chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+				internals::forAllChunksParallel(img.dimensions(), chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart, size_t threadIndex)
 					{
-						readSingleChunk(img, path, img.dimensions(), chunkIndex, chunkStart, chunkSize, compression, temp);
+						readSingleChunk(img, path, img.dimensions(), chunkSize, shardSize, chunkIndex, chunkStart, chunkSize, compression, temps[threadIndex], buffers[threadIndex]);
 					});
 			}
 
@@ -426,21 +718,23 @@ namespace itl2
 			/**
 			Reads NN5 chunk files.
 			*/
-			template<typename pixel_t> void readChunksInRange(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression,
+			template<typename pixel_t> void readChunksInRange(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression,
 				const Vec3c& datasetDimensions,
 				const Vec3c& start, const Vec3c& end,
 				bool showProgressInfo)
 			{
-				Image<pixel_t> temp;
+				// Scratch buffers for each thread.
+				std::vector<Image<pixel_t> > temps(getIOConcurrency());
+				std::vector<std::vector<uint8_t> > buffers(getIOConcurrency());
 
 				AABoxc imageBox = AABoxc::fromMinMax(start, end);
 
 				// This is a check-all-chunks algoritm. Alternatively, we could calculate the required chunk range.
-				internals::forAllChunks(datasetDimensions, chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart)
+				internals::forAllChunksParallel(datasetDimensions, chunkSize, showProgressInfo, [&](const Vec3c& chunkIndex, const Vec3c& chunkStart, size_t threadIndex)
 					{
 						AABox<coord_t> currentChunk = AABox<coord_t>::fromPosSize(chunkStart, chunkSize);
 						if (currentChunk.overlapsExclusive(imageBox))
-							readSingleChunk(img, path, datasetDimensions, chunkIndex, chunkStart - start, currentChunk.intersection(imageBox).size(), compression, temp);
+							readSingleChunk(img, path, datasetDimensions, chunkSize, shardSize, chunkIndex, chunkStart - start, currentChunk.intersection(imageBox).size(), compression, temps[threadIndex], buffers[threadIndex]);
 					});
 			}
 
@@ -449,23 +743,51 @@ namespace itl2
 			*/
 			void check(const Vec3c& chunkSize);
 
+			/**
+			Checks that chunk size and shard size are valid and if not, throws an exception.
+			*/
+			void check(const Vec3c& chunkSize, const Vec3c& shardSize);
+
+			/**
+			Gets shard size of an existing NN5 dataset if its chunk size is the given one.
+			@return Shard size of the dataset, or (0, 0, 0) if the dataset does not exist, is not sharded, or has different chunk size.
+			*/
+			Vec3c existingShardSize(const std::string& path, const Vec3c& chunkSize);
+
 			/**
 			Checks that provided NN5 information is correct and writes metadata.
+			@param shardSize Count of chunks in each shard, or (0, 0, 0) to store each chunk in a separate file.
 			@param deleteOldData Contents of the dataset are usually deleted when a write process is started. Set this to false to delete only if the path contains an incompatible dataset, but keep the dataset if it seems to be the same than the current image.
 			*/
-			void beginWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, bool deleteOldData);
+			void beginWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, bool deleteOldData);
 		
 
-			template<typename pixel_t> void write(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, bool deleteOldData, bool showProgressInfo)
+			template<typename pixel_t> void write(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, bool deleteOldData, bool showProgressInfo)
 			{
-				internals::beginWrite(img.dimensions(), img.dataType(), path, chunkSize, compression, deleteOldData);
+				internals::beginWrite(img.dimensions(), img.dataType(), path, chunkSize, shardSize, compression, deleteOldData);
 
 				// Write data
-				internals::writeChunks(img, path, chunkSize, compression, img.dimensions(), showProgressInfo);
+				internals::writeChunks(img, path, chunkSize, shardSize, compression, img.dimensions(), showProgressInfo);
+			}
+
+			template<typename pixel_t> void write(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, bool deleteOldData, bool showProgressInfo)
+			{
+				write(img, path, chunkSize, Vec3c(0, 0, 0), compression, deleteOldData, showProgressInfo);
 			}
 		}
 
-		bool getInfo(const std::string& path, Vec3c& dimensions, bool& isNativeByteOrder, ImageDataType& dataType, Vec3c& chunkSize, NN5Compression& compression, std::string& reason);
+		/**
+		Get information of an NN5 dataset.
+		@param shardSize Count of chunks in each shard, or (0, 0, 0) if each chunk is stored in a separate file.
+		@return True if the path seems to contain a valid NN5 dataset.
+		*/
+		bool getInfo(const std::string& path, Vec3c& dimensions, bool& isNativeByteOrder, ImageDataType& dataType, Vec3c& chunkSize, Vec3c& shardSize, NN5Compression& compression, std::string& reason);
+
+		inline bool getInfo(const std::string& path, Vec3c& dimensions, bool& isNativeByteOrder, ImageDataType& dataType, Vec3c& chunkSize, NN5Compression& compression, std::string& reason)
+		{
+			Vec3c dummyShardSize;
+			return getInfo(path, dimensions, isNativeByteOrder, dataType, chunkSize, dummyShardSize, compression, reason);
+		}
 
 		inline bool getInfo(const std::string& path, Vec3c& dimensions, ImageDataType& dataType, std::string& reason)
 		{
@@ -485,6 +807,19 @@ namespace itl2
 			internals::write(img, path, chunkSize, compression, false, showProgressInfo);
 		}
 
+		/**
+		Write an image to a sharded nn5 dataset.
+		In a sharded dataset, multiple chunks are stored in a single shard file that contains an offset table
+		and the data of each chunk. This reduces the count of files in the dataset.
+		@param targetImg Image to write.
+		@param path Name of the top directory of the nn5 dataset.
+		@param shardSize Count of chunks in each shard in each dimension.
+		*/
+		template<typename pixel_t> void write(const Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, bool showProgressInfo = false)
+		{
+			internals::write(img, path, chunkSize, shardSize, compression, false, showProgressInfo);
+		}
+
 
 		/**
 		Write an image to an nn5 dataset.
@@ -517,26 +852,48 @@ namespace itl2
 		If the output file does not exist, it is created.
 		@param targetImg Image to write.
 		@param filename Name of file to write.
+		@param shardSize Count of chunks in each shard, or (0, 0, 0) to store each chunk in a separate file.
 		@param filePosition Position in the file to write to.
 		@param fileDimension Total dimensions of the entire output file.
 		@param imagePosition Position in the image where the block to be written starts.
 		@param blockDimensions Dimensions of the block of the source image to write.
 		*/
-		template<typename pixel_t> void writeBlock(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression,
+		template<typename pixel_t> void writeBlock(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression,
 			const Vec3c& filePosition, const Vec3c& fileDimensions,
 			const Vec3c& imagePosition,
 			const Vec3c& blockDimensions,
 			bool showProgressInfo = false)
 		{
-			internals::check(chunkSize);
+			internals::check(chunkSize, shardSize);
 
 			fs::create_directories(path);
 
 			// Write metadata
-			internals::writeMetadata(path, fileDimensions, img.dataType(), chunkSize, compression);
+			internals::writeMetadata(path, fileDimensions, img.dataType(), chunkSize, compression, shardSize);
 
 			// Write data
-			internals::writeChunksInRange(img, path, chunkSize, compression, filePosition, fileDimensions, imagePosition, blockDimensions, showProgressInfo);
+			internals::writeChunksInRange(img, path, chunkSize, shardSize, compression, filePosition, fileDimensions, imagePosition, blockDimensions, showProgressInfo);
+		}
+
+		/**
+		Writes a block of an image to the specified location in an .nn5 dataset.
+		The output dataset is not truncated if it exists.
+		If the output file does not exist, it is created.
+		If the output dataset exists, is sharded, and has the given chunk size, its sharding is preserved.
+		@param targetImg Image to write.
+		@param filename Name of file to write.
+		@param filePosition Position in the file to write to.
+		@param fileDimension Total dimensions of the entire output file.
+		@param imagePosition Position in the image where the block to be written starts.
+		@param blockDimensions Dimensions of the block of the source image to write.
+		*/
+		template<typename pixel_t> void writeBlock(Image<pixel_t>& img, const std::string& path, const Vec3c& chunkSize, NN5Compression compression,
+			const Vec3c& filePosition, const Vec3c& fileDimensions,
+			const Vec3c& imagePosition,
+			const Vec3c& blockDimensions,
+			bool showProgressInfo = false)
+		{
+			writeBlock(img, path, chunkSize, internals::existingShardSize(path, chunkSize), compression, filePosition, fileDimensions, imagePosition, blockDimensions, showProgressInfo);
 		}
 
 
@@ -552,9 +909,10 @@ namespace itl2
 			Vec3c dimensions;
 			ImageDataType dataType;
 			Vec3c chunkSize;
+			Vec3c shardSize;
 			NN5Compression compression;
 			string reason;
-			if (!getInfo(path, dimensions, isNativeByteOrder, dataType, chunkSize, compression, reason))
+			if (!getInfo(path, dimensions, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
 				throw ITLException(string("Unable to read nn5 dataset: ") + reason);
 
 			if (dataType != img.dataType())
@@ -562,7 +920,7 @@ namespace itl2
 
 			img.ensureSize(dimensions);
 
-			internals::readChunks(img, path, chunkSize, compression, showProgressInfo);
+			internals::readChunks(img, path, chunkSize, shardSize, compression, showProgressInfo);
 
 			if (!isNativeByteOrder)
 				swapByteOrder(img);
@@ -581,9 +939,10 @@ namespace itl2
 			Vec3c fileDimensions;
 			ImageDataType dataType;
 			Vec3c chunkSize;
+			Vec3c shardSize;
 			NN5Compression compression;
 			string reason;
-			if (!getInfo(path, fileDimensions, isNativeByteOrder, dataType, chunkSize, compression, reason))
+			if (!getInfo(path, fileDimensions, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
 				throw ITLException(string("Unable to read nn5 dataset: ") + reason);
 
 			if (dataType != img.dataType())
@@ -605,7 +964,7 @@ namespace itl2
 				return;
 			}
 
-			internals::readChunksInRange(img, path, chunkSize, compression, fileDimensions, cStart, cEnd, showProgressInfo);
+			internals::readChunksInRange(img, path, chunkSize, shardSize, compression, fileDimensions, cStart, cEnd, showProgressInfo);
 
 			if (!isNativeByteOrder)
 				swapByteOrder(img);
@@ -632,6 +991,22 @@ namespace itl2
 		*/
 		size_t startConcurrentWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, NN5Compression compression, const std::vector<NN5Process>& processes);
 
+		/**
+		Enables concurrent access from multiple processes for an existing or a new sharded NN5 dataset.
+		This function should be called before the processes are started.
+		In sharded datasets, the safety of concurrent access is determined for each shard instead of each chunk,
+		and the other concurrency-related functions take shard indices in place of chunk indices.
+		@param imageDimensions Dimensions of the image to be saved into the NN5 dataset.
+		@param imageDataType Data type of the image.
+		@param path Path to the NN5 dataset.
+		@param chunkSize Chunk size for the NN5 dataset.
+		@param shardSize Count of chunks in each shard, or (0, 0, 0) to store each chunk in a separate file.
+		@param compression Compression method to be used.
+		@param processes A list of NN5Process objects that define the block that where each process will have read and write access. The blocks may overlap.
+		@return Number of shards that require special processing in endConcurrentWrite.
+		*/
+		size_t startConcurrentWrite(const Vec3c& imageDimensions, ImageDataType imageDataType, const std::string& path, const Vec3c& chunkSize, const Vec3c& shardSize, NN5Compression compression, const std::vector<NN5Process>& processes);
+
 		/**
 		Enables concurrent access from multiple processes for an existing or a new NN5 dataset.
 		This function should be called before the processes are started.
@@ -658,12 +1033,12 @@ namespace itl2
 		/**
 		Used to test if a block in the given NN5 dataset requires calling endConcurrentWrite after concurrent access by multiple processes.
 		@param path Path to the NN5 dataset.
-		@param chunkIndex Index of the chunk to finalize.
+		@param chunkIndex Index of the chunk to finalize, or index of the shard if the dataset is sharded.
 		*/
 		bool needsEndConcurrentWrite(const std::string& path, const Vec3c& chunkIndex);
 
 		/**
-		Get a list of chunks for which needsEndConcurrentWrite must be called.
+		Get a list of chunks (or shards if the dataset is sharded) for which needsEndConcurrentWrite must be called.
 		*/
 		std::vector<Vec3c> getChunksThatNeedEndConcurrentWrite(const std::string& path);
 
@@ -674,7 +1049,7 @@ namespace itl2
 		The function can be called concurrently for different chunk indices.
 		Processing might involve doing nothing, or reading and re-writing the chunk.
 		@param path Path to the NN5 dataset.
-		@param chunkIndex Index of the chunk to finalize.
+		@param chunkIndex Index of the chunk to finalize, or index of the shard if the dataset is sharded.
 		*/
 		void endConcurrentWrite(const std::string& path, const Vec3c& chunkIndex);
 
@@ -686,6 +1061,8 @@ namespace itl2
 			void nn5BlockIo();
 			void concurrency();
 			void concurrencyLong();
+			void parallelIo();
+			void shardedIo();
 		}
 	}
 
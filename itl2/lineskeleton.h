@@ -2,10 +2,9 @@
 
 #include "image.h"
 #include "surfaceskeleton.h"
+#include "thinning.h"
 #include "math/vec3.h"
 
-#include <deque>
-
 namespace itl2
 {
 
@@ -413,15 +412,12 @@ namespace itl2
 		}
 
 
-		template<typename pixel_t> bool isSimplePointLine(const Image<pixel_t>& nb)
+		/**
+		Tests if the center point of a neighbourhood is simple in the sense of line thinning.
+		@param Np Neighbour list that does not contain the center pixel. Value 1 denotes foreground and value 0 background.
+		*/
+		inline bool isSimplePointLine(const uint8_t Np[26])
 		{
-			// Initialize neighbor list. The list will not contain the center pixel.
-			uint8_t Np[26];
-			for (coord_t i = 0; i < 13; i++)  // i =  0..12 -> cube[0..12]
-				Np[i] = nb(i) != (pixel_t)0 ? 1 : 0;
-			for (coord_t i = 14; i < 27; i++) // i = 14..26 -> cube[13..25]
-				Np[i - 1] = nb(i) != (pixel_t)0 ? 1 : 0;
-
 			// Calculate count of foreground 6-connected neighbours
 			static const size_t N6[] = { 4, 10, 12, 13, 15, 21 };
 			int N6Sum = 6;
@@ -465,6 +461,39 @@ namespace itl2
 			return true;
 		}
 
+		template<typename pixel_t> bool isSimplePointLine(const Image<pixel_t>& nb)
+		{
+			// Initialize neighbor list. The list will not contain the center pixel.
+			uint8_t Np[26];
+			for (coord_t i = 0; i < 13; i++)  // i =  0..12 -> cube[0..12]
+				Np[i] = nb(i) != (pixel_t)0 ? 1 : 0;
+			for (coord_t i = 14; i < 27; i++) // i = 14..26 -> cube[13..25]
+				Np[i - 1] = nb(i) != (pixel_t)0 ? 1 : 0;
+
+			return isSimplePointLine(Np);
+		}
+
+		/**
+		Calculates isSimplePointLine for 26-bit neighbour mask (see withoutCenter).
+		*/
+		inline bool isSimplePointLineUncached(uint32_t neighbours)
+		{
+			uint8_t Np[26];
+			for (size_t i = 0; i < 26; i++)
+				Np[i] = (neighbours >> i) & 1;
+			return isSimplePointLine(Np);
+		}
+
+		/**
+		Tests if the center point of the given 3x3x3 neighbourhood mask (see neighbourhoodMask) is simple in the sense of line thinning.
+		The results are cached in a lookup table.
+		*/
+		inline bool isSimplePointLine(uint32_t mask)
+		{
+			static const NeighbourhoodTable table(isSimplePointLineUncached);
+			return table(mask);
+		}
+
 		/*
 		This function uses similar getNeighbourhood pixel ordering than ImageJ implementation,
 		but it should not be necessary to use exactly this ordering...
@@ -513,89 +542,73 @@ namespace itl2
 	/*
 	Performs one thinning iteration and returns count of pixels removed from the image.
 	Repeating this thinning process until the image does not change results in line skeleton.
+	Only the parts of the image that are flagged in the frontier are examined, so the same frontier object should be used in all iterations.
 	@param img Image that should be thinned.
+	@param frontier Frontier of the thinning process. Initialize with a new ThinningFrontier object before the first iteration.
 	*/
-	template<typename pixel_t> size_t lineThin(Image<pixel_t>& img)
+	template<typename pixel_t> size_t lineThin(Image<pixel_t>& img, internals::ThinningFrontier& frontier)
 	{
-		size_t changed = 0;
-		std::deque<Vec3c> points;
-		size_t counter = 0;
+		if (frontier.dimensions() != img.dimensions())
+			throw ITLException("Thinning frontier and image dimensions do not match.");
 
-		for(int direction = 1; direction <= 6; direction++)
-		{
-			points.clear();
+		// Offsets to the neighbours that define border points of each direction, see internals::isBorderPoint.
+		const Vec3c borderOffsets[] = { Vec3c(0, -1, 0), Vec3c(0, 1, 0), Vec3c(-1, 0, 0), Vec3c(1, 0, 0), Vec3c(0, 0, -1), Vec3c(0, 0, 1) };
 
-			// Collect initial list of points
-			#pragma omp parallel
+		auto isRemovable = [](uint32_t nb)
 			{
-				Image<pixel_t> nbPrivate(3, 3, 3);
+				// Note: This uses the same isEndPoint than hybridSkeleton!
+				return !internals::isEndPoint(nb) &&
+					internals::isSimplePointLine(nb);
+			};
 
-				#pragma omp for
-				for (coord_t z = 0; z < img.depth(); z++)
-				{
-					for (coord_t y = 0; y < img.height(); y++)
-					{
-						for (coord_t x = 0; x < img.width(); x++)
-						{
-							pixel_t c = img(x, y, z);
-							if (c != (pixel_t)0)
-							{
-								if (internals::isBorderPoint(direction, img, x, y, z))
-								{
-									getNeighbourhood(img, Vec3c(x, y, z), Vec3c(1, 1, 1), nbPrivate, BoundaryCondition::Zero);
-
-									// Note: This uses the same isEndPoint than hybridSkeleton!
-									if (!internals::isEndPoint(nbPrivate) &&
-										internals::isSimplePointLine(nbPrivate))
-									{
-										#pragma omp critical(linethin_insert)
-											points.push_back(Vec3c(x, y, z));
-									}
-								}
-							}
-						}
-					}
-
-					showThreadProgress(counter, 6 * img.depth());
-				}
-			}
+		size_t changed = 0;
+		std::vector<uint8_t> removed;
 
-			// This is required to make the result exactly the same than in Fiji (non-threaded version)
-			// Otherwise, the point removal order may change the skeleton points.
-			std::sort(points.begin(), points.end(), vecComparer<coord_t>);
+		for (size_t direction = 0; direction < internals::ThinningFrontier::DIRECTION_COUNT; direction++)
+		{
+			std::vector<Vec3c> points = internals::thinningCandidates(img, frontier, direction, borderOffsets[direction], isRemovable);
 
-			// Process all points
+			// Process all points, alternately from the beginning and from the end of the list.
+			// The order depends on the results of the previous points, so this cannot be parallelized.
+			removed.assign(points.size(), 0);
+			size_t first = 0;
+			size_t last = points.size();
 			size_t counter = 0;
-			Image<pixel_t> nb(3, 3, 3);
-			while (!points.empty())
+			while (first < last)
 			{
-				Vec3c p;
+				size_t n;
 				if (counter % 2 == 0)
-				{
-					p = points.front();
-					points.pop_front();
-				}
+					n = first++;
 				else
-				{
-					p = points.back();
-					points.pop_back();
-				}
+					n = --last;
 
-				getNeighbourhood(img, p, Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
-				if (!internals::isEndPoint(nb) &&
-					internals::isSimplePointLine(nb))
+				if (isRemovable(internals::neighbourhoodMask(img, points[n])))
 				{
-					img(p) = 0;
+					img(points[n]) = 0;
+					removed[n] = 1;
 					changed++;
 				}
 
 				counter++;
 			}
+
+			frontier.update(direction, points, removed);
 		}
 
 		return changed;
 	}
 
+	/*
+	Performs one thinning iteration and returns count of pixels removed from the image.
+	Repeating this thinning process until the image does not change results in line skeleton.
+	@param img Image that should be thinned.
+	*/
+	template<typename pixel_t> size_t lineThin(Image<pixel_t>& img)
+	{
+		internals::ThinningFrontier frontier(img.dimensions());
+		return lineThin(img, frontier);
+	}
+
 	/*
 	Calculates skeleton of image by thinning it until no pixels can be removed.
 	Background is assumed to have value 0 and all nonzero pixels are assumed to be foreground.
@@ -610,11 +623,12 @@ namespace itl2
 	template<typename pixel_t> void lineSkeleton(Image<pixel_t>& img, size_t maxIterations = std::numeric_limits<size_t>::max())
 	{
 
+		internals::ThinningFrontier frontier(img.dimensions());
 		size_t it = 0;
 		size_t changes;
 		do
 		{
-			changes = lineThin(img);
+			changes = lineThin(img, frontier);
 
 			std::cout << changes << " pixels removed." << std::endl;
 
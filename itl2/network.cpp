@@ -8,6 +8,7 @@
 
 #include <random>
 #include <functional>
+#include <algorithm>
 
 using namespace std;
 
@@ -20,6 +21,70 @@ namespace itl2
 
 	const Vec3f Network::INVALID_VERTEX = Vec3f(numeric_limits<float32_t>::signaling_NaN(), numeric_limits<float32_t>::signaling_NaN(), numeric_limits<float32_t>::signaling_NaN());
 
+	void NetworkAdjacency::build(size_t vertexCount, const vector<Edge>& edges)
+	{
+		indexedVertexCount = vertexCount;
+		indexedEdgeCount = edges.size();
+
+		auto isIndexed = [&](const Edge& e)
+			{
+				return e.verts[0] >= 0 && e.verts[0] < (coord_t)vertexCount && e.verts[1] >= 0 && e.verts[1] < (coord_t)vertexCount;
+			};
+
+		// Count incidences of each vertex
+		offsets.assign(vertexCount + 1, 0);
+		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
+		for (coord_t n = 0; n < (coord_t)edges.size(); n++)
+		{
+			const Edge& e = edges[n];
+			if (isIndexed(e))
+			{
+				#pragma omp atomic
+				offsets[e.verts[0] + 1]++;
+				#pragma omp atomic
+				offsets[e.verts[1] + 1]++;
+			}
+		}
+
+		for (size_t n = 0; n < vertexCount; n++)
+			offsets[n + 1] += offsets[n];
+
+		// Place incidences to their vertices
+		incidences.resize(offsets[vertexCount]);
+		vector<size_t> next(offsets.begin(), offsets.end() - 1);
+		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
+		for (coord_t n = 0; n < (coord_t)edges.size(); n++)
+		{
+			const Edge& e = edges[n];
+			if (isIndexed(e))
+			{
+				size_t pos;
+				#pragma omp atomic capture
+				pos = next[e.verts[0]]++;
+				incidences[pos] = incidence(n, false);
+
+				#pragma omp atomic capture
+				pos = next[e.verts[1]]++;
+				incidences[pos] = incidence(n, true);
+			}
+		}
+
+		// Threads place the incidences in arbitrary order, so sort them back to edge order.
+		#pragma omp parallel for if(!omp_in_parallel() && vertexCount > PARALLELIZATION_THRESHOLD)
+		for (coord_t n = 0; n < (coord_t)vertexCount; n++)
+			sort(incidences.begin() + offsets[n], incidences.begin() + offsets[n + 1]);
+	}
+
+	void Network::updateAdjacency()
+	{
+		adjacency.build(vertices.size(), edges);
+	}
+
+	bool Network::hasAdjacency(size_t n) const
+	{
+		return n < vertices.size() && adjacency.isBuiltFor(vertices.size(), edges.size());
+	}
+
 	void Network::degree(vector<size_t>& deg, bool reportProgress) const
 	{
 		deg.resize(vertices.size());
@@ -63,6 +128,16 @@ namespace itl2
 
 	void Network::inEdges(size_t n, vector<size_t>& edg) const
 	{
+		if (hasAdjacency(n))
+		{
+			for (const size_t* p = adjacency.begin(n); p < adjacency.end(n); p++)
+			{
+				if (NetworkAdjacency::isTarget(*p))
+					edg.push_back(NetworkAdjacency::edgeIndex(*p));
+			}
+			return;
+		}
+
 		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
 		for (coord_t i = 0; i < (coord_t)edges.size(); i++)
 		{
@@ -78,6 +153,16 @@ namespace itl2
 
 	void Network::outEdges(size_t n, vector<size_t>& edg) const
 	{
+		if (hasAdjacency(n))
+		{
+			for (const size_t* p = adjacency.begin(n); p < adjacency.end(n); p++)
+			{
+				if (!NetworkAdjacency::isTarget(*p))
+					edg.push_back(NetworkAdjacency::edgeIndex(*p));
+			}
+			return;
+		}
+
 		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
 		for (coord_t i = 0; i < (coord_t)edges.size(); i++)
 		{
@@ -93,6 +178,18 @@ namespace itl2
 
 	void Network::inOutEdges(size_t n, vector<size_t>& inEdg, vector<size_t>& outEdg) const
 	{
+		if (hasAdjacency(n))
+		{
+			for (const size_t* p = adjacency.begin(n); p < adjacency.end(n); p++)
+			{
+				if (NetworkAdjacency::isTarget(*p))
+					inEdg.push_back(NetworkAdjacency::edgeIndex(*p));
+				else
+					outEdg.push_back(NetworkAdjacency::edgeIndex(*p));
+			}
+			return;
+		}
+
 		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
 		for (coord_t i = 0; i < (coord_t)edges.size(); i++)
 		{
@@ -116,6 +213,18 @@ namespace itl2
 
 	void Network::neighbours(size_t n, vector<size_t>& edgeIndices) const
 	{
+		if (hasAdjacency(n))
+		{
+			for (const size_t* p = adjacency.begin(n); p < adjacency.end(n); p++)
+			{
+				// Loops are stored twice, list them only once.
+				size_t e = NetworkAdjacency::edgeIndex(*p);
+				if (!NetworkAdjacency::isTarget(*p) || edges[e].verts[0] != (coord_t)n)
+					edgeIndices.push_back(e);
+			}
+			return;
+		}
+
 		#pragma omp parallel for if(!omp_in_parallel() && edges.size() > PARALLELIZATION_THRESHOLD)
 		for (coord_t i = 0; i < (coord_t)edges.size(); i++)
 		{
@@ -238,64 +347,77 @@ namespace itl2
 			}
 			else
 			{
-			    newEdges.push_back(edges[n]);
+			    newEdges.push_back(std::move(edges[n]));
 			}
 
 			showProgress(n, edges.size(), reportProgress);
 		}
 		
-		edges = newEdges;
-	}
-
-	size_t find(size_t ind, const vector<tuple<size_t, EdgeMeasurements> >& list)
-	{
-		for (size_t n = 0; n < list.size(); n++)
-		{
-			if (get<0>(list[n]) == ind)
-				return n;
-		}
-
-		throw ITLException("Impossible situation: Unable to find correct index from neighbour list.");
-	}
+		edges = std::move(newEdges);
 
-	void remove(size_t ind, vector<tuple<size_t, EdgeMeasurements> >& list)
-	{
-		size_t n = find(ind, list);
-		list.erase(list.begin() + n);
+		updateAdjacency();
 	}
 
 	void Network::markStraightThroughNodes(bool reportProgress)
 	{
-		// For each node, list of [neighbour node index, edge properties]
-		vector<vector<tuple<size_t, EdgeMeasurements> > > net(vertices.size());
+		// The index is always rebuilt as direct modifications of vertices or edges that do not change their count cannot be detected.
+		// Building the index is cheap compared to the rest of this method.
+		updateAdjacency();
 
-		// Populate net list from edges
+		// Each incidence in the adjacency index is a slot in the neighbour list of its vertex.
+		// For each slot, store the neighbour at the other end of the edge, index of the edge properties, and position of the slot at the other end of the edge.
+		// The slots never move, so a straight-through node can be bypassed in constant time by redirecting the slots that point to it.
 		cout << "Convert to neighbour list format..." << endl;
+		size_t slotCount = adjacency.incidenceCount();
+		const size_t* allIncidences = adjacency.begin(0);
+		vector<size_t> slotPosition(2 * edges.size());
+		#pragma omp parallel for if(!omp_in_parallel() && slotCount > PARALLELIZATION_THRESHOLD)
+		for (coord_t n = 0; n < (coord_t)slotCount; n++)
+			slotPosition[allIncidences[n]] = n;
+
+		vector<size_t> neighbour(slotCount);
+		vector<size_t> propertyIndex(slotCount);
+		vector<size_t> twin(slotCount);
+		vector<uint8_t> removed(slotCount, 0);
+		#pragma omp parallel for if(!omp_in_parallel() && slotCount > PARALLELIZATION_THRESHOLD)
+		for (coord_t n = 0; n < (coord_t)slotCount; n++)
+		{
+			size_t inc = allIncidences[n];
+			size_t e = NetworkAdjacency::edgeIndex(inc);
+			bool isTarget = NetworkAdjacency::isTarget(inc);
+			neighbour[n] = edges[e].verts[isTarget ? 0 : 1];
+			propertyIndex[n] = e;
+			twin[n] = slotPosition[NetworkAdjacency::incidence(e, !isTarget)];
+		}
+		slotPosition.clear();
+		slotPosition.shrink_to_fit();
+
+		vector<EdgeMeasurements> properties(edges.size());
 		for (size_t n = 0; n < edges.size(); n++)
 		{
-			const Edge& edge = edges[n];
-			net[edge.verts[0]].push_back(make_tuple(edge.verts[1], edge.properties));
-			net[edge.verts[1]].push_back(make_tuple(edge.verts[0], edge.properties));
+			properties[n] = std::move(edges[n].properties);
 			showProgress(n, edges.size(), reportProgress);
 		}
 		edges.clear();
 
 		// Find nodes with exactly 2 neighbours
 		cout << "Erase connections to nodes with 2 neighbours..." << endl;
-		for (size_t n = 0; n < net.size(); n++)
+		for (size_t n = 0; n < vertices.size(); n++)
 		{
-			if (net[n].size() == 2)
+			size_t s0 = adjacency.offset(n);
+			size_t s1 = s0 + 1;
+			if (adjacency.offset(n + 1) - s0 == 2)
 			{
 				// Connect a to b by replacing
 				// - n by b in a:s neighbour list and
 				// - n by a in b:s neighbour list.
-				size_t a = get<0>(net[n][0]);
-				size_t b = get<0>(net[n][1]);
+				size_t a = neighbour[s0];
+				size_t b = neighbour[s1];
 
 				if (a != n && b != n) // Don't adjust connections if any of the neighbours is this node, i.e. there is a loop.
 				{
-					EdgeMeasurements p1 = get<1>(net[n][0]);
-					EdgeMeasurements p2 = get<1>(net[n][1]);
+					EdgeMeasurements& p1 = properties[propertyIndex[s0]];
+					EdgeMeasurements& p2 = properties[propertyIndex[s1]];
 
 					EdgeMeasurements combined;
 					combined.pointCount = p1.pointCount + p2.pointCount;
@@ -310,8 +432,8 @@ namespace itl2
 					Vec3f endVertex = vertices[b];
 
 					vector<vector<Vec3sc>> pointLists;
-					pointLists.push_back(p1.edgePoints);
-					pointLists.push_back(p2.edgePoints);
+					pointLists.push_back(std::move(p1.edgePoints));
+					pointLists.push_back(std::move(p2.edgePoints));
 					Vec3f currentEnd = startVertex;
 					while (pointLists.size() > 0)
 					{
@@ -387,36 +509,49 @@ namespace itl2
 							combined.area = p2.area;
 					}
 
-					size_t nInd;
-					nInd = find(n, net[a]);
-					net[a][nInd] = make_tuple(b, combined);
-					nInd = find(n, net[b]);
-					net[b][nInd] = make_tuple(a, combined);
+					// The combined edge replaces the properties of the first edge.
+					size_t combinedIndex = propertyIndex[s0];
+					properties[propertyIndex[s1]] = EdgeMeasurements();
+					properties[combinedIndex] = std::move(combined);
 
-					net[n].clear();
+					size_t ta = twin[s0];
+					size_t tb = twin[s1];
+					neighbour[ta] = b;
+					propertyIndex[ta] = combinedIndex;
+					twin[ta] = tb;
+					neighbour[tb] = a;
+					propertyIndex[tb] = combinedIndex;
+					twin[tb] = ta;
+
+					removed[s0] = 1;
+					removed[s1] = 1;
 
 					// The node should be removed (and it does not have any connections), so mark it as invalid.
 					vertices[n] = INVALID_VERTEX;
 				}
 			}
-			showProgress(n, net.size(), reportProgress);
+			showProgress(n, vertices.size(), reportProgress);
 		}
 
 		// Convert network back to edge list format
 		cout << "Convert to edge list format..." << endl;
-		for (size_t n = 0; n < net.size(); n++)
+		for (size_t n = 0; n < vertices.size(); n++)
 		{
-			for (size_t m = 0; m < net[n].size(); m++)
+			for (size_t m = adjacency.offset(n); m < adjacency.offset(n + 1); m++)
 			{
-				size_t b = get<0>(net[n][m]);
-				EdgeMeasurements p = get<1>(net[n][m]);
-				edges.push_back(Edge(n, b, p));
+				if (!removed[m])
+				{
+					edges.push_back(Edge(n, neighbour[m], std::move(properties[propertyIndex[m]])));
 
-				// Remove the other item corresponding to this edge.
-				remove(n, net[b]);
+					// Remove the other slot corresponding to this edge.
+					removed[twin[m]] = 1;
+				}
 			}
-			showProgress(n, net.size(), reportProgress);
+			showProgress(n, vertices.size(), reportProgress);
 		}
+
+		// The vertex indices change when the invalid nodes are removed, so building the index now would be a waste.
+		adjacency.clear();
 	}
 
 	void Network::removeStraightThroughNodes(bool reportProgress)
@@ -515,6 +650,8 @@ namespace itl2
 				showThreadProgress(counter, incompleteVertices.size(), reportProgress);
 			}
 		}
+
+		updateAdjacency();
 	}
 
 	void Network::removeEdges(const vector<coord_t>& edgeIndices, bool removeStraightThrough, bool removeIsolated, bool reportProgress)
@@ -757,6 +894,8 @@ namespace itl2
 				}
 			}
 		}
+
+		updateAdjacency();
 	}
 
 	void writeEdge(ofstream& out, const Edge& e)
@@ -988,6 +1127,7 @@ namespace itl2
 				net.incompleteEdges.push_back(v);
 			}
 
+			net.updateAdjacency();
 			nets.push_back(net);
 		} while (!in.eof());
 		
@@ -1149,6 +1289,88 @@ namespace itl2
 			}
 		}
 
+		void networkAdjacency()
+		{
+			// Random network with loops and multiple edges between the same nodes.
+			Network net;
+			const size_t NODE_COUNT = 2000;
+			for (size_t n = 0; n < NODE_COUNT; n++)
+				net.vertices.push_back(Vec3f((float32_t)n, 0, 0));
+
+			std::mt19937 gen(5);
+			std::uniform_int_distribution<size_t> dist(0, NODE_COUNT - 1);
+			for (size_t n = 0; n < 3000; n++)
+			{
+				size_t start = dist(gen);
+				size_t end = n % 50 == 0 ? start : dist(gen);
+				net.edges.push_back(Edge(start, end, EdgeMeasurements(2, 1, 1)));
+			}
+			net.edges.push_back(Edge(7, 8, EdgeMeasurements(2, 1, 1)));
+			net.edges.push_back(Edge(8, 7, EdgeMeasurements(2, 1, 1)));
+
+			auto checkQueries = [](const Network& net, const string& desc)
+				{
+					bool ok = true;
+					for (size_t n = 0; n < net.vertices.size(); n++)
+					{
+						vector<size_t> in, out, inOutIn, inOutOut, nb;
+						net.inEdges(n, in);
+						net.outEdges(n, out);
+						net.inOutEdges(n, inOutIn, inOutOut);
+						net.neighbours(n, nb);
+
+						vector<size_t> inGt, outGt, nbGt;
+						for (size_t i = 0; i < net.edges.size(); i++)
+						{
+							if (net.edges[i].verts[1] == (coord_t)n)
+								inGt.push_back(i);
+							if (net.edges[i].verts[0] == (coord_t)n)
+								outGt.push_back(i);
+							if (net.edges[i].verts[0] == (coord_t)n || net.edges[i].verts[1] == (coord_t)n)
+								nbGt.push_back(i);
+						}
+
+						if (in != inGt || out != outGt || inOutIn != inGt || inOutOut != outGt || nb != nbGt)
+							ok = false;
+					}
+					testAssert(ok, "neighbourhood queries, " + desc);
+				};
+
+			checkQueries(net, "without index");
+			net.updateAdjacency();
+			checkQueries(net, "with index");
+
+			float32_t totalLength = 0;
+			for (const Edge& e : net.edges)
+				totalLength += e.properties.length;
+
+			net.removeStraightThroughNodes(false);
+			checkQueries(net, "after straight-through node removal");
+
+			// Only nodes with loops may be left with two connections.
+			vector<size_t> deg;
+			net.degree(deg, false);
+			bool ok = true;
+			float32_t newTotalLength = 0;
+			for (const Edge& e : net.edges)
+				newTotalLength += e.properties.length;
+			for (size_t n = 0; n < net.vertices.size(); n++)
+			{
+				if (deg[n] == 2)
+				{
+					vector<size_t> out;
+					net.outEdges(n, out);
+					if (out.size() != 1 || net.edges[out[0]].verts[1] != (coord_t)n)
+						ok = false;
+				}
+			}
+			testAssert(ok, "no straight-through nodes left");
+			testAssert(NumberUtils<float32_t>::equals(totalLength, newTotalLength), "total edge length after straight-through node removal");
+
+			net.prune(1.5f, false, true, false);
+			checkQueries(net, "after pruning");
+		}
+
 		void pruning()
 		{
 			Network net;
@@ -236,10 +236,126 @@ namespace itl2
 		}
 	};
 
+	/**
+	Index of edges connected to each vertex of a network, stored in compressed sparse row format.
+	For each vertex, the index stores incidences (see incidence) of the edges connected to the vertex, ordered by edge index.
+	Loops are stored twice, once as outgoing and once as incoming edge.
+	Edges whose vertex indices are out of range (e.g. Edge::INVALID) are not indexed.
+	*/
+	class NetworkAdjacency
+	{
+	private:
+		/**
+		Count of vertices and edges in the network that the index has been built for.
+		*/
+		size_t indexedVertexCount = 0;
+		size_t indexedEdgeCount = 0;
+
+		/**
+		Incidences of vertex n are stored in incidences[offsets[n]]...incidences[offsets[n + 1] - 1].
+		*/
+		std::vector<size_t> offsets;
+		std::vector<size_t> incidences;
+
+	public:
+		/**
+		Creates incidence from edge index and a flag indicating if the vertex is source (verts[0]) or target (verts[1]) of the edge.
+		*/
+		static size_t incidence(size_t edgeIndex, bool isTarget)
+		{
+			return 2 * edgeIndex + (isTarget ? 1 : 0);
+		}
+
+		/**
+		Gets index of the edge of the given incidence.
+		*/
+		static size_t edgeIndex(size_t incidence)
+		{
+			return incidence >> 1;
+		}
+
+		/**
+		Tests if the vertex is target of the edge in the given incidence.
+		*/
+		static bool isTarget(size_t incidence)
+		{
+			return (incidence & 1) != 0;
+		}
+
+		/**
+		Builds the index.
+		@param vertexCount Count of vertices in the network.
+		@param edges Edges of the network.
+		*/
+		void build(size_t vertexCount, const std::vector<Edge>& edges);
+
+		/**
+		Frees the index. Queries that use the index fall back to scanning all the edges until the index is built again.
+		*/
+		void clear()
+		{
+			offsets.clear();
+			offsets.shrink_to_fit();
+			incidences.clear();
+			incidences.shrink_to_fit();
+		}
+
+		/**
+		Tests if the index has been built for a network that has the given count of vertices and edges.
+		Changes that keep the counts the same cannot be detected.
+		*/
+		bool isBuiltFor(size_t vertexCount, size_t edgeCount) const
+		{
+			return offsets.size() == vertexCount + 1 && indexedVertexCount == vertexCount && indexedEdgeCount == edgeCount;
+		}
+
+		/**
+		Gets pointer to the first incidence of vertex n.
+		*/
+		const size_t* begin(size_t n) const
+		{
+			return incidences.data() + offsets[n];
+		}
+
+		/**
+		Gets pointer to one past the last incidence of vertex n.
+		*/
+		const size_t* end(size_t n) const
+		{
+			return incidences.data() + offsets[n + 1];
+		}
+
+		/**
+		Gets position of the first incidence of vertex n in the list of all incidences.
+		*/
+		size_t offset(size_t n) const
+		{
+			return offsets[n];
+		}
+
+		/**
+		Gets count of incidences in the index.
+		*/
+		size_t incidenceCount() const
+		{
+			return incidences.size();
+		}
+	};
+
 	class Network
 	{
 	private:
 
+		/**
+		Adjacency index of the network.
+		*/
+		NetworkAdjacency adjacency;
+
+		/**
+		Tests if the adjacency index can be used to answer neighbourhood queries of node n.
+		*/
+		bool hasAdjacency(size_t n) const;
+
 		/**
 		Disconnects node n but does not call clean().
 		The network is not in clean state before clean() is called.
@@ -248,6 +364,7 @@ namespace itl2
 
 		/**
 		Sets straight-through nodes to INVALID_VERTEX.
+		The adjacency index is freed. It is rebuilt when the invalid nodes are removed.
 		*/
 		void markStraightThroughNodes(bool reportProgress = true);
 
@@ -263,11 +380,13 @@ namespace itl2
 
 		/**
 		Positions of vertices.
+		Call updateAdjacency after modifying this list directly.
 		*/
 		std::vector<Vec3f> vertices;
 
 		/**
 		Edges between vertices.
+		Call updateAdjacency after modifying this list directly.
 		*/
 		std::vector<Edge> edges;
 
@@ -282,6 +401,15 @@ namespace itl2
 		std::vector<IncompleteEdge> incompleteEdges;
 
 
+		/**
+		Rebuilds the adjacency index that is used to answer neighbourhood queries (inEdges, outEdges, inOutEdges, neighbours).
+		The index is rebuilt automatically by all methods of this class that change the network.
+		Call this method after modifying vertices or edges directly, before making neighbourhood queries.
+		If the count of vertices or edges has changed since the index was built, the queries fall back to scanning all the edges.
+		Modifications that do not change the counts (e.g. changing the vertices of an edge) are not detected, and the queries give wrong results until this method is called.
+		*/
+		void updateAdjacency();
+
 		/**
 		Calculate degree of each node and place the values to given list.
 		Degree of a node is number of edges connected to it.
@@ -440,5 +568,6 @@ namespace itl2
 		void disconnectStraightThroughPerformance();
 		void networkio();
 		void pruning();
+		void networkAdjacency();
 	}
 }
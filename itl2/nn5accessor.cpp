@@ -0,0 +1,128 @@
+#include "nn5accessor.h"
+
+#include "generation.h"
+#include "pointprocess.h"
+#include "testutils.h"
+
+using namespace std;
+
+namespace itl2
+{
+	namespace tests
+	{
+		void nn5Accessor()
+		{
+			Image<uint16_t> img(100, 90, 80);
+			ramp3(img);
+
+			Vec3c chunkSize(16, 32, 24);
+
+			// The cache is smaller than the image so that the chunks are evicted many times.
+			size_t cacheSize = 64 * 1024;
+
+			for (nn5::NN5Compression compression : { nn5::NN5Compression::Raw, nn5::NN5Compression::LZ4 })
+			{
+				for (Vec3c shardSize : { Vec3c(0, 0, 0), Vec3c(2, 2, 2) })
+				{
+					string desc = toString(compression) + ", shard size " + toString(shardSize);
+					string path = "./nn5accessor/data";
+
+					fs::remove_all(path);
+					nn5::write(img, path, chunkSize, shardSize, compression);
+
+					// Random read access.
+					{
+						NN5Accessor<uint16_t> accessor(path, true, cacheSize);
+						testAssert(accessor.dimensions() == img.dimensions(), "NN5 accessor dimensions, " + desc);
+
+						srand(3);
+						bool ok = true;
+						for (size_t n = 0; n < 20000; n++)
+						{
+							Vec3c p(rand() % img.width(), rand() % img.height(), rand() % img.depth());
+							if (accessor(p.x, p.y, p.z) != img(p))
+								ok = false;
+						}
+						testAssert(ok, "NN5 accessor random read, " + desc);
+
+						bool thrown = false;
+						try
+						{
+							accessor.set(Vec3c(0, 0, 0), 1);
+						}
+						catch (const ITLException&)
+						{
+							thrown = true;
+						}
+						testAssert(thrown, "NN5 accessor read-only write, " + desc);
+					}
+
+					// Block read that extends outside of the dataset.
+					{
+						NN5Accessor<uint16_t> accessor(path, true, cacheSize);
+						Image<uint16_t> block(40, 50, 60), gt(block.dimensions());
+						Vec3c pos(70, 10, 30);
+						accessor.readBlock(block, pos);
+						crop(img, gt, pos);
+						testAssert(equals(block, gt), "NN5 accessor block read, " + desc);
+					}
+
+					// Pixel and block writes.
+					Image<uint16_t> gt(img.dimensions());
+					setValue(gt, img);
+
+					Image<uint16_t> fromDisk;
+					{
+						NN5Accessor<uint16_t> accessor(path, false, cacheSize);
+						for (coord_t z = 0; z < img.depth(); z += 3)
+						{
+							for (coord_t y = 0; y < img.height(); y += 2)
+							{
+								for (coord_t x = 0; x < img.width(); x++)
+								{
+									accessor.set(Vec3c(x, y, z), accessor(x, y, z) + 7);
+									gt(x, y, z) += 7;
+								}
+							}
+						}
+
+						accessor.flush();
+						nn5::read(fromDisk, path);
+						testAssert(equals(fromDisk, gt), "flushed NN5 accessor write, " + desc);
+
+						// The modified pixels are written back when the accessor is deleted.
+						Image<uint16_t> block(50, 40, 30);
+						setValue(block, 5);
+						Vec3c pos(3, 20, 17);
+						accessor.writeBlock(block, pos);
+						copyValues(gt, block, pos);
+					}
+
+					nn5::read(fromDisk, path);
+					testAssert(equals(fromDisk, gt), "NN5 accessor write, " + desc);
+					testAssert(nn5::internals::existingShardSize(path, chunkSize) == shardSize, "NN5 accessor sharding preserved, " + desc);
+				}
+
+				// New dataset.
+				{
+					string path = "./nn5accessor/new";
+					{
+						NN5Accessor<uint16_t> accessor(path, img.dimensions(), chunkSize, compression, cacheSize);
+						testAssert(accessor(10, 20, 30) == 0, "new NN5 accessor dataset is zero, " + toString(compression));
+
+						Image<uint16_t> slab(img.width(), img.height(), 10);
+						for (coord_t z = 0; z < img.depth(); z += slab.depth())
+						{
+							crop(img, slab, Vec3c(0, 0, z));
+							accessor.writeBlock(slab, Vec3c(0, 0, z));
+						}
+					}
+
+					Image<uint16_t> fromDisk;
+					nn5::read(fromDisk, path);
+					testAssert(equals(fromDisk, img), "new NN5 accessor dataset, " + toString(compression));
+				}
+			}
+		}
+	}
+}
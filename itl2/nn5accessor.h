@@ -0,0 +1,371 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <iostream>
+
+#include "image.h"
+#include "transform.h"
+#include "io/nn5.h"
+
+namespace itl2
+{
+	/**
+	Provides random access to pixels of an NN5 dataset (raw or LZ4 compressed, sharded or not) that might not fit into the memory.
+	The pixels are read from and written to the dataset through a least-recently-used cache of decoded chunks, so only a bounded
+	amount of the dataset is in memory at any time.
+	Modified chunks are written back to the dataset when they are evicted from the cache, and when the accessor is flushed or destroyed.
+	The accessor is not thread-safe.
+	*/
+	template<typename pixel_t> class NN5Accessor
+	{
+	private:
+		std::string path;
+		Vec3c dims;
+		Vec3c chunkSize;
+		Vec3c shardSize;
+		nn5::NN5Compression compression;
+		bool readOnly;
+
+		/**
+		Count of chunks in each dimension.
+		*/
+		Vec3c chunkCounts;
+
+		/**
+		Decoded chunk in the cache.
+		*/
+		struct CachedChunk
+		{
+			Vec3c index;
+			Vec3c start;
+			Image<pixel_t> data;
+			bool dirty = false;
+		};
+
+		/**
+		Cached chunks, the most recently used first, and map from linear chunk index to the cache entries.
+		*/
+		std::list<CachedChunk> chunks;
+		std::unordered_map<size_t, typename std::list<CachedChunk>::iterator> chunkMap;
+		size_t maxChunks;
+
+		/**
+		The most recently used chunk, or nullptr. Consecutive accesses usually hit the same chunk, and then the cache lookup is skipped.
+		*/
+		CachedChunk* lastChunk = nullptr;
+
+		/**
+		Scratch buffers for reading chunks.
+		*/
+		Image<pixel_t> temp;
+		std::vector<uint8_t> readBuffer;
+
+		size_t linearIndex(const Vec3c& chunkIndex) const
+		{
+			return (size_t)chunkIndex.x + (size_t)chunkCounts.x * ((size_t)chunkIndex.y + (size_t)chunkCounts.y * (size_t)chunkIndex.z);
+		}
+
+		/**
+		Writes chunk to the dataset if it is dirty.
+		*/
+		void writeChunk(CachedChunk& chunk)
+		{
+			if (chunk.dirty)
+			{
+				nn5::internals::writeSingleChunk(chunk.data, path, chunk.index, chunkSize, shardSize, dims, Vec3c(0, 0, 0), Vec3c(0, 0, 0), chunk.data.dimensions(), compression);
+				chunk.dirty = false;
+			}
+		}
+
+		/**
+		Gets chunk from the cache, and reads it from the dataset if it is not in the cache.
+		@param load Set to false to skip reading the chunk from the dataset, if the caller overwrites all of its pixels.
+		*/
+		CachedChunk& getChunk(const Vec3c& chunkIndex, bool load = true)
+		{
+			if (lastChunk && lastChunk->index == chunkIndex)
+				return *lastChunk;
+
+			size_t key = linearIndex(chunkIndex);
+
+			auto it = chunkMap.find(key);
+			if (it != chunkMap.end())
+			{
+				// Move to the front of the LRU list.
+				chunks.splice(chunks.begin(), chunks, it->second);
+				lastChunk = &*it->second;
+				return *it->second;
+			}
+
+			if (chunks.size() >= maxChunks)
+			{
+				CachedChunk& last = chunks.back();
+				writeChunk(last);
+				chunkMap.erase(linearIndex(last.index));
+				chunks.pop_back();
+			}
+
+			chunks.emplace_front();
+			CachedChunk& chunk = chunks.front();
+			chunk.index = chunkIndex;
+			chunk.start = chunkIndex.componentwiseMultiply(chunkSize);
+			chunkMap[key] = chunks.begin();
+			lastChunk = &chunk;
+
+			Vec3c realChunkSize = nn5::internals::clampedChunkSize(chunkIndex, chunkSize, dims);
+			chunk.data.ensureSize(realChunkSize);
+			if (load)
+				nn5::internals::readSingleChunk(chunk.data, path, dims, chunkSize, shardSize, chunkIndex, Vec3c(0, 0, 0), realChunkSize, compression, temp, readBuffer);
+
+			return chunk;
+		}
+
+		/**
+		Gets the chunk that contains the given pixel.
+		*/
+		CachedChunk& getChunkAt(const Vec3c& pos)
+		{
+			if (!isInImage(pos))
+				throw ITLException(std::string("Position ") + toString(pos) + " is outside of the NN5 dataset " + path + " of size " + toString(dims) + ".");
+
+			return getChunk(Vec3c(pos.x / chunkSize.x, pos.y / chunkSize.y, pos.z / chunkSize.z));
+		}
+
+		void mustBeWritable() const
+		{
+			if (readOnly)
+				throw ITLException(std::string("The NN5 dataset ") + path + " has been opened in read-only mode.");
+		}
+
+		/**
+		Calls f(chunk, box) for each chunk that intersects the given box, where box is the intersection in dataset coordinates.
+		@param load See getChunk.
+		*/
+		template<typename F> void forAllChunksInBox(const AABoxc& box, bool load, F&& f)
+		{
+			AABoxc clipped = box.intersection(AABoxc::fromPosSize(Vec3c(0, 0, 0), dims));
+			if (clipped.size().min() <= 0)
+				return;
+
+			Vec3c startChunk(clipped.minc.x / chunkSize.x, clipped.minc.y / chunkSize.y, clipped.minc.z / chunkSize.z);
+			Vec3c endChunk((clipped.maxc.x - 1) / chunkSize.x, (clipped.maxc.y - 1) / chunkSize.y, (clipped.maxc.z - 1) / chunkSize.z);
+
+			for (coord_t z = startChunk.z; z <= endChunk.z; z++)
+			{
+				for (coord_t y = startChunk.y; y <= endChunk.y; y++)
+				{
+					for (coord_t x = startChunk.x; x <= endChunk.x; x++)
+					{
+						Vec3c chunkIndex(x, y, z);
+						Vec3c chunkStart = chunkIndex.componentwiseMultiply(chunkSize);
+						AABoxc chunkBox = AABoxc::fromPosSize(chunkStart, nn5::internals::clampedChunkSize(chunkIndex, chunkSize, dims));
+						AABoxc part = chunkBox.intersection(clipped);
+						f(getChunk(chunkIndex, load || part.size() != chunkBox.size()), part);
+					}
+				}
+			}
+		}
+
+	public:
+
+		/**
+		Default maximum amount of memory used by the chunk cache.
+		*/
+		static const size_t DEFAULT_CACHE_SIZE = (size_t)1024 * 1024 * 1024;
+
+		/**
+		Constructor, opens an existing NN5 dataset.
+		@param path Path to the dataset.
+		@param readOnly Set to true to disallow writing to the dataset.
+		@param cacheSize Approximate maximum amount of memory in bytes used for the cached chunks.
+		The cache always contains at least one chunk so the memory usage might be higher for datasets with large chunks.
+		*/
+		NN5Accessor(const std::string& path, bool readOnly, size_t cacheSize = DEFAULT_CACHE_SIZE) :
+			path(path),
+			readOnly(readOnly)
+		{
+			bool isNativeByteOrder;
+			ImageDataType dataType;
+			std::string reason;
+			if (!nn5::getInfo(path, dims, isNativeByteOrder, dataType, chunkSize, shardSize, compression, reason))
+				throw ITLException(std::string("Unable to read nn5 dataset: ") + reason);
+
+			if (dataType != imageDataType<pixel_t>())
+				throw ITLException(std::string("Expected data type is ") + toString(imageDataType<pixel_t>()) + " but the nn5 dataset contains data of type " + toString(dataType) + ".");
+
+			if (!isNativeByteOrder)
+				throw ITLException("Only NN5 datasets in native byte order can be accessed through NN5Accessor.");
+
+			chunkCounts = Vec3c(
+				(dims.x + chunkSize.x - 1) / chunkSize.x,
+				(dims.y + chunkSize.y - 1) / chunkSize.y,
+				(dims.z + chunkSize.z - 1) / chunkSize.z);
+
+			size_t chunkBytes = (size_t)chunkSize.product() * sizeof(pixel_t);
+			maxChunks = std::max<size_t>(1, cacheSize / chunkBytes);
+		}
+
+		/**
+		Constructor, creates a new NN5 dataset whose pixels are all zero.
+		If the dataset exists, it is overwritten.
+		@param path Path to the dataset.
+		@param dimensions Dimensions of the dataset.
+		@param chunkSize Chunk size of the dataset.
+		@param compression Compression method of the dataset.
+		@param cacheSize Approximate maximum amount of memory in bytes used for the cached chunks.
+		*/
+		NN5Accessor(const std::string& path, const Vec3c& dimensions, const Vec3c& chunkSize, nn5::NN5Compression compression, size_t cacheSize = DEFAULT_CACHE_SIZE) :
+			NN5Accessor((nn5::internals::beginWrite(dimensions, imageDataType<pixel_t>(), path, chunkSize, Vec3c(0, 0, 0), compression, true), path), false, cacheSize)
+		{
+		}
+
+		NN5Accessor(const NN5Accessor&) = delete;
+		NN5Accessor& operator=(const NN5Accessor&) = delete;
+
+		/**
+		Destructor, writes all modified pixels to the dataset.
+		*/
+		~NN5Accessor()
+		{
+			try
+			{
+				flush();
+			}
+			catch (const ITLException& e)
+			{
+				std::cout << "Warning: Unable to write modified pixels to NN5 dataset " << path << ": " << e.message() << std::endl;
+			}
+		}
+
+		/**
+		Writes all modified pixels to the dataset.
+		*/
+		void flush()
+		{
+			for (CachedChunk& chunk : chunks)
+				writeChunk(chunk);
+		}
+
+		/**
+		Gets dimensions of the dataset.
+		*/
+		const Vec3c& dimensions() const
+		{
+			return dims;
+		}
+
+		/**
+		Gets width of the dataset.
+		*/
+		coord_t width() const
+		{
+			return dims.x;
+		}
+
+		/**
+		Gets height of the dataset.
+		*/
+		coord_t height() const
+		{
+			return dims.y;
+		}
+
+		/**
+		Gets depth of the dataset.
+		*/
+		coord_t depth() const
+		{
+			return dims.z;
+		}
+
+		/**
+		Gets chunk size of the dataset.
+		*/
+		const Vec3c& chunkDimensions() const
+		{
+			return chunkSize;
+		}
+
+		/**
+		Tests if the given position is inside the dataset.
+		*/
+		bool isInImage(const Vec3c& pos) const
+		{
+			return pos.x >= 0 && pos.y >= 0 && pos.z >= 0 && pos.x < dims.x && pos.y < dims.y && pos.z < dims.z;
+		}
+
+		/**
+		Gets value of pixel at the given position.
+		*/
+		pixel_t get(const Vec3c& pos)
+		{
+			CachedChunk& chunk = getChunkAt(pos);
+			return chunk.data(pos - chunk.start);
+		}
+
+		/**
+		Gets value of pixel at the given position.
+		*/
+		pixel_t operator()(coord_t x, coord_t y, coord_t z)
+		{
+			return get(Vec3c(x, y, z));
+		}
+
+		/**
+		Gets value of pixel at the given position.
+		*/
+		pixel_t operator()(const Vec3c& pos)
+		{
+			return get(pos);
+		}
+
+		/**
+		Sets value of pixel at the given position.
+		*/
+		void set(const Vec3c& pos, pixel_t value)
+		{
+			mustBeWritable();
+
+			CachedChunk& chunk = getChunkAt(pos);
+			chunk.data(pos - chunk.start) = value;
+			chunk.dirty = true;
+		}
+
+		/**
+		Reads a block of the dataset to an image.
+		Pixels of the block that are outside of the dataset are not changed.
+		@param block Image where the pixels are read to. The size of the image determines the size of the block.
+		@param pos Position of the block in the dataset.
+		*/
+		void readBlock(Image<pixel_t>& block, const Vec3c& pos)
+		{
+			forAllChunksInBox(AABoxc::fromPosSize(pos, block.dimensions()), true, [&](CachedChunk& chunk, const AABoxc& part)
+				{
+					copyValues(block, chunk.data, part.minc - pos, part.minc - chunk.start, part.size());
+				});
+		}
+
+		/**
+		Writes a block to the dataset.
+		Pixels of the block that are outside of the dataset are ignored.
+		@param block Image containing the pixels to write.
+		@param pos Position of the block in the dataset.
+		*/
+		void writeBlock(const Image<pixel_t>& block, const Vec3c& pos)
+		{
+			mustBeWritable();
+
+			forAllChunksInBox(AABoxc::fromPosSize(pos, block.dimensions()), false, [&](CachedChunk& chunk, const AABoxc& part)
+				{
+					copyValues(chunk.data, block, part.minc - chunk.start, part.minc - pos, part.size());
+					chunk.dirty = true;
+				});
+		}
+	};
+
+	namespace tests
+	{
+		void nn5Accessor();
+	}
+}
@@ -326,6 +326,104 @@ namespace itl2
 			}
 		}
 
+		/**
+		Removes columns from the end of each result row so that only the given number of columns remain, and sorts the rows.
+		*/
+		void truncateAndSort(Results& results, size_t columns)
+		{
+			for (auto& row : results)
+				row.resize(columns);
+			sort(results.begin(), results.end(), resultsComparer);
+		}
+
+		void analyzeParticlesAccumulate()
+		{
+			Image<uint8_t> geometry(200, 200, 200);
+			for (coord_t n = 0; n < 3000; n++)
+			{
+				Vec3d pos(frand((double)geometry.width()), frand((double)geometry.height()), frand((double)geometry.depth()));
+				double r = frand(1, 10);
+				draw(geometry, Sphere(pos, r), (uint8_t)1);
+			}
+
+			// Analyzers that support accumulation, and the same analyzers followed by an analyzer that requires point lists.
+			AnalyzerSet<Vec3sc, uint8_t> accumulating = createAnalyzers<uint8_t>("coordinates volume isonedge bounds", geometry.dimensions());
+			AnalyzerSet<Vec3sc, uint8_t> pointLists = createAnalyzers<uint8_t>("coordinates volume isonedge bounds pca", geometry.dimensions());
+			testAssert(accumulating.canAccumulate(), "analyzers support accumulation");
+			testAssert(!pointLists.canAccumulate(), "pca does not support accumulation");
+			size_t columns = accumulating.headers().size();
+
+			uint8_t fillColor = internals::SpecialColors<uint8_t>::fillColor();
+			uint8_t largeColor = internals::SpecialColors<uint8_t>::largeColor();
+
+			for (Connectivity conn : { Connectivity::AllNeighbours, Connectivity::NearestNeighbours })
+			{
+				for (size_t volumeLimit : { (size_t)0, (size_t)500 })
+				{
+					string desc = toString(conn) + ", volume limit " + toString(volumeLimit);
+
+					Image<uint8_t> img(geometry.dimensions());
+
+					Timer timer;
+					Results gt;
+					setValue(img, geometry);
+					timer.start();
+					analyzeParticlesSingleThreaded(img, pointLists, gt, conn, volumeLimit);
+					timer.stop();
+					cout << "Point list particle analysis took " << timer.getTime() << " ms." << endl;
+					truncateAndSort(gt, columns);
+
+					Results single;
+					setValue(img, geometry);
+					timer.start();
+					analyzeParticlesSingleThreaded(img, accumulating, single, conn, volumeLimit);
+					timer.stop();
+					cout << "Accumulating particle analysis took " << timer.getTime() << " ms." << endl;
+					truncateAndSort(single, columns);
+					testAssert(single == gt, "single-threaded accumulating particle analysis, " + desc);
+
+					Results multi;
+					setValue(img, geometry);
+					analyzeParticles(img, accumulating, multi, conn, volumeLimit);
+					truncateAndSort(multi, columns);
+					testAssert(multi == gt, "multi-threaded accumulating particle analysis, " + desc);
+
+					// Analyze in small blocks so that many particles are combined from multiple parts.
+					Results blocks;
+					setValue(img, geometry);
+					prepareParticleAnalysis(img, fillColor, largeColor);
+					vector<vector<Vec3sc> > largeEdgePoints;
+					vector<internals::AccumulatedParticle> incompleteParticles;
+					size_t counter = 0;
+					for (coord_t minZ = 0; minZ < img.depth(); minZ += 37)
+					{
+						coord_t maxZ = std::min(minZ + 36, img.depth() - 1);
+						Image<uint8_t> block(img, minZ, maxZ);
+						internals::analyzeParticlesSingleBlockAccumulate(block, accumulating, blocks, &incompleteParticles, &largeEdgePoints, conn, volumeLimit, fillColor, largeColor, counter, img.depth() * img.height(), Vec3sc(0, 0, (int32_t)minZ));
+					}
+					internals::combineParticleAnalysisResults(accumulating, blocks, largeEdgePoints, incompleteParticles, volumeLimit, conn);
+					truncateAndSort(blocks, columns);
+					testAssert(blocks == gt, "block-wise accumulating particle analysis, " + desc);
+				}
+			}
+
+			// Labeled regions
+			Image<uint16_t> labels(geometry.dimensions());
+			for (coord_t z = 0; z < labels.depth(); z++)
+				for (coord_t y = 0; y < labels.height(); y++)
+					for (coord_t x = 0; x < labels.width(); x++)
+						labels(x, y, z) = geometry(x, y, z) != 0 ? (uint16_t)(1 + x / 30 + 7 * (y / 30) + 49 * (z / 30)) : 0;
+
+			AnalyzerSet<Vec3sc, uint16_t> accumulatingLabels = createAnalyzers<uint16_t>("coordinates volume isonedge bounds", labels.dimensions());
+			AnalyzerSet<Vec3sc, uint16_t> pointListLabels = createAnalyzers<uint16_t>("coordinates volume isonedge bounds pca", labels.dimensions());
+			Results labelsGt, labelsAcc;
+			analyzeLabels(labels, pointListLabels, labelsGt);
+			analyzeLabels(labels, accumulatingLabels, labelsAcc);
+			truncateAndSort(labelsGt, columns);
+			truncateAndSort(labelsAcc, columns);
+			testAssert(labelsAcc == labelsGt, "accumulating label analysis");
+		}
+
 		void analyzeParticlesSanity()
 		{
 			Image<uint8_t> img(150, 150, 150);
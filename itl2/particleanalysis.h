@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
 
 #include "image.h"
 #include "floodfill.h"
@@ -331,6 +332,143 @@ namespace itl2
 		}
 
 
+		/**
+		Particle whose points have been added to the accumulators of the analyzers instead of storing them.
+		*/
+		struct AccumulatedParticle
+		{
+			/**
+			Points of the particle that are on the z-edges of the calculation block.
+			These are required for combining the particle with its parts in the neighbouring blocks.
+			*/
+			std::vector<Vec3sc> edgePoints;
+
+			/**
+			Accumulator of the analyzers, see AnalyzerSet::initAccumulator.
+			*/
+			std::vector<double> accumulator;
+
+			/**
+			Count of points in the particle.
+			*/
+			size_t volume = 0;
+		};
+
+		/**
+		Perform particle analysis for single image block without storing the points of the particles.
+		The particles are analyzed during flood fill, so all the analyzers must support accumulation (see AnalyzerSet::canAccumulate).
+		Otherwise works like analyzeParticlesSingleBlock, but particles that touch the z-edges of the block are returned as
+		accumulators and edge points instead of lists of all their points.
+		*/
+		template<typename pixel_t> void analyzeParticlesSingleBlockAccumulate(Image<pixel_t>& image, const AnalyzerSet<Vec3sc, pixel_t>& analyzers, Results& results, std::vector<AccumulatedParticle>* pIncompleteParticles, std::vector<std::vector<Vec3sc> >* pLargeEdgePoints, Connectivity connectivity, size_t volumeLimit, pixel_t fillColor, pixel_t largeColor, size_t& counter, size_t counterMax, const Vec3sc& coordinateShift)
+		{
+			coord_t maxZ = image.depth() - 1;
+			std::vector<Vec3sc> seeds(1);
+			AccumulatedParticle particle;
+			std::set<pixel_t> neighbourColors;
+
+			// If there is a volume limit, the filled points are stored and accumulated only if the particle is not large.
+			// Otherwise they are marked as belonging to a large particle.
+			// The fill is stopped at volumeLimit points so this requires only a bounded amount of memory.
+			// Without volume limit there are no large particles and the points are accumulated during the fill.
+			std::vector<Vec3sc> filledPoints;
+
+			auto accumulate = [&](const Vec3sc& p)
+				{
+					// The edge test must be done before shifting.
+					Vec3sc q = p + coordinateShift;
+					analyzers.accumulate(particle.accumulator, q);
+					particle.volume++;
+					if (pIncompleteParticles && (p.z == 0 || p.z == maxZ))
+						particle.edgePoints.push_back(q);
+				};
+
+			auto addPoint = [&](const Vec3sc& p)
+				{
+					if (volumeLimit > 0)
+						filledPoints.push_back(p);
+					else
+						accumulate(p);
+				};
+
+			for (coord_t z = 0; z < image.depth(); z++)
+			{
+				for (coord_t y = 0; y < image.height(); y++)
+				{
+					for (coord_t x = 0; x < image.width(); x++)
+					{
+						pixel_t pixel = image(x, y, z);
+
+						if (pixel != fillColor && pixel != 0 && pixel != largeColor)
+						{
+							seeds[0] = Vec3sc((int32_t)x, (int32_t)y, (int32_t)z);
+							analyzers.initAccumulator(particle.accumulator);
+							particle.edgePoints.clear();
+							particle.volume = 0;
+							filledPoints.clear();
+
+							bool isOk;
+							if (volumeLimit <= 0)
+							{
+								isOk = floodfillVisit(image, seeds, pixel, fillColor, fillColor, connectivity, addPoint);
+							}
+							else
+							{
+								// See analyzeParticlesSingleBlock.
+								isOk = floodfillVisit(image, seeds, pixel, fillColor, fillColor, connectivity, addPoint, volumeLimit, &neighbourColors);
+								if (isOk)
+									isOk = neighbourColors.count(largeColor) <= 0;
+							}
+
+							if (isOk)
+							{
+								for (size_t n = 0; n < filledPoints.size(); n++)
+									accumulate(filledPoints[n]);
+
+								if (particle.edgePoints.size() > 0)
+								{
+									// The particle touches image edge, store it as incomplete particle.
+									pIncompleteParticles->push_back(particle);
+								}
+								else
+								{
+									std::vector<double> resultLine;
+									analyzers.finalize(particle.accumulator, resultLine);
+									results.push_back(resultLine);
+								}
+							}
+							else
+							{
+								// The filled region is part of large particle.
+								if (filledPoints.size() <= 0)
+									filledPoints.push_back(seeds[0]);
+
+								// Mark the filled points as belonging to a large particle.
+								for (size_t n = 0; n < filledPoints.size(); n++)
+									image(filledPoints[n]) = largeColor;
+
+								// Store image edge points belonging to large particle
+								if (pLargeEdgePoints)
+								{
+									std::vector<Vec3sc> edgePoints;
+									for (size_t n = 0; n < filledPoints.size(); n++)
+									{
+										if (filledPoints[n].z <= 0 || filledPoints[n].z >= maxZ)
+											edgePoints.push_back(filledPoints[n] + coordinateShift);
+									}
+
+									if (edgePoints.size() > 0)
+										pLargeEdgePoints->push_back(edgePoints);
+								}
+							}
+						}
+					}
+
+					showThreadProgress(counter, counterMax);
+				}
+			}
+		}
+
 		/**
 		Perform particle analysis in blocks, one thread per block.
 		Has no restrictions on particle count. (uses flood fill algorithm)
@@ -341,11 +479,13 @@ namespace itl2
 		@param analyzers List of analyzers to apply to the particles.
 		@param results List for result matrix.
 		@param pLargeEdgePoints Pointer to array that will be filled with coordinates of image edge points belonging to large particle.
+		@param incompleteParticles Array that will be filled with particles that touch block edges. Use AccumulatedParticle as element type to analyze the particles without storing their points,
+		or std::vector<Vec3sc> to store the points of the particles.
 		@param volumeLimit Only include particles smaller than this value in the results.
 		@param fillColor The analyzed particles will be colored with this color.
 		@param largeColor Particles that are skipped because their size is larger than volumeLimit are colored with this color.
 		*/
-		template<typename pixel_t> void analyzeParticlesBlocks(Image<pixel_t>& image, AnalyzerSet<Vec3sc, pixel_t>& analyzers, Results& results, std::vector<std::vector<Vec3sc> >& largeEdgePoints, std::vector<std::vector<Vec3sc> >& incompleteParticles, Connectivity connectivity, size_t volumeLimit, pixel_t fillColor, pixel_t largeColor, const Vec3sc& origin, std::vector<coord_t>& blockEdgeZ)
+		template<typename pixel_t, typename particle_t> void analyzeParticlesBlocks(Image<pixel_t>& image, AnalyzerSet<Vec3sc, pixel_t>& analyzers, Results& results, std::vector<std::vector<Vec3sc> >& largeEdgePoints, std::vector<particle_t>& incompleteParticles, Connectivity connectivity, size_t volumeLimit, pixel_t fillColor, pixel_t largeColor, const Vec3sc& origin, std::vector<coord_t>& blockEdgeZ)
 		{
 			size_t counter = 0;
 
@@ -409,8 +549,11 @@ namespace itl2
 					// Analyze the block. All coordinates are shifted in analyzeParticlesSingleBlock function to global original image coordinates.
 					Results blockResults;
 					std::vector<std::vector<Vec3sc> > blockLargeEdgePoints;
-					std::vector<std::vector<Vec3sc> > blockIncompleteParticles;
-					internals::analyzeParticlesSingleBlock(block, analyzers, blockResults, &blockIncompleteParticles, &blockLargeEdgePoints, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), origin + Vec3sc(0, 0, (int32_t)minZ));
+					std::vector<particle_t> blockIncompleteParticles;
+					if constexpr (std::is_same_v<particle_t, AccumulatedParticle>)
+						internals::analyzeParticlesSingleBlockAccumulate(block, analyzers, blockResults, &blockIncompleteParticles, &blockLargeEdgePoints, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), origin + Vec3sc(0, 0, (int32_t)minZ));
+					else
+						internals::analyzeParticlesSingleBlock(block, analyzers, blockResults, &blockIncompleteParticles, &blockLargeEdgePoints, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), origin + Vec3sc(0, 0, (int32_t)minZ));
 
 					//raw::writed(block, "./particleanalysis/block");
 					//raw::writed(image, "./particleanalysis/image");
@@ -802,6 +945,75 @@ namespace itl2
 				incompleteParticles.clear();
 			}
 		}
+
+		/**
+		Combines incomplete accumulated particles and analyzes them.
+		Works like the final call to combineParticleAnalysisResults, but the parts of the particles are combined by merging their accumulators
+		instead of concatenating their point lists.
+		*/
+		template<typename pixel_t> void combineParticleAnalysisResults(const AnalyzerSet<Vec3sc, pixel_t>& analyzers, Results& results, std::vector<std::vector<Vec3sc> >& largeEdgePoints, std::vector<AccumulatedParticle>& incompleteParticles, size_t volumeLimit, Connectivity connectivity)
+		{
+			std::cout << "Processing " << incompleteParticles.size() << " particles on block edge boundaries..." << std::endl;
+
+			// NOTE: The items {edgePoints[0], ..., edgePoints[incompleteParticles.size()-1]} correspond to the incomplete particles,
+			// and the items {edgePoints[incompleteParticles.size()], ..., edgePoints[edgePoints.size()-1]} correspond to large particles.
+			std::vector<std::vector<Vec3sc> > edgePoints;
+			edgePoints.reserve(incompleteParticles.size() + largeEdgePoints.size());
+			for (AccumulatedParticle& particle : incompleteParticles)
+				edgePoints.push_back(std::move(particle.edgePoints));
+			edgePoints.insert(edgePoints.end(), largeEdgePoints.begin(), largeEdgePoints.end());
+
+			IndexForest forest;
+			findNeighboringParticles(edgePoints, forest, connectivity);
+
+			// Merge accumulators to roots. Zero volume indicates that the particle has been combined with some other particle.
+			std::cout << "Combine particles..." << std::endl;
+			for (size_t n = 0; n < incompleteParticles.size(); n++)
+			{
+				size_t base = forest.find_set(n);
+				if (base != n)
+				{
+					// If the root is a large particle, the particle is discarded.
+					if (base < incompleteParticles.size())
+					{
+						analyzers.mergeAccumulators(incompleteParticles[base].accumulator, incompleteParticles[n].accumulator);
+						incompleteParticles[base].volume += incompleteParticles[n].volume;
+					}
+					incompleteParticles[n].volume = 0;
+				}
+			}
+
+			std::vector<bool> isBig(incompleteParticles.size(), false);
+			if (volumeLimit > 0)
+			{
+				for (size_t n = 0; n < incompleteParticles.size(); n++)
+				{
+					if (incompleteParticles[n].volume >= volumeLimit)
+						isBig[n] = true;
+				}
+
+				// Particles that have been combined with any of the big particles are big.
+				for (size_t n = incompleteParticles.size(); n < edgePoints.size(); n++)
+				{
+					size_t base = forest.find_set(n);
+					if (base < incompleteParticles.size())
+						isBig[base] = true;
+				}
+			}
+
+			std::cout << "Analyze combined particles..." << std::endl;
+			for (size_t n = 0; n < incompleteParticles.size(); n++)
+			{
+				if (incompleteParticles[n].volume > 0 && !isBig[n])
+				{
+					std::vector<double> resultLine;
+					analyzers.finalize(incompleteParticles[n].accumulator, resultLine);
+					results.push_back(resultLine);
+				}
+			}
+
+			incompleteParticles.clear();
+		}
 	}
 
 	/**
@@ -846,7 +1058,6 @@ namespace itl2
 		if (largeColor == 0)
 			throw ITLException("Large color must not be zero as zero is background color.");
 
-		std::vector<std::vector<Vec3sc> > incompleteParticles;
 		std::vector<std::vector<Vec3sc> > largeEdgePoints;
 		std::vector<coord_t> edgeZ;
 		
@@ -854,6 +1065,16 @@ namespace itl2
 
 		prepareParticleAnalysis(image, fillColor, largeColor);
 
+		if (analyzers.canAccumulate())
+		{
+			// Analyze without storing the points of the particles.
+			std::vector<internals::AccumulatedParticle> incompleteParticles;
+			internals::analyzeParticlesBlocks(image, analyzers, results, largeEdgePoints, incompleteParticles, connectivity, volumeLimit, fillColor, largeColor, Vec3sc(), edgeZ);
+			internals::combineParticleAnalysisResults(analyzers, results, largeEdgePoints, incompleteParticles, volumeLimit, connectivity);
+			return;
+		}
+
+		std::vector<std::vector<Vec3sc> > incompleteParticles;
 		internals::analyzeParticlesBlocks(image, analyzers, results, largeEdgePoints, incompleteParticles, connectivity, volumeLimit, fillColor, largeColor, Vec3sc(), edgeZ);
 
 		//std::cout << "Block edges are at" << std::endl;
@@ -920,7 +1141,10 @@ namespace itl2
 
 		prepareParticleAnalysis(image, fillColor, largeColor);
 
-		internals::analyzeParticlesSingleBlock(image, analyzers, results, nullptr, nullptr, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), Vec3sc());
+		if (analyzers.canAccumulate())
+			internals::analyzeParticlesSingleBlockAccumulate(image, analyzers, results, nullptr, nullptr, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), Vec3sc());
+		else
+			internals::analyzeParticlesSingleBlock(image, analyzers, results, nullptr, nullptr, connectivity, volumeLimit, fillColor, largeColor, counter, image.depth() * image.height(), Vec3sc());
 
 		//raw::writed(image, "particleanalysis/labels");
 	}
@@ -952,7 +1176,54 @@ namespace itl2
 	*/
 	template<typename pixel_t> void analyzeLabels(const Image<pixel_t>& image, AnalyzerSet<Vec3sc, pixel_t>& analyzers, Results& results)
 	{
-		// TODO: This can be done more efficiently by changing analyzers such that they don't require all the points at once.
+		if (analyzers.canAccumulate())
+		{
+			// Accumulate the points of each region without storing them.
+			std::map<pixel_t, std::vector<double> > accumulators;
+			{
+				ProgressIndicator prog(image.depth());
+				for (coord_t z = 0; z < image.depth(); z++)
+				{
+					for (coord_t y = 0; y < image.height(); y++)
+					{
+						// Regions are often continuous along a row, so look up the accumulator only when the label changes.
+						pixel_t prevPixel = 0;
+						std::vector<double>* pAcc = nullptr;
+						for (coord_t x = 0; x < image.width(); x++)
+						{
+							pixel_t pixel = image(x, y, z);
+							if (pixel != 0)
+							{
+								if (!pAcc || pixel != prevPixel)
+								{
+									auto it = accumulators.find(pixel);
+									if (it == accumulators.end())
+									{
+										it = accumulators.emplace(pixel, std::vector<double>()).first;
+										analyzers.initAccumulator(it->second);
+									}
+									pAcc = &it->second;
+									prevPixel = pixel;
+								}
+
+								analyzers.accumulate(*pAcc, Vec3sc(Vec3c(x, y, z)));
+							}
+						}
+					}
+					prog.step();
+				}
+			}
+
+			results.headers() = analyzers.headers();
+			for (auto& item : accumulators)
+			{
+				std::vector<double> resultLine;
+				analyzers.finalize(item.second, resultLine);
+				results.push_back(resultLine);
+			}
+
+			return;
+		}
 
 		// Divide pixels into point sets based on their value
 		std::map<pixel_t, std::vector<Vec3sc> > points;
@@ -1343,6 +1614,7 @@ namespace itl2
 		void analyzeParticlesSanity();
 		void analyzeParticlesSanity2();
 		void analyzeParticlesVolumeLimit();
+		void analyzeParticlesAccumulate();
 	}
 }
 
@@ -0,0 +1,126 @@
+
+#include "pointpipeline.h"
+
+#include "noise.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
+
+namespace itl2
+{
+	namespace tests
+	{
+		template<typename pixel_t> void pointPipelineCase(double mean, double stddev)
+		{
+			Image<pixel_t> img(101, 53, 27);
+			add(img, mean);
+			noise(img, 0, stddev, 17);
+
+			Image<pixel_t> gt;
+			setValue(gt, img);
+			add(gt, 3.5);
+			multiply(gt, 1.7);
+			negate(gt);
+			abs(gt);
+			squareRoot(gt);
+			linearMap(gt, Vec4d(0, 20, 0, 100));
+			divide(gt, 3.0);
+			max(gt, 2.0);
+			threshold(gt, 10.0);
+
+			Image<pixel_t> res;
+			setValue(res, img);
+			PointPipeline<pixel_t> p;
+			p.add(3.5).multiply(1.7).negate().abs().squareRoot().linearMap(Vec4d(0, 20, 0, 100)).divide(3.0).max(2.0).threshold(10.0);
+			testAssert(p.size() == 9, "pipeline size");
+			p.run(res);
+			checkDifference(gt, res, string("pipeline result, ") + toString(img.dataType()));
+
+			// Same from string
+			setValue(res, img);
+			pointOperations(res, "add(3.5) | multiply(1.7) | negate | abs | squareroot | linmap(0, 20, 0, 100) | divide(3) | max(2) | threshold(10)");
+			checkDifference(gt, res, string("pipeline from string, ") + toString(img.dataType()));
+
+			// Thresholds and replace
+			setValue(gt, img);
+			subtract(gt, mean);
+			replace(gt, Vec2<pixel_t>(pixelRound<pixel_t>(0), pixelRound<pixel_t>(7)));
+			multiThreshold(gt, vector<pixel_t>{ pixelRound<pixel_t>(5), pixelRound<pixel_t>(30) });
+
+			setValue(res, img);
+			pointOperations(res, "subtract(" + toString(mean) + ") | replace(0, 7) | doublethreshold(5, 30)");
+			checkDifference(gt, res, string("thresholds from string, ") + toString(img.dataType()));
+		}
+
+		void pointPipeline()
+		{
+			pointPipelineCase<uint8_t>(100, 30);
+			pointPipelineCase<uint16_t>(1000, 300);
+			pointPipelineCase<int16_t>(0, 300);
+			pointPipelineCase<float32_t>(100, 30);
+
+			// Empty pipeline does nothing.
+			Image<float32_t> img(10, 10, 10), orig;
+			noise(img, 0, 1, 3);
+			setValue(orig, img);
+			PointPipeline<float32_t>().run(img);
+			checkDifference(img, orig, "empty pipeline");
+
+			// Invalid strings
+			bool thrown = false;
+			try
+			{
+				pointOperations(img, "add(1) | nonexistent(3)");
+			}
+			catch (ITLException&)
+			{
+				thrown = true;
+			}
+			testAssert(thrown, "unknown operation");
+
+			thrown = false;
+			try
+			{
+				pointOperations(img, "linmap(1, 2)");
+			}
+			catch (ITLException&)
+			{
+				thrown = true;
+			}
+			testAssert(thrown, "wrong parameter count");
+		}
+
+		void pointPipelineSpeed()
+		{
+			Image<float32_t> img(500, 500, 400);
+			add(img, 1000);
+			noise(img, 0, 100, 5);
+
+			Image<float32_t> gt, res;
+			setValue(gt, img);
+			setValue(res, img);
+
+			Timer timer;
+			timer.start();
+			subtract(gt, 100.0);
+			divide(gt, 1000.0);
+			negLog(gt);
+			multiply(gt, 2.0);
+			linearMap(gt, Vec4d(-1, 1, 0, 255));
+			threshold(gt, 128.0);
+			timer.stop();
+			cout << "Separate point operations took " << timer.getTime() << " ms" << endl;
+
+			timer.start();
+			PointPipeline<float32_t> p;
+			p.subtract(100.0).divide(1000.0).negLog().multiply(2.0).linearMap(Vec4d(-1, 1, 0, 255)).threshold(128.0);
+			p.run(res);
+			timer.stop();
+			cout << "Fused point operations took " << timer.getTime() << " ms" << endl;
+
+			checkDifference(gt, res, "fused point operations");
+		}
+	}
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "image.h"
+#include "pointprocess.h"
+#include "stringutils.h"
+#include "utilities.h"
+
+#include <vector>
+#include <functional>
+#include <type_traits>
+
+namespace itl2
+{
+	/**
+	Records a sequence of point operations and runs all of them in a single pass over the image.
+	The image is processed in blocks that fit into the L1 cache, and all the operations are applied to
+	one block before moving to the next one. Each operation is applied to the block in a tight loop
+	that the compiler can vectorize.
+	The result is the same than that of calling the corresponding functions in pointprocess.h one after another,
+	but the image data is streamed through the memory only once.
+
+	Usage:
+	PointPipeline<float32_t> p;
+	p.add(10.0).multiply(2.0).negLog().threshold(0.5);
+	p.run(img);
+	*/
+	template<typename pixel_t> class PointPipeline
+	{
+	public:
+		/**
+		Number of pixels in each block that is processed by all the operations before moving to the next block.
+		*/
+		static constexpr coord_t BLOCK_SIZE = 2048;
+
+	private:
+		/**
+		Each stage processes count pixels starting from the given pointer.
+		*/
+		std::vector<std::function<void(pixel_t*, coord_t)> > stages;
+
+	public:
+
+		/**
+		Returns count of operations in the pipeline.
+		*/
+		size_t size() const
+		{
+			return stages.size();
+		}
+
+		/**
+		Returns true if the pipeline does not contain any operations.
+		*/
+		bool empty() const
+		{
+			return stages.empty();
+		}
+
+		/**
+		Removes all operations from the pipeline.
+		*/
+		void clear()
+		{
+			stages.clear();
+		}
+
+		/**
+		Adds a generic unary operation to the pipeline.
+		Corresponds to pointProcess function.
+		*/
+		template<typename intermediate_t, intermediate_t process(pixel_t)> PointPipeline& then()
+		{
+			stages.push_back([](pixel_t* p, coord_t count)
+				{
+					for (coord_t n = 0; n < count; n++)
+						p[n] = pixelRound<pixel_t, intermediate_t>(process(p[n]));
+				});
+			return *this;
+		}
+
+		/**
+		Adds a generic operation with a parameter to the pipeline.
+		Corresponds to pointProcessImageParam function.
+		The parameter is copied to the pipeline.
+		*/
+		template<typename param_t, typename intermediate_t, intermediate_t process(pixel_t, param_t)> PointPipeline& then(param_t param)
+		{
+			stages.push_back([param = std::decay_t<param_t>(param)](pixel_t* p, coord_t count)
+				{
+					for (coord_t n = 0; n < count; n++)
+						p[n] = pixelRound<pixel_t, intermediate_t>(process(p[n], param));
+				});
+			return *this;
+		}
+
+		PointPipeline& swapByteOrder()
+		{
+			return then<pixel_t, internals::swapByteOrderOp<pixel_t> >();
+		}
+
+		PointPipeline& negate()
+		{
+			return then<pixel_t, internals::negateOp<pixel_t, pixel_t> >();
+		}
+
+		PointPipeline& abs()
+		{
+			return then<pixel_t, internals::absOp<pixel_t, pixel_t> >();
+		}
+
+#define DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(name) \
+		PointPipeline& name() \
+		{ \
+			return then<typename NumberUtils<pixel_t>::FloatType, internals::name##Op<pixel_t, typename NumberUtils<pixel_t>::FloatType> >(); \
+		}
+
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(exponentiate)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(square)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(squareRoot)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(log)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(negLog)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(log10)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(sin)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(cos)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(tan)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(inv)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(round)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(ceil)
+		DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE(floor)
+
+#undef DEF_PIPELINE_FLOAT_INTERMEDIATE_TYPE
+
+		template<typename param_t> PointPipeline& add(param_t r)
+		{
+			using intermediate_t = typename math_intermediate_type<pixel_t, param_t>::type;
+			return then<param_t, intermediate_t, internals::addOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& subtract(param_t r)
+		{
+			using intermediate_t = typename math_intermediate_type<pixel_t, param_t>::type;
+			return then<param_t, intermediate_t, internals::subtractOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& invsubtract(param_t r)
+		{
+			using intermediate_t = typename math_intermediate_type<pixel_t, param_t>::type;
+			return then<param_t, intermediate_t, internals::invsubtractOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& multiply(param_t r)
+		{
+			using intermediate_t = typename math_intermediate_type<pixel_t, param_t>::type;
+			return then<param_t, intermediate_t, internals::multiplyOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& divide(param_t r)
+		{
+			// NOTE: Float intermediate type as in divide function.
+			using intermediate_t = typename NumberUtils<pixel_t>::FloatType;
+			return then<param_t, intermediate_t, internals::divideOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& pow(param_t r)
+		{
+			using intermediate_t = typename NumberUtils<pixel_t>::FloatType;
+			return then<param_t, intermediate_t, internals::powOp<pixel_t, param_t, intermediate_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& max(param_t r)
+		{
+			return then<param_t, pixel_t, internals::maxOp<pixel_t, param_t, pixel_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& min(param_t r)
+		{
+			return then<param_t, pixel_t, internals::minOp<pixel_t, param_t, pixel_t> >(r);
+		}
+
+		template<typename param_t> PointPipeline& setValue(param_t value)
+		{
+			return then<pixel_t, pixel_t, internals::setValueOp<pixel_t> >(pixelRound<pixel_t>(value));
+		}
+
+		template<typename param_t> PointPipeline& threshold(param_t threshold)
+		{
+			return then<pixel_t, pixel_t, internals::thresholdOp<pixel_t, pixel_t> >(pixelRound<pixel_t>(threshold));
+		}
+
+		PointPipeline& thresholdRange(const Vec2d& range)
+		{
+			return then<Vec2d, pixel_t, internals::thresholdRangeOp<pixel_t> >(range);
+		}
+
+		PointPipeline& multiThreshold(const std::vector<pixel_t>& thresholds)
+		{
+			return then<const std::vector<pixel_t>&, pixel_t, internals::multiThresholdOp<pixel_t> >(thresholds);
+		}
+
+		PointPipeline& thresholdPeriodic(const Vec4d& inputs)
+		{
+			return then<const Vec4d&, pixel_t, internals::thresholdPeriodicOp<pixel_t> >(inputs);
+		}
+
+		PointPipeline& linearMap(const Vec4d& bounds)
+		{
+			return then<const Vec4d&, typename NumberUtils<pixel_t>::FloatType, internals::linearMapOp<pixel_t> >(bounds);
+		}
+
+		PointPipeline& replace(const Vec2<pixel_t>& v)
+		{
+			return then<Vec2<pixel_t>, pixel_t, internals::replaceOp<pixel_t> >(v);
+		}
+
+		/**
+		Adds operation to the pipeline by name.
+		Supported operations and their parameter counts are
+		add, subtract, invsubtract, multiply, divide, pow, max, min, set, threshold (1 parameter),
+		thresholdrange, doublethreshold, replace (2 parameters), linmap, thresholdperiodic (4 parameters),
+		and swapbyteorder, negate, abs, exponentiate, square, squareroot, log, neglog, log10, sin, cos, tan, inv, round, ceil, floor (no parameters).
+		The parameters have the same meaning than in the corresponding pi2 commands.
+		Only real pixel types are supported.
+		*/
+		PointPipeline& append(std::string name, const std::vector<double>& params)
+		{
+			toLower(name);
+			trim(name);
+
+			auto check = [&](size_t count)
+			{
+				if (params.size() != count)
+					throw ITLException(std::string("Point operation ") + name + " requires " + itl2::toString(count) + " parameter(s), but " + itl2::toString(params.size()) + " were given.");
+			};
+
+			if (name == "swapbyteorder") { check(0); return swapByteOrder(); }
+			if (name == "negate") { check(0); return negate(); }
+			if (name == "abs") { check(0); return abs(); }
+			if (name == "exponentiate") { check(0); return exponentiate(); }
+			if (name == "square") { check(0); return square(); }
+			if (name == "squareroot") { check(0); return squareRoot(); }
+			if (name == "log") { check(0); return log(); }
+			if (name == "neglog") { check(0); return negLog(); }
+			if (name == "log10") { check(0); return log10(); }
+			if (name == "sin") { check(0); return sin(); }
+			if (name == "cos") { check(0); return cos(); }
+			if (name == "tan") { check(0); return tan(); }
+			if (name == "inv") { check(0); return inv(); }
+			if (name == "round") { check(0); return round(); }
+			if (name == "ceil") { check(0); return ceil(); }
+			if (name == "floor") { check(0); return floor(); }
+
+			if (name == "add") { check(1); return add(params[0]); }
+			if (name == "subtract") { check(1); return subtract(params[0]); }
+			if (name == "invsubtract") { check(1); return invsubtract(params[0]); }
+			if (name == "multiply") { check(1); return multiply(params[0]); }
+			if (name == "divide") { check(1); return divide(params[0]); }
+			if (name == "pow") { check(1); return pow(params[0]); }
+			if (name == "max") { check(1); return max(params[0]); }
+			if (name == "min") { check(1); return min(params[0]); }
+			if (name == "set") { check(1); return setValue(params[0]); }
+			if (name == "threshold") { check(1); return threshold(params[0]); }
+
+			if (name == "thresholdrange") { check(2); return thresholdRange(Vec2d(params[0], params[1])); }
+			if (name == "doublethreshold") { check(2); return multiThreshold({ pixelRound<pixel_t>(params[0]), pixelRound<pixel_t>(params[1]) }); }
+			if (name == "replace") { check(2); return replace(Vec2<pixel_t>(pixelRound<pixel_t>(params[0]), pixelRound<pixel_t>(params[1]))); }
+
+			if (name == "linmap") { check(4); return linearMap(Vec4d(params[0], params[1], params[2], params[3])); }
+			if (name == "thresholdperiodic") { check(4); return thresholdPeriodic(Vec4d(params[0], params[1], params[2], params[3])); }
+
+			throw ITLException(std::string("Unsupported point operation: ") + name);
+		}
+
+		/**
+		Adds operations to the pipeline from a string of form "operation1(param1, param2, ...) | operation2 | operation3(param1) | ...".
+		See append for the list of supported operations.
+		*/
+		PointPipeline& append(const std::string& operations)
+		{
+			for (std::string item : split(operations, false, '|'))
+			{
+				std::string name = item;
+				std::vector<double> params;
+
+				size_t start = item.find('(');
+				if (start != std::string::npos)
+				{
+					size_t end = item.rfind(')');
+					if (end == std::string::npos || end < start)
+						throw ITLException(std::string("Expected closing bracket in point operation ") + item);
+
+					name = item.substr(0, start);
+					std::string paramString = item.substr(start + 1, end - start - 1);
+					trim(paramString);
+					if (paramString.length() > 0)
+						params = fromString<double>(split(paramString, true, ','));
+				}
+
+				append(name, params);
+			}
+
+			return *this;
+		}
+
+		/**
+		Runs all the operations in the pipeline on the given image.
+		*/
+		void run(Image<pixel_t>& img) const
+		{
+			if (stages.empty())
+				return;
+
+			pixel_t* data = img.getData();
+			coord_t pixelCount = img.pixelCount();
+			coord_t blockCount = (pixelCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+			#pragma omp parallel for if(!omp_in_parallel() && pixelCount > PARALLELIZATION_THRESHOLD)
+			for (coord_t b = 0; b < blockCount; b++)
+			{
+				coord_t start = b * BLOCK_SIZE;
+				coord_t count = std::min(BLOCK_SIZE, pixelCount - start);
+				for (const auto& stage : stages)
+					stage(data + start, count);
+
+				// Showing progress info here would induce more processing than is done in the whole loop.
+			}
+		}
+	};
+
+	/**
+	Runs operations defined in a string on the given image in a single pass.
+	See PointPipeline::append for the syntax of the operations string.
+	*/
+	template<typename pixel_t> void pointOperations(Image<pixel_t>& img, const std::string& operations)
+	{
+		PointPipeline<pixel_t> pipeline;
+		pipeline.append(operations);
+		pipeline.run(img);
+	}
+
+	namespace tests
+	{
+		void pointPipeline();
+		void pointPipelineSpeed();
+	}
+}
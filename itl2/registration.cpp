@@ -12,6 +12,8 @@
 #include "filters.h"
 #include "inpaint.h"
 #include "generation.h"
+#include "testutils.h"
+#include "timer.h"
 
 using namespace std;
 
@@ -584,5 +586,85 @@ namespace itl2
 			cout << "Reference point = " << p1 << endl;
 			cout << "Deformed point = " << points[0] << endl;
 		}
+
+		void blockMatchBatch()
+		{
+			// Random spheres on a non-zero background.
+			Image<float32_t> reference(120, 110, 100);
+			setValue(reference, 10.0f);
+			srand(5);
+			for (size_t n = 0; n < 800; n++)
+				draw(reference, Sphere<double>(Vec3d(rand() % 120, rand() % 110, rand() % 100), 3.0), 100.0f);
+
+			Image<float32_t> deformed(reference.dimensions());
+			translate(reference, deformed, Vec3d(2.3, -1.6, 3.2), LinearInterpolator<float32_t, float32_t>(BoundaryCondition::Zero));
+
+			// Missing values that must be inpainted.
+			draw(deformed, AABoxc::fromMinMax(Vec3c(0, 0, 0), Vec3c(30, 40, 25)), 0.0f);
+
+			PointGrid3D<coord_t> refGrid(PointGrid1D<coord_t>(5, 115, 12), PointGrid1D<coord_t>(5, 105, 12), PointGrid1D<coord_t>(5, 95, 12));
+			Vec3c pointCount = refGrid.pointCounts();
+			Image<Vec3d> initialPoints(pointCount);
+			for (coord_t z = 0; z < pointCount.z; z++)
+				for (coord_t y = 0; y < pointCount.y; y++)
+					for (coord_t x = 0; x < pointCount.x; x++)
+						initialPoints(x, y, z) = Vec3d(refGrid(x, y, z));
+
+			auto gridPoint = [&](coord_t n)
+				{
+					Vec3c p = indexToCoords(n, pointCount);
+					return refGrid(p.x, p.y, p.z);
+				};
+
+			for (size_t coarseBinning : { 1, 2 })
+			{
+				Vec3c coarseRadius(10, 10, 10);
+				Vec3c fineRadius(5, 5, 5);
+				string desc = string("coarse binning ") + toString(coarseBinning);
+
+				// Reference implementation, one point at a time.
+				Image<Vec3d> gtPoints(pointCount);
+				Image<float32_t> gtAccuracy(pointCount);
+				Timer timer;
+				timer.start();
+				#pragma omp parallel for if(!omp_in_parallel())
+				for (coord_t n = 0; n < gtPoints.pixelCount(); n++)
+				{
+					Vec3d defPoint = initialPoints(n);
+					double gof;
+					internals::blockMatchOnePointMultires(reference, deformed, coarseRadius, coarseBinning, fineRadius, 1, gridPoint(n), defPoint, gof);
+					gtPoints(n) = defPoint;
+					gtAccuracy(n) = (float32_t)gof;
+				}
+				timer.stop();
+				cout << "Block matching one point at a time took " << timer.getSeconds() << " s, " << desc << endl;
+
+				Image<Vec3d> defPoints(pointCount);
+				setValue(defPoints, initialPoints);
+				Image<float32_t> accuracy;
+				timer.start();
+				blockMatchMulti(reference, deformed, refGrid, defPoints, accuracy, coarseRadius, coarseBinning, fineRadius, 1);
+				timer.stop();
+				cout << "Block matching in batches took " << timer.getSeconds() << " s, " << desc << endl;
+
+				bool same = true;
+				for (coord_t n = 0; n < defPoints.pixelCount(); n++)
+				{
+					if ((defPoints(n) - gtPoints(n)).max() > 1e-6 || (defPoints(n) - gtPoints(n)).min() < -1e-6 || std::abs(accuracy(n) - gtAccuracy(n)) > 1e-6)
+						same = false;
+				}
+				testAssert(same, "batched block matching result, " + desc);
+
+				// Most of the shifts are found.
+				size_t correct = 0;
+				for (coord_t n = 0; n < defPoints.pixelCount(); n++)
+				{
+					Vec3d shift = defPoints(n) - Vec3d(gridPoint(n));
+					if ((shift - Vec3d(2.3, -1.6, 3.2)).norm() < 1)
+						correct++;
+				}
+				testAssert(correct > (size_t)defPoints.pixelCount() / 2, "batched block matching accuracy, " + desc);
+			}
+		}
 	}
 }
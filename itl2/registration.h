@@ -86,6 +86,196 @@ namespace itl2
 			if(accuracy > 0 && coarseBinning > fineBinning)
 				blockMatchOnePoint(reference, deformed, fineBlockRadius, refPoint, defPoint, accuracy, fineBinning);
 		}
+
+		/**
+		Count of points whose blocks are phase correlated together in block matching.
+		*/
+		constexpr size_t BLOCK_MATCH_BATCH_SIZE = 16;
+
+		/**
+		Temporary storage for block matching of one block size.
+		The buffers are allocated on first use and re-used for all batches of points, so one workspace should be kept per thread.
+		*/
+		struct BlockMatchWorkspace
+		{
+			std::unique_ptr<PhaseCorrelationBatch> correlator;
+			Image<float32_t> refBlockOrig;
+			Image<float32_t> defBlockOrig;
+			Image<float32_t> binnedBlock;
+			Image<float32_t> distance;
+			Image<Vec3c> nearest;
+			std::vector<Vec3c> defPointsRounded;
+			std::vector<Vec3d> shifts;
+			std::vector<double> goodness;
+
+			/**
+			Makes sure that the correlator processes blocks of given size.
+			*/
+			void ensureBlockSize(const Vec3c& blockSize)
+			{
+				if (!correlator || correlator->dimensions() != blockSize)
+					correlator = std::make_unique<PhaseCorrelationBatch>(blockSize, BLOCK_MATCH_BATCH_SIZE);
+			}
+		};
+
+		/*
+		Block matches a batch of points.
+		The result is the same than calling blockMatchOnePoint for each point, but the Fourier transforms of the whole batch are calculated together and
+		the temporary buffers are taken from the workspace.
+		NOTE: Assumes that zero pixels in the images represent unknown values. The unknown values are replaced by the nearest non-zero value.
+		@param count Count of points in the batch. Must not be greater than BLOCK_MATCH_BATCH_SIZE.
+		*/
+		template<typename ref_t, typename def_t> void blockMatchBatch(const Image<ref_t>& reference, const Image<def_t>& deformed, const Vec3c& blockRadius, size_t binningSize, const Vec3c* refPoints, Vec3d* defPoints, double* accuracy, size_t count, BlockMatchWorkspace& ws)
+		{
+			Vec3c r = blockRadius;
+			for (size_t n = reference.dimensionality(); n < 3; n++)
+				r[n] = 0;
+
+			Vec3c blockSize = 2 * r + Vec3c(1, 1, 1);
+
+			ws.defPointsRounded.resize(count);
+			ws.shifts.resize(count);
+			ws.goodness.resize(count);
+
+			for (size_t n = 0; n < count; n++)
+			{
+				ws.defPointsRounded[n] = round(defPoints[n]);
+
+				if (binningSize > 1)
+				{
+					ws.refBlockOrig.ensureSize(blockSize);
+					ws.defBlockOrig.ensureSize(blockSize);
+					getNeighbourhood(reference, refPoints[n], r, ws.refBlockOrig, BoundaryCondition::Zero);
+					getNeighbourhood(deformed, ws.defPointsRounded[n], r, ws.defBlockOrig, BoundaryCondition::Zero);
+
+					maskedBinning(ws.refBlockOrig, ws.binnedBlock, binningSize, (float32_t)0, (float32_t)0, false);
+					ws.ensureBlockSize(ws.binnedBlock.dimensions());
+					setValue(ws.correlator->reference(n), ws.binnedBlock);
+
+					maskedBinning(ws.defBlockOrig, ws.binnedBlock, binningSize, (float32_t)0, (float32_t)0, false);
+					setValue(ws.correlator->shifted(n), ws.binnedBlock);
+				}
+				else
+				{
+					ws.ensureBlockSize(blockSize);
+					getNeighbourhood(reference, refPoints[n], r, ws.correlator->reference(n), BoundaryCondition::Zero);
+					getNeighbourhood(deformed, ws.defPointsRounded[n], r, ws.correlator->shifted(n), BoundaryCondition::Zero);
+				}
+
+				// Set zeros to nearest non-zero value. This has effect particularly in the edges and corners of non-rectangular images.
+				inpaintNearest(ws.correlator->reference(n), (float32_t)0, ws.distance, ws.nearest);
+				inpaintNearest(ws.correlator->shifted(n), (float32_t)0, ws.distance, ws.nearest);
+			}
+
+			if (count > 0)
+				ws.correlator->correlate(count, r / binningSize, ws.shifts.data(), ws.goodness.data());
+
+			for (size_t n = 0; n < count; n++)
+			{
+				defPoints[n] = Vec3d(ws.defPointsRounded[n]) - ws.shifts[n] * (double)binningSize;
+				accuracy[n] = ws.goodness[n];
+			}
+		}
+
+		/**
+		Block matcher that first block matches with low resolution and then improves the result by block matching with full resolution,
+		processing the points in batches.
+		The result is the same than calling blockMatchOnePointMultires for each point.
+		The matcher stores temporary buffers that are re-used for all the batches, so one matcher should be created for each thread.
+		See blockMatchOnePointMultires for description of the parameters.
+		*/
+		template<typename ref_t, typename def_t> class BlockMatcher
+		{
+		private:
+			const Image<ref_t>& reference;
+			const Image<def_t>& deformed;
+			Vec3c coarseBlockRadius;
+			size_t coarseBinning;
+			Vec3c fineBlockRadius;
+			size_t fineBinning;
+
+			BlockMatchWorkspace coarse;
+			BlockMatchWorkspace fine;
+
+			/**
+			Points that are refined in the full-resolution phase, and their indices in the batch.
+			*/
+			std::vector<size_t> refineIndices;
+			std::vector<Vec3c> refineRefPoints;
+			std::vector<Vec3d> refineDefPoints;
+			std::vector<double> refineAccuracy;
+
+		public:
+			BlockMatcher(const Image<ref_t>& reference, const Image<def_t>& deformed, const Vec3c& coarseBlockRadius, size_t coarseBinning, const Vec3c& fineBlockRadius, size_t fineBinning) :
+				reference(reference),
+				deformed(deformed),
+				coarseBlockRadius(coarseBlockRadius),
+				coarseBinning(coarseBinning),
+				fineBlockRadius(fineBlockRadius),
+				fineBinning(fineBinning)
+			{
+			}
+
+			/**
+			Block matches a batch of at most BLOCK_MATCH_BATCH_SIZE points.
+			*/
+			void match(const Vec3c* refPoints, Vec3d* defPoints, double* accuracy, size_t count)
+			{
+				blockMatchBatch(reference, deformed, coarseBlockRadius, coarseBinning, refPoints, defPoints, accuracy, count, coarse);
+
+				if (coarseBinning > fineBinning)
+				{
+					refineIndices.clear();
+					refineRefPoints.clear();
+					refineDefPoints.clear();
+					for (size_t n = 0; n < count; n++)
+					{
+						if (accuracy[n] > 0)
+						{
+							refineIndices.push_back(n);
+							refineRefPoints.push_back(refPoints[n]);
+							refineDefPoints.push_back(defPoints[n]);
+						}
+					}
+					refineAccuracy.resize(refineIndices.size());
+
+					blockMatchBatch(reference, deformed, fineBlockRadius, fineBinning, refineRefPoints.data(), refineDefPoints.data(), refineAccuracy.data(), refineIndices.size(), fine);
+
+					for (size_t n = 0; n < refineIndices.size(); n++)
+					{
+						defPoints[refineIndices[n]] = refineDefPoints[n];
+						accuracy[refineIndices[n]] = refineAccuracy[n];
+					}
+				}
+			}
+		};
+
+		/**
+		Block matches all the given points in parallel.
+		See blockMatchOnePointMultires for description of the parameters. Set coarseBinning = fineBinning = 1 for single-resolution matching.
+		*/
+		template<typename ref_t, typename def_t> void blockMatchPoints(const Image<ref_t>& reference, const Image<def_t>& deformed, const std::vector<Vec3c>& refPoints, std::vector<Vec3d>& defPoints, std::vector<double>& accuracy,
+			const Vec3c& coarseBlockRadius, size_t coarseBinning,
+			const Vec3c& fineBlockRadius, size_t fineBinning)
+		{
+			coord_t batchCount = ((coord_t)refPoints.size() + BLOCK_MATCH_BATCH_SIZE - 1) / BLOCK_MATCH_BATCH_SIZE;
+
+			size_t counter = 0;
+			#pragma omp parallel if(!omp_in_parallel() && batchCount > 1)
+			{
+				BlockMatcher<ref_t, def_t> matcher(reference, deformed, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning);
+
+				#pragma omp for schedule(dynamic)
+				for (coord_t b = 0; b < batchCount; b++)
+				{
+					size_t start = b * BLOCK_MATCH_BATCH_SIZE;
+					size_t count = std::min(BLOCK_MATCH_BATCH_SIZE, refPoints.size() - start);
+					matcher.match(&refPoints[start], &defPoints[start], &accuracy[start], count);
+
+					showThreadProgress(counter, batchCount);
+				}
+			}
+		}
 	}
 
 	/*
@@ -106,14 +296,7 @@ namespace itl2
 		while (accuracy.size() < refPoints.size())
 			accuracy.push_back(0);
 
-		size_t counter = 0;
-		#pragma omp parallel for if(!omp_in_parallel())
-		for (coord_t n = 0; n < (coord_t)refPoints.size(); n++)
-		{
-			internals::blockMatchOnePoint(reference, deformed, blockRadius, refPoints[n], defPoints[n], accuracy[n]);
-
-			showThreadProgress(counter, refPoints.size());
-		}
+		internals::blockMatchPoints(reference, deformed, refPoints, defPoints, accuracy, blockRadius, 1, blockRadius, 1);
 	}
 
 	/*
@@ -245,38 +428,56 @@ namespace itl2
 		}
 	};
 
-	/*
-	Block matching for point grid and image output.
-	NOTE: Assumes that zero pixels in the images represent unknown values. The unknown values are replaced by the nearest non-zero value.
-	*/
-	template<typename ref_t, typename def_t> void blockMatch(const Image<ref_t>& reference, const Image<def_t>& deformed, const PointGrid3D<coord_t>& refGrid, Image<Vec3d>& defPoints, Image<float32_t>& accuracy, const Vec3c& blockRadius)
+	namespace internals
 	{
-		accuracy.ensureSize(refGrid.pointCounts());
-		defPoints.ensureSize(refGrid.pointCounts());
-
-		size_t counter = 0;
-		#pragma omp parallel for if(!omp_in_parallel())
-		for (coord_t z = 0; z < defPoints.depth(); z++)
+		/**
+		Block matches points of a grid in parallel.
+		@param refOffset, defOffset The grid points are shifted by refOffset and the deformed points by defOffset before block matching.
+		*/
+		template<typename ref_t, typename def_t> void blockMatchGrid(const Image<ref_t>& reference, const Image<def_t>& deformed, const PointGrid3D<coord_t>& refGrid, Image<Vec3d>& defPoints, Image<float32_t>& accuracy,
+			const Vec3c& coarseBlockRadius, size_t coarseBinning,
+			const Vec3c& fineBlockRadius, size_t fineBinning,
+			const Vec3c& refOffset = Vec3c(0, 0, 0), const Vec3d& defOffset = Vec3d(0, 0, 0))
 		{
-			for (coord_t y = 0; y < defPoints.height(); y++)
+			accuracy.ensureSize(refGrid.pointCounts());
+			defPoints.ensureSize(refGrid.pointCounts());
+
+			std::vector<Vec3c> refList;
+			std::vector<Vec3d> defList;
+			refList.reserve(defPoints.pixelCount());
+			defList.reserve(defPoints.pixelCount());
+			for (coord_t z = 0; z < defPoints.depth(); z++)
 			{
-				for (coord_t x = 0; x < defPoints.width(); x++)
+				for (coord_t y = 0; y < defPoints.height(); y++)
 				{
-					Vec3c refPoint = refGrid(x, y, z);
-					Vec3d defPoint = defPoints(x, y, z);
-					double gof;
-
-					internals::blockMatchOnePoint(reference, deformed, blockRadius, refPoint, defPoint, gof);
-
-					defPoints(x, y, z) = defPoint;
-					accuracy(x, y, z) = (float32_t)gof;
+					for (coord_t x = 0; x < defPoints.width(); x++)
+					{
+						refList.push_back(refGrid(x, y, z) + refOffset);
+						defList.push_back(defPoints(x, y, z) + defOffset);
+					}
 				}
+			}
+			std::vector<double> accuracyList(refList.size());
+
+			blockMatchPoints(reference, deformed, refList, defList, accuracyList, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning);
 
-				showThreadProgress(counter, defPoints.depth() * defPoints.height());
+			for (coord_t n = 0; n < defPoints.pixelCount(); n++)
+			{
+				defPoints(n) = defList[n] - defOffset;
+				accuracy(n) = (float32_t)accuracyList[n];
 			}
 		}
 	}
 
+	/*
+	Block matching for point grid and image output.
+	NOTE: Assumes that zero pixels in the images represent unknown values. The unknown values are replaced by the nearest non-zero value.
+	*/
+	template<typename ref_t, typename def_t> void blockMatch(const Image<ref_t>& reference, const Image<def_t>& deformed, const PointGrid3D<coord_t>& refGrid, Image<Vec3d>& defPoints, Image<float32_t>& accuracy, const Vec3c& blockRadius)
+	{
+		internals::blockMatchGrid(reference, deformed, refGrid, defPoints, accuracy, blockRadius, 1, blockRadius, 1);
+	}
+
 
 	/*
 	Block matching for point grid and image output.
@@ -286,30 +487,7 @@ namespace itl2
 		const Vec3c& coarseBlockRadius, size_t coarseBinning,
 		const Vec3c& fineBlockRadius, size_t fineBinning)
 	{
-		accuracy.ensureSize(refGrid.pointCounts());
-		defPoints.ensureSize(refGrid.pointCounts());
-
-		size_t counter = 0;
-#pragma omp parallel for if(!omp_in_parallel())
-		for (coord_t z = 0; z < defPoints.depth(); z++)
-		{
-			for (coord_t y = 0; y < defPoints.height(); y++)
-			{
-				for (coord_t x = 0; x < defPoints.width(); x++)
-				{
-					Vec3c refPoint = refGrid(x, y, z);
-					Vec3d defPoint = defPoints(x, y, z);
-					double gof;
-
-					internals::blockMatchOnePointMultires(reference, deformed, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning, refPoint, defPoint, gof);
-
-					defPoints(x, y, z) = defPoint;
-					accuracy(x, y, z) = (float32_t)gof;
-				}
-
-				showThreadProgress(counter, defPoints.depth() * defPoints.height());
-			}
-		}
+		internals::blockMatchGrid(reference, deformed, refGrid, defPoints, accuracy, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning);
 	}
 
 	/*
@@ -388,27 +566,7 @@ namespace itl2
 		//std::cout << "Initial translation = " << mipTranslation << std::endl;
 
 
-		size_t counter = 0;
-		#pragma omp parallel for if(!omp_in_parallel())
-		for (coord_t z = 0; z < defPoints.depth(); z++)
-		{
-			for (coord_t y = 0; y < defPoints.height(); y++)
-			{
-				for (coord_t x = 0; x < defPoints.width(); x++)
-				{
-					Vec3c refPoint = refGrid(x, y, z) - refStart;
-					Vec3d defPoint = defPoints(x, y, z) - Vec3d(defStart);
-					double gof;
-
-					internals::blockMatchOnePointMultires(referenceBlock, deformedBlock, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning, refPoint, defPoint, gof);
-
-					defPoints(x, y, z) = defPoint + Vec3d(defStart);
-					accuracy(x, y, z) = (float32_t)gof;
-				}
-
-				showThreadProgress(counter, defPoints.depth() * defPoints.height());
-			}
-		}
+		internals::blockMatchGrid(referenceBlock, deformedBlock, refGrid, defPoints, accuracy, coarseBlockRadius, coarseBinning, fineBlockRadius, fineBinning, -refStart, -Vec3d(defStart));
 	}
 
 	/*
@@ -421,8 +579,9 @@ namespace itl2
 	{
 		/*
 		Calculates coordinates of a point in deformed image corresponding to a point in reference coordinates.
+		The interpolator is a template parameter so that concrete interpolator types are called without virtual function calls.
 		*/
-		template<typename real_t> Vec3<real_t> projectPointToDeformed(const Vec3<real_t>& xRef, const PointGrid3D<coord_t>& refPoints, const Image<Vec3<real_t> >& defPoints, const Interpolator<Vec3<real_t>, Vec3<real_t>, real_t>& interpolator)
+		template<typename real_t, class interpolator_t> Vec3<real_t> projectPointToDeformed(const Vec3<real_t>& xRef, const PointGrid3D<coord_t>& refPoints, const Image<Vec3<real_t> >& defPoints, const interpolator_t& interpolator)
 		{
 			real_t fx = (real_t)refPoints.xg.getIndex(xRef.x);
 			real_t fy = (real_t)refPoints.yg.getIndex(xRef.y);
@@ -501,25 +660,13 @@ namespace itl2
 
 		LinearInterpolator<Vec3d, Vec3d, double, Vec3d> shiftInterpolator(BoundaryCondition::Nearest);
 
-		size_t counter = 0;
-		#pragma omp parallel for if(pullback.pixelCount() > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
-		for (coord_t z = 0; z < pullback.depth(); z++)
-		{
-			for (coord_t y = 0; y < pullback.height(); y++)
+		resample(deformed, pullback, interpolator, [&](coord_t x, coord_t y, coord_t z)
 			{
-				for (coord_t x = 0; x < pullback.width(); x++)
-				{
-					Vec3d xRef((double)x, (double)y, (double)z);
-					Vec3d shift = internals::projectPointToDeformed(xRef, refGrid, shifts, shiftInterpolator);
-					
-					Vec3d xDef = xRef + shift;
-					result_t val = interpolator(deformed, xDef);
-					pullback(x, y, z) = val;
-				}
-			}
-
-			showThreadProgress(counter, pullback.depth());
-		}
+				Vec3d xRef((double)x, (double)y, (double)z);
+				Vec3d shift = internals::projectPointToDeformed(xRef, refGrid, shifts, shiftInterpolator);
+				return xRef + shift;
+			},
+			true);
 	}
 
 	/*
@@ -544,5 +691,6 @@ namespace itl2
 		void blockMatch2Pullback();
 		void mipMatch();
 		void pointsToDeformed();
+		void blockMatchBatch();
 	}
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+
+#include "runningsumfilters.h"
+
+#include "filters.h"
+#include "noise.h"
+#include "pointprocess.h"
+#include "projections.h"
+#include "stringutils.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
+
+namespace itl2
+{
+	namespace tests
+	{
+		template<typename pixel_t, typename out_t> void runningSumCase(const Vec3c& size, const Vec3c& r, BoundaryCondition bc, double mean, double stddev, double tolerance)
+		{
+			Image<pixel_t> img(size);
+			add(img, mean);
+			noise(img, 0, stddev, 42);
+
+			string desc = string(" ") + toString(size) + ", r = " + toString(r) + ", " + toString(bc) + ", " + toString(img.dataType());
+
+			Image<out_t> gt, res;
+			filter<pixel_t, out_t, internals::meanOp<pixel_t> >(img, gt, r, NeighbourhoodType::Rectangular, bc);
+			internals::runningSumFilter<pixel_t, out_t>(img, res, r, bc, internals::RunningSumStatistic::Mean);
+			checkDifference(gt, res, "mean" + desc, tolerance);
+
+			filter<pixel_t, out_t, internals::varianceOp<pixel_t> >(img, gt, r, NeighbourhoodType::Rectangular, bc);
+			internals::runningSumFilter<pixel_t, out_t>(img, res, r, bc, internals::RunningSumStatistic::Variance);
+			// Relative tolerance as the variance is large near the edges if the boundary condition is Zero.
+			checkDifference(gt, res, "variance" + desc, tolerance * stddev + 1e-5 * max(gt));
+
+			filter<pixel_t, out_t, internals::stddevOp<pixel_t> >(img, gt, r, NeighbourhoodType::Rectangular, bc);
+			internals::runningSumFilter<pixel_t, out_t>(img, res, r, bc, internals::RunningSumStatistic::StdDev);
+			checkDifference(gt, res, "stddev" + desc, tolerance);
+		}
+
+		void runningSumFilters()
+		{
+			for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+			{
+				// Large mean and small deviation test numerical stability of the variance calculation.
+				runningSumCase<float32_t, float32_t>(Vec3c(40, 30, 20), Vec3c(2, 3, 1), bc, 10000, 10, 1e-2);
+				runningSumCase<float32_t, float32_t>(Vec3c(7, 30, 20), Vec3c(5, 2, 4), bc, 0, 100, 1e-2);
+				runningSumCase<float32_t, float32_t>(Vec3c(60, 50, 1), Vec3c(4, 4, 4), bc, 100, 10, 1e-2);
+				runningSumCase<float32_t, float32_t>(Vec3c(60, 1, 1), Vec3c(4, 4, 4), bc, 100, 10, 1e-2);
+				// Less slices than threads, so the slabs are divided in the y-direction.
+				runningSumCase<float32_t, float32_t>(Vec3c(40, 57, 2), Vec3c(3, 5, 1), bc, 100, 10, 1e-2);
+
+				// Integer output may differ by one due to different rounding of the intermediate results.
+				runningSumCase<uint8_t, uint8_t>(Vec3c(40, 30, 20), Vec3c(3, 3, 3), bc, 100, 30, 1);
+				runningSumCase<uint16_t, float32_t>(Vec3c(40, 30, 20), Vec3c(3, 1, 2), bc, 1000, 300, 1e-2);
+				runningSumCase<int16_t, int16_t>(Vec3c(30, 20, 10), Vec3c(1, 4, 2), bc, 0, 300, 1);
+			}
+
+			// Check that the public filters select the running sum version for rectangular neighbourhoods.
+			Image<uint16_t> img(50, 40, 30);
+			add(img, 1000);
+			noise(img, 0, 300, 321);
+			Image<float32_t> gt, res;
+			filter<uint16_t, float32_t, internals::stddevOp<uint16_t> >(img, gt, Vec3c(3, 3, 3), NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			stddevFilter(img, res, 3, NeighbourhoodType::Rectangular);
+			checkDifference(gt, res, "stddevFilter", 1e-2);
+
+			filter<uint16_t, float32_t, internals::varianceOp<uint16_t> >(img, gt, Vec3c(3, 3, 3), NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			varianceFilter(img, res, 3, NeighbourhoodType::Rectangular);
+			checkDifference(gt, res, "varianceFilter", 5);
+
+			filter<uint16_t, float32_t, internals::meanOp<uint16_t> >(img, gt, Vec3c(3, 3, 3), NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			meanFilter(img, res, 3, NeighbourhoodType::Rectangular);
+			checkDifference(gt, res, "meanFilter", 1e-2);
+
+			// Non-finite values are processed with the generic filter so that they affect only their own neighbourhood.
+			Image<float32_t> nanImg(30, 20, 10);
+			add(nanImg, 100);
+			noise(nanImg, 0, 10, 5);
+			nanImg(15, 10, 5) = std::numeric_limits<float32_t>::quiet_NaN();
+			nanImg(3, 3, 3) = std::numeric_limits<float32_t>::infinity();
+			testAssert(!internals::runningSumFilter<float32_t, float32_t>(nanImg, res, Vec3c(2, 2, 2), BoundaryCondition::Nearest, internals::RunningSumStatistic::Mean), "running sum filter rejects non-finite values");
+			filter<float32_t, float32_t, internals::meanOp<float32_t> >(nanImg, gt, Vec3c(2, 2, 2), NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			meanFilter(nanImg, res, 2, NeighbourhoodType::Rectangular);
+			bool same = true;
+			for (coord_t n = 0; n < gt.pixelCount(); n++)
+			{
+				if (gt(n) != res(n) && !(std::isnan(gt(n)) && std::isnan(res(n))))
+					same = false;
+			}
+			testAssert(same, "meanFilter with non-finite values");
+			testAssert(std::isfinite(res(25, 15, 0)), "non-finite values do not spread");
+		}
+
+		void runningSumFiltersSpeed()
+		{
+			Image<float32_t> img(100, 100, 100);
+			add(img, 1000);
+			noise(img, 0, 100, 1);
+
+			Image<float32_t> gt, res;
+			coord_t r = 10;
+
+			Timer timer;
+			timer.start();
+			filter<float32_t, float32_t, internals::stddevOp<float32_t> >(img, gt, Vec3c(r, r, r), NeighbourhoodType::Rectangular, BoundaryCondition::Nearest);
+			timer.stop();
+			cout << "Generic standard deviation filter took " << timer.getTime() << " ms" << endl;
+
+			timer.start();
+			stddevFilter(img, res, r, NeighbourhoodType::Rectangular);
+			timer.stop();
+			cout << "Running sum standard deviation filter took " << timer.getTime() << " ms" << endl;
+
+			checkDifference(gt, res, "running sum standard deviation", 1e-2);
+		}
+	}
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include "image.h"
+#include "boundarycondition.h"
+#include "utilities.h"
+#include "math/vec3.h"
+#include "math/numberutils.h"
+
+#include <vector>
+#include <cmath>
+#include <type_traits>
+#include <algorithm>
+
+namespace itl2
+{
+	namespace internals
+	{
+		/**
+		Tests if mean, variance and standard deviation filters of pixel type pixel_t can be calculated using running sums.
+		*/
+		template<typename pixel_t> constexpr bool supportsRunningSumFilter()
+		{
+			return std::is_arithmetic_v<pixel_t>;
+		}
+
+		/**
+		Enumerates statistics that can be calculated with runningSumFilter.
+		*/
+		enum class RunningSumStatistic
+		{
+			Mean,
+			Variance,
+			StdDev
+		};
+
+		/**
+		Calculates mean, variance or standard deviation filtering in rectangular neighbourhood using running sums of
+		pixel values and their squares. The cost per pixel does not depend on the size of the neighbourhood.
+
+		The image is divided into z-directional slabs, and if there are less slices than threads, the slabs are further
+		divided into y-directional bands. The pieces are processed in parallel.
+		In each piece, sums over the z-directional window are updated incrementally when moving from one plane to the next,
+		and the plane of z-sums is then filtered with running sums in y- and x-directions.
+		The sums are accumulated in double precision, and the mean of the image is subtracted from all the values
+		before accumulation in order to avoid catastrophic cancellation when calculating the variance.
+
+		The result equals to that of the generic filter function with meanOp, varianceOp or stddevOp and rectangular neighbourhood,
+		up to floating point rounding.
+		A single NaN or infinite pixel would make all the running sums non-finite, so such images are not processed.
+		@return False if the input image contains non-finite values, in which case the output is not calculated, and the generic filter should be used instead.
+		*/
+		template<typename pixel_t, typename out_t> bool runningSumFilter(const Image<pixel_t>& in, Image<out_t>& out, Vec3c nbRadius, BoundaryCondition bc, RunningSumStatistic stat)
+		{
+			static_assert(supportsRunningSumFilter<pixel_t>(), "Running sum filters support only real pixel data types.");
+
+			if (bc != BoundaryCondition::Zero && bc != BoundaryCondition::Nearest)
+				throw ITLException("Unsupported boundary condition.");
+
+			out.mustNotBe(in);
+			out.ensureSize(in);
+
+			// Zero radius in those dimensions that are not in use
+			for (size_t n = in.dimensionality(); n < nbRadius.size(); n++)
+				nbRadius[n] = 0;
+
+			const coord_t w = in.width();
+			const coord_t h = in.height();
+			const coord_t d = in.depth();
+			const coord_t rx = nbRadius.x;
+			const coord_t ry = nbRadius.y;
+			const coord_t rz = nbRadius.z;
+			const double Nz = (double)(2 * rz + 1);
+			const double Nyz = (double)(2 * ry + 1) * Nz;
+			const double N = (double)(2 * rx + 1) * Nyz;
+
+			// Shift all values by the mean of the image for numerical stability.
+			double K = 0;
+			#pragma omp parallel for if(!omp_in_parallel() && in.pixelCount() > PARALLELIZATION_THRESHOLD) reduction(+:K)
+			for (coord_t i = 0; i < in.pixelCount(); i++)
+				K += (double)in(i);
+			K /= (double)in.pixelCount();
+
+			if (!std::isfinite(K))
+				return false;
+
+			// Value of out-of-bounds pixels in the shifted coordinates, when the boundary condition is Zero.
+			const double c = -K;
+
+			size_t counter = 0;
+			#pragma omp parallel if(!omp_in_parallel() && in.pixelCount() > PARALLELIZATION_THRESHOLD)
+			{
+				// Sums of values and squared values over the z-directional window, for each (x, y).
+				std::vector<double> zs1(w * h), zs2(w * h);
+
+				// Sums of zs1 and zs2 over the y-directional window, for one row.
+				std::vector<double> ys1(w), ys2(w);
+
+				// Adds (sign = 1) or removes (sign = -1) rows [ya, yb[ of plane z to/from z-sums.
+				auto updatePlane = [&](coord_t z, coord_t ya, coord_t yb, double sign)
+				{
+					if (z < 0 || z >= d)
+					{
+						if (bc == BoundaryCondition::Zero)
+						{
+							for (coord_t i = ya * w; i < yb * w; i++)
+							{
+								zs1[i] += sign * c;
+								zs2[i] += sign * c * c;
+							}
+							return;
+						}
+						z = z < 0 ? 0 : d - 1;
+					}
+
+					const pixel_t* p = &in(0, 0, z);
+					for (coord_t i = ya * w; i < yb * w; i++)
+					{
+						double v = (double)p[i] - K;
+						zs1[i] += sign * v;
+						zs2[i] += sign * v * v;
+					}
+				};
+
+				// Adds (sign = 1) or removes (sign = -1) row y of z-sums to/from y-sums.
+				auto updateRow = [&](coord_t y, double sign)
+				{
+					if (y < 0 || y >= h)
+					{
+						if (bc == BoundaryCondition::Zero)
+						{
+							for (coord_t x = 0; x < w; x++)
+							{
+								ys1[x] += sign * Nz * c;
+								ys2[x] += sign * Nz * c * c;
+							}
+							return;
+						}
+						y = y < 0 ? 0 : h - 1;
+					}
+
+					const double* p1 = &zs1[y * w];
+					const double* p2 = &zs2[y * w];
+					for (coord_t x = 0; x < w; x++)
+					{
+						ys1[x] += sign * p1[x];
+						ys2[x] += sign * p2[x];
+					}
+				};
+
+				// Gets y-sums at given x-coordinate, taking boundary condition into account.
+				auto column = [&](coord_t x, double& s1, double& s2)
+				{
+					if (x < 0 || x >= w)
+					{
+						if (bc == BoundaryCondition::Zero)
+						{
+							s1 = Nyz * c;
+							s2 = Nyz * c * c;
+							return;
+						}
+						x = x < 0 ? 0 : w - 1;
+					}
+					s1 = ys1[x];
+					s2 = ys2[x];
+				};
+
+				auto result = [&](double s1, double s2)
+				{
+					if (stat == RunningSumStatistic::Mean)
+						return s1 / N + K;
+
+					double var = (s2 - s1 * s1 / N) / (N - 1);
+					if (var < 0)
+						var = 0;
+					if (stat == RunningSumStatistic::Variance)
+						return var;
+					return std::sqrt(var);
+				};
+
+				// Divide the image into slabs, one for each thread.
+				// If there are not enough slices (e.g. in 2D images), divide the slabs further in the y-direction.
+				coord_t slabCount = std::min<coord_t>(d, omp_get_num_threads());
+				coord_t bandCount = std::clamp<coord_t>(omp_get_num_threads() / slabCount, 1, h);
+				#pragma omp for schedule(static)
+				for (coord_t piece = 0; piece < slabCount * bandCount; piece++)
+				{
+					coord_t slab = piece / bandCount;
+					coord_t band = piece % bandCount;
+					coord_t z0 = slab * d / slabCount;
+					coord_t z1 = (slab + 1) * d / slabCount;
+					coord_t y0 = band * h / bandCount;
+					coord_t y1 = (band + 1) * h / bandCount;
+
+					// Rows of z-sums that are needed for the y-sums of rows [y0, y1[.
+					coord_t ya = std::max<coord_t>(0, y0 - ry);
+					coord_t yb = std::min<coord_t>(h, y1 + ry);
+
+					std::fill(zs1.begin(), zs1.end(), 0.0);
+					std::fill(zs2.begin(), zs2.end(), 0.0);
+					for (coord_t zz = z0 - rz; zz <= z0 + rz; zz++)
+						updatePlane(zz, ya, yb, 1);
+
+					for (coord_t z = z0; z < z1; z++)
+					{
+						if (z > z0)
+						{
+							updatePlane(z + rz, ya, yb, 1);
+							updatePlane(z - rz - 1, ya, yb, -1);
+						}
+
+						std::fill(ys1.begin(), ys1.end(), 0.0);
+						std::fill(ys2.begin(), ys2.end(), 0.0);
+						for (coord_t yy = y0 - ry; yy <= y0 + ry; yy++)
+							updateRow(yy, 1);
+
+						for (coord_t y = y0; y < y1; y++)
+						{
+							if (y > y0)
+							{
+								updateRow(y + ry, 1);
+								updateRow(y - ry - 1, -1);
+							}
+
+							double s1 = 0, s2 = 0;
+							for (coord_t xx = -rx; xx <= rx; xx++)
+							{
+								double a1, a2;
+								column(xx, a1, a2);
+								s1 += a1;
+								s2 += a2;
+							}
+
+							out_t* outLine = &out(0, y, z);
+							for (coord_t x = 0; x < w; x++)
+							{
+								if (x > 0)
+								{
+									double a1, a2, r1, r2;
+									column(x + rx, a1, a2);
+									column(x - rx - 1, r1, r2);
+									s1 += a1 - r1;
+									s2 += a2 - r2;
+								}
+
+								outLine[x] = pixelRound<out_t>((typename NumberUtils<pixel_t>::FloatType)result(s1, s2));
+							}
+						}
+
+						showThreadProgress(counter, d * bandCount);
+					}
+				}
+			}
+
+			return true;
+		}
+	}
+
+	namespace tests
+	{
+		void runningSumFilters();
+		void runningSumFiltersSpeed();
+	}
+}
@@ -2,6 +2,13 @@
 #include "stitching.h"
 #include <cmath>
 
+#include "filters.h"
+#include "noise.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
 namespace itl2
 {
 	namespace tests
@@ -64,6 +71,123 @@ namespace itl2
 		//	raw::writed(output, "./stitching/simple2_out");
 		//}
 
+		/**
+		Stitches one image without mean normalization and standard deviation, interpolating the shifts from the
+		shift grid separately at each pixel, as in stitchOneVer3 before the dense shift field.
+		*/
+		void referenceStitchOne(const Image<uint16_t>& src, const PointGrid3D<coord_t>& refPoints, const Image<Vec3f>& shifts, Image<float32_t>& mean, Image<float32_t>& weight)
+		{
+			const Interpolator<float32_t, uint16_t, float32_t>& interpolator = CubicInvalidValueInterpolator<float32_t, uint16_t, float32_t>(BoundaryCondition::Zero, 0, 0);
+			const Interpolator<Vec3f, Vec3f, float32_t>& shiftInterpolator = CubicInterpolator<Vec3f, Vec3f, float32_t, Vec3f>(BoundaryCondition::Nearest);
+
+			Vec3c srcDimensions = src.dimensions();
+			coord_t s = srcDimensions.min();
+
+			for (coord_t z = refPoints.zg.first; z < std::min(refPoints.zg.maximum, mean.depth()); z++)
+			{
+				for (coord_t y = refPoints.yg.first; y < std::min(refPoints.yg.maximum, mean.height()); y++)
+				{
+					for (coord_t x = refPoints.xg.first; x < std::min(refPoints.xg.maximum, mean.width()); x++)
+					{
+						Vec3f X((float32_t)x, (float32_t)y, (float32_t)z);
+						Vec3f p = X + internals::projectPointToDeformed(X, refPoints, shifts, shiftInterpolator);
+
+						if (src.isInImage(p))
+						{
+							float32_t pix = interpolator(src, p);
+							if (pix != 0)
+							{
+								float32_t w1 = 2 * std::min(p.x, srcDimensions.x - 1 - p.x) / s;
+								float32_t w2 = 2 * std::min(p.y, srcDimensions.y - 1 - p.y) / s;
+								float32_t w3 = 2 * std::min(p.z, srcDimensions.z - 1 - p.z) / s;
+								float32_t ww = w1 * w2 * w3;
+
+								if (ww > 0)
+								{
+									float32_t& wSum = weight(x, y, z);
+									wSum += ww;
+									float32_t& m = mean(x, y, z);
+									m = m + (ww / wSum) * (pix - m);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		void stitchShiftField()
+		{
+			Image<float32_t> noiseImg(120, 110, 100);
+			noise(noiseImg, 1000.0, 200.0, 17);
+			Image<float32_t> smooth;
+			gaussFilter(noiseImg, smooth, 2.0);
+			Image<uint16_t> src(smooth.dimensions());
+			setValue(src, smooth);
+
+			PointGrid3D<coord_t> refPoints(PointGrid1D<coord_t>(5, 115, 20), PointGrid1D<coord_t>(5, 105, 25), PointGrid1D<coord_t>(5, 95, 30));
+			Image<Vec3f> shifts(refPoints.xg.pointCount(), refPoints.yg.pointCount(), refPoints.zg.pointCount());
+			srand(31);
+			for (coord_t n = 0; n < shifts.pixelCount(); n++)
+				shifts(n) = Vec3f((float32_t)(rand() % 200 - 100) / 100, (float32_t)(rand() % 200 - 100) / 100, (float32_t)(rand() % 200 - 100) / 100);
+
+			Image<float32_t> gtMean(src.dimensions());
+			Image<float32_t> gtWeight(src.dimensions());
+			Timer timer;
+			timer.start();
+			referenceStitchOne(src, refPoints, shifts, gtMean, gtWeight);
+			timer.stop();
+			cout << "Per-pixel shift interpolation took " << timer.getSeconds() << " s" << endl;
+
+			for (coord_t fieldStep : { 1, 4 })
+			{
+				Image<float32_t> mean(src.dimensions());
+				Image<float32_t> weight(src.dimensions());
+				timer.start();
+				internals::stitchOneVer3<uint16_t, float32_t>(src, refPoints, shifts, 0, 1, 0, Vec3c(0, 0, 0), mean, weight, nullptr, false, fieldStep);
+				timer.stop();
+				cout << "Shift field with step " << fieldStep << " took " << timer.getSeconds() << " s" << endl;
+
+				// The pixel values change up to about 20 units per pixel.
+				double tolerance = fieldStep == 1 ? 0.01 : 2.0;
+				checkDifference(mean, gtMean, "stitched image, shift field step " + toString(fieldStep), tolerance);
+				checkDifference(weight, gtWeight, "stitching weight, shift field step " + toString(fieldStep), tolerance / 100);
+			}
+
+			// Accuracy of the shift field.
+			const Interpolator<Vec3f, Vec3f, float32_t>& shiftInterpolator = CubicInterpolator<Vec3f, Vec3f, float32_t, Vec3f>(BoundaryCondition::Nearest);
+			Vec3c start(refPoints.xg.first, refPoints.yg.first, refPoints.zg.first);
+			Vec3c end(refPoints.xg.maximum, refPoints.yg.maximum, refPoints.zg.maximum);
+			for (coord_t fieldStep : { 1, 4, 8 })
+			{
+				Image<Vec3f> field;
+				internals::createShiftField(refPoints, shifts, start, end, fieldStep, field);
+
+				float32_t maxError = 0;
+				vector<Vec3f> row;
+				for (coord_t z = start.z; z < end.z; z++)
+				{
+					for (coord_t y = start.y; y < end.y; y++)
+					{
+						internals::shiftFieldRow(field, fieldStep, y - start.y, z - start.z, row);
+						for (coord_t x = start.x; x < end.x; x++)
+						{
+							coord_t i0 = (x - start.x) / fieldStep;
+							float32_t t = (float32_t)(x - start.x - i0 * fieldStep) / fieldStep;
+							Vec3f shift = row[i0] * (1 - t) + row[std::min(i0 + 1, field.width() - 1)] * t;
+							Vec3f X((float32_t)x, (float32_t)y, (float32_t)z);
+							Vec3f gt = internals::projectPointToDeformed(X, refPoints, shifts, shiftInterpolator);
+							maxError = std::max(maxError, (shift - gt).max());
+							maxError = std::max(maxError, (gt - shift).max());
+						}
+					}
+				}
+
+				cout << "Maximum shift error with step " << fieldStep << " = " << maxError << " pixels" << endl;
+				testAssert(maxError < 0.01f * fieldStep * fieldStep, "shift field accuracy, step " + toString(fieldStep));
+			}
+		}
+
 		void stitchFiles()
 		{
 
@@ -880,6 +880,138 @@ namespace itl2
 		//	}
 		//}
 
+		/*
+		Cubic interpolation weight function in 1D, with sharpness 0.5 (see CubicInterpolator).
+		*/
+		template<typename real_t> real_t cubicWeight(real_t x)
+		{
+			const real_t a = (real_t)0.5;
+
+			if (x < 0)
+				x = -x;
+
+			if (x < 1)
+				return (-a + 2) * x * x * x + (a - 3) * x * x + 1;
+			else if (x < 2)
+				return -a * x * x * x + 5 * a * x * x - 8 * a * x + 4 * a;
+
+			return 0;
+		}
+
+		/*
+		Calculates indices of grid points and the corresponding cubic interpolation weights needed to evaluate values
+		interpolated from the given point grid at positions start, start + step, start + 2 * step, ..., along one dimension.
+		The indices are clamped to range [0, gridPointCount - 1] (nearest boundary condition).
+		@param indices, weights At output, 4 indices and weights for each position.
+		*/
+		template<typename real_t> void cubicGridWeights(const PointGrid1D<coord_t>& grid, coord_t gridPointCount, coord_t start, coord_t step, coord_t count, std::vector<coord_t>& indices, std::vector<real_t>& weights)
+		{
+			indices.resize(4 * count);
+			weights.resize(4 * count);
+			for (coord_t n = 0; n < count; n++)
+			{
+				real_t f = (real_t)grid.getIndex((real_t)(start + n * step));
+				coord_t u0 = (coord_t)floor(f);
+				for (coord_t i = 0; i <= 3; i++)
+				{
+					coord_t u = u0 - 1 + i;
+					weights[4 * n + i] = cubicWeight<real_t>(f - u);
+					indices[4 * n + i] = std::max<coord_t>(0, std::min<coord_t>(u, gridPointCount - 1));
+				}
+			}
+		}
+
+		/*
+		Calculates dense shift field in region [start, end[ of the reference (output) image, sampled at every step pixels.
+		The shifts are cubic interpolated from the shifts defined at the given point grid, i.e. the values
+		are the same than those given by projectPointToDeformed with CubicInterpolator and nearest boundary condition.
+		The interpolation is separable, so each field point costs only a few operations.
+		Point (i, j, k) of the field corresponds to reference image position start + step * (i, j, k).
+		The field covers the whole region, i.e. its last point in each dimension is at or after end - 1.
+		*/
+		template<typename real_t> void createShiftField(const PointGrid3D<coord_t>& refPoints, const Image<Vec3<real_t> >& shifts, const Vec3c& start, const Vec3c& end, coord_t step, Image<Vec3<real_t> >& field)
+		{
+			Vec3c fieldSize;
+			for (size_t n = 0; n < 3; n++)
+				fieldSize[n] = (std::max<coord_t>(end[n] - start[n], 1) - 1 + step - 1) / step + 1;
+
+			field.ensureSize(fieldSize);
+
+			std::vector<coord_t> ix, iy, iz;
+			std::vector<real_t> wx, wy, wz;
+			cubicGridWeights(refPoints.xg, shifts.width(), start.x, step, fieldSize.x, ix, wx);
+			cubicGridWeights(refPoints.yg, shifts.height(), start.y, step, fieldSize.y, iy, wy);
+			cubicGridWeights(refPoints.zg, shifts.depth(), start.z, step, fieldSize.z, iz, wz);
+
+			// Interpolate in x, y, and z directions in turn.
+			Image<Vec3<real_t> > tmpX(fieldSize.x, shifts.height(), shifts.depth());
+			for (coord_t z = 0; z < tmpX.depth(); z++)
+			{
+				for (coord_t y = 0; y < tmpX.height(); y++)
+				{
+					for (coord_t x = 0; x < tmpX.width(); x++)
+					{
+						Vec3<real_t> p;
+						for (size_t i = 0; i < 4; i++)
+							p = p + shifts(ix[4 * x + i], y, z) * wx[4 * x + i];
+						tmpX(x, y, z) = p;
+					}
+				}
+			}
+
+			Image<Vec3<real_t> > tmpY(fieldSize.x, fieldSize.y, shifts.depth());
+			for (coord_t z = 0; z < tmpY.depth(); z++)
+			{
+				for (coord_t y = 0; y < tmpY.height(); y++)
+				{
+					for (coord_t x = 0; x < tmpY.width(); x++)
+					{
+						Vec3<real_t> q;
+						for (size_t j = 0; j < 4; j++)
+							q = q + tmpX(x, iy[4 * y + j], z) * wy[4 * y + j];
+						tmpY(x, y, z) = q;
+					}
+				}
+			}
+
+			for (coord_t z = 0; z < field.depth(); z++)
+			{
+				for (coord_t y = 0; y < field.height(); y++)
+				{
+					for (coord_t x = 0; x < field.width(); x++)
+					{
+						Vec3<real_t> r;
+						for (size_t k = 0; k < 4; k++)
+							r = r + tmpY(x, y, iz[4 * z + k]) * wz[4 * z + k];
+						field(x, y, z) = r;
+					}
+				}
+			}
+		}
+
+		/*
+		Linearly interpolates one row of a shift field created by createShiftField in y- and z-directions.
+		@param y, z Position of the row relative to the start of the field region.
+		@param row At output, the interpolated values for each x-coordinate of the field.
+		*/
+		template<typename real_t> void shiftFieldRow(const Image<Vec3<real_t> >& field, coord_t step, coord_t y, coord_t z, std::vector<Vec3<real_t> >& row)
+		{
+			coord_t j0 = y / step;
+			coord_t k0 = z / step;
+			real_t ty = (real_t)(y - j0 * step) / step;
+			real_t tz = (real_t)(z - k0 * step) / step;
+			coord_t j1 = std::min(j0 + 1, field.height() - 1);
+			coord_t k1 = std::min(k0 + 1, field.depth() - 1);
+
+			row.resize(field.width());
+			for (coord_t i = 0; i < field.width(); i++)
+			{
+				Vec3<real_t> a = field(i, j0, k0) * (1 - ty) + field(i, j1, k0) * ty;
+				Vec3<real_t> b = field(i, j0, k1) * (1 - ty) + field(i, j1, k1) * ty;
+				row[i] = a * (1 - tz) + b * tz;
+			}
+		}
+
 		/*
 		Stitch src image and the corresponding transformation to output image, and update weight image.
 		This function only processes region starting at outPos and having the size of output image.
@@ -887,22 +1019,28 @@ namespace itl2
 		After calling the method for all input images:
 		- image mean does not need further processing.
 		- image S must be divided by image weight and to get standard deviation, sqrt must be taken.
+		The shifts are cubic interpolated from the shift grid to a dense shift field that has one point per fieldStep pixels,
+		and the shift at each pixel is linearly interpolated from that field. The field takes 3 * sizeof(real_t) / fieldStep^3 bytes
+		per output pixel, so fieldStep should be larger than one for big output blocks. Set fieldStep to 1 to evaluate the cubic
+		interpolation exactly at each pixel.
 		*/
 		template<typename pixel_t, typename real_t> void stitchOneVer3(
 			const Image<pixel_t>& src,
 			const PointGrid3D<coord_t>& refPoints, const Image<Vec3<real_t> >& shifts,
 			real_t normFactor, real_t normFactorStd, real_t meanDef,
 			const Vec3c& outPos, Image<real_t>& mean, Image<real_t>& weight, Image<real_t>* S,
-			bool normalize)
+			bool normalize, coord_t fieldStep = 4)
 		{
-			//const Interpolator<real_t, pixel_t, real_t>& interpolator = NearestNeighbourInterpolator<real_t, pixel_t, real_t>(BoundaryCondition::Zero);
-			//const Interpolator<real_t, pixel_t, real_t>& interpolator = LinearInvalidValueInterpolator<real_t, pixel_t, real_t>(BoundaryCondition::Zero, 0, 0);
-			const Interpolator<real_t, pixel_t, real_t>& interpolator = CubicInvalidValueInterpolator<real_t, pixel_t, real_t>(BoundaryCondition::Zero, 0, 0);
-			//const Interpolator<real_t, pixel_t, real_t>& interpolator = CubicInterpolator<real_t, pixel_t, real_t>(BoundaryCondition::Zero);
+			if (fieldStep < 1)
+				throw ITLException("Shift field step must be positive.");
+
+			//const NearestNeighbourInterpolator<real_t, pixel_t, real_t> interpolator(BoundaryCondition::Zero);
+			//const LinearInvalidValueInterpolator<real_t, pixel_t, real_t> interpolator(BoundaryCondition::Zero, 0, 0);
+			const CubicInvalidValueInterpolator<real_t, pixel_t, real_t> interpolator(BoundaryCondition::Zero, 0, 0);
+			//const CubicInterpolator<real_t, pixel_t, real_t> interpolator(BoundaryCondition::Zero);
 
 			// NOTE: Cubic interpolator will overshoot, linear is rough. Perhaps monotone cubic would be the best for shifts?
-			//const Interpolator<Vec3<real_t>, Vec3<real_t>, real_t>& shiftInterpolator = LinearInterpolator<Vec3<real_t>, Vec3<real_t>, real_t, Vec3<real_t> >(BoundaryCondition::Nearest);
-			const Interpolator<Vec3<real_t>, Vec3<real_t>, real_t>& shiftInterpolator = CubicInterpolator<Vec3<real_t>, Vec3<real_t>, real_t, Vec3<real_t> >(BoundaryCondition::Nearest);
+			// The shifts are cubic interpolated in createShiftField.
 
 			Vec3c cc(refPoints.xg.first, refPoints.yg.first, refPoints.zg.first);
 			Vec3c cd(refPoints.xg.maximum, refPoints.yg.maximum, refPoints.zg.maximum);
@@ -933,21 +1071,41 @@ namespace itl2
 				zmax = 1;
 			}
 
+			if (xmin >= xmax || ymin >= ymax || zmin >= zmax)
+				return;
+
+			std::cout << "Calculating shift field..." << std::endl;
+			Image<Vec3<real_t> > field;
+			createShiftField(refPoints, shifts, Vec3c(xmin, ymin, zmin), Vec3c(xmax, ymax, zmax), fieldStep, field);
+
 			std::cout << "Transforming..." << std::endl;
 			// Process all pixels in the relevant region of the target image and find source image value at each location.
 			size_t counter = 0;
 #pragma omp parallel for if((zmax-zmin)*(ymax-ymin)*(xmax-xmin) > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
 			for (coord_t z = zmin; z < zmax; z++)
 			{
+				std::vector<Vec3<real_t> > fieldRow;
+				std::vector<coord_t> xs;
+				std::vector<real_t> px, py, pz, pixs;
 				for (coord_t y = ymin; y < ymax; y++)
 				{
+					shiftFieldRow(field, fieldStep, y - ymin, z - zmin, fieldRow);
+
+					// Find positions in the input image, and interpolate the ones that are inside the input image.
+					xs.clear();
+					px.clear();
+					py.clear();
+					pz.clear();
 					for (coord_t x = xmin; x < xmax; x++)
 					{
 						// X is position in the output image
 						Vec3<real_t> X((real_t)x, (real_t)y, (real_t)z);
 
 						// Convert X to p, position in the input image.
-						Vec3<real_t> p = X + internals::projectPointToDeformed(X, refPoints, shifts, shiftInterpolator);
+						coord_t i0 = (x - xmin) / fieldStep;
+						coord_t i1 = std::min(i0 + 1, field.width() - 1);
+						real_t t = (real_t)(x - xmin - i0 * fieldStep) / fieldStep;
+						Vec3<real_t> p = X + fieldRow[i0] * (1 - t) + fieldRow[i1] * t;
 
 						// Convert p to pdot, position in the input block.
 						//Vec3<real_t> pdot = p - Vec3<real_t>(srcBlockPos);
@@ -955,47 +1113,61 @@ namespace itl2
 
 						if (src.isInImage(pdot))
 						{
-							real_t pix = interpolator(src, pdot);
-							if (pix != 0) // Don't process pixels that could not be interpolated (are given background value)
-							{
-								if (normalize)
-									pix = (pix - meanDef) * normFactorStd + meanDef + normFactor;
-									//pix += normFactor;
+							xs.push_back(x);
+							px.push_back(pdot.x);
+							py.push_back(pdot.y);
+							pz.push_back(pdot.z);
+						}
+					}
 
-								real_t w1 = 2 * std::min(p.x, srcDimensions.x - 1 - p.x) / s;
-								real_t w2 = 2 * std::min(p.y, srcDimensions.y - 1 - p.y) / s;
-								real_t w3 = 2 * std::min(p.z, srcDimensions.z - 1 - p.z) / s;
+					pixs.resize(xs.size());
+					interpolator.interpolateRow(src, px.data(), py.data(), pz.data(), pixs.data(), xs.size());
 
-								if (src.dimensionality() < 3)
-									w3 = 1;
+					for (size_t n = 0; n < xs.size(); n++)
+					{
+						coord_t x = xs[n];
+						Vec3<real_t> p(px[n], py[n], pz[n]);
+						real_t pix = pixs[n];
 
-								real_t ww = w1 * w2 * w3;
+						if (pix != 0) // Don't process pixels that could not be interpolated (are given background value)
+						{
+							if (normalize)
+								pix = (pix - meanDef) * normFactorStd + meanDef + normFactor;
+								//pix += normFactor;
 
-								if (ww > 0)
-								{
-									// Finally transform to the coordinates of the region of the target image that we are processing
-									coord_t xo = x - outPos.x;
-									coord_t yo = y - outPos.y;
-									coord_t zo = z - outPos.z;
+							real_t w1 = 2 * std::min(p.x, srcDimensions.x - 1 - p.x) / s;
+							real_t w2 = 2 * std::min(p.y, srcDimensions.y - 1 - p.y) / s;
+							real_t w3 = 2 * std::min(p.z, srcDimensions.z - 1 - p.z) / s;
 
-									if (xo >= 0 && yo >= 0 && zo >= 0 && xo < mean.width() && yo < mean.height() && zo < mean.depth())
-									{
-										// Calculate mean and, if requested, standard deviation.
-										// This uses algorithm from West, D. H. D. (1979). "Updating Mean and Variance Estimates: An Improved Method". 
-										// See also https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance -> Weighted incremental algorithm
+							if (src.dimensionality() < 3)
+								w3 = 1;
 
-										real_t& wSum = weight(xo, yo, zo);
-										wSum += ww;
-										
-										real_t& meanNew = mean(xo, yo, zo);
-										real_t meanOld = meanNew;
+							real_t ww = w1 * w2 * w3;
 
-										meanNew = meanOld + (ww / wSum) * (pix - meanOld);
+							if (ww > 0)
+							{
+								// Finally transform to the coordinates of the region of the target image that we are processing
+								coord_t xo = x - outPos.x;
+								coord_t yo = y - outPos.y;
+								coord_t zo = z - outPos.z;
 
-										if (S)
-											(*S)(xo, yo, zo) += ww * (pix - meanOld) * (pix - meanNew);
+								if (xo >= 0 && yo >= 0 && zo >= 0 && xo < mean.width() && yo < mean.height() && zo < mean.depth())
+								{
+									// Calculate mean and, if requested, standard deviation.
+									// This uses algorithm from West, D. H. D. (1979). "Updating Mean and Variance Estimates: An Improved Method". 
+									// See also https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance -> Weighted incremental algorithm
+
+									real_t& wSum = weight(xo, yo, zo);
+									wSum += ww;
+									
+									real_t& meanNew = mean(xo, yo, zo);
+									real_t meanOld = meanNew;
+
+									meanNew = meanOld + (ww / wSum) * (pix - meanOld);
+
+									if (S)
+										(*S)(xo, yo, zo) += ww * (pix - meanOld) * (pix - meanNew);
 
-									}
 								}
 							}
 						}
@@ -1117,7 +1289,7 @@ namespace itl2
 	//	convert(out, output);
 	//}
 
-	template<typename pixel_t> void stitchVer3(const string& indexFile, const Vec3c& outputPos, const Vec3c& outputSize, Image<pixel_t>& output, Image<pixel_t>* std, bool normalize, bool maskMaxCircle)
+	template<typename pixel_t> void stitchVer3(const string& indexFile, const Vec3c& outputPos, const Vec3c& outputSize, Image<pixel_t>& output, Image<pixel_t>* std, bool normalize, bool maskMaxCircle, coord_t fieldStep = 4)
 	{
 
 		// Read index file
@@ -1210,7 +1382,7 @@ namespace itl2
 					multiply(src, mask, true);
 				}
 
-				internals::stitchOneVer3<pixel_t, float32_t>(src, refPoints, shifts, normFact, normFactStd, meanDef, outputPos, out, weight, std ? &stdtmp : nullptr, normalize);
+				internals::stitchOneVer3<pixel_t, float32_t>(src, refPoints, shifts, normFact, normFactStd, meanDef, outputPos, out, weight, std ? &stdtmp : nullptr, normalize, fieldStep);
 			}
 		}
 
@@ -1234,4 +1406,9 @@ namespace itl2
 			convert(stdtmp, *std);
 		}
 	}
+
+	namespace tests
+	{
+		void stitchShiftField();
+	}
 }
@@ -607,12 +607,15 @@ namespace itl2
 			//multiThreshold(img, th);
 		}
 
-		template<typename pixel_t> void cannyPart2(Image<pixel_t>& img)
+		/**
+		Performs edge tracking part of Canny edge detection.
+		@return Count of changed pixels.
+		*/
+		template<typename pixel_t> size_t cannyPart2(Image<pixel_t>& img)
 		{
 			// 5. Edge tracking - Convert all those edges to "sure" that touch a "sure" edge.
 			std::cout << "Edge tracking..." << std::endl;
-			size_t changed = grow<pixel_t>(img, pixelRound<pixel_t>(2), pixelRound<pixel_t>(1));
-			std::cout << changed << " pixels changed." << std::endl;
+			return grow<pixel_t>(img, pixelRound<pixel_t>(2), pixelRound<pixel_t>(1));
 		}
 	}
 
@@ -630,7 +633,8 @@ namespace itl2
 		// In the distributed implementation (using overlapped block distribution) part 1 must be run once
 		// and part 2 until convergence, and part 3 (the thresholding) once.
 		internals::cannyPart1(img, derivativeSigma, lowerThreshold, upperThreshold);
-		internals::cannyPart2(img);
+		size_t changed = internals::cannyPart2(img);
+		std::cout << changed << " pixels changed." << std::endl;
 		
 		// 6. Remove all other non-sure edges.
 		threshold<pixel_t>(img, 1);
@@ -4,9 +4,11 @@
 #include "neighbourhood.h"
 #include "utilities.h"
 #include "minhash.h"
+#include "thinning.h"
 #include "math/vec3.h"
 
 #include <algorithm>
+#include <bitset>
 
 
 namespace itl2
@@ -719,17 +721,10 @@ namespace itl2
 
 		/**
 		Counts number of connected components in the neighbourhood, setting center pixel to background, and returns true if there are zero or one connected components.
+		@param cube Neighbour list that does not contain the center pixel. Value 1 denotes foreground and value 0 background. The list is modified.
 		*/
-		template<typename pixel_t> bool isSimplePointHybrid(const Image<pixel_t>& nb)
+		inline bool isSimplePointHybrid(uint8_t cube[26])
 		{
-			// Initialize neighbor list for labeling. The list will not contain center pixel.
-			// Value 1 denotes unlabeled foreground voxels, value 0 denotes background.
-			uint8_t cube[26];
-			for (coord_t i = 0; i < 13; i++)  // i =  0..12 -> cube[0..12]
-				cube[i] = nb(i) != (pixel_t)0 ? 1 : 0;
-			for (coord_t i = 14; i < 27; i++) // i = 14..26 -> cube[13..25]
-				cube[i - 1] = nb(i) != (pixel_t)0 ? 1 : 0;
-			
 			int label = 2;
 			for (coord_t i = 0; i < 26; i++)
 			{
@@ -793,6 +788,22 @@ namespace itl2
 			return true;
 		}
 
+		/**
+		Counts number of connected components in the neighbourhood, setting center pixel to background, and returns true if there are zero or one connected components.
+		*/
+		template<typename pixel_t> bool isSimplePointHybrid(const Image<pixel_t>& nb)
+		{
+			// Initialize neighbor list for labeling. The list will not contain center pixel.
+			// Value 1 denotes unlabeled foreground voxels, value 0 denotes background.
+			uint8_t cube[26];
+			for (coord_t i = 0; i < 13; i++)  // i =  0..12 -> cube[0..12]
+				cube[i] = nb(i) != (pixel_t)0 ? 1 : 0;
+			for (coord_t i = 14; i < 27; i++) // i = 14..26 -> cube[13..25]
+				cube[i - 1] = nb(i) != (pixel_t)0 ? 1 : 0;
+
+			return isSimplePointHybrid(cube);
+		}
+
 		/**
 		Gets 2x2x2 'cube' from 'nb'.
 		The first corner of the cube is placed at 'start'.
@@ -948,102 +959,158 @@ namespace itl2
 				isSurfaceCubeCached(nb, Vec3c(0, 1, 1)) &&
 				isSurfaceCubeCached(nb, Vec3c(1, 1, 1));
 		}
+
+		/*
+		Versions of the tests above that operate on bit masks of 3x3x3 neighbourhoods (see neighbourhoodMask).
+		All nonzero pixels are considered to be foreground.
+		*/
+
+		/*
+		Checks if a point is at the end of an arc.
+		*/
+		inline bool isEndPoint(uint32_t mask)
+		{
+			coord_t numberOfNeighbors = (coord_t)std::bitset<32>(mask).count() - 1;   // -1 because the center pixel will be counted as well
+			return numberOfNeighbors == 1;
+		}
+
+		/*
+		Checks if a point is Euler invariant.
+		*/
+		inline bool isEulerInvariant(uint32_t mask)
+		{
+			// Neighbourhood pixels that correspond to bits 7, 6, ..., 1 of the eulerLUT index, for each octant.
+			// Bit 0 corresponds to the center pixel.
+			static const uint8_t octants[8][7] = {
+				{ 24, 25, 15, 16, 21, 22, 12 },	// SWU
+				{ 26, 23, 17, 14, 25, 22, 16 },	// SEU
+				{ 18, 21, 9, 12, 19, 22, 10 },	// NWU
+				{ 20, 23, 19, 22, 11, 14, 10 },	// NEU
+				{ 6, 15, 7, 16, 3, 12, 4 },		// SWB
+				{ 8, 7, 17, 16, 5, 4, 14 },		// SEB
+				{ 0, 9, 3, 12, 1, 10, 4 },		// NWB
+				{ 2, 1, 11, 10, 5, 4, 14 }		// NEB
+			};
+
+			// calculate Euler characteristic for each octant and sum up
+			int eulerChar = 0;
+			for (size_t o = 0; o < 8; o++)
+			{
+				unsigned int n = 1;
+				for (size_t i = 0; i < 7; i++)
+					n |= ((mask >> octants[o][i]) & 1) << (7 - i);
+				eulerChar += eulerLUT[n];
+			}
+
+			return eulerChar == 0;
+		}
+
+		/**
+		Calculates isSimplePointHybrid for 26-bit neighbour mask (see withoutCenter).
+		*/
+		inline bool isSimplePointHybridUncached(uint32_t neighbours)
+		{
+			uint8_t cube[26];
+			for (size_t i = 0; i < 26; i++)
+				cube[i] = (neighbours >> i) & 1;
+			return isSimplePointHybrid(cube);
+		}
+
+		/**
+		Counts number of connected components in the neighbourhood, setting center pixel to background, and returns true if there are zero or one connected components.
+		The results are cached in a lookup table.
+		*/
+		inline bool isSimplePointHybrid(uint32_t mask)
+		{
+			static const NeighbourhoodTable table(isSimplePointHybridUncached);
+			return table(mask);
+		}
+
+		/**
+		Test if the point in the center of the given 3x3x3 neighbourhood mask is a surface point.
+		createAllowedHashList must be called before calling this function.
+		*/
+		inline bool isSurfacePoint(uint32_t mask)
+		{
+			// Divide the 3x3x3 neighbourhood to 8 2x2x2 neighbourhoods, and see if all of them look like surface.
+			// Bit n of the 2x2x2 neighbourhood index corresponds to pixel n of the 2x2x2 neighbourhood.
+			for (uint32_t z = 0; z < 2; z++)
+			{
+				for (uint32_t y = 0; y < 2; y++)
+				{
+					for (uint32_t x = 0; x < 2; x++)
+					{
+						uint32_t start = x + 3 * y + 9 * z;
+						size_t ind = ((mask >> start) & 0x3) |
+							(((mask >> (start + 3)) & 0x3) << 2) |
+							(((mask >> (start + 9)) & 0x3) << 4) |
+							(((mask >> (start + 12)) & 0x3) << 6);
+						if (!isSurfaceFlags[ind])
+							return false;
+					}
+				}
+			}
+			return true;
+		}
 	}
 
 
 	/*
 	Performs one thinning iteration and returns count of pixels removed from the image.
 	Repeating this thinning process until the image does not change results in skeleton.
+	Only the parts of the image that are flagged in the frontier are examined, so the same frontier object should be used in all iterations.
 	@param retainSurfaces If true, surfaces are not thinned to lines.
 	@param img Image that should be thinned.
+	@param frontier Frontier of the thinning process. Initialize with a new ThinningFrontier object before the first iteration.
 	*/
-	template<typename pixel_t> size_t thin(Image<pixel_t>& img, bool retainSurfaces)
+	template<typename pixel_t> size_t thin(Image<pixel_t>& img, bool retainSurfaces, internals::ThinningFrontier& frontier)
 	{
+		if (frontier.dimensions() != img.dimensions())
+			throw ITLException("Thinning frontier and image dimensions do not match.");
+
 		internals::createAllowedHashList();
 
+		// Offsets to the neighbours that define border points of types N, S, E, W, U and B.
+		const Vec3c borderOffsets[] = { Vec3c(0, -1, 0), Vec3c(0, 1, 0), Vec3c(1, 0, 0), Vec3c(-1, 0, 0), Vec3c(0, 0, 1), Vec3c(0, 0, -1) };
+
 		size_t changed = 0;
-		size_t counter = 0;
-		std::vector<Vec3c> pointsToRemove;
-		pointsToRemove.reserve(10000);
+		std::vector<uint8_t> removed;
 
-		for (int currentBorder = 1; currentBorder <= 6; currentBorder++)
+		for (size_t currentBorder = 0; currentBorder < internals::ThinningFrontier::DIRECTION_COUNT; currentBorder++)
 		{
-			pointsToRemove.clear();
-
-			#pragma omp parallel
-			{
-				Image<uint8_t> nbPrivate(3, 3, 3);
-
-				#pragma omp for
-				for (coord_t z = 0; z < img.depth(); z++)
+			std::vector<Vec3c> pointsToRemove = internals::thinningCandidates(img, frontier, currentBorder, borderOffsets[currentBorder], [](uint32_t nb)
 				{
-					for (coord_t y = 0; y < img.height(); y++)
-					{
-						for (coord_t x = 0; x < img.width(); x++)
-						{
-							pixel_t c = img(x, y, z);
-							if (c != (pixel_t)0)
-							{
-
-								// check 6-neighbors to see if the point is a border point of type currentBorder
-								bool isBorderPoint = false;
-								switch (currentBorder)
-								{
-								case 1: isBorderPoint = internals::N(img, x, y, z); break;
-								case 2: isBorderPoint = internals::S(img, x, y, z); break;
-								case 3: isBorderPoint = internals::E(img, x, y, z); break;
-								case 4: isBorderPoint = internals::W(img, x, y, z); break;
-								case 5: isBorderPoint = internals::U(img, x, y, z); break;
-								case 6: isBorderPoint = internals::B(img, x, y, z); break;
-								}
-
-								if (isBorderPoint)
-								{
-									getNeighbourhood(img, Vec3c(x, y, z), Vec3c(1, 1, 1), nbPrivate, BoundaryCondition::Zero);
-
-									if (!internals::isEndPoint(nbPrivate) &&
-										internals::isEulerInvariant(nbPrivate) &&
-										internals::isSimplePointHybrid(nbPrivate))
-									{
-										#pragma omp critical(surfacethin_insert)
-											pointsToRemove.push_back(Vec3c(x, y, z));
-									}
-								}
-							}
-						}
-
-					}
-
-					showThreadProgress(counter, 6 * img.depth());
-				}
-			}
-
-			// This is required to make the result exactly the same than in Fiji (non-threaded version)
-			// Otherwise, the point removal order may change the skeleton points.
-			std::sort(pointsToRemove.begin(), pointsToRemove.end(), vecComparer<coord_t>);
+					return !internals::isEndPoint(nb) &&
+						internals::isEulerInvariant(nb) &&
+						internals::isSimplePointHybrid(nb);
+				});
 
 			// Re-check while removing points so that connectivity is preserved.
-			Image<uint8_t> nb(3, 3, 3);
-			for (size_t n = 0; n < pointsToRemove.size(); n++)
-			{
-				Vec3c p = pointsToRemove[n];
-
-				getNeighbourhood(img, p, Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
-				//nb(1, 1, 1) = 0; // This must not be done. Function isSimplePointHybrid does not consider the center pixel, but it is needed for isSurfacePoint.
-
-				if (internals::isSimplePointHybrid(nb) &&
-					((retainSurfaces && !internals::isSurfacePoint(nb)) || !retainSurfaces)
-					)
+			// NOTE: Center pixel must not be set to zero. Function isSimplePointHybrid does not consider the center pixel, but it is needed for isSurfacePoint.
+			changed += internals::removeSimplePoints(img, pointsToRemove, [retainSurfaces](uint32_t nb)
 				{
-					img(p) = 0;
-					changed++;
-				}
-			}
+					return internals::isSimplePointHybrid(nb) &&
+						((retainSurfaces && !internals::isSurfacePoint(nb)) || !retainSurfaces);
+				}, removed);
+
+			frontier.update(currentBorder, pointsToRemove, removed);
 		}
 
 		return changed;
 	}
 
+	/*
+	Performs one thinning iteration and returns count of pixels removed from the image.
+	Repeating this thinning process until the image does not change results in skeleton.
+	@param retainSurfaces If true, surfaces are not thinned to lines.
+	@param img Image that should be thinned.
+	*/
+	template<typename pixel_t> size_t thin(Image<pixel_t>& img, bool retainSurfaces)
+	{
+		internals::ThinningFrontier frontier(img.dimensions());
+		return thin(img, retainSurfaces, frontier);
+	}
+
 	/*
 	Performs one thinning iteration and returns count of pixels removed from the image.
 	Repeating this thinning process until the image does not change results in surface skeleton.
@@ -1069,11 +1136,12 @@ namespace itl2
 	template<typename pixel_t> void surfaceSkeleton(Image<pixel_t>& img, bool retainSurfaces = true, size_t maxIterations = std::numeric_limits<size_t>::max())
 	{
 
+		internals::ThinningFrontier frontier(img.dimensions());
 		size_t it = 0;
 		size_t changes;
 		do
 		{
-			changes = thin(img, retainSurfaces);
+			changes = thin(img, retainSurfaces, frontier);
 
 			std::cout << std::endl << changes << " pixels removed." << std::endl;
 
@@ -0,0 +1,325 @@
+#include "thinning.h"
+#include "surfaceskeleton.h"
+#include "lineskeleton.h"
+#include "generation.h"
+#include "filters.h"
+#include "pointprocess.h"
+#include "noise.h"
+#include "testutils.h"
+#include "timer.h"
+
+using namespace std;
+
+namespace itl2
+{
+	namespace internals
+	{
+		NeighbourhoodTable::NeighbourhoodTable(function_t f) :
+			f(f),
+			known(new std::atomic<uint32_t>[((size_t)1 << 26) / 32]()),
+			values(new std::atomic<uint32_t>[((size_t)1 << 26) / 32]())
+		{
+		}
+
+		bool NeighbourhoodTable::evaluate(uint32_t index) const
+		{
+			size_t word = index >> 5;
+			uint32_t bit = 1u << (index & 31);
+
+			// Multiple threads may calculate the same entry, but they all store the same value.
+			bool value = f(index);
+			if (value)
+				values[word].fetch_or(bit, std::memory_order_relaxed);
+			known[word].fetch_or(bit, std::memory_order_release);
+
+			return value;
+		}
+
+		ThinningFrontier::ThinningFrontier(const Vec3c& dimensions) :
+			imageDimensions(dimensions)
+		{
+			brickCounts = Vec3c(
+				(dimensions.x + BRICK_SIZE - 1) / BRICK_SIZE,
+				(dimensions.y + BRICK_SIZE - 1) / BRICK_SIZE,
+				(dimensions.z + BRICK_SIZE - 1) / BRICK_SIZE);
+
+			flags.resize(brickCounts.product(), (uint8_t)((1 << DIRECTION_COUNT) - 1));
+		}
+
+		vector<Vec3c> ThinningFrontier::takeBricks(size_t direction)
+		{
+			uint8_t mask = (uint8_t)(1 << direction);
+
+			vector<Vec3c> bricks;
+			for (coord_t z = 0; z < brickCounts.z; z++)
+			{
+				for (coord_t y = 0; y < brickCounts.y; y++)
+				{
+					for (coord_t x = 0; x < brickCounts.x; x++)
+					{
+						uint8_t& f = flags[brickIndex(Vec3c(x, y, z))];
+						if (f & mask)
+						{
+							bricks.push_back(Vec3c(x, y, z) * BRICK_SIZE);
+							f &= ~mask;
+						}
+					}
+				}
+			}
+
+			return bricks;
+		}
+
+		void ThinningFrontier::markChanged(const Vec3c& p)
+		{
+			Vec3c start = max(p - Vec3c(1, 1, 1), Vec3c(0, 0, 0)) / BRICK_SIZE;
+			Vec3c end = min(p + Vec3c(1, 1, 1), imageDimensions - Vec3c(1, 1, 1)) / BRICK_SIZE;
+			uint8_t all = (uint8_t)((1 << DIRECTION_COUNT) - 1);
+
+			for (coord_t z = start.z; z <= end.z; z++)
+				for (coord_t y = start.y; y <= end.y; y++)
+					for (coord_t x = start.x; x <= end.x; x++)
+						flags[brickIndex(Vec3c(x, y, z))] = all;
+		}
+
+		void ThinningFrontier::update(size_t direction, const vector<Vec3c>& candidates, const vector<uint8_t>& removed)
+		{
+			for (size_t n = 0; n < candidates.size(); n++)
+			{
+				if (removed[n])
+					markChanged(candidates[n]);
+				else
+					flags[brickIndex(candidates[n] / BRICK_SIZE)] |= (uint8_t)(1 << direction);
+			}
+		}
+	}
+
+	namespace tests
+	{
+		/**
+		Sequential full-image thinning iteration, as implemented before the frontier-based thinning.
+		*/
+		template<typename pixel_t, typename candidate_t, typename remove_t> size_t referenceThin(Image<pixel_t>& img, const Vec3c borderOffsets[6], candidate_t isCandidate, remove_t canRemove, bool lineOrder)
+		{
+			size_t changed = 0;
+			Image<uint8_t> nb(3, 3, 3);
+			for (size_t direction = 0; direction < 6; direction++)
+			{
+				vector<Vec3c> points;
+				for (coord_t z = 0; z < img.depth(); z++)
+				{
+					for (coord_t y = 0; y < img.height(); y++)
+					{
+						for (coord_t x = 0; x < img.width(); x++)
+						{
+							Vec3c b = Vec3c(x, y, z) + borderOffsets[direction];
+							if (img(x, y, z) != 0 && img.isInImage(b) && img(b) == 0)
+							{
+								getNeighbourhood(img, Vec3c(x, y, z), Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
+								if (isCandidate(nb))
+									points.push_back(Vec3c(x, y, z));
+							}
+						}
+					}
+				}
+
+				// Line thinning processes the points alternately from the beginning and from the end of the list.
+				vector<Vec3c> order;
+				size_t first = 0;
+				size_t last = points.size();
+				while (first < last)
+				{
+					if (!lineOrder || order.size() % 2 == 0)
+						order.push_back(points[first++]);
+					else
+						order.push_back(points[--last]);
+				}
+
+				for (const Vec3c& p : order)
+				{
+					getNeighbourhood(img, p, Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
+					if (canRemove(nb))
+					{
+						img(p) = 0;
+						changed++;
+					}
+				}
+			}
+			return changed;
+		}
+
+		void frontierThinning()
+		{
+			// Thick random structure.
+			Image<float32_t> noiseImg(100, 90, 80);
+			noise(noiseImg, 0.0, 1.0, 123);
+			Image<float32_t> f;
+			gaussFilter(noiseImg, f, 10.0);
+			threshold(f, 0.0f);
+			Image<uint8_t> orig(f.dimensions());
+			setValue(orig, f);
+
+			internals::createAllowedHashList();
+
+			const Vec3c surfaceOffsets[] = { Vec3c(0, -1, 0), Vec3c(0, 1, 0), Vec3c(1, 0, 0), Vec3c(-1, 0, 0), Vec3c(0, 0, 1), Vec3c(0, 0, -1) };
+			const Vec3c lineOffsets[] = { Vec3c(0, -1, 0), Vec3c(0, 1, 0), Vec3c(-1, 0, 0), Vec3c(1, 0, 0), Vec3c(0, 0, -1), Vec3c(0, 0, 1) };
+
+			auto surfaceCandidate = [](const Image<uint8_t>& nb)
+				{
+					return !internals::isEndPoint(nb) && internals::isEulerInvariant(nb) && internals::isSimplePointHybrid(nb);
+				};
+
+			for (bool retainSurfaces : { true, false })
+			{
+				Image<uint8_t> gt(orig.dimensions());
+				setValue(gt, orig);
+				Timer timer;
+				timer.start();
+				while (referenceThin(gt, surfaceOffsets, surfaceCandidate, [&](const Image<uint8_t>& nb)
+					{
+						return internals::isSimplePointHybrid(nb) && (!retainSurfaces || !internals::isSurfacePoint(nb));
+					}, false) > 0);
+				timer.stop();
+				cout << "Reference surface skeleton took " << timer.getSeconds() << " s" << endl;
+
+				Image<uint8_t> img(orig.dimensions());
+				setValue(img, orig);
+				timer.start();
+				surfaceSkeleton(img, retainSurfaces);
+				timer.stop();
+				cout << "Frontier-based surface skeleton took " << timer.getSeconds() << " s" << endl;
+
+				testAssert(equals(img, gt), string("frontier-based surface skeleton, retain surfaces = ") + toString(retainSurfaces));
+			}
+
+			{
+				Image<uint8_t> gt(orig.dimensions());
+				setValue(gt, orig);
+				Timer timer;
+				timer.start();
+				auto lineTest = [](const Image<uint8_t>& nb)
+					{
+						return !internals::isEndPoint(nb) && internals::isSimplePointLine(nb);
+					};
+				while (referenceThin(gt, lineOffsets, lineTest, lineTest, true) > 0);
+				timer.stop();
+				cout << "Reference line skeleton took " << timer.getSeconds() << " s" << endl;
+
+				Image<uint8_t> img(orig.dimensions());
+				setValue(img, orig);
+				timer.start();
+				lineSkeleton(img);
+				timer.stop();
+				cout << "Frontier-based line skeleton took " << timer.getSeconds() << " s" << endl;
+
+				testAssert(equals(img, gt), "frontier-based line skeleton");
+			}
+		}
+
+		void neighbourhoodMasks()
+		{
+			internals::createAllowedHashList();
+
+			// Compare mask reading to getNeighbourhood, also near the edges of the image.
+			Image<uint16_t> img(12, 11, 10);
+			noise(img, 0, 1000, 7);
+			threshold(img, 1000);
+			Image<uint8_t> nb(3, 3, 3);
+			bool ok = true;
+			for (coord_t z = 0; z < img.depth(); z++)
+			{
+				for (coord_t y = 0; y < img.height(); y++)
+				{
+					for (coord_t x = 0; x < img.width(); x++)
+					{
+						getNeighbourhood(img, Vec3c(x, y, z), Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
+						uint32_t mask = internals::neighbourhoodMask(img, Vec3c(x, y, z));
+						for (coord_t i = 0; i < 27; i++)
+						{
+							if (((mask >> i) & 1) != (nb(i) != 0 ? 1u : 0u))
+								ok = false;
+						}
+					}
+				}
+			}
+			testAssert(ok, "neighbourhood mask");
+
+			// Compare predicates in random neighbourhoods of varying density.
+			size_t errors[5] = { 0, 0, 0, 0, 0 };
+			srand(1234);
+			for (size_t n = 0; n < 200000; n++)
+			{
+				int density = rand() % 101;
+				for (coord_t i = 0; i < 27; i++)
+					nb(i) = (rand() % 100) < density ? 1 : 0;
+				nb(13) = 1;
+
+				uint32_t mask = 0;
+				for (coord_t i = 0; i < 27; i++)
+					mask |= (uint32_t)nb(i) << i;
+
+				if (internals::isEndPoint(nb) != internals::isEndPoint(mask))
+					errors[0]++;
+				if (internals::isEulerInvariant(nb) != internals::isEulerInvariant(mask))
+					errors[1]++;
+				if (internals::isSimplePointHybrid(nb) != internals::isSimplePointHybrid(mask))
+					errors[2]++;
+				if (internals::isSurfacePoint(nb) != internals::isSurfacePoint(mask))
+					errors[3]++;
+				if (internals::isSimplePointLine(nb) != internals::isSimplePointLine(mask))
+					errors[4]++;
+			}
+			testAssert(errors[0] == 0, "isEndPoint for mask");
+			testAssert(errors[1] == 0, "isEulerInvariant for mask");
+			testAssert(errors[2] == 0, "isSimplePointHybrid for mask");
+			testAssert(errors[3] == 0, "isSurfacePoint for mask");
+			testAssert(errors[4] == 0, "isSimplePointLine for mask");
+
+			// Timing in a structure whose neighbourhood configurations are typical to real images.
+			Image<float32_t> noiseImg(200, 200, 200);
+			noise(noiseImg, 0.0, 1.0, 3);
+			Image<float32_t> smooth;
+			gaussFilter(noiseImg, smooth, 3.0);
+			threshold(smooth, 0.0f);
+			Image<uint8_t> bin(smooth.dimensions());
+			setValue(bin, smooth);
+
+			size_t imageCount = 0;
+			Timer timer;
+			timer.start();
+			for (coord_t z = 0; z < bin.depth(); z++)
+			{
+				for (coord_t y = 0; y < bin.height(); y++)
+				{
+					for (coord_t x = 0; x < bin.width(); x++)
+					{
+						getNeighbourhood(bin, Vec3c(x, y, z), Vec3c(1, 1, 1), nb, BoundaryCondition::Zero);
+						if (internals::isEulerInvariant(nb) && internals::isSimplePointHybrid(nb))
+							imageCount++;
+					}
+				}
+			}
+			timer.stop();
+			cout << "Neighbourhood image tests took " << timer.getSeconds() << " s" << endl;
+
+			size_t maskCount = 0;
+			timer.start();
+			for (coord_t z = 0; z < bin.depth(); z++)
+			{
+				for (coord_t y = 0; y < bin.height(); y++)
+				{
+					for (coord_t x = 0; x < bin.width(); x++)
+					{
+						uint32_t mask = internals::neighbourhoodMask(bin, Vec3c(x, y, z));
+						if (internals::isEulerInvariant(mask) && internals::isSimplePointHybrid(mask))
+							maskCount++;
+					}
+				}
+			}
+			timer.stop();
+			cout << "Neighbourhood mask tests took " << timer.getSeconds() << " s" << endl;
+
+			testAssert(imageCount == maskCount, "neighbourhood image and mask test counts");
+		}
+	}
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <omp.h>
+
+#include "image.h"
+#include "utilities.h"
+
+namespace itl2
+{
+	namespace internals
+	{
+		/**
+		Reads 3x3x3 neighbourhood of the given point into a bit mask.
+		Bit i of the mask is set if pixel i of the neighbourhood (in x-y-z order) is nonzero, so bit 13 corresponds to the center point.
+		Pixels outside of the image are considered to be zero.
+		*/
+		template<typename pixel_t> uint32_t neighbourhoodMask(const Image<pixel_t>& img, const Vec3c& p)
+		{
+			uint32_t mask = 0;
+			if (p.x > 0 && p.y > 0 && p.z > 0 && p.x < img.width() - 1 && p.y < img.height() - 1 && p.z < img.depth() - 1)
+			{
+				// Read three pixels from each of the nine rows.
+				size_t bit = 0;
+				for (coord_t dz = -1; dz <= 1; dz++)
+				{
+					for (coord_t dy = -1; dy <= 1; dy++)
+					{
+						const pixel_t* row = &img(p.x, p.y + dy, p.z + dz);
+						mask |= (row[-1] != (pixel_t)0 ? 1u : 0u) << bit;
+						mask |= (row[0] != (pixel_t)0 ? 1u : 0u) << (bit + 1);
+						mask |= (row[1] != (pixel_t)0 ? 1u : 0u) << (bit + 2);
+						bit += 3;
+					}
+				}
+			}
+			else
+			{
+				size_t bit = 0;
+				for (coord_t dz = -1; dz <= 1; dz++)
+				{
+					for (coord_t dy = -1; dy <= 1; dy++)
+					{
+						for (coord_t dx = -1; dx <= 1; dx++)
+						{
+							Vec3c q = p + Vec3c(dx, dy, dz);
+							if (img.isInImage(q) && img(q) != (pixel_t)0)
+								mask |= 1u << bit;
+							bit++;
+						}
+					}
+				}
+			}
+			return mask;
+		}
+
+		/**
+		Converts 3x3x3 neighbourhood mask to a 26-bit mask that does not contain the center point.
+		Bit i of the result corresponds to pixel i of the neighbourhood for i < 13 and to pixel i + 1 for i >= 13.
+		*/
+		inline uint32_t withoutCenter(uint32_t mask)
+		{
+			return (mask & 0x1fff) | ((mask >> 14) << 13);
+		}
+
+		/**
+		Lookup table of a binary property of the 26-neighbourhood of a point, e.g. whether the point is simple.
+		The table contains one bit for each of the 2^26 possible neighbourhoods, and it is filled lazily:
+		each entry is calculated when it is needed for the first time. After that, evaluating the property requires only two memory loads.
+		The table can be used from multiple threads simultaneously.
+		*/
+		class NeighbourhoodTable
+		{
+		public:
+			/**
+			Function that calculates the property for the given 26-bit mask (see withoutCenter).
+			*/
+			typedef bool (*function_t)(uint32_t neighbours);
+
+			explicit NeighbourhoodTable(function_t f);
+
+			/**
+			Evaluates the property for the given 3x3x3 neighbourhood mask.
+			*/
+			bool operator()(uint32_t mask) const
+			{
+				uint32_t index = withoutCenter(mask);
+				size_t word = index >> 5;
+				uint32_t bit = 1u << (index & 31);
+				if (known[word].load(std::memory_order_acquire) & bit)
+					return (values[word].load(std::memory_order_relaxed) & bit) != 0;
+				return evaluate(index);
+			}
+
+		private:
+			function_t f;
+
+			/**
+			Bits that indicate if the entry has been calculated, and the values of the entries.
+			*/
+			std::unique_ptr<std::atomic<uint32_t>[]> known;
+			std::unique_ptr<std::atomic<uint32_t>[]> values;
+
+			/**
+			Calculates and stores value of the given entry.
+			*/
+			bool evaluate(uint32_t index) const;
+		};
+
+		/**
+		Keeps track of the parts of the image that must be re-examined in directional thinning.
+		The image is divided into bricks, and for each brick and thinning direction there is a flag that indicates if the brick
+		may contain removable points in the next thinning pass of that direction.
+		A point that is not a removal candidate stays so until its 3x3x3 neighbourhood changes, so after the first pass only the bricks near
+		removed points and the bricks containing candidates that were not removed must be examined again.
+		Initially all bricks are flagged for all directions.
+		*/
+		class ThinningFrontier
+		{
+		public:
+			/**
+			Size of one brick.
+			*/
+			static constexpr coord_t BRICK_SIZE = 8;
+
+			/**
+			Count of thinning directions.
+			*/
+			static constexpr size_t DIRECTION_COUNT = 6;
+
+			/**
+			Constructor
+			@param dimensions Dimensions of the image that is being thinned.
+			*/
+			explicit ThinningFrontier(const Vec3c& dimensions);
+
+			/**
+			Gets dimensions of the image.
+			*/
+			const Vec3c& dimensions() const
+			{
+				return imageDimensions;
+			}
+
+			/**
+			Gets start positions of the bricks flagged for the given direction, and clears the flags.
+			@param direction Thinning direction in range [0, DIRECTION_COUNT[.
+			*/
+			std::vector<Vec3c> takeBricks(size_t direction);
+
+			/**
+			Flags all bricks that contain a neighbour of the given point, for all directions.
+			Call this when the point is removed from the image.
+			*/
+			void markChanged(const Vec3c& p);
+
+			/**
+			Updates flags after removal candidates of a thinning pass have been processed.
+			Candidates that were removed flag their neighbourhood for all directions, and candidates that were not removed flag their own brick
+			for the given direction.
+			@param direction Thinning direction of the pass.
+			@param candidates Removal candidates.
+			@param removed Nonzero for each candidate that was removed.
+			*/
+			void update(size_t direction, const std::vector<Vec3c>& candidates, const std::vector<uint8_t>& removed);
+
+		private:
+			Vec3c imageDimensions;
+			Vec3c brickCounts;
+
+			/**
+			Bit n is set if the brick must be examined in the next pass of direction n.
+			*/
+			std::vector<uint8_t> flags;
+
+			size_t brickIndex(const Vec3c& brick) const
+			{
+				return (size_t)brick.x + (size_t)brickCounts.x * ((size_t)brick.y + (size_t)brickCounts.y * (size_t)brick.z);
+			}
+		};
+
+		/**
+		Finds removal candidates for one directional thinning pass.
+		Only the bricks flagged in the frontier are examined, and the image is not modified.
+		@param img Image that is being thinned.
+		@param frontier Frontier of the thinning process.
+		@param direction Thinning direction in range [0, ThinningFrontier::DIRECTION_COUNT[.
+		@param borderOffset A foreground point is a border point of the current direction if the pixel at this offset from it is inside the image and background.
+		@param isCandidate Predicate that is evaluated for the 3x3x3 neighbourhood mask (see neighbourhoodMask) of each border point.
+		@return Removal candidates sorted in z-y-x order.
+		*/
+		template<typename pixel_t, typename pred_t> std::vector<Vec3c> thinningCandidates(const Image<pixel_t>& img, ThinningFrontier& frontier, size_t direction, const Vec3c& borderOffset, pred_t isCandidate)
+		{
+			std::vector<Vec3c> bricks = frontier.takeBricks(direction);
+
+			std::vector<Vec3c> candidates;
+			size_t counter = 0;
+			#pragma omp parallel if(!omp_in_parallel() && bricks.size() > 1)
+			{
+				std::vector<Vec3c> localCandidates;
+
+				#pragma omp for schedule(dynamic) nowait
+				for (coord_t n = 0; n < (coord_t)bricks.size(); n++)
+				{
+					Vec3c start = bricks[n];
+					Vec3c end = min(start + Vec3c(ThinningFrontier::BRICK_SIZE, ThinningFrontier::BRICK_SIZE, ThinningFrontier::BRICK_SIZE), img.dimensions());
+					for (coord_t z = start.z; z < end.z; z++)
+					{
+						for (coord_t y = start.y; y < end.y; y++)
+						{
+							for (coord_t x = start.x; x < end.x; x++)
+							{
+								if (img(x, y, z) != (pixel_t)0)
+								{
+									Vec3c p(x, y, z);
+									Vec3c b = p + borderOffset;
+									if (img.isInImage(b) && img(b) == (pixel_t)0 && isCandidate(neighbourhoodMask(img, p)))
+										localCandidates.push_back(p);
+								}
+							}
+						}
+					}
+
+					showThreadProgress(counter, bricks.size());
+				}
+
+				#pragma omp critical(thinning_candidates)
+				candidates.insert(candidates.end(), localCandidates.begin(), localCandidates.end());
+			}
+
+			// This is required to make the result exactly the same than in Fiji (non-threaded version)
+			// Otherwise, the point removal order may change the skeleton points.
+			std::sort(candidates.begin(), candidates.end(), vecComparer<coord_t>);
+
+			return candidates;
+		}
+
+		/**
+		Removes points in the given order if they pass the given test, re-evaluating the test for each point in the current image.
+		The result is the same as if the points were processed sequentially, but image rows are processed in parallel.
+		The test of a point depends only on its 3x3x3 neighbourhood, so row (y, z) depends only on rows (y - 1, z), (y - 1, z - 1), (y, z - 1) and (y + 1, z - 1)
+		that precede it in z-y-x order. Therefore all rows whose 2 * z + y is the same can be processed at the same time.
+		@param img Image that is being thinned.
+		@param points Points to process, sorted in z-y-x order.
+		@param canRemove Predicate that is evaluated for the 3x3x3 neighbourhood mask (see neighbourhoodMask) of each point.
+		@param removed At output, nonzero for each point that was removed.
+		@return Count of removed points.
+		*/
+		template<typename pixel_t, typename pred_t> size_t removeSimplePoints(Image<pixel_t>& img, const std::vector<Vec3c>& points, pred_t canRemove, std::vector<uint8_t>& removed)
+		{
+			removed.assign(points.size(), 0);
+
+			// Divide points into rows.
+			std::vector<size_t> rowStarts;
+			for (size_t n = 0; n < points.size(); n++)
+			{
+				if (n == 0 || points[n].y != points[n - 1].y || points[n].z != points[n - 1].z)
+					rowStarts.push_back(n);
+			}
+			rowStarts.push_back(points.size());
+
+			// Order rows by wavefront index.
+			std::vector<size_t> rows(rowStarts.size() - 1);
+			for (size_t n = 0; n < rows.size(); n++)
+				rows[n] = n;
+
+			auto wave = [&](size_t row)
+				{
+					const Vec3c& p = points[rowStarts[row]];
+					return 2 * p.z + p.y;
+				};
+			std::stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) { return wave(a) < wave(b); });
+
+			std::vector<size_t> waveStarts;
+			for (size_t n = 0; n < rows.size(); n++)
+			{
+				if (n == 0 || wave(rows[n]) != wave(rows[n - 1]))
+					waveStarts.push_back(n);
+			}
+			waveStarts.push_back(rows.size());
+
+			#pragma omp parallel if(!omp_in_parallel() && rows.size() > 1)
+			{
+				for (size_t w = 0; w < waveStarts.size() - 1; w++)
+				{
+					#pragma omp for schedule(dynamic)
+					for (coord_t n = (coord_t)waveStarts[w]; n < (coord_t)waveStarts[w + 1]; n++)
+					{
+						size_t row = rows[n];
+						for (size_t i = rowStarts[row]; i < rowStarts[row + 1]; i++)
+						{
+							const Vec3c& p = points[i];
+							if (canRemove(neighbourhoodMask(img, p)))
+							{
+								img(p) = 0;
+								removed[i] = 1;
+							}
+						}
+					}
+				}
+			}
+
+			size_t changed = 0;
+			for (uint8_t r : removed)
+				changed += r;
+			return changed;
+		}
+	}
+
+	namespace tests
+	{
+		void frontierThinning();
+		void neighbourhoodMasks();
+	}
+}
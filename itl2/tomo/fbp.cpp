@@ -10,6 +10,8 @@
 #include "math/vec4.h"
 #include "io/raw.h"
 #include "generation.h"
+#include "testutils.h"
+#include "timer.h"
 
 #if defined(USE_OPENCL)
 #define __CL_ENABLE_EXCEPTIONS
@@ -19,6 +21,9 @@
 #include <iostream>
 #include <functional>
 #include <array>
+#include <future>
+#include <memory>
+#include <omp.h>
 using namespace std;
 
 
@@ -320,9 +325,9 @@ namespace itl2
 		Checks that projection images and settings correspond to each other.
 		Adjusts zero elements in roi size vector to full image dimension.
 		*/
-		void sanityCheck(const Image<float32_t>& transmissionProjections, RecSettings& settings, bool projectionsAreBinned)
+		void sanityCheck(const Vec3c& transmissionProjectionsSize, RecSettings& settings, bool projectionsAreBinned)
 		{
-			if (transmissionProjections.depth() != settings.angles.size())
+			if (transmissionProjectionsSize.z != (coord_t)settings.angles.size())
 				throw ITLException("Count of projection images and count of angles do not match.");
 
 			size_t projCount = settings.angles.size();
@@ -347,18 +352,22 @@ namespace itl2
 
 			// Roi size and position
 			if (settings.roiSize.x <= 0)
-				settings.roiSize.x = projectionsAreBinned ? transmissionProjections.width() * settings.binning : transmissionProjections.width();
+				settings.roiSize.x = projectionsAreBinned ? transmissionProjectionsSize.x * settings.binning : transmissionProjectionsSize.x;
 			if (settings.roiSize.x <= 0)
 				settings.roiSize.x = 1;
 			if (settings.roiSize.y <= 0)
-				settings.roiSize.y = projectionsAreBinned ? transmissionProjections.width() * settings.binning : transmissionProjections.width();
+				settings.roiSize.y = projectionsAreBinned ? transmissionProjectionsSize.x * settings.binning : transmissionProjectionsSize.x;
 			if (settings.roiSize.y <= 0)
 				settings.roiSize.y = 1;
 			if (settings.roiSize.z <= 0)
-				settings.roiSize.z = projectionsAreBinned ? transmissionProjections.height() * settings.binning : transmissionProjections.height();
+				settings.roiSize.z = projectionsAreBinned ? transmissionProjectionsSize.y * settings.binning : transmissionProjectionsSize.y;
 			if (settings.roiSize.z <= 0)
 				settings.roiSize.z = 1;
+		}
 
+		void sanityCheck(const Image<float32_t>& transmissionProjections, RecSettings& settings, bool projectionsAreBinned)
+		{
+			sanityCheck(transmissionProjections.dimensions(), settings, projectionsAreBinned);
 		}
 	}
 
@@ -498,16 +507,11 @@ namespace itl2
 			}
 			case FilterType::Ramp:
 			{
-				initFFTW();
 				coord_t s = filter.width() - 1;
 				coord_t pow2 = s << 1;
 				Image<complex32_t> F(pow2);
 
-				fftwf_plan plan;
-				#pragma omp critical
-				{
-					plan = fftwf_plan_dft_1d((int)pow2, (fftwf_complex*)F.getData(), (fftwf_complex*)F.getData(), FFTW_FORWARD, FFTW_ESTIMATE);
-				}
+				internals::FFTWPlan plan = internals::fftwPlan(internals::FFTWTransform::Forward, F.dimensions(), 1, F.getData(), F.getData());
 
 				F(0) = 0.25;
 				for (coord_t i = 1; i < F.width(); i++)
@@ -523,16 +527,11 @@ namespace itl2
 						F(i) = F(pow2 - i);
 				}
 
-				fftwf_execute(plan);
+				fftwf_execute_dft(plan.get(), (fftwf_complex*)F.getData(), (fftwf_complex*)F.getData());
 
 				for (coord_t n = 0; n < filter.width(); n++)
 					filter(n) = 2 * F(n).real();
 
-				#pragma omp critical
-				{
-					fftwf_destroy_plan(plan);
-				}
-
 				break;
 			}
 			case FilterType::SheppLogan:
@@ -648,9 +647,10 @@ namespace itl2
 
 		/**
 		FFT plans.
+		These come from the plan cache and are shared between threads.
 		*/
-		fftwf_plan forward;
-		fftwf_plan backward;
+		internals::FFTWPlan forward;
+		internals::FFTWPlan backward;
 
 		/**
 		Amount of padding on each size of the buffers in pixels.
@@ -676,20 +676,8 @@ namespace itl2
 
 			createFilter(H, filterType, cutoff);
 
-			#pragma omp critical
-			{
-				forward = fftwf_plan_dft_r2c_1d((int)paddedWidth, in.getData(), (fftwf_complex*)out.getData(), FFTW_ESTIMATE);
-				backward = fftwf_plan_dft_c2r_1d((int)paddedWidth, (fftwf_complex*)out.getData(), in.getData(), FFTW_ESTIMATE);
-			}
-		}
-
-		~FilterSettings()
-		{
-			#pragma omp critical
-			{
-				fftwf_destroy_plan(backward);
-				fftwf_destroy_plan(forward);
-			}
+			forward = internals::fftwPlan(internals::FFTWTransform::RealToComplex, in.dimensions(), 1, in.getData(), out.getData());
+			backward = internals::fftwPlan(internals::FFTWTransform::ComplexToReal, in.dimensions(), 1, out.getData(), in.getData());
 		}
 	};
 
@@ -726,14 +714,14 @@ namespace itl2
 
 			// Transform
 			// NOTE: Output stores only non-negative frequencies!
-			fftwf_execute(settings.forward);
+			fftwf_execute_dft_r2c(settings.forward.get(), settings.in.getData(), (fftwf_complex*)settings.out.getData());
 
 			// Apply filter
 			for (coord_t x = 0; x < settings.out.width(); x++)
 				settings.out(x) *= settings.H(x);
 
 			// Inverse transform
-			fftwf_execute(settings.backward);
+			fftwf_execute_dft_c2r(settings.backward.get(), (fftwf_complex*)settings.out.getData(), settings.in.getData());
 
 			// Normalize and copy to output
 			for (coord_t x = 0; x < projectionWidth; x++)
@@ -916,70 +904,134 @@ namespace itl2
 		}
 	}
 	
-	void fbpPreprocess(const Image<float32_t>& transmissionProjections, Image<float32_t>& preprocessedProjections, RecSettings settings)
+	namespace internals
 	{
-		internals::sanityCheck(transmissionProjections, settings, false);
-
-		size_t origBinning = settings.binning;
-
-		// Calculate size of preprocessed projections
-		Vec3c croppedSize(transmissionProjections.dimensions());
-		if (settings.cropSize.max() > 0)
+		/**
+		Preprocesses transmission projections one projection at a time.
+		*/
+		class ProjectionPreprocessor
 		{
-			croppedSize.x = transmissionProjections.width() - 2 * settings.cropSize.x;
-			croppedSize.y = transmissionProjections.height() - 2 * settings.cropSize.y;
+		private:
+			/**
+			Reconstruction settings with binning applied.
+			*/
+			RecSettings settings;
 
-			//if (croppedSize.x / settings.binning <= 0 || croppedSize.y / settings.binning <= 0)
-			//	throw ITLException("Too large crop size. Cropped projection image size must be at least 1x1 pixels after cropping and binning.");
-		}
+			/**
+			Binning of the transmission projections.
+			*/
+			size_t origBinning;
+
+			/**
+			Size of the transmission projections after cropping, and size of the preprocessed projections.
+			*/
+			Vec3c croppedSize;
+			Vec3c outSize;
+
+			float32_t gammamax0;
+			float32_t centralAngle;
+
+		public:
+			/**
+			Temporary buffers needed to preprocess one projection.
+			*/
+			struct Workspace
+			{
+				Image<float32_t> med;
+				Image<float32_t> tmp;
+				Image<float32_t> cropTmp;
+				FilterSettings filterSettings;
+
+				Workspace(const ProjectionPreprocessor& preprocessor) :
+					cropTmp(preprocessor.croppedSize.x, preprocessor.croppedSize.y),
+					filterSettings(preprocessor.settings.padFraction, preprocessor.outSize.x, preprocessor.settings.filterType, preprocessor.settings.filterCutOff)
+				{
+				}
+			};
+
+			/**
+			Constructor
+			@param transmissionProjectionsSize Dimensions of the transmission projection stack.
+			@param settings Reconstruction settings.
+			*/
+			ProjectionPreprocessor(const Vec3c& transmissionProjectionsSize, RecSettings settings) :
+				settings(settings)
+			{
+				sanityCheck(transmissionProjectionsSize, this->settings, false);
 
-		Vec3c outputSize = croppedSize;
-		if (settings.binning > 1)
-		{
-			outputSize.x /= (coord_t)settings.binning;
-			outputSize.y /= (coord_t)settings.binning;
-		}
+				origBinning = this->settings.binning;
 
-		if (outputSize.min() <= 0)
-			throw ITLException("Too large crop size or binning. A projection image must have at least 1x1 pixels after cropping and binning.");
-		
-		// Adjust parameters for binning
-		internals::applyBinningToParameters(settings);
+				// Calculate size of preprocessed projections
+				croppedSize = transmissionProjectionsSize;
+				if (this->settings.cropSize.max() > 0)
+				{
+					croppedSize.x = transmissionProjectionsSize.x - 2 * this->settings.cropSize.x;
+					croppedSize.y = transmissionProjectionsSize.y - 2 * this->settings.cropSize.y;
+				}
 
-		preprocessedProjections.ensureSize(outputSize);
+				outSize = croppedSize;
+				if (origBinning > 1)
+				{
+					outSize.x /= (coord_t)origBinning;
+					outSize.y /= (coord_t)origBinning;
+				}
 
-		// Maximum angle for any ray
-		float32_t gammamax0 = internals::calculateGammaMax0((float32_t)preprocessedProjections.width(), settings.sourceToRA);
+				if (outSize.min() <= 0)
+					throw ITLException("Too large crop size or binning. A projection image must have at least 1x1 pixels after cropping and binning.");
 
-		cout << "Maximum half cone angle on optical axis = " << gammamax0 << " deg" << endl;
+				// Adjust parameters for binning
+				applyBinningToParameters(this->settings);
 
-		float32_t centralAngle = internals::calculateTrueCentralAngle(settings.centralAngleFor180degScan, settings.angles, gammamax0);
+				// Maximum angle for any ray
+				gammamax0 = calculateGammaMax0((float32_t)outSize.x, this->settings.sourceToRA);
 
-		if (settings.reconstructAs180degScan)
-			cout << "Central angle for 180 deg reconstruction: " << centralAngle << " deg (available angular range = " << min(settings.angles) << " deg - " << max(settings.angles) << " deg)" << endl;
+				cout << "Maximum half cone angle on optical axis = " << gammamax0 << " deg" << endl;
 
-		cout << "Preprocessing..." << endl;
+				centralAngle = calculateTrueCentralAngle(this->settings.centralAngleFor180degScan, this->settings.angles, gammamax0);
 
-		// Process slice by slice to reduce disk I/O when the transmission projection image is memory-mapped.
-		float32_t averageBadPixels = 0;
-		size_t maxBadPixels = 0;
-		size_t counter = 0;
-		#pragma omp parallel
-		{
-			Image<float32_t> med;
-			Image<float32_t> tmp;
-			FilterSettings filterSettings(settings.padFraction, preprocessedProjections.width(), settings.filterType, settings.filterCutOff);
+				if (this->settings.reconstructAs180degScan)
+					cout << "Central angle for 180 deg reconstruction: " << centralAngle << " deg (available angular range = " << min(this->settings.angles) << " deg - " << max(this->settings.angles) << " deg)" << endl;
+			}
 
-			Image<float32_t> cropTmp(croppedSize.x, croppedSize.y);
+			/**
+			Gets dimensions of the preprocessed projection stack.
+			*/
+			const Vec3c& outputSize() const
+			{
+				return outSize;
+			}
 
-			#pragma omp for
-			for (coord_t z = 0; z < preprocessedProjections.depth(); z++)
+			/**
+			Estimates amount of memory in bytes needed by one Workspace and the temporary images allocated while preprocessing one projection.
+			*/
+			size_t workspaceBytes() const
 			{
-				//cout << "Processing slice " << z << endl;
+				size_t sliceBytes = (size_t)outSize.x * (size_t)outSize.y * sizeof(float32_t);
 
-				Image<float32_t> origSlice(transmissionProjections, z, z);
-				Image<float32_t> slice(preprocessedProjections, z, z);
+				// Median filtering and its temporary buffers, and the cropping buffer.
+				size_t bytes = 4 * sliceBytes + (size_t)croppedSize.x * (size_t)croppedSize.y * sizeof(float32_t);
+
+				// Padded real-valued and complex-valued Paganin buffers.
+				if (settings.phaseMode == PhaseMode::Paganin)
+				{
+					float32_t padFraction = settings.phasePadFraction;
+					clamp(padFraction, 0.0f, 1.0f);
+					bytes += (size_t)(2 * (1 + 2 * padFraction) * (1 + 2 * padFraction) * sliceBytes);
+				}
+
+				return bytes;
+			}
 
+			/**
+			Preprocesses one projection.
+			@param origSlice Transmission projection.
+			@param slice Image where the preprocessed projection is placed. The size of the image must be outputSize().x x outputSize().y.
+			@param angleIndex Index of the projection.
+			@param workspace Temporary buffers.
+			@return Count of dead pixels in the projection.
+			*/
+			size_t process(const Image<float32_t>& origSlice, Image<float32_t>& slice, coord_t angleIndex, Workspace& workspace) const
+			{
 				if (settings.cropSize.max() > 0 && origBinning <= 1)
 				{
 					// Cropping but no binning
@@ -993,22 +1045,63 @@ namespace itl2
 				else if (settings.cropSize.max() > 0 && origBinning > 1)
 				{
 					// Cropping and binning
-					crop(origSlice, cropTmp, Vec3c(settings.cropSize.x, settings.cropSize.y, 0));
-					binning(cropTmp, slice, Vec3c(origBinning, origBinning, 1), false);
+					crop(origSlice, workspace.cropTmp, Vec3c(settings.cropSize.x, settings.cropSize.y, 0));
+					binning(workspace.cropTmp, slice, Vec3c(origBinning, origBinning, 1), false);
 				}
 				else
 				{
 					// No binning, no cropping
 					setValue(slice, origSlice);
 				}
-				
+
 				// NOTE: In the Direct mode no values are out of range.
-				if(settings.phaseMode != PhaseMode::Direct)
+				if (settings.phaseMode != PhaseMode::Direct)
 					replaceOutOfRangeValues(slice);
 
-				if(settings.removeDeadPixels)
+				size_t badPixelCount = 0;
+				if (settings.removeDeadPixels)
+					badPixelCount = deadPixelRemovalSlice(slice, workspace.med, workspace.tmp, settings.deadPixelMedianRadius, settings.deadPixelStdDevCount);
+
+				phaseRetrievalSlice(slice, settings.phaseMode, settings.phasePadType, settings.phasePadFraction, settings.sourceToRA, settings.objectCameraDistance, settings.delta, settings.mu);
+
+				if (!NumberUtils<float32_t>::equals(settings.bhc, 0))
+					beamHardeningCorrection(slice, settings.bhc);
+
+				fbpWeightingSlice(slice, angleIndex, settings.reconstructAs180degScan, settings.angles, settings.centerShift, settings.csAngleSlope, settings.sourceToRA, settings.cameraZShift, centralAngle, gammamax0, settings.heuristicSinogramWindowingParameter);
+
+				filterSlice(slice, workspace.filterSettings, settings.padType);
+
+				return badPixelCount;
+			}
+		};
+	}
+
+	void fbpPreprocess(const Image<float32_t>& transmissionProjections, Image<float32_t>& preprocessedProjections, RecSettings settings)
+	{
+		internals::ProjectionPreprocessor preprocessor(transmissionProjections.dimensions(), settings);
+
+		preprocessedProjections.ensureSize(preprocessor.outputSize());
+
+		cout << "Preprocessing..." << endl;
+
+		// Process slice by slice to reduce disk I/O when the transmission projection image is memory-mapped.
+		float32_t averageBadPixels = 0;
+		size_t maxBadPixels = 0;
+		size_t counter = 0;
+		#pragma omp parallel
+		{
+			internals::ProjectionPreprocessor::Workspace workspace(preprocessor);
+
+			#pragma omp for
+			for (coord_t z = 0; z < preprocessedProjections.depth(); z++)
+			{
+				Image<float32_t> origSlice(transmissionProjections, z, z);
+				Image<float32_t> slice(preprocessedProjections, z, z);
+
+				size_t badPixelCount = preprocessor.process(origSlice, slice, z, workspace);
+
+				if (settings.removeDeadPixels)
 				{
-					size_t badPixelCount = deadPixelRemovalSlice(slice, med, tmp, settings.deadPixelMedianRadius, settings.deadPixelStdDevCount);
 #pragma omp critical(badpixelsslice)
 					{
 						averageBadPixels += badPixelCount;
@@ -1016,15 +1109,6 @@ namespace itl2
 					}
 				}
 
-				phaseRetrievalSlice(slice, settings.phaseMode, settings.phasePadType, settings.phasePadFraction, settings.sourceToRA, settings.objectCameraDistance, settings.delta, settings.mu);
-				
-				if(!NumberUtils<float32_t>::equals(settings.bhc, 0))
-					beamHardeningCorrection(slice, settings.bhc);
-
-				fbpWeightingSlice(slice, z, settings.reconstructAs180degScan, settings.angles, settings.centerShift, settings.csAngleSlope, settings.sourceToRA, settings.cameraZShift, centralAngle, gammamax0, settings.heuristicSinogramWindowingParameter);
-				
-				filterSlice(slice, filterSettings, settings.padType);
-				
 				showThreadProgress(counter, preprocessedProjections.depth());
 			}
 		}
@@ -1061,6 +1145,450 @@ namespace itl2
 	}
 
 
+	namespace internals
+	{
+		vector<BackprojectionAngle> determineBackprojectionAngles(const RecSettings& settings, coord_t projectionWidth)
+		{
+			vector<Vec3f> pss, pds, us, vs, ws;
+			determineBackprojectionGeometry(settings, projectionWidth, pss, pds, us, vs, ws);
+
+			vector<BackprojectionAngle> angles;
+			angles.reserve(pss.size());
+			for (size_t n = 0; n < pss.size(); n++)
+			{
+				BackprojectionAngle a;
+				a.ps = pss[n];
+				a.psmpd = pss[n] - pds[n];
+				a.u = us[n];
+				a.v = vs[n];
+				a.w = ws[n];
+				a.K = -a.psmpd.dot(a.w);
+				angles.push_back(a);
+			}
+
+			return angles;
+		}
+
+		void backprojectBlock(const Image<float32_t>& transmissionProjections, coord_t projectionRowStart, coord_t projectionHeight, const vector<BackprojectionAngle>& angles, float32_t sourceToRA, const Vec3f& center,
+			const AABox<coord_t>& block, coord_t projectionBlockSize, vector<float32_t>& sums)
+		{
+			constexpr coord_t L = BACKPROJECTION_LANES;
+
+			const coord_t projWidth = transmissionProjections.width();
+			const coord_t projHeight = transmissionProjections.height();
+			const coord_t projCount = transmissionProjections.depth();
+			const float32_t projectionHalfWidth = (float32_t)projWidth / 2.0f;
+			const float32_t projectionHalfHeight = (float32_t)projectionHeight / 2.0f;
+			const float32_t maxU = (float32_t)projWidth + 1;
+			const float32_t maxV = (float32_t)projHeight + 1;
+			const float32_t tol = NumberUtils<float32_t>::tolerance();
+
+			// 32-bit indices are used in the inner loop as they vectorize better.
+			if (projWidth * projHeight > (coord_t)std::numeric_limits<int32_t>::max())
+				throw ITLException("Projection images are too large for blocked backprojection.");
+			const int32_t w = (int32_t)projWidth;
+			const int32_t h = (int32_t)projHeight;
+
+			sums.assign(block.volume(), 0.0f);
+
+			for (coord_t angleStart = 0; angleStart < projCount; angleStart += projectionBlockSize)
+			{
+				coord_t angleEnd = std::min(angleStart + projectionBlockSize, projCount);
+
+				size_t rowStart = 0;
+				for (coord_t z = block.minc.z; z < block.maxc.z; z++)
+				{
+					for (coord_t y = block.minc.y; y < block.maxc.y; y++)
+					{
+						for (coord_t x0 = block.minc.x; x0 < block.maxc.x; x0 += L)
+						{
+							coord_t count = std::min(L, block.maxc.x - x0);
+							float32_t* pSum = &sums[rowStart + (x0 - block.minc.x)];
+
+							float32_t acc[L];
+							int32_t ind00[L], ind10[L], ind01[L], ind11[L];
+							float32_t w00[L], w10[L], w01[L], w11[L];
+							for (coord_t i = 0; i < L; i++)
+								acc[i] = i < count ? pSum[i] : 0.0f;
+
+							// Position of the first pixel of this run of pixels.
+							Vec3f p0 = Vec3f((float32_t)x0, (float32_t)y, (float32_t)z) - center;
+
+							for (coord_t anglei = angleStart; anglei < angleEnd; anglei++)
+							{
+								const BackprojectionAngle& g = angles[anglei];
+								const float32_t* pProj = transmissionProjections.getData() + transmissionProjections.getLinearIndex(0, 0, anglei);
+
+								// All the quantities below are affine functions of x, so we calculate them
+								// at the first pixel of the run and then advance by a constant step.
+								Vec3f dVec0 = p0 - g.ps;
+								const float32_t denom0 = dVec0.dot(g.w);
+								const float32_t nu0 = dVec0.dot(g.u);
+								const float32_t nv0 = dVec0.dot(g.v);
+								const float32_t pw0 = sourceToRA + p0.dot(g.w);
+								const float32_t cu = g.psmpd.dot(g.u) + projectionHalfWidth;
+								const float32_t cv = g.psmpd.dot(g.v) + projectionHalfHeight - (float32_t)projectionRowStart;
+								const float32_t dx = g.w.x;
+								const float32_t dux = g.u.x;
+								const float32_t dvx = g.v.x;
+								const float32_t K = g.K;
+
+								// Calculate detector coordinates, interpolation positions and weights.
+								#pragma omp simd
+								for (coord_t i = 0; i < L; i++)
+								{
+									float32_t xi = (float32_t)i;
+									float32_t denom = denom0 + xi * dx;
+									bool valid = std::abs(denom) >= tol;
+									// NOTE: The division is done for all lanes so that the compiler does not need to make it conditional.
+									float32_t d = K / (valid ? denom : 1.0f);
+									d = valid ? d : 0.0f;
+
+									float32_t u = cu + d * (nu0 + xi * dux);
+									float32_t v = cv + d * (nv0 + xi * dvx);
+
+									// This weight is needed in the FDK algorithm.
+									float32_t weight = sourceToRA / (pw0 + xi * dx);
+									weight *= weight;
+									weight = valid ? weight : 0.0f;
+
+									// Linear interpolation with zero boundary condition.
+									// Coordinates are clamped to a range slightly larger than the image so that they can be safely converted to integers.
+									// As the clamped coordinates are >= -2, floor can be calculated by truncation. (std::floor does not vectorize
+									// without -fno-trapping-math.)
+									u = std::min(std::max(u, -2.0f), maxU);
+									v = std::min(std::max(v, -2.0f), maxV);
+									int32_t iu0 = (int32_t)(u + 2.0f) - 2;
+									int32_t iv0 = (int32_t)(v + 2.0f) - 2;
+									float32_t au = u - (float32_t)iu0;
+									float32_t av = v - (float32_t)iv0;
+									int32_t iu1 = iu0 + 1;
+									int32_t iv1 = iv0 + 1;
+
+									// Pixels outside of the projection get zero weight, and their index is clamped to a valid pixel.
+									float32_t wu0 = (iu0 >= 0) & (iu0 < w) ? (1 - au) : 0.0f;
+									float32_t wu1 = (iu1 >= 0) & (iu1 < w) ? au : 0.0f;
+									float32_t wv0 = (iv0 >= 0) & (iv0 < h) ? (1 - av) * weight : 0.0f;
+									float32_t wv1 = (iv1 >= 0) & (iv1 < h) ? av * weight : 0.0f;
+
+									int32_t cu0 = std::min(std::max(iu0, 0), w - 1);
+									int32_t cu1 = std::min(std::max(iu1, 0), w - 1);
+									int32_t cv0 = std::min(std::max(iv0, 0), h - 1) * w;
+									int32_t cv1 = std::min(std::max(iv1, 0), h - 1) * w;
+
+									ind00[i] = cv0 + cu0;
+									ind10[i] = cv0 + cu1;
+									ind01[i] = cv1 + cu0;
+									ind11[i] = cv1 + cu1;
+									w00[i] = wu0 * wv0;
+									w10[i] = wu1 * wv0;
+									w01[i] = wu0 * wv1;
+									w11[i] = wu1 * wv1;
+								}
+
+								// Accumulate. This loop is separate from the one above as it contains the (non-contiguous) loads
+								// from the projection, and those vectorize only on some hardware.
+								#pragma omp simd
+								for (coord_t i = 0; i < L; i++)
+								{
+									acc[i] += w00[i] * pProj[ind00[i]] + w10[i] * pProj[ind10[i]] + w01[i] * pProj[ind01[i]] + w11[i] * pProj[ind11[i]];
+								}
+							}
+
+							for (coord_t i = 0; i < count; i++)
+								pSum[i] = acc[i];
+						}
+
+						rowStart += block.width();
+					}
+				}
+			}
+		}
+
+		void projectionRowRange(const vector<BackprojectionAngle>& angles, const Vec3f& center, const AABox<coord_t>& block, coord_t projectionHeight, coord_t& rowStart, coord_t& rowEnd)
+		{
+			const float32_t projectionHalfHeight = (float32_t)projectionHeight / 2.0f;
+			const float32_t tol = NumberUtils<float32_t>::tolerance();
+
+			float32_t minV = numeric_limits<float32_t>::infinity();
+			float32_t maxV = -numeric_limits<float32_t>::infinity();
+			for (const BackprojectionAngle& g : angles)
+			{
+				const float32_t cv = g.psmpd.dot(g.v) + projectionHalfHeight;
+
+				// The detector v-coordinate is a ratio of two affine functions of the position, so if the denominator
+				// does not change sign in the block, the extreme values of v are found at the corners of the block.
+				float32_t firstDenom = 0;
+				for (size_t n = 0; n < 8; n++)
+				{
+					Vec3f p((float32_t)((n & 1) ? block.maxc.x - 1 : block.minc.x),
+						(float32_t)((n & 2) ? block.maxc.y - 1 : block.minc.y),
+						(float32_t)((n & 4) ? block.maxc.z - 1 : block.minc.z));
+					Vec3f dVec = p - center - g.ps;
+					float32_t denom = dVec.dot(g.w);
+					if (n == 0)
+						firstDenom = denom;
+
+					if (std::abs(denom) < tol || (denom < 0) != (firstDenom < 0))
+					{
+						// The source is (nearly) in the block, so any row might be needed.
+						rowStart = 0;
+						rowEnd = projectionHeight;
+						return;
+					}
+
+					float32_t v = cv + g.K / denom * dVec.dot(g.v);
+					minV = std::min(minV, v);
+					maxV = std::max(maxV, v);
+				}
+			}
+
+			// Linear interpolation reads rows floor(v) and floor(v) + 1.
+			// One extra row is included at both ends to account for rounding errors.
+			rowStart = (coord_t)floor(minV) - 1;
+			rowEnd = (coord_t)floor(maxV) + 3;
+			clamp(rowStart, (coord_t)0, projectionHeight - 1);
+			clamp(rowEnd, rowStart + 1, projectionHeight);
+		}
+
+		/**
+		Preprocesses transmission projections stored in a .raw file, and writes the results to another .raw file.
+		The projections are processed in batches, and the next batch is read and the previous one is written while the current batch is being processed.
+		*/
+		void fbpPreprocessStreaming(const string& inFile, const Vec3c& inDimensions, const ProjectionPreprocessor& preprocessor, bool removeDeadPixels, const string& outFile, size_t maxMemory)
+		{
+			const Vec3c& outDimensions = preprocessor.outputSize();
+			size_t threadCount = (size_t)omp_get_max_threads();
+
+			// Input and output batches are double-buffered, and each thread needs its own workspace.
+			size_t inBytes = (size_t)inDimensions.x * (size_t)inDimensions.y * sizeof(float32_t);
+			size_t outBytes = (size_t)outDimensions.x * (size_t)outDimensions.y * sizeof(float32_t);
+			size_t projectionBytes = 2 * (inBytes + outBytes);
+			size_t workspaceBytes = threadCount * preprocessor.workspaceBytes();
+			if (maxMemory < workspaceBytes + projectionBytes)
+				throw ITLException(string("The memory budget is too small for preprocessing. At least ") + bytesToString((double)(workspaceBytes + projectionBytes)) + " is required.");
+
+			coord_t batchSize = std::min((coord_t)((maxMemory - workspaceBytes) / projectionBytes), inDimensions.z);
+			coord_t batchCount = (inDimensions.z + batchSize - 1) / batchSize;
+
+			cout << "Preprocessing in " << batchCount << " batches of " << batchSize << " projections..." << endl;
+
+			Image<float32_t> inBuffers[2];
+			Image<float32_t> outBuffers[2];
+			for (size_t n = 0; n < 2; n++)
+			{
+				inBuffers[n].ensureSize(inDimensions.x, inDimensions.y, batchSize);
+				outBuffers[n].ensureSize(outDimensions.x, outDimensions.y, batchSize);
+			}
+
+			auto batchStart = [&](coord_t batch)
+				{
+					return batch * batchSize;
+				};
+
+			auto batchEnd = [&](coord_t batch)
+				{
+					return std::min(batchStart(batch) + batchSize, inDimensions.z);
+				};
+
+			auto read = [&](coord_t batch)
+				{
+					Image<float32_t> view(inBuffers[batch % 2], 0, batchEnd(batch) - batchStart(batch) - 1);
+					raw::readBlockNoParse(view, inFile, inDimensions, Vec3c(0, 0, batchStart(batch)));
+				};
+
+			auto write = [&](coord_t batch)
+				{
+					Image<float32_t> view(outBuffers[batch % 2], 0, batchEnd(batch) - batchStart(batch) - 1);
+					raw::writeBlock(view, outFile, Vec3c(0, 0, batchStart(batch)), outDimensions);
+				};
+
+			vector<unique_ptr<ProjectionPreprocessor::Workspace> > workspaces(threadCount);
+
+			float32_t averageBadPixels = 0;
+			size_t maxBadPixels = 0;
+
+			{
+				ProgressIndicator progress(batchCount);
+				future<void> reading = async(launch::async, read, 0);
+				future<void> writing;
+				for (coord_t batch = 0; batch < batchCount; batch++)
+				{
+					reading.get();
+					if (batch + 1 < batchCount)
+						reading = async(launch::async, read, batch + 1);
+
+					// The output buffer of this batch was used by batch - 2, and that has been written before writing of batch - 1 was started.
+					const Image<float32_t>& in = inBuffers[batch % 2];
+					Image<float32_t>& out = outBuffers[batch % 2];
+					coord_t start = batchStart(batch);
+					#pragma omp parallel
+					{
+						unique_ptr<ProjectionPreprocessor::Workspace>& workspace = workspaces[omp_get_thread_num()];
+						if (!workspace)
+							workspace = make_unique<ProjectionPreprocessor::Workspace>(preprocessor);
+
+						#pragma omp for schedule(dynamic)
+						for (coord_t anglei = start; anglei < batchEnd(batch); anglei++)
+						{
+							Image<float32_t> origSlice(in, anglei - start, anglei - start);
+							Image<float32_t> slice(out, anglei - start, anglei - start);
+
+							size_t badPixelCount = preprocessor.process(origSlice, slice, anglei, *workspace);
+
+							if (removeDeadPixels)
+							{
+#pragma omp critical(badpixelsslice)
+								{
+									averageBadPixels += badPixelCount;
+									maxBadPixels = std::max(maxBadPixels, badPixelCount);
+								}
+							}
+						}
+					}
+
+					if (writing.valid())
+						writing.get();
+					writing = async(launch::async, write, batch);
+
+					progress.step();
+				}
+				writing.get();
+			}
+
+			if (removeDeadPixels)
+				printBadPixelInfo(averageBadPixels / (float)inDimensions.z, maxBadPixels);
+		}
+
+		/**
+		Backprojects preprocessed projections stored in a .raw file to a .raw file.
+		The output is processed in slabs of slices, and only the projection rows needed for the current slab are kept in memory.
+		The rows of the next slab are read and the previous slab is written while the current slab is being backprojected.
+		@param settings Reconstruction settings, with binning applied.
+		*/
+		void backprojectStreaming(const string& inFile, const Vec3c& inDimensions, const RecSettings& settings, const string& outFile, size_t maxMemory,
+			const Vec3c& blockSize, coord_t projectionBlockSize)
+		{
+			vector<BackprojectionAngle> angles = determineBackprojectionAngles(settings, inDimensions.x);
+			Vec3f center = Vec3f(settings.roiSize) / 2.0f - Vec3f(settings.roiCenter) - Vec3f(0.5, 0.5, 0.5);
+			const Vec3c& outDimensions = settings.roiSize;
+
+			// Find the thickest slabs whose projection rows and output slices fit into the memory budget.
+			// Both are double-buffered. Additionally, each thread in backprojectSlab needs a buffer for the sums of one output block.
+			size_t rowBytes = (size_t)inDimensions.x * (size_t)inDimensions.z * sizeof(float32_t);
+			size_t sliceBytes = (size_t)outDimensions.x * (size_t)outDimensions.y * sizeof(float32_t);
+			size_t threadBytes = (size_t)omp_get_max_threads() * (size_t)blockSize.product() * sizeof(float32_t);
+			coord_t slabDepth = outDimensions.z;
+			vector<Vec2c> rows;
+			while (true)
+			{
+				rows.clear();
+				coord_t maxRows = 0;
+				for (coord_t z = 0; z < outDimensions.z; z += slabDepth)
+				{
+					AABox<coord_t> slab = AABox<coord_t>::fromMinMax(Vec3c(0, 0, z), Vec3c(outDimensions.x, outDimensions.y, std::min(z + slabDepth, outDimensions.z)));
+					Vec2c r;
+					projectionRowRange(angles, center, slab, inDimensions.y, r.x, r.y);
+					rows.push_back(r);
+					maxRows = std::max(maxRows, r.y - r.x);
+				}
+
+				size_t requiredBytes = 2 * ((size_t)maxRows * rowBytes + (size_t)slabDepth * sliceBytes) + threadBytes;
+				if (requiredBytes <= maxMemory)
+					break;
+
+				if (slabDepth <= 1)
+					throw ITLException(string("The memory budget is too small for backprojection. At least ") + bytesToString((double)requiredBytes) + " is required.");
+
+				slabDepth = (slabDepth + 1) / 2;
+			}
+
+			cout << "Backprojecting in " << rows.size() << " slabs of " << slabDepth << " slices..." << endl;
+
+			Image<float32_t> inBuffers[2];
+			Image<float32_t> outBuffers[2];
+
+			auto read = [&](size_t slab)
+				{
+					Image<float32_t>& buffer = inBuffers[slab % 2];
+					buffer.ensureSize(inDimensions.x, rows[slab].y - rows[slab].x, inDimensions.z);
+					raw::readBlockNoParse(buffer, inFile, inDimensions, Vec3c(0, rows[slab].x, 0));
+				};
+
+			auto write = [&](size_t slab)
+				{
+					raw::writeBlock(outBuffers[slab % 2], outFile, Vec3c(0, 0, slab * slabDepth), outDimensions);
+				};
+
+			ProgressIndicator progress(rows.size());
+			future<void> reading = async(launch::async, read, 0);
+			future<void> writing;
+			for (size_t slab = 0; slab < rows.size(); slab++)
+			{
+				reading.get();
+				if (slab + 1 < rows.size())
+					reading = async(launch::async, read, slab + 1);
+
+				// The output buffer of this slab was used by slab - 2, and that has been written before writing of slab - 1 was started.
+				coord_t z = slab * slabDepth;
+				Image<float32_t>& out = outBuffers[slab % 2];
+				out.ensureSize(outDimensions.x, outDimensions.y, std::min(slabDepth, outDimensions.z - z));
+				backprojectSlab(inBuffers[slab % 2], rows[slab].x, inDimensions.y, angles, settings, z, out, blockSize, projectionBlockSize, false);
+
+				if (writing.valid())
+					writing.get();
+				writing = async(launch::async, write, slab);
+
+				progress.step();
+			}
+			writing.get();
+		}
+	}
+
+	string fbpStreaming(const string& transmissionProjectionsFile, const string& outputFile, RecSettings settings, size_t maxMemory, const Vec3c& blockSize, coord_t projectionBlockSize)
+	{
+		if (blockSize.min() <= 0)
+			throw ITLException("Block size must be positive.");
+		if (projectionBlockSize <= 0)
+			throw ITLException("Projection block size must be positive.");
+
+		string inFile = transmissionProjectionsFile;
+		Vec3c inDimensions;
+		raw::getInfoAndCheck<float32_t>(inFile, inDimensions);
+		raw::internals::expandRawFilename(inFile);
+
+		internals::ProjectionPreprocessor preprocessor(inDimensions, settings);
+		const Vec3c& preprocessedDimensions = preprocessor.outputSize();
+
+		// Backprojection settings are determined as in backprojectBlocked.
+		internals::sanityCheck(preprocessedDimensions, settings, true);
+		internals::applyBinningToParameters(settings);
+
+		string preprocessedFile = concatDimensions(outputFile + "_preprocessed", preprocessedDimensions);
+		string outFile = concatDimensions(outputFile, settings.roiSize);
+
+		// Removes the temporary file when leaving this function, also if an exception is thrown.
+		struct TempFileRemover
+		{
+			string filename;
+
+			~TempFileRemover()
+			{
+				std::error_code ec;
+				fs::remove(filename, ec);
+			}
+		} preprocessedFileRemover{ preprocessedFile };
+
+		cout << "Preprocessing..." << endl;
+		internals::fbpPreprocessStreaming(inFile, inDimensions, preprocessor, settings.removeDeadPixels, preprocessedFile, maxMemory);
+
+		cout << "Backprojection..." << endl;
+		internals::backprojectStreaming(preprocessedFile, preprocessedDimensions, settings, outFile, maxMemory, blockSize, projectionBlockSize);
+
+		return outFile;
+	}
+
+
 
 #if defined(USE_OPENCL)
 
@@ -1761,6 +2289,137 @@ kernel void backproject(read_only image3d_t transmissionProjections,
 			raw::writed(slice, "./fbp/after_paganin");
 		}
 
+		void backprojectBlocked()
+		{
+			// Create some non-trivial projection data
+			coord_t projWidth = 60;
+			coord_t projHeight = 40;
+			coord_t projectionCount = 90;
+			Image<float32_t> projections(projWidth, projHeight, projectionCount);
+			forAllPixels(projections, [&](coord_t x, coord_t y, coord_t z)
+				{
+					projections(x, y, z) = (float32_t)(sin(0.3 * x + 0.05 * z) * cos(0.2 * y) + 0.01 * x);
+				});
+
+			RecSettings settings;
+			for (coord_t anglei = 0; anglei < projectionCount; anglei++)
+			{
+				settings.angles.push_back(360.0f / projectionCount * anglei);
+				settings.sampleShifts.push_back(Vec3f(2 * cos(0.1f * anglei), sin(0.1f * anglei), 0.5f * cos(0.2f * anglei)));
+				settings.cameraShifts.push_back(Vec3f(0, 1.5f * sin(0.3f * anglei), 0));
+			}
+			settings.reconstructAs180degScan = false;
+			settings.sourceToRA = 200;
+			settings.objectCameraDistance = 100;
+			settings.centerShift = 1.5f;
+			settings.cameraZShift = -2;
+			settings.cameraRotation = 1.0f;
+			settings.roiSize = Vec3c(47, 43, 37);
+			settings.roiCenter = Vec3c(2, -3, 1);
+
+			Timer timer;
+
+			Image<float32_t> reference;
+			timer.start();
+			itl2::backproject(projections, settings, reference);
+			timer.stop();
+			cout << "Backprojection takes " << timer.getSeconds() << " s" << endl;
+
+			Image<float32_t> blocked;
+			timer.start();
+			itl2::backprojectBlocked(projections, settings, blocked, Vec3c(20, 7, 5), 13);
+			timer.stop();
+			cout << "Blocked backprojection takes " << timer.getSeconds() << " s" << endl;
+
+			double tol = 1e-5 * std::max(std::abs(max(reference)), std::abs(min(reference)));
+			checkDifference(reference, blocked, "blocked backprojection and normal backprojection", tol);
+
+			// Non-float output type
+			settings.dynMin = min(reference);
+			settings.dynMax = max(reference);
+			Image<uint16_t> reference16;
+			Image<uint16_t> blocked16;
+			itl2::backproject(projections, settings, reference16);
+			itl2::backprojectBlocked(projections, settings, blocked16);
+			checkDifference(reference16, blocked16, "blocked backprojection and normal backprojection (uint16)", 1.5);
+		}
+
+		void fbpStreaming()
+		{
+			// Transmission projections with some dead pixels
+			coord_t projWidth = 68;
+			coord_t projHeight = 44;
+			coord_t projectionCount = 90;
+			Image<float32_t> projections(projWidth, projHeight, projectionCount);
+			forAllPixels(projections, [&](coord_t x, coord_t y, coord_t z)
+				{
+					projections(x, y, z) = (float32_t)(0.6 + 0.3 * sin(0.3 * x + 0.05 * z) * cos(0.2 * y));
+				});
+			for (coord_t z = 0; z < projectionCount; z += 7)
+				projections((3 * z) % projWidth, (5 * z) % projHeight, z) = 0.001f;
+
+			string inFile = raw::writed(projections, "./fbp_streaming/transmission");
+
+			RecSettings settings;
+			for (coord_t anglei = 0; anglei < projectionCount; anglei++)
+				settings.angles.push_back(360.0f / projectionCount * anglei);
+			settings.reconstructAs180degScan = false;
+			settings.sourceToRA = 100;
+			settings.objectCameraDistance = 50;
+			settings.centerShift = 1.5f;
+			settings.roiSize = Vec3c(120, 120, 40);
+			settings.removeDeadPixels = true;
+			settings.phasePadFraction = 0.25f;
+
+			// The budget must leave room for the per-thread preprocessing buffers, and it is small enough that
+			// the projections are preprocessed in multiple batches and the output is reconstructed in multiple slabs.
+			size_t maxMemory = (size_t)omp_get_max_threads() * 256 * 1024 + 1024 * 1024;
+
+			for (PhaseMode phaseMode : { PhaseMode::Absorption, PhaseMode::Paganin })
+			{
+				for (size_t binning : { 1, 2 })
+				{
+					string desc = toString(phaseMode) + ", binning " + toString(binning);
+
+					settings.phaseMode = phaseMode;
+					settings.binning = binning;
+					settings.cropSize = binning > 1 ? Vec2c(2, 1) : Vec2c(0, 0);
+
+					Timer timer;
+					timer.start();
+					Image<float32_t> preprocessed;
+					fbpPreprocess(projections, preprocessed, settings);
+					Image<float32_t> reference;
+					itl2::backprojectBlocked(preprocessed, settings, reference);
+					timer.stop();
+					cout << "In-memory reconstruction takes " << timer.getSeconds() << " s" << endl;
+
+					timer.start();
+					string outFile = itl2::fbpStreaming(inFile, "./fbp_streaming/reconstruction", settings, maxMemory);
+					timer.stop();
+					cout << "Streaming reconstruction takes " << timer.getSeconds() << " s" << endl;
+					for (const auto& entry : fs::directory_iterator("./fbp_streaming"))
+						testAssert(entry.path().filename().string().find("_preprocessed") == string::npos, "preprocessed temporary file has been removed");
+
+					Image<float32_t> result;
+					raw::read(result, outFile);
+
+					double tol = 1e-4 * std::max(std::abs(max(reference)), std::abs(min(reference)));
+					checkDifference(reference, result, "streaming reconstruction and in-memory reconstruction, " + desc, tol);
+				}
+			}
+
+			// A thin slab needs only part of the projection rows.
+			RecSettings s = settings;
+			s.binning = 1;
+			internals::sanityCheck(projections, s, true);
+			vector<internals::BackprojectionAngle> angles = internals::determineBackprojectionAngles(s, projWidth);
+			Vec3f center = Vec3f(s.roiSize) / 2.0f - Vec3f(s.roiCenter) - Vec3f(0.5, 0.5, 0.5);
+			coord_t rowStart, rowEnd;
+			internals::projectionRowRange(angles, center, AABox<coord_t>::fromMinMax(Vec3c(0, 0, 18), Vec3c(s.roiSize.x, s.roiSize.y, 22)), projHeight, rowStart, rowEnd);
+			testAssert(rowStart > 0 && rowEnd < projHeight, "projection row range of a thin slab");
+		}
+
 		void fbp()
 		{
 			Image<float32_t> original;
@@ -632,6 +632,8 @@ namespace itl2
 	{
 		void sanityCheck(const Image<float32_t>& transmissionProjections, RecSettings& settings, bool projectionsAreBinned);
 
+		void sanityCheck(const Vec3c& transmissionProjectionsSize, RecSettings& settings, bool projectionsAreBinned);
+
 		float32_t calculateTrueCentralAngle(float32_t centralAngleFor180degScan, const std::vector<float32_t>& angles, float32_t gammamax0);
 
 		float32_t calculateGammaMax0(float32_t projectionWidth, float32_t d);
@@ -883,6 +885,173 @@ namespace itl2
 	}
 
 
+	namespace internals
+	{
+		/**
+		Count of output pixels that are processed together in the inner loop of the blocked CPU backprojection.
+		The loops over the lanes are written such that the compiler can vectorize them (e.g. with AVX2 or AVX-512).
+		*/
+		constexpr coord_t BACKPROJECTION_LANES = 16;
+
+		/**
+		Geometry of single projection, in the form needed by the blocked CPU backprojection.
+		*/
+		struct BackprojectionAngle
+		{
+			/**
+			Source position.
+			*/
+			Vec3f ps;
+
+			/**
+			Source position minus detector position.
+			*/
+			Vec3f psmpd;
+
+			/**
+			Detector right and up vectors (divided by magnification), and detector normal.
+			*/
+			Vec3f u, v, w;
+
+			/**
+			-(ps - pd).w, i.e. numerator of the distance from the source to the detector plane.
+			*/
+			float32_t K;
+		};
+
+		/**
+		Calculates geometry of each projection for blocked backprojection.
+		*/
+		std::vector<BackprojectionAngle> determineBackprojectionAngles(const RecSettings& settings, coord_t projectionWidth);
+
+		/**
+		Backprojects all projections to the block [block.minc, block.maxc[ of the output image.
+		Stores the unscaled sums of the backprojected values to the given buffer, in the same order than pixels are stored in an image.
+		The projections are processed in blocks of projectionBlockSize so that the parts of the projections
+		that are needed for the output block stay in the cache while the rows of the output block are processed.
+		@param transmissionProjections Rows [projectionRowStart, projectionRowStart + transmissionProjections.height()[ of the projections.
+		The rows must contain all the rows needed for the block (see projectionRowRange), or the whole projections.
+		@param projectionRowStart Index of the first row in transmissionProjections.
+		@param projectionHeight Height of the whole projections.
+		@param center Vec3f(settings.roiSize) / 2 - Vec3f(settings.roiCenter) - Vec3f(0.5, 0.5, 0.5).
+		*/
+		void backprojectBlock(const Image<float32_t>& transmissionProjections, coord_t projectionRowStart, coord_t projectionHeight, const std::vector<BackprojectionAngle>& angles, float32_t sourceToRA, const Vec3f& center,
+			const AABox<coord_t>& block, coord_t projectionBlockSize, std::vector<float32_t>& sums);
+
+		/**
+		Determines the range of projection rows that are needed to backproject to the block [block.minc, block.maxc[ of the output image.
+		@param center Vec3f(settings.roiSize) / 2 - Vec3f(settings.roiCenter) - Vec3f(0.5, 0.5, 0.5).
+		@param projectionHeight Height of the projections.
+		@param rowStart, rowEnd At output, the needed rows are [rowStart, rowEnd[. The range contains at least one row.
+		*/
+		void projectionRowRange(const std::vector<BackprojectionAngle>& angles, const Vec3f& center, const AABox<coord_t>& block, coord_t projectionHeight, coord_t& rowStart, coord_t& rowEnd);
+
+		/**
+		Backprojects to slices [outputStartZ, outputStartZ + output.depth()[ of the reconstruction.
+		The slab is divided into blocks that are processed in parallel.
+		@param transmissionProjections Rows [projectionRowStart, projectionRowStart + transmissionProjections.height()[ of the projections, see backprojectBlock.
+		@param projectionRowStart Index of the first row in transmissionProjections.
+		@param projectionHeight Height of the whole projections.
+		@param settings Reconstruction settings, with binning applied.
+		@param output Image where the slices of the reconstruction are placed. The width and height of the image must equal settings.roiSize.
+		@param blockSize Size of output blocks that are processed by a single thread.
+		@param projectionBlockSize Count of projections that are processed at once for each output block.
+		*/
+		template<typename out_t> void backprojectSlab(const Image<float32_t>& transmissionProjections, coord_t projectionRowStart, coord_t projectionHeight,
+			const std::vector<BackprojectionAngle>& angles, const RecSettings& settings, coord_t outputStartZ, Image<out_t>& output,
+			const Vec3c& blockSize, coord_t projectionBlockSize, bool showProgressInfo)
+		{
+			float32_t normFact = normFactor(settings);
+
+			Vec3f center = Vec3f(settings.roiSize) / 2.0f - Vec3f(settings.roiCenter) - Vec3f(0.5, 0.5, 0.5);
+
+			// The blocks are in the coordinates of the whole reconstruction.
+			// They are calculated from their linear index so that the list of blocks does not need to be stored.
+			Vec3c outputStart(0, 0, outputStartZ);
+			Vec3c outputEnd(output.width(), output.height(), outputStartZ + output.depth());
+			Vec3c blockCounts = (outputEnd - outputStart + blockSize - Vec3c(1, 1, 1)).componentwiseDivide(blockSize);
+			coord_t blockCount = blockCounts.product();
+
+			ProgressIndicator progress((size_t)blockCount, showProgressInfo);
+			#pragma omp parallel if(!omp_in_parallel())
+			{
+				std::vector<float32_t> sums;
+
+				#pragma omp for schedule(dynamic)
+				for (coord_t n = 0; n < blockCount; n++)
+				{
+					Vec3c minc = outputStart + indexToCoords(n, blockCounts).componentwiseMultiply(blockSize);
+					Vec3c maxc = itl2::min(minc + blockSize, outputEnd);
+					AABox<coord_t> block = AABox<coord_t>::fromMinMax(minc, maxc);
+					backprojectBlock(transmissionProjections, projectionRowStart, projectionHeight, angles, settings.sourceToRA, center, block, projectionBlockSize, sums);
+
+					size_t i = 0;
+					for (coord_t z = block.minc.z; z < block.maxc.z; z++)
+					{
+						for (coord_t y = block.minc.y; y < block.maxc.y; y++)
+						{
+							for (coord_t x = block.minc.x; x < block.maxc.x; x++)
+							{
+								float32_t sum = sums[i] * normFact;
+								i++;
+
+								// Scaling
+								sum = (sum - settings.dynMin) / (settings.dynMax - settings.dynMin) * NumberUtils<out_t>::scale();
+								output(x, y, z - outputStartZ) = pixelRound<out_t>(sum);
+							}
+						}
+					}
+
+					progress.step();
+				}
+			}
+		}
+	}
+
+	/**
+	Backprojection on the CPU that divides the output image into blocks, and the projections into blocks of projectionBlockSize projections.
+	The blocks are processed in parallel, and in each block the detector coordinates are calculated incrementally along the rows of the output image.
+	The output equals that of backproject function up to floating point rounding errors, but this version is typically much faster.
+	@param blockSize Size of output blocks that are processed by a single thread.
+	@param projectionBlockSize Count of projections that are processed at once for each output block.
+	*/
+	template<typename out_t> void backprojectBlocked(const Image<float32_t>& transmissionProjections, RecSettings settings, Image<out_t>& output, const Vec3c& blockSize = Vec3c(64, 8, 8), coord_t projectionBlockSize = 16)
+	{
+		internals::sanityCheck(transmissionProjections, settings, true);
+		output.mustNotBe(transmissionProjections);
+
+		if (blockSize.min() <= 0)
+			throw ITLException("Block size must be positive.");
+		if (projectionBlockSize <= 0)
+			throw ITLException("Projection block size must be positive.");
+
+		internals::applyBinningToParameters(settings);
+
+		output.ensureSize(settings.roiSize);
+
+		std::vector<internals::BackprojectionAngle> angles = internals::determineBackprojectionAngles(settings, transmissionProjections.width());
+
+		internals::backprojectSlab(transmissionProjections, 0, transmissionProjections.height(), angles, settings, 0, output, blockSize, projectionBlockSize, true);
+	}
+
+
+	/**
+	Filtered backprojection of transmission projections stored in a .raw file, for data that does not fit into the memory.
+	The projections are preprocessed as in fbpPreprocess one batch of projections at a time, and the preprocessed projections are stored
+	in a temporary file [outputFile]_preprocessed_[width]x[height]x[depth].raw that is deleted at the end.
+	The output is then reconstructed one slab of slices at a time as in backprojectBlocked, reading only the projection rows that are needed for the slab.
+	Reading the next batch or slab and writing the previous one are done in background threads while the current one is being processed.
+	The preprocessing is done for whole projections as Paganin phase retrieval and dead pixel removal require them.
+	@param transmissionProjectionsFile Name of .raw file containing the transmission projections (pixel data type float32).
+	@param outputFile Template of the output file name. The full file name will be [outputFile]_[width]x[height]x[depth].raw.
+	@param settings Reconstruction settings.
+	@param maxMemory Approximate maximum amount of memory in bytes used for the projection and output buffers.
+	@param blockSize Size of output blocks that are processed by a single thread.
+	@param projectionBlockSize Count of projections that are processed at once for each output block.
+	@return The name of the output file.
+	*/
+	std::string fbpStreaming(const std::string& transmissionProjectionsFile, const std::string& outputFile, RecSettings settings, size_t maxMemory,
+		const Vec3c& blockSize = Vec3c(64, 8, 8), coord_t projectionBlockSize = 16);
 
 
 #if defined(USE_OPENCL)
@@ -894,6 +1063,8 @@ namespace itl2
 	{
 		void recSettings();
 		void fbp();
+		void backprojectBlocked();
+		void fbpStreaming();
 		void paganin();
 
 		void openCLBackProjection();
@@ -6,6 +6,8 @@
 #include "pointprocess.h"
 #include "testutils.h"
 #include "generation.h"
+#include "noise.h"
+#include "timer.h"
 
 
 using namespace std;
@@ -249,6 +251,211 @@ namespace itl2
 			checkDifference(orig, img, string("cropped and back-copied are different, pos = ") + toString(pos));
 		}
 
+		/**
+		Checks that interpolateRow gives the same results than interpolating one location at a time.
+		@param exact Set to false to allow small differences that result from the compiler contracting multiplications and additions
+		differently in the vectorized and in the per-location code.
+		*/
+		template<typename out_t, typename in_t, typename real_t> void checkInterpolateRow(const Image<in_t>& img, const Interpolator<out_t, in_t, real_t>& interpolator, const string& name, bool exact)
+		{
+			size_t count = 20000;
+			vector<real_t> x(count), y(count), z(count);
+			srand(5);
+			for (size_t n = 0; n < count; n++)
+			{
+				x[n] = (real_t)(rand() % 10000) / 10000 * (img.width() + 6) - 3;
+				y[n] = (real_t)(rand() % 10000) / 10000 * (img.height() + 6) - 3;
+				if (img.depth() > 1 || n % 4 == 0)
+					z[n] = (real_t)(rand() % 10000) / 10000 * (img.depth() + 6) - 3;
+				else
+					z[n] = 0;
+
+				// Integer coordinates.
+				if (n % 10 == 0)
+					x[n] = ::round(x[n]);
+			}
+
+			vector<out_t> row(count);
+			interpolator.interpolateRow(img, x.data(), y.data(), z.data(), row.data(), count);
+
+			size_t errors = 0;
+			for (size_t n = 0; n < count; n++)
+			{
+				out_t single = interpolator(img, x[n], y[n], z[n]);
+				if (exact ? single != row[n] : !NumberUtils<double>::equals((double)single, (double)row[n], 1e-4 * (1 + std::abs((double)single))))
+					errors++;
+			}
+
+			testAssert(errors == 0, "interpolateRow, " + name + ", " + toString(errors) + " errors");
+		}
+
+		template<typename out_t, typename in_t> void checkInterpolateRow(const Image<in_t>& img, const string& name)
+		{
+			for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+			{
+				string desc = name + ", " + toString(bc);
+				checkInterpolateRow(img, NearestNeighbourInterpolator<out_t, in_t>(bc), "nearest, " + desc, true);
+				checkInterpolateRow(img, LinearInterpolator<out_t, in_t>(bc), "linear, " + desc, true);
+				checkInterpolateRow(img, LinearInvalidValueInterpolator<out_t, in_t>(bc, 0, 0), "linear invalid value, " + desc, false);
+				checkInterpolateRow(img, CubicInterpolator<out_t, in_t>(bc), "cubic, " + desc, true);
+				checkInterpolateRow(img, CubicInvalidValueInterpolator<out_t, in_t>(bc, 0, 0), "cubic invalid value, " + desc, false);
+			}
+		}
+
+		void interpolateRow()
+		{
+			Image<float32_t> img(50, 40, 30);
+			noise(img, 100.0, 20.0, 11);
+			Image<uint16_t> img16(img.dimensions());
+			setValue(img16, img);
+
+			// Invalid values.
+			for (coord_t n = 0; n < img16.pixelCount(); n += 7)
+				img16(n) = 0;
+
+			checkInterpolateRow<float32_t>(img, "float32, 3D");
+			checkInterpolateRow<uint16_t>(img16, "uint16, 3D");
+			checkInterpolateRow<float32_t>(img16, "uint16 to float32, 3D");
+
+			Image<float32_t> img2(70, 60);
+			noise(img2, 100.0, 20.0, 12);
+			checkInterpolateRow<float32_t>(img2, "float32, 2D");
+
+			// Timing
+			Image<float32_t> large(200, 200, 200);
+			noise(large, 100.0, 20.0, 13);
+
+			size_t count = 4000000;
+			vector<float32_t> x(count), y(count), z(count);
+			srand(7);
+			for (size_t n = 0; n < count; n++)
+			{
+				x[n] = (float32_t)(rand() % 10000) / 10000 * 190 + 5;
+				y[n] = (float32_t)(rand() % 10000) / 10000 * 190 + 5;
+				z[n] = (float32_t)(rand() % 10000) / 10000 * 190 + 5;
+			}
+			// Locations in a row are typically close to each other.
+			sort(x.begin(), x.end());
+
+			vector<float32_t> result1(count), result2(count);
+			for (InterpolationMode mode : { InterpolationMode::Linear, InterpolationMode::Cubic })
+			{
+				auto interpolator = createInterpolator<float32_t, float32_t>(mode, BoundaryCondition::Zero);
+
+				Timer timer;
+				timer.start();
+				for (size_t n = 0; n < count; n++)
+					result1[n] = (*interpolator)(large, x[n], y[n], z[n]);
+				timer.stop();
+				cout << toString(mode) << " interpolation one location at a time took " << timer.getSeconds() << " s" << endl;
+
+				timer.start();
+				for (size_t n = 0; n < count; n += 1000)
+					interpolator->interpolateRow(large, &x[n], &y[n], &z[n], &result2[n], 1000);
+				timer.stop();
+				cout << toString(mode) << " interpolation in rows took " << timer.getSeconds() << " s" << endl;
+
+				testAssert(result1 == result2, "interpolateRow result, " + toString(mode));
+			}
+		}
+
+		/**
+		Calculates affine transformation of the image by interpolating at A * outPos + b separately for each pixel.
+		*/
+		template<typename pixel_t, typename out_t> void referenceAffineTransform(const Image<pixel_t>& in, Image<out_t>& out, const Matrix3x3d& A, const Vec3d& b, const Interpolator<out_t, pixel_t>& interpolate)
+		{
+			using real_t = typename NumberUtils<out_t>::RealFloatType;
+			#pragma omp parallel for if(!omp_in_parallel())
+			for (coord_t z = 0; z < out.depth(); z++)
+			{
+				for (coord_t y = 0; y < out.height(); y++)
+				{
+					for (coord_t x = 0; x < out.width(); x++)
+					{
+						Vec3d p = A * Vec3d((double)x, (double)y, (double)z) + b;
+						out(x, y, z) = interpolate(in, (real_t)p.x, (real_t)p.y, (real_t)p.z);
+					}
+				}
+			}
+		}
+
+		void affineTransform()
+		{
+			Image<float32_t> img(60, 50, 40);
+			noise(img, 100.0, 20.0, 17);
+
+			Matrix3x3d R = Matrix3x3d::rotationMatrix(0.3, Vec3d(1, 2, 3));
+			Matrix3x3d S(0.7, 0.1, 0, -0.2, 1.3, 0.05, 0, 0, 0.5);
+
+			for (InterpolationMode mode : { InterpolationMode::Nearest, InterpolationMode::Linear, InterpolationMode::Cubic })
+			{
+				for (BoundaryCondition bc : { BoundaryCondition::Zero, BoundaryCondition::Nearest })
+				{
+					auto interpolator = createInterpolator<float32_t, float32_t>(mode, bc);
+					string desc = toString(mode) + ", " + toString(bc);
+
+					// Output larger than input so that some rows are partially and some completely outside of the input.
+					Image<float32_t> out(80, 70, 50), gt(80, 70, 50);
+					itl2::affineTransform(img, out, R, Vec3d(-10, -8, 5), *interpolator);
+					referenceAffineTransform(img, gt, R, Vec3d(-10, -8, 5), *interpolator);
+					checkDifference(out, gt, "rotation, " + desc, 1e-3f);
+
+					itl2::affineTransform(img, out, S, Vec3d(3.5, -2.25, 1), *interpolator);
+					referenceAffineTransform(img, gt, S, Vec3d(3.5, -2.25, 1), *interpolator);
+					checkDifference(out, gt, "shear, " + desc, 1e-3f);
+
+					// 2D
+					Image<float32_t> img2(70, 60), out2(90, 50), gt2(90, 50);
+					noise(img2, 100.0, 20.0, 18);
+					Matrix3x3d R2 = Matrix3x3d::rotationMatrix(-0.4, Vec3d(0, 0, 1));
+					itl2::affineTransform(img2, out2, R2, Vec3d(10, -20, 0), *interpolator);
+					referenceAffineTransform(img2, gt2, R2, Vec3d(10, -20, 0), *interpolator);
+					checkDifference(out2, gt2, "2D rotation, " + desc, 1e-3f);
+				}
+			}
+
+			// Reslicing along the coordinate axes does not change the image.
+			{
+				Image<float32_t> out(img.dimensions());
+				itl2::reslice(img, out, Vec3d(img.dimensions()) / 2.0, Vec3d(1, 0, 0), Vec3d(0, 1, 0), Vec3d(0, 0, 1), LinearInterpolator<float32_t, float32_t>(BoundaryCondition::Zero));
+				checkDifference(out, img, "reslice along coordinate axes");
+
+				// Axes (0, 0, 1), (1, 0, 0), (0, 1, 0) turn z into x, x into y and y into z.
+				Image<float32_t> out2(img.depth(), img.width(), img.height());
+				itl2::reslice(img, out2, Vec3d(img.dimensions()) / 2.0, Vec3d(0, 0, 1), Vec3d(1, 0, 0), Vec3d(0, 1, 0), NearestNeighbourInterpolator<float32_t, float32_t>(BoundaryCondition::Zero));
+				bool ok = true;
+				for (coord_t z = 0; z < out2.depth(); z++)
+					for (coord_t y = 0; y < out2.height(); y++)
+						for (coord_t x = 0; x < out2.width(); x++)
+							if (out2(x, y, z) != img(y, z, x))
+								ok = false;
+				testAssert(ok, "reslice along permuted axes");
+			}
+
+			// Timing
+			Image<float32_t> large(300, 300, 300);
+			noise(large, 100.0, 20.0, 19);
+			Image<float32_t> result1(large.dimensions()), result2(large.dimensions());
+			Vec3d b = Vec3d(large.dimensions()) / 2.0 - R * (Vec3d(large.dimensions()) / 2.0);
+			for (InterpolationMode mode : { InterpolationMode::Linear, InterpolationMode::Cubic })
+			{
+				auto interpolator = createInterpolator<float32_t, float32_t>(mode, BoundaryCondition::Zero);
+
+				Timer timer;
+				timer.start();
+				referenceAffineTransform(large, result1, R, b, *interpolator);
+				timer.stop();
+				cout << toString(mode) << " rotation one pixel at a time took " << timer.getSeconds() << " s" << endl;
+
+				timer.start();
+				itl2::affineTransform(large, result2, R, b, *interpolator);
+				timer.stop();
+				cout << toString(mode) << " rotation with affine transform engine took " << timer.getSeconds() << " s" << endl;
+
+				checkDifference(result1, result2, "rotation of large image, " + toString(mode), 1e-3f);
+			}
+		}
+
 		void crop()
 		{
 			singleCropTest(Vec3c(50, 40, 0));
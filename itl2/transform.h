@@ -17,6 +17,149 @@
 
 namespace itl2
 {
+	namespace internals
+	{
+		/**
+		Size of the output tiles processed by one thread in affineTransform.
+		One tile row spans a few kilobytes of output, and the source pixels needed by the tile stay in the cache while the tile is processed.
+		*/
+		constexpr coord_t AFFINE_TILE_WIDTH = 256;
+		constexpr coord_t AFFINE_TILE_HEIGHT = 16;
+		constexpr coord_t AFFINE_TILE_DEPTH = 16;
+
+		/**
+		Distance from the image edge beyond which the interpolators do not read any pixels of the image.
+		*/
+		constexpr double AFFINE_SUPPORT_MARGIN = 3;
+
+		/**
+		Clips the line p + t * d, t in [t0, t1[, to the box [lo, hi].
+		@param t0, t1 At input, the range of t to consider. At output, the clipped range. If the range is empty, t1 <= t0.
+		*/
+		inline void clipLine(const Vec3d& p, const Vec3d& d, const Vec3d& lo, const Vec3d& hi, coord_t& t0, coord_t& t1)
+		{
+			if (t1 <= t0)
+				return;
+
+			// Clip in double precision so that almost parallel lines do not overflow coord_t.
+			double first = (double)t0;
+			double last = (double)(t1 - 1);
+			for (size_t n = 0; n < 3; n++)
+			{
+				if (d[n] == 0)
+				{
+					if (p[n] < lo[n] || p[n] > hi[n])
+					{
+						t1 = t0;
+						return;
+					}
+				}
+				else
+				{
+					double a = (lo[n] - p[n]) / d[n];
+					double b = (hi[n] - p[n]) / d[n];
+					if (a > b)
+						std::swap(a, b);
+					first = std::max(first, a);
+					last = std::min(last, b);
+				}
+			}
+
+			if (first > last)
+			{
+				t1 = t0;
+				return;
+			}
+
+			t1 = (coord_t)std::floor(last) + 1;
+			t0 = (coord_t)std::ceil(first);
+		}
+	}
+
+	/**
+	Applies affine transformation to the input image and places the result to the output image.
+	Pixel at position outPos in the output image gets the interpolated value of the input image at position A * outPos + b.
+	The output is processed in tiles in parallel. In each output row, the source position is advanced incrementally by the first column of A,
+	and the range of the row whose source positions are near the input image is calculated analytically, so that
+	with the zero boundary condition the rest of the row is filled without interpolation.
+	@param in Input image.
+	@param out Output image. The size of this image is not changed.
+	@param A, b Transformation from output image coordinates to input image coordinates.
+	@param interpolate Interpolator used to sample the input image.
+	@param showProgressIndicator Set to true to show a progress bar.
+	*/
+	template<typename pixel_t, typename out_t, typename real_t> void affineTransform(const Image<pixel_t>& in, Image<out_t>& out, const Matrix3x3d& A, const Vec3d& b, const Interpolator<out_t, pixel_t, real_t>& interpolate, bool showProgressIndicator = false)
+	{
+		out.mustNotBe(in);
+
+		Vec3c tileSize(internals::AFFINE_TILE_WIDTH, internals::AFFINE_TILE_HEIGHT, internals::AFFINE_TILE_DEPTH);
+		Vec3c tileCounts(
+			(out.width() + tileSize.x - 1) / tileSize.x,
+			(out.height() + tileSize.y - 1) / tileSize.y,
+			(out.depth() + tileSize.z - 1) / tileSize.z);
+		coord_t tileCount = tileCounts.product();
+
+		// With the zero boundary condition, output pixels whose source position is far from the input image get a constant value.
+		bool clip = interpolate.boundaryCondition() == BoundaryCondition::Zero && in.pixelCount() > 0;
+		out_t outsideValue = clip ? interpolate(in, (real_t)(-2 * internals::AFFINE_SUPPORT_MARGIN), 0, 0) : out_t();
+		Vec3d lo(-internals::AFFINE_SUPPORT_MARGIN, -internals::AFFINE_SUPPORT_MARGIN, -internals::AFFINE_SUPPORT_MARGIN);
+		Vec3d hi = Vec3d(in.dimensions()) - Vec3d(1, 1, 1) - lo;
+
+		Vec3d dx(A.a00, A.a10, A.a20);
+
+		ProgressIndicator progress(tileCount, showProgressIndicator);
+		#pragma omp parallel if(!omp_in_parallel() && out.pixelCount() > PARALLELIZATION_THRESHOLD)
+		{
+			std::vector<real_t> xs(tileSize.x), ys(tileSize.x), zs(tileSize.x);
+
+			#pragma omp for schedule(dynamic)
+			for (coord_t n = 0; n < tileCount; n++)
+			{
+				Vec3c start = Vec3c(n % tileCounts.x, (n / tileCounts.x) % tileCounts.y, n / (tileCounts.x * tileCounts.y)).componentwiseMultiply(tileSize);
+				Vec3c end = min(start + tileSize, out.dimensions());
+
+				for (coord_t z = start.z; z < end.z; z++)
+				{
+					for (coord_t y = start.y; y < end.y; y++)
+					{
+						Vec3d p = A * Vec3d((double)start.x, (double)y, (double)z) + b;
+						out_t* row = &out(start.x, y, z);
+
+						coord_t t0 = 0;
+						coord_t t1 = end.x - start.x;
+						if (clip)
+						{
+							internals::clipLine(p, dx, lo, hi, t0, t1);
+							if (t1 <= t0)
+							{
+								t0 = 0;
+								t1 = 0;
+							}
+							for (coord_t t = 0; t < t0; t++)
+								row[t] = outsideValue;
+							for (coord_t t = t1; t < end.x - start.x; t++)
+								row[t] = outsideValue;
+						}
+
+						coord_t count = t1 - t0;
+						for (coord_t t = 0; t < count; t++)
+						{
+							double s = (double)(t0 + t);
+							xs[t] = (real_t)(p.x + s * dx.x);
+							ys[t] = (real_t)(p.y + s * dx.y);
+							zs[t] = (real_t)(p.z + s * dx.z);
+						}
+
+						if (count > 0)
+							interpolate.interpolateRow(in, xs.data(), ys.data(), zs.data(), row + t0, (size_t)count);
+					}
+				}
+
+				progress.step();
+			}
+		}
+	}
+
 	/**
 	Possible directions for volume image re-slicing.
 	*/
@@ -130,6 +273,26 @@ namespace itl2
 		
 	}
 
+	/**
+	Re-slices the input image along arbitrary axes into the output image.
+	Pixel at position outPos in the output image gets the value of the input image at position
+	inCenter + (outPos.x - c.x) * xAxis + (outPos.y - c.y) * yAxis + (outPos.z - c.z) * zAxis,
+	where c is the center of the output image.
+	The axes do not have to be orthogonal or unit vectors; their lengths define the pixel spacing of the output image in the input image.
+	The size of the output image is not changed.
+	@param in Input image.
+	@param out Output image.
+	@param inCenter Position in the input image that maps to the center of the output image.
+	@param xAxis, yAxis, zAxis Directions in the input image corresponding to the x-, y-, and z-axes of the output image.
+	@param interpolate Interpolation type.
+	*/
+	template<typename pixel_t, typename out_t> void reslice(const Image<pixel_t>& in, Image<out_t>& out, const Vec3d& inCenter, const Vec3d& xAxis, const Vec3d& yAxis, const Vec3d& zAxis, const Interpolator<out_t, pixel_t>& interpolate = LinearInterpolator<out_t, pixel_t>(BoundaryCondition::Zero))
+	{
+		Matrix3x3d A(xAxis, yAxis, zAxis);
+		Vec3d outCenter = Vec3d(out.dimensions()) / 2.0;
+		affineTransform(in, out, A, inCenter - A * outCenter, interpolate);
+	}
+
 	/**
 	Flips image 'in' in one or more dimensions and stores the output to 'out'.
 	*/
@@ -240,16 +403,10 @@ namespace itl2
 	{
 		out.mustNotBe(in);
 
-		using real_t = double;
-		Matrix3x3<real_t> R = Matrix3x3<real_t>::rotationMatrix(angle, axis);
+		Matrix3x3d R = Matrix3x3d::rotationMatrix(angle, axis);
 		R.transpose();
 
-		forAllPixels(out, [&](coord_t x, coord_t y, coord_t z)
-		{
-			Vec3d outPos((real_t)x, (real_t)y, (real_t)z);
-			Vec3d inPos = R * (outPos - outCenter) + inCenter;
-			out(x, y, z) = interpolate(in, Vec3<typename NumberUtils<out_t>::RealFloatType>(inPos));
-		});
+		affineTransform(in, out, R, inCenter - R * outCenter, interpolate);
 	}
 
 	/**
@@ -277,18 +434,11 @@ namespace itl2
 	*/
 	template<typename pixel_t, typename out_t> void translate(const Image<pixel_t>& in, Image<out_t>& out, const Vec3d& shift, const Interpolator<out_t, pixel_t>& interpolate = LinearInterpolator<out_t, pixel_t>(BoundaryCondition::Zero))
 	{
-		using real_t = typename NumberUtils<out_t>::RealFloatType;
 		out.mustNotBe(in);
 		if(out.dimensions().max() <= 1)
 			out.ensureSize(in);
 
-		forAllPixels(out, [&](coord_t x, coord_t y, coord_t z)
-		{
-			real_t xs = (real_t)(x - shift.x);
-			real_t ys = (real_t)(y - shift.y);
-			real_t zs = (real_t)(z - shift.z);
-			out(x, y, z) = interpolate(in, xs, ys, zs);
-		});
+		affineTransform(in, out, Matrix3x3d::identity(), -shift, interpolate);
 	}
 
 	/**
@@ -588,24 +738,10 @@ namespace itl2
 	{
 		template<typename in_t, typename out_t, typename real_t> void scaleHelper(const Image<in_t>& in, Image<out_t>& out, const Interpolator<out_t, in_t, real_t>& interpolate = LinearInterpolator<out_t, in_t>(BoundaryCondition::Zero), bool indicateProgress = true, const Vec3d& factor = Vec3d(0, 0, 0), const Vec3d& delta = Vec3d(0, 0, 0))
 		{
-			size_t counter = 0;
-			#pragma omp parallel for if(out.pixelCount() > PARALLELIZATION_THRESHOLD && !omp_in_parallel())
-			for (coord_t z = 0; z < out.depth(); z++)
-			{
-				real_t sz = (real_t)(z / factor.z) + (real_t)delta.z;
-				for (coord_t y = 0; y < out.height(); y++)
-				{
-					real_t sy = (real_t)(y / factor.y) + (real_t)delta.y;
-					for (coord_t x = 0; x < out.width(); x++)
-					{
-						real_t sx = (real_t)(x / factor.x) + (real_t)delta.x;
-						out(x, y, z) = interpolate(in, sx, sy, sz);
-					}
-				}
-
-				showThreadProgress(counter, out.depth(), indicateProgress);
-			}
-
+			Matrix3x3d A(1 / factor.x, 0, 0,
+				0, 1 / factor.y, 0,
+				0, 0, 1 / factor.z);
+			affineTransform(in, out, A, delta, interpolate, indicateProgress);
 		}
 	}
 
@@ -893,25 +1029,13 @@ namespace itl2
 
 		std::vector<Vec3f> shifts = defPoints - refPoints;
 
-		size_t counter = 0;
-		#pragma omp parallel for if (!omp_in_parallel())
-		for (coord_t z = 0; z < out.depth(); z++)
-		{
-			for (coord_t y = 0; y < out.height(); y++)
+		resample(img, out, interpolate, [&](coord_t x, coord_t y, coord_t z)
 			{
-				for (coord_t x = 0; x < out.width(); x++)
-				{
-					Vec3c oix(x, y, z);
-
-					Vec3f ix = Vec3f(oix + outPos);
-					Vec3f transformed = ix + internals::inverseDistanceInterpolate(refPoints, shifts, ix, exponent);
-
-					out(oix) = interpolate(img, transformed.x, transformed.y, transformed.z);
-				}
-			}
-
-			showThreadProgress(counter, out.pixelCount());
-		}
+				Vec3f ix = Vec3f(Vec3c(x, y, z) + outPos);
+				Vec3f transformed = ix + internals::inverseDistanceInterpolate(refPoints, shifts, ix, exponent);
+				return Vec3<typename NumberUtils<out_t>::RealFloatType>(transformed);
+			},
+			true);
 
 	}
 
@@ -926,6 +1050,8 @@ namespace itl2
 		void rotate();
 		void reslice();
 		void crop();
+		void interpolateRow();
+		void affineTransform();
 	}
 
 }
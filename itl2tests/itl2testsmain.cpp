@@ -24,6 +24,7 @@
 #include "lineskeleton.h"
 #include "surfaceskeleton.h"
 #include "surfaceskeleton2.h"
+#include "thinning.h"
 #include "traceskeleton.h"
 #include "structure.h"
 #include "particleanalysis.h"
@@ -51,6 +52,8 @@
 #include "eval.h"
 #include "sdmap.h"
 #include "io/itllz4.h"
+#include "pointpipeline.h"
+#include "nn5accessor.h"
 
 using namespace itl2;
 using namespace std;
@@ -101,9 +104,16 @@ int main()
 	//test(itl2::tests::projections, "projections");
 	//test(itl2::tests::fourierTransformPair, "Fourier transforms");
 	//test(itl2::tests::dctPair, "DCT");
+	//test(itl2::tests::fftPlanCache, "FFTW plan cache");
 	//test(itl2::tests::bandpass, "Bandpass filtering");
 	//test(itl2::tests::projections2, "projections 2");
 	//test(itl2::tests::filters, "filtering");
+	//test(itl2::tests::histogramMedian, "Sliding histogram median filter");
+	//test(itl2::tests::histogramMedianSpeed, "Sliding histogram median filter speed");
+	//test(itl2::tests::runningSumFilters, "Running sum mean, variance and standard deviation filters");
+	//test(itl2::tests::runningSumFiltersSpeed, "Running sum filter speed");
+	//test(itl2::tests::chordFilters, "chord decomposition min and max filters");
+	//test(itl2::tests::chordFiltersSpeed, "chord decomposition min and max filters speed");
 
 	//test(itl2::tests::broadcast, "Broadcasted point process");
 	//test(itl2::tests::bilateral, "bilateral filter");
@@ -114,13 +124,18 @@ int main()
 	//test(itl2::tests::rotate, "rotations around general axes");
 	//test(itl2::tests::reslice, "reslice");
 	//test(itl2::tests::crop, "crop and reverse crop");
+	//test(itl2::tests::interpolateRow, "interpolation in rows");
+	//test(itl2::tests::affineTransform, "affine transform");
 
 	//test(itl2::tests::pointProcess, "point processes");
 	//test(itl2::tests::pointProcessComplex, "point processes on complex numbers");
 	//test(itl2::tests::byteOrder, "byte order swaps");
+	//test(itl2::tests::pointPipeline, "Fused point operation pipeline");
+	//test(itl2::tests::pointPipelineSpeed, "Fused point operation pipeline speed");
 
 
 	//test(itl2::tests::phaseCorrelation, "phase correlation");
+	//test(itl2::tests::phaseCorrelationBatch, "batch phase correlation");
 	//test(itl2::tests::modulo, "modulo function");
 
 	//test(itl2::tests::phaseCorrelation2, "phase correlation 2 (rotation)");
@@ -128,16 +143,20 @@ int main()
 	//test(itl2::tests::blockMatch1, "block match 1");
 	//test(itl2::tests::blockMatch2Match, "block match 2 (match)");
 	//test(itl2::tests::blockMatch2Pullback, "block match 2 (pullback)");
+	//test(itl2::tests::blockMatchBatch, "batched block matching");
+	//test(itl2::tests::stitchShiftField, "stitching with dense shift field");
 
 	//test(itl2::tests::inpaintNearest, "Inpainting");
 	//test(itl2::tests::inpaintGarcia, "Inpainting (Garcia)");
 	//test(itl2::tests::inpaintGarcia2, "Inpainting 2 (Garcia)");
 	//test(itl2::tests::dmap1, "Distance map");
+	//test(itl2::tests::dmapBundles, "Distance map in bundles of rows");
 
 	//test(itl2::tests::buffers, "Disk mapped buffer");
 	//test(itl2::tests::histogramIntermediateType, "Intermediate types in histogram");
 	//test(itl2::tests::histogram, "Histogram");
 	//test(itl2::tests::histogram2d, "Bivariate histogram");
+	//test(itl2::tests::histogramFastPaths, "Histogram fast paths");
 
 	//test(itl2::tests::binning, "Binning");
 	//test(itl2::tests::genericTransform, "Generic geometric transform");
@@ -146,6 +165,7 @@ int main()
 	//test(itl2::tests::floodfillSanityChecks, "sanity checks of flood fill implementations");
 	//test(itl2::tests::floodfillLeaks, "Flood fill leak tests");
 	//test(itl2::tests::floodfillThreading, "Flood fill multithreading");
+	//test(itl2::tests::floodfillNN5, "Flood fill in NN5 dataset");
 
 	//test(itl2::tests::mipMatch, "MIP Match");
 
@@ -156,6 +176,8 @@ int main()
 	//test(itl2::tests::surfaceSkeleton, "Surface skeleton");
 	//test(itl2::experimental::tests::surfaceSkeleton2, "Hybrid skeleton 2");
 	//test(itl2::tests::lineSkeleton, "Line skeleton");
+	//test(itl2::tests::frontierThinning, "Frontier-based thinning");
+	//test(itl2::tests::neighbourhoodMasks, "Neighbourhood mask predicates");
 
 	//test(itl2::tests::traceSkeleton, "trace skeleton");
 	//test(itl2::tests::traceSkeletonRealData, "trace skeleton (real data)");
@@ -163,6 +185,7 @@ int main()
 	//test(itl2::tests::disconnections, "network connect, disconnect, degree, etc.");
 	//test(itl2::tests::disconnectStraightThroughPerformance, "network optimization performance");
 	//test(itl2::tests::pruning, "pruning");
+	//test(itl2::tests::networkAdjacency, "network adjacency index");
 	//test(itl2::tests::lineLength, "line length calculation");
 	//test(itl2::tests::skeletonToPointsAndLines, "skeleton to point-line form");
 
@@ -176,6 +199,7 @@ int main()
 	//test(itl2::tests::analyzeParticlesSanity2, "Analyze particles sanity checks 2");
 	//test(itl2::tests::analyzeParticlesVolumeLimit, "Analyze particles volume limit");
 	//test(itl2::tests::analyzeParticlesThreading, "Analyze particles threading");
+	//test(itl2::tests::analyzeParticlesAccumulate, "Analyze particles using accumulators");
 	//test(itl2::tests::analyzeParticlesThreadingBig, "Analyze particles threading, big volumes"); // This is a long test
 
 	//test(itl2::tests::regionRemoval, "Region removal");
@@ -218,6 +242,7 @@ int main()
 
 	//test(itl2::tests::autothreshold, "automatic thresholding");
 	//test(itl2::tests::localThreshold, "local thresholding");
+	//test(itl2::tests::slidingLocalThreshold, "sliding local thresholding");
 	//test(itl2::tests::localMaxima, "local maxima search");
 
 	//test(itl2::tests::carpet, "surface finding");
@@ -235,6 +260,8 @@ int main()
 	
 
 	//test(itl2::tests::eval, "evaluation of string expressions");
+	//test(itl2::tests::evalCompiled, "compiled evaluation of string expressions");
+	//test(itl2::tests::evalSpeed, "compiled evaluation speed");
 
 	//test(itl2::tests::seededDMap, "seeded distance map");
 
@@ -246,12 +273,16 @@ int main()
 	
 	//test(itl2::lz4::tests::lz4io, "LZ4");
 	//test(itl2::lz4::tests::lz4blockIo, "LZ4 block");
+	//test(itl2::lz4::tests::lz4slabIo, "LZ4 slab format I/O");
 	//
 	//test(itl2::nn5::tests::nn5Metadata, "NN5 metadata");
 	//test(itl2::nn5::tests::nn5io, "NN5 I/O");
 	//test(itl2::nn5::tests::nn5BlockIo, "NN5 block I/O");
 	//test(itl2::nn5::tests::concurrency, "NN5 concurrent I/O");
 	//test(itl2::nn5::tests::concurrencyLong, "NN5 concurrent I/O, long test");
+	//test(itl2::nn5::tests::parallelIo, "NN5 parallel chunk I/O");
+	//test(itl2::nn5::tests::shardedIo, "NN5 sharded I/O");
+	//test(itl2::tests::nn5Accessor, "NN5 chunk-cached accessor");
 	
 	//test(itl2::tests::aabox, "AABox");
 
@@ -263,6 +294,8 @@ int main()
 	//test(itl2::tests::createPlates, "Input geometry generation");
 	//test(itl2::tests::createMoreProjections, "Large number of projections");
 	//test(itl2::tests::fbp, "Filtered backprojection");
+	//test(itl2::tests::backprojectBlocked, "Blocked CPU backprojection");
+	//test(itl2::tests::fbpStreaming, "Streaming filtered backprojection");
 	
 	
 	//test(itl2::tests::openCLBackProjection, "OpenCL filtered backprojection");
@@ -86,6 +86,8 @@ namespace pilib
 
 		JobType getJobType() const;
 
+		std::string getPointOperation() const;
+
 		bool canDistributeInArbitraryBlocks() const;
 
 		bool needsToRun(const Vec3c& readStart, const Vec3c& readSize, const Vec3c& writeFilePos, const Vec3c& writeImPos, const Vec3c& writeSize, size_t blockIndex) const;
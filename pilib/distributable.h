@@ -136,5 +136,16 @@ namespace pilib
 		{
 			return true;
 		}
+
+		/**
+		Gets the point operation performed by this command in the syntax accepted by the pointops command, e.g. "add(3)".
+		Consecutive delayed commands that process the same image and return non-empty point operation are run
+		in a single pass over each block of the image using the pointops command.
+		By default returns empty string, i.e. the command is not a point operation that could be fused.
+		*/
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const
+		{
+			return "";
+		}
 	};
 }
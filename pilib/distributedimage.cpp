@@ -6,6 +6,7 @@
 #include "math/mathutils.h"
 #include "distributor.h"
 #include "utilities.h"
+#include "transform.h"
 
 #include "filesystem.h"
 
@@ -14,6 +15,87 @@ using namespace std;
 
 namespace pilib
 {
+	template<typename pixel_t> unique_ptr<Image<pixel_t> > DistributedImage<pixel_t>::mapRaw(const string& filename, bool readOnly) const
+	{
+		// Disk-mapped images generate the name of the mapped file from a prefix and the dimensions,
+		// so files that are named differently are read and written without mapping.
+		string prefix = getPrefix(filename);
+		if (concatDimensions(prefix, dimensions()) != filename)
+			return nullptr;
+
+		return make_unique<Image<pixel_t> >(prefix, readOnly, dimensions());
+	}
+
+	template<typename pixel_t> void DistributedImage<pixel_t>::beginInProcessAccess(bool forWriting)
+	{
+		endInProcessAccess();
+
+		if (forWriting && currentWriteTargetType() == DistributedImageStorageType::Raw)
+			writeMapping = mapRaw(currentWriteTarget(), false);
+
+		if (isSavedToDisk() && currentReadSourceType() == DistributedImageStorageType::Raw && !(writeMapping && currentReadSource() == currentWriteTarget()))
+			readMapping = mapRaw(currentReadSource(), true);
+	}
+
+	template<typename pixel_t> unique_ptr<ImageBase> DistributedImage<pixel_t>::readBlock(const Vec3c& filePos, const Vec3c& blockSize, bool dataNeeded) const
+	{
+		Image<pixel_t>* mapping = readSourceMapping();
+
+		if (isSavedToDisk() && dataNeeded && mapping && mapping == writeMapping.get() &&
+			filePos.x == 0 && filePos.y == 0 && blockSize.x == width() && blockSize.y == height())
+		{
+			// The block is processed directly in the mapped file.
+			return make_unique<Image<pixel_t> >(*mapping, filePos.z, filePos.z + blockSize.z - 1);
+		}
+
+		unique_ptr<Image<pixel_t> > block = make_unique<Image<pixel_t> >(blockSize);
+		if (isSavedToDisk() && dataNeeded)
+		{
+			if (mapping)
+				copyValues(*block, *mapping, Vec3c(0, 0, 0), filePos, blockSize);
+			else
+				io::readBlock(*block, currentReadSource(), filePos);
+		}
+		return block;
+	}
+
+	template<typename pixel_t> void DistributedImage<pixel_t>::writeBlock(ImageBase& blockBase, const Vec3c& filePos, const Vec3c& imagePos, const Vec3c& blockSize)
+	{
+		Image<pixel_t>* pBlock = dynamic_cast<Image<pixel_t>*>(&blockBase);
+		if (!pBlock)
+			throw ITLException("The data type of the block is not the same than the data type of the distributed image.");
+		Image<pixel_t>& block = *pBlock;
+
+		if (writeMapping)
+		{
+			// If the block is a view to the mapped file, the pixels are already in place.
+			if (&block(imagePos) != &(*writeMapping)(filePos))
+				copyValues(*writeMapping, block, filePos, imagePos, blockSize);
+			return;
+		}
+
+		switch (currentWriteTargetType())
+		{
+		case DistributedImageStorageType::NN5:
+		{
+			// TODO: NN5 compression defaults to LZ4
+			nn5::writeBlock(block, currentWriteTarget(), getChunkSize(), nn5::NN5Compression::LZ4, filePos, dimensions(), imagePos, blockSize);
+			break;
+		}
+		case DistributedImageStorageType::Raw:
+		{
+			raw::writeBlock(block, currentWriteTarget(), filePos, dimensions(), imagePos, blockSize);
+			break;
+		}
+		case DistributedImageStorageType::Sequence:
+		{
+			sequence::writeBlock(block, currentWriteTarget(), filePos, dimensions(), imagePos, blockSize);
+			break;
+		}
+		default: throw ITLException("Invalid write target type.");
+		}
+	}
+
 	template class DistributedImage<uint8_t>;
 	template class DistributedImage<uint16_t>;
 	template class DistributedImage<uint32_t>;
@@ -317,6 +399,12 @@ namespace pilib
 		}
 	}
 
+	void DistributedImageBase::endConcurrentWrite(const Vec3c& chunk) const
+	{
+		if (currentWriteTargetType() == DistributedImageStorageType::NN5)
+			nn5::endConcurrentWrite(currentWriteTarget(), chunk);
+	}
+
 	vector<Vec3c> DistributedImageBase::getChunksThatNeedEndConcurrentWrite() const
 	{
 		if (currentWriteTargetType() == DistributedImageStorageType::NN5)
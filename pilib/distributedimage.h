@@ -283,6 +283,39 @@ namespace pilib
 		*/
 		void writeComplete();
 
+		/**
+		Prepares this image for reading and writing blocks in the current process using readBlock and writeBlock.
+		These are the in-process equivalents of emitReadBlock and emitWriteBlock.
+		Raw read source and write target files are mapped to memory, so their blocks do not have to be transferred through file reads and writes.
+		Call endInProcessAccess when all the blocks have been processed.
+		@param forWriting Set to true if blocks are going to be written to this image.
+		*/
+		virtual void beginInProcessAccess(bool forWriting) = 0;
+
+		/**
+		Releases the memory mappings created in beginInProcessAccess.
+		*/
+		virtual void endInProcessAccess() = 0;
+
+		/**
+		Creates an image that contains a block of this image.
+		If the read source and the write target are the same memory-mapped .raw file and the block consists of whole slices,
+		the returned image is a view to the mapped file and the processing happens directly in the file.
+		@param dataNeeded Set to true if the image is used as input data. Otherwise the block is just allocated.
+		*/
+		virtual std::unique_ptr<ImageBase> readBlock(const Vec3c& filePos, const Vec3c& blockSize, bool dataNeeded) const = 0;
+
+		/**
+		Writes a block of the given image to the write target of this image.
+		@param block Image returned by readBlock.
+		*/
+		virtual void writeBlock(ImageBase& block, const Vec3c& filePos, const Vec3c& imagePos, const Vec3c& blockSize) = 0;
+
+		/**
+		Ends concurrent write for given chunk in the current process. This is the in-process equivalent of emitEndConcurrentWrite.
+		*/
+		void endConcurrentWrite(const Vec3c& chunk) const;
+
 		/**
 		Gets the file path where the image data should be read.
 		*/
@@ -468,6 +501,30 @@ namespace pilib
 
 	template<typename pixel_t> class DistributedImage : public DistributedImageBase
 	{
+	private:
+		/**
+		Memory-mapped read source and write target for in-process block access, or nullptr if the corresponding file is not mapped.
+		If the read source and the write target are the same file, it is mapped only once to writeMapping.
+		*/
+		std::unique_ptr<Image<pixel_t> > readMapping, writeMapping;
+
+		/**
+		Maps the given .raw file of this image to memory, or returns nullptr if the file name does not allow mapping.
+		*/
+		std::unique_ptr<Image<pixel_t> > mapRaw(const std::string& filename, bool readOnly) const;
+
+		/**
+		Gets the mapping that contains the read source of this image, or nullptr.
+		*/
+		Image<pixel_t>* readSourceMapping() const
+		{
+			if (readMapping)
+				return readMapping.get();
+			if (currentReadSource() == currentWriteTarget())
+				return writeMapping.get();
+			return nullptr;
+		}
+
 	public:
 		/**
 		Creates distributed image whose source points to the given file.
@@ -645,6 +702,18 @@ namespace pilib
 			writeComplete();
 		}
 
+		virtual void beginInProcessAccess(bool forWriting) override;
+
+		virtual void endInProcessAccess() override
+		{
+			readMapping.reset();
+			writeMapping.reset();
+		}
+
+		virtual std::unique_ptr<ImageBase> readBlock(const Vec3c& filePos, const Vec3c& blockSize, bool dataNeeded) const override;
+
+		virtual void writeBlock(ImageBase& block, const Vec3c& filePos, const Vec3c& imagePos, const Vec3c& blockSize) override;
+
 
 		/**
 		Throws exception if the given image is the same than this image.
@@ -14,6 +14,8 @@
 #include <tuple>
 #include "filesystem.h"
 #include "timing.h"
+#include "commandlist.h"
+#include "pilibutilities.h"
 
 using namespace std;
 
@@ -768,17 +770,14 @@ namespace pilib
 			}
 
 
-			if (memoryReq <= allowedMemory())
+			if (memoryReq <= jobMemoryLimit())
 			{
 				cout << "Block size = " << refSize << ", preferred multiple = " << preferredBlockSizeMultiple << endl;
 				break;
 			}
 
 			// Condition 1: memory requirement must go down when we increase subdivisions.
-			if (memoryReq > lastMemoryReq)
-			{
-				throw ITLException(string("Unable to find suitable subdivision. Memory requirement does not decrease from ") + bytesToString((double)lastMemoryReq) + " when decreasing processing block size, and only " + bytesToString((double)allowedMemory()) + " is available for a single process. See also cluster configuration file max_memory setting.");
-			}
+			bool canSubdivide = memoryReq <= lastMemoryReq;
 
 			// Condition 2: Images must not be subdivided more than their dimensions allow.
 			for (DistributedImageBase* img : inputImages)
@@ -788,8 +787,24 @@ namespace pilib
 					(distributionDirection2 <= 2 && img->dimensions()[distributionDirection2] > 1 && subDivisions[distributionDirection2] >= img->dimensions()[distributionDirection2])
 					)
 				{
-					throw ITLException(string("Unable to find suitable subdivision. The smallest possible blocks of the input and output images require ") + bytesToString((double)memoryReq) + " of memory, but only " + bytesToString((double)allowedMemory()) + " is available for a single process. See also cluster configuration file max_memory setting.");
+					canSubdivide = false;
+				}
+			}
+
+			if (!canSubdivide)
+			{
+				// The blocks cannot be made small enough to be processed in as many concurrent jobs as jobMemoryLimit() assumes,
+				// but if they fit into the allowed memory, they can still be processed in fewer concurrent jobs.
+				if (memoryReq <= allowedMemory())
+				{
+					cout << "Block size = " << refSize << ", preferred multiple = " << preferredBlockSizeMultiple << endl;
+					break;
 				}
+
+				if (memoryReq > lastMemoryReq)
+					throw ITLException(string("Unable to find suitable subdivision. Memory requirement does not decrease from ") + bytesToString((double)lastMemoryReq) + " when decreasing processing block size, and the jobs may use only " + bytesToString((double)allowedMemory()) + " of RAM. See also max_memory setting in the distributed processing configuration file.");
+
+				throw ITLException(string("Unable to find suitable subdivision. The smallest possible blocks of the input and output images require ") + bytesToString((double)memoryReq) + " of memory, but the jobs may use only " + bytesToString((double)allowedMemory()) + " of RAM. See also max_memory setting in the distributed processing configuration file.");
 			}
 
 			lastMemoryReq = memoryReq;
@@ -1011,6 +1026,125 @@ namespace pilib
 		return newOutput;
 	}
 
+	/**
+	Functor that casts an image block to the type corresponding to its pixel data type and assigns it to a ParamVariant.
+	*/
+	template<typename pixel_t> struct CastBlock
+	{
+		static void run(ImageBase* p, ParamVariant& target)
+		{
+			target = dynamic_cast<Image<pixel_t>*>(p);
+		}
+	};
+
+	/**
+	Finds pointops command that processes images of the given data type.
+	*/
+	const Command* findPointOpsCommand(ImageDataType dt)
+	{
+		ArgumentDataType adt = imageDataTypeToArgumentDataType(dt);
+		for (const Command* cmd : CommandList::byName("pointops"))
+		{
+			if (cmd->args()[0].dataType() == adt)
+				return cmd;
+		}
+		throw ITLException(string("No pointops command found for ") + itl2::toString(dt) + " images.");
+	}
+
+	string Distributor::runJobInProcess(size_t i, const vector<vector<size_t> >& commandGroups, const set<DistributedImageBase*>& inputImages, const set<DistributedImageBase*>& outputImages, map<DistributedImageBase*, vector<tuple<Vec3c, Vec3c, Vec3c, Vec3c, Vec3c> > >& blocksPerImage)
+	{
+		string output;
+		JobOutputCapture capture(output);
+
+		// Read blocks of input images and create blocks of output images.
+		map<DistributedImageBase*, unique_ptr<ImageBase> > blocks;
+		for (DistributedImageBase* img : inputImages)
+		{
+			Vec3c readStart = get<0>(blocksPerImage[img][i]);
+			Vec3c readSize = get<1>(blocksPerImage[img][i]);
+			blocks[img] = img->readBlock(readStart, readSize, true);
+		}
+
+		for (DistributedImageBase* img : outputImages)
+		{
+			if (inputImages.find(img) == inputImages.end())
+			{
+				Vec3c readStart = get<0>(blocksPerImage[img][i]);
+				Vec3c readSize = get<1>(blocksPerImage[img][i]);
+				blocks[img] = img->readBlock(readStart, readSize, false);
+			}
+		}
+
+		// Converts distributed image argument to the corresponding block.
+		auto toBlock = [&](ParamVariant& arg)
+		{
+			DistributedImageBase* img = getDistributedImageNoThrow(arg);
+			if (img)
+				itl2::pick<CastBlock>(img->dataType(), blocks.at(img).get(), arg);
+		};
+
+		// Processing commands
+		for (const vector<size_t>& group : commandGroups)
+		{
+			if (group.size() == 1)
+			{
+				size_t cmdi = group[0];
+				const Command* command = delayedCommands[cmdi].getCommand();
+				vector<ParamVariant> args = delayedCommands[cmdi].getArgs();
+				size_t refIndex = delayedCommands[cmdi].getRefIndex();
+				Vec3c readStart = get<0>(blocksPerImage[getDistributedImage(args[refIndex])][i]);
+
+				for (size_t n = 0; n < args.size(); n++)
+				{
+					// Block origin and block index arguments are replaced just like when the commands are run in job scripts.
+					const CommandArgumentBase& argDef = command->args()[n];
+					if (argDef.dataType() == parameterType<BLOCK_ORIGIN_ARG_TYPE>() && argDef.name() == BLOCK_ORIGIN_ARG_NAME)
+						args[n] = readStart;
+					else if (argDef.dataType() == parameterType<BLOCK_INDEX_ARG_TYPE>() && argDef.name() == BLOCK_INDEX_ARG_NAME)
+						args[n] = (coord_t)i;
+					else
+						toBlock(args[n]);
+				}
+
+				command->runInternal(piSystem, args);
+			}
+			else
+			{
+				string operations;
+				for (size_t n = 0; n < group.size(); n++)
+				{
+					if (n > 0)
+						operations += " | ";
+					operations += delayedCommands[group[n]].getPointOperation();
+				}
+
+				ParamVariant image = delayedCommands[group[0]].getArgs()[0];
+				const Command* command = findPointOpsCommand(getDistributedImage(image)->dataType());
+				toBlock(image);
+				vector<ParamVariant> args = { image, operations };
+				command->runInternal(piSystem, args);
+			}
+		}
+
+		// Write blocks of output images.
+		for (DistributedImageBase* img : outputImages)
+		{
+			// Only write if the image is still visible from the main PI system object
+			if (piSystem->isDistributedImage(img))
+			{
+				Vec3c writeFilePos = get<2>(blocksPerImage[img][i]);
+				Vec3c writeImPos = get<3>(blocksPerImage[img][i]);
+				Vec3c writeSize = get<4>(blocksPerImage[img][i]);
+
+				// Only write if writing is requested by the command.
+				if (writeSize.min() > 0)
+					img->writeBlock(*blocks[img], writeFilePos, writeImPos, writeSize);
+			}
+		}
+
+		return output;
+	}
+
 	void Distributor::runDelayedCommands()
 	{
 		if (delayedCommands.size() <= 0)
@@ -1082,6 +1216,8 @@ namespace pilib
 		cout << "Submitting " << jobCount << " jobs, each estimated to require at most " << bytesToString((double)memoryReq) << " of RAM per job..." << endl;
 		vector<size_t> skippedJobs;
 		vector<tuple<string, JobType>> jobsToSubmit;
+		// Block index and command groups of each job in jobsToSubmit, for running the jobs in the current process.
+		vector<tuple<size_t, vector<vector<size_t> > > > inProcessJobs;
 		for (size_t i = 0; i < jobCount; i++)
 		{
 			// Build job script:
@@ -1125,12 +1261,69 @@ namespace pilib
 			}
 
 			// Processing commands
+			// Consecutive point operations that process the same image are fused into a single pointops command
+			// so that each block is processed in one pass.
 			bool hasCommandsToRun = false;
-			for (size_t cmdi = 0; cmdi < delayedCommands.size(); cmdi++)
+			vector<size_t> pointOperationGroup;
+			vector<vector<size_t> > commandGroups;
+			auto emitCommand = [&](size_t cmdi)
 			{
+				commandGroups.push_back({ cmdi });
+
 				const Command* command = delayedCommands[cmdi].getCommand();
 				vector<ParamVariant>& args = delayedCommands[cmdi].getArgs();
 				size_t refIndex = delayedCommands[cmdi].getRefIndex();
+				DistributedImageBase* refImage = getDistributedImage(args[refIndex]);
+				Vec3c readStart = get<0>(blocksPerImage[refImage][i]);
+
+				script << command->name() << "(";
+				for (size_t n = 0; n < args.size(); n++)
+				{
+					// Value of argument whose type is Vec3c and name is "block origin" is replaced by the origin of current calculation block.
+					// This functionality is needed at least in skeleton tracing command.
+					const CommandArgumentBase& argDef = command->args()[n];
+					ParamVariant argVal = args[n];
+					if (argDef.dataType() == parameterType<BLOCK_ORIGIN_ARG_TYPE>() && argDef.name() == BLOCK_ORIGIN_ARG_NAME)
+					{
+						argVal = readStart;
+					}
+					else if (argDef.dataType() == parameterType<BLOCK_INDEX_ARG_TYPE>() && argDef.name() == BLOCK_INDEX_ARG_NAME)
+					{
+						argVal = (coord_t)i;
+					}
+
+					script << "\"" << argumentToString(argDef, argVal) << "\"";
+					if (n < args.size() - 1)
+						script << ", ";
+				}
+				script << ");" << endl;
+			};
+
+			auto emitPointOperationGroup = [&]()
+			{
+				if (pointOperationGroup.size() == 1)
+				{
+					emitCommand(pointOperationGroup[0]);
+				}
+				else if (pointOperationGroup.size() > 1)
+				{
+					commandGroups.push_back(pointOperationGroup);
+					script << "pointops(\"" << getDistributedImage(delayedCommands[pointOperationGroup[0]].getArgs()[0])->uniqueName() << "\", \"";
+					for (size_t n = 0; n < pointOperationGroup.size(); n++)
+					{
+						if (n > 0)
+							script << " | ";
+						script << delayedCommands[pointOperationGroup[n]].getPointOperation();
+					}
+					script << "\");" << endl;
+				}
+				pointOperationGroup.clear();
+			};
+
+			for (size_t cmdi = 0; cmdi < delayedCommands.size(); cmdi++)
+			{
+				vector<ParamVariant>& args = delayedCommands[cmdi].getArgs();
+				size_t refIndex = delayedCommands[cmdi].getRefIndex();
 
 				DistributedImageBase* refImage = getDistributedImage(args[refIndex]);
 				Vec3c readStart = get<0>(blocksPerImage[refImage][i]);
@@ -1141,29 +1334,24 @@ namespace pilib
 				if (delayedCommands[cmdi].needsToRun(readStart, readSize, writeFilePos, writeImPos, writeSize, i))
 				{
 					hasCommandsToRun = true;
-					script << command->name() << "(";
-					for (size_t n = 0; n < args.size(); n++)
+
+					if (delayedCommands[cmdi].getPointOperation() != "")
 					{
-						// Value of argument whose type is Vec3c and name is "block origin" is replaced by the origin of current calculation block.
-						// This functionality is needed at least in skeleton tracing command.
-						const CommandArgumentBase& argDef = command->args()[n];
-						ParamVariant argVal = args[n];
-						if (argDef.dataType() == parameterType<BLOCK_ORIGIN_ARG_TYPE>() && argDef.name() == BLOCK_ORIGIN_ARG_NAME)
-						{
-							argVal = readStart;
-						}
-						else if (argDef.dataType() == parameterType<BLOCK_INDEX_ARG_TYPE>() && argDef.name() == BLOCK_INDEX_ARG_NAME)
+						if (pointOperationGroup.size() > 0 &&
+							getDistributedImage(delayedCommands[pointOperationGroup[0]].getArgs()[0]) != getDistributedImage(args[0]))
 						{
-							argVal = (coord_t)i;
+							emitPointOperationGroup();
 						}
-
-						script << "\"" << argumentToString(argDef, argVal) << "\"";
-						if (n < args.size() - 1)
-							script << ", ";
+						pointOperationGroup.push_back(cmdi);
+					}
+					else
+					{
+						emitPointOperationGroup();
+						emitCommand(cmdi);
 					}
-					script << ");" << endl;
 				}
 			}
+			emitPointOperationGroup();
 
 			// Image write commands
 			for (DistributedImageBase* img : outputImages)
@@ -1184,6 +1372,7 @@ namespace pilib
 			if (hasCommandsToRun || !jobSkippingAllowed)
 			{
 				jobsToSubmit.push_back(make_tuple(script.str(), jobType));
+				inProcessJobs.push_back(make_tuple(i, commandGroups));
 			}
 			else
 			{
@@ -1277,6 +1466,57 @@ namespace pilib
 
 		Timing::Add(TimeClass::WritePreparation, timer.lap());
 
+		if (runsJobsInProcess())
+		{
+			// Run the jobs one after another in this process. Each command uses all the processors.
+			auto endInProcessAccess = [&]()
+			{
+				for (DistributedImageBase* img : inputImages)
+					img->endInProcessAccess();
+				for (DistributedImageBase* img : outputImages)
+					img->endInProcessAccess();
+			};
+
+			try
+			{
+				for (DistributedImageBase* img : inputImages)
+					img->beginInProcessAccess(outputImages.find(img) != outputImages.end());
+				for (DistributedImageBase* img : outputImages)
+				{
+					if (inputImages.find(img) == inputImages.end())
+						img->beginInProcessAccess(true);
+				}
+
+				cout << "Running " << inProcessJobs.size() << " jobs in this process..." << endl;
+				lastOutput.clear();
+				for (const auto& job : inProcessJobs)
+					lastOutput.push_back(runJobInProcess(get<0>(job), get<1>(job), inputImages, outputImages, blocksPerImage));
+
+				endInProcessAccess();
+
+				Timing::Add(TimeClass::JobsInclQueuing, timer.lap());
+
+				for (DistributedImageBase* img : outputImages)
+				{
+					for (const Vec3c& chunk : img->getChunksThatNeedEndConcurrentWrite())
+						img->endConcurrentWrite(chunk);
+
+					img->writeComplete();
+				}
+
+				Timing::Add(TimeClass::WriteFinalizationInclQueuing, timer.lap());
+			}
+			catch (...)
+			{
+				endInProcessAccess();
+				delayedCommands.clear();
+				throw;
+			}
+
+			delayedCommands.clear();
+			return;
+		}
+
 		// Combine small jobs
 		const string jobStartLine = "------ start of job";
 		size_t combinationRounds = 0;
@@ -1314,6 +1554,7 @@ namespace pilib
 			cout << "Small jobs were combined into " << jobsToSubmit.size() << " larger jobs (" << std::fixed << std::setprecision(1) << tasksPerJob << " small jobs per combined job)." << endl;
 
 		// Submit jobs
+		currentJobMemory = memoryReq;
 		for (auto& tup : jobsToSubmit)
 		{
 			string& script = get<0>(tup);
@@ -1406,10 +1647,13 @@ namespace pilib
 		}
 		catch (...)
 		{
+			currentJobMemory = 0;
 			delayedCommands.clear();
 			throw;
 		}
 
+		currentJobMemory = 0;
+
 		// This may deallocate images that are not in PISystem anymore.
 		delayedCommands.clear();
 	}
@@ -92,6 +92,12 @@ namespace pilib
 		*/
 		Vec3c nn5ChunkSize;
 
+		/**
+		Estimated memory requirement of each job that is currently being submitted by runDelayedCommands,
+		or zero if the jobs are not submitted by runDelayedCommands.
+		*/
+		size_t currentJobMemory = 0;
+
 		/**
 		Determines suitable block size etc. for running commands in delayedCommands list.
 		Throws exception if the commands cannot be run together.
@@ -103,6 +109,15 @@ namespace pilib
 		*/
 		void runDelayedCommands();
 
+		/**
+		Runs one job of the delayed commands in the current process.
+		The blocks of the distributed images are read and written directly, and the commands are run using the current PISystem object.
+		@param blockIndex Index of the block to process.
+		@param commandGroups Indices of delayed commands to run. Commands in the same group are point operations that are combined into a single pointops command.
+		@return Output of the job.
+		*/
+		std::string runJobInProcess(size_t blockIndex, const std::vector<std::vector<size_t> >& commandGroups, const std::set<DistributedImageBase*>& inputImages, const std::set<DistributedImageBase*>& outputImages, std::map<DistributedImageBase*, std::vector<std::tuple<Vec3c, Vec3c, Vec3c, Vec3c, Vec3c> > >& blocksPerImage);
+
 		/**
 		Test if the given command can be added to the delayed commands queue.
 		Does not account for other commands.
@@ -141,6 +156,17 @@ namespace pilib
 		*/
 		void readSettings(INIReader& reader);
 
+		/**
+		Gets estimated amount of memory in bytes required by each job that is currently being submitted,
+		or zero if the estimate is not available.
+		The estimate is available when the jobs are generated from delayed commands.
+		Jobs submitted directly through submitJob (see e.g. thickness map calculation) may use
+		up to allowedMemory() bytes of memory.
+		*/
+		size_t jobMemoryEstimate() const
+		{
+			return currentJobMemory;
+		}
 
 	public:
 
@@ -242,15 +268,35 @@ namespace pilib
 		virtual std::vector<string> waitForJobs() = 0;
 
 		/**
-		Returns the amount of memory in bytes that single process is allowed to use.
+		Returns the amount of memory in bytes that the jobs are allowed to use.
+		In cluster environments this is the memory available for each job, and in the local mode the total memory
+		available for all concurrently running jobs.
 		*/
 		virtual size_t allowedMemory() const = 0;
 
 		/**
-		Set the amount of allowed memory in bytes for single process.
+		Set the amount of allowed memory in bytes.
 		Set to 0 to determine the amount automatically.
 		*/
 		virtual void allowedMemory(size_t maxMem) = 0;
+
+		/**
+		Returns true if the jobs generated from delayed commands are run in the current process instead of submitting them as pi2 scripts.
+		*/
+		virtual bool runsJobsInProcess() const
+		{
+			return false;
+		}
+
+		/**
+		Returns the amount of memory in bytes that a single job should use.
+		Processing blocks are made small enough to fit into this amount of memory if possible.
+		If not, blocks up to allowedMemory() bytes are used.
+		*/
+		virtual size_t jobMemoryLimit() const
+		{
+			return allowedMemory();
+		}
 	};
 
 }
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -199,4 +200,17 @@ namespace pilib
 	{
 		return execute(cmd + " " + args, showOutput);
 	}
+
+	void setEnvironmentVariable(const string& name, const string& value)
+	{
+#if defined(_WIN32)
+		// Empty value removes the variable.
+		_putenv_s(name.c_str(), value.c_str());
+#else
+		if (value.length() > 0)
+			setenv(name.c_str(), value.c_str(), 1);
+		else
+			unsetenv(name.c_str());
+#endif
+	}
 }
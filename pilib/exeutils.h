@@ -17,6 +17,13 @@ namespace pilib
 	*/
 	std::string execute(const std::string& cmd, const std::string& args, bool showOutput = false);
 
+	/**
+	Sets value of an environment variable of this process.
+	Processes started after the call inherit the value.
+	@param value New value of the variable. Empty value removes the variable.
+	*/
+	void setEnvironmentVariable(const std::string& name, const std::string& value);
+
 	/**
 	Gets path of this program.
 	*/
@@ -85,7 +85,7 @@ namespace pilib
 		virtual void run(Image<seed_t>& in, Image<mask_t>& param, vector<ParamVariant>& args) const override
 		{
 			size_t changed = morphoRec<seed_t, mask_t>(in, param);
-			std::cout << std::endl << changed << " pixels changed." << std::endl;
+			jobOutput() << std::endl << changed << " pixels changed." << std::endl;
 		}
 
 		virtual Vec3c getMargin(const vector<ParamVariant>& args) const override
@@ -121,7 +121,7 @@ namespace pilib
 	protected:
 		friend class CommandList;
 
-		MedianFilterCommand() : NeighbourhoodFilterCommand<pixel_t>("medianfilter", "Median filtering. Replaces pixel by median of pixels in its neighbourhood. Removes noise from the image while preserving sharp edges.")
+		MedianFilterCommand() : NeighbourhoodFilterCommand<pixel_t>("medianfilter", "Median filtering. Replaces pixel by median of pixels in its neighbourhood. Removes noise from the image while preserving sharp edges. Has optimized implementation for uint8 and uint16 images and Zero and Nearest boundary conditions.")
 		{
 		}
 
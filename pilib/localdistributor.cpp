@@ -5,6 +5,10 @@
 #include "exeutils.h"
 
 #include <algorithm>
+#include <thread>
+#include <chrono>
+#include <omp.h>
+#include <cstdlib>
 #include "filesystem.h"
 
 using namespace itl2;
@@ -12,15 +16,37 @@ using namespace std;
 
 namespace pilib
 {
-	LocalDistributor::LocalDistributor(PISystem* piSystem) : Distributor(piSystem), allowedMem(0)
+	LocalDistributor::LocalDistributor(PISystem* piSystem) : Distributor(piSystem), allowedMem(0), maxParallelJobs(0), inProcess(false), submittedCount(0)
 	{
 		fs::path configPath = getConfigDirectory() / "local_config.txt";
 
 		INIReader reader(configPath.string());
 		size_t mem = (size_t)(reader.get<double>("max_memory", 0) * 1024 * 1024);
+		maxParallelJobs = reader.get<size_t>("max_parallel_jobs", 0);
+		inProcess = reader.get<bool>("in_process", false);
 		readSettings(reader);
 
 		allowedMemory(mem);
+
+		const char* ompThreads = std::getenv("OMP_NUM_THREADS");
+		if (ompThreads)
+			originalOmpNumThreads = ompThreads;
+	}
+
+	LocalDistributor::~LocalDistributor()
+	{
+		// Wait for possibly running processes so that their script files can be removed.
+		for (size_t n = 0; n < outputs.size(); n++)
+		{
+			if (outputs[n].valid())
+				outputs[n].wait();
+
+			// Destructors must not throw, so failures to remove the file are ignored.
+			std::error_code ec;
+			fs::remove(scriptFiles[n], ec);
+		}
+
+		setEnvironmentVariable("OMP_NUM_THREADS", originalOmpNumThreads);
 	}
 
 	void LocalDistributor::allowedMemory(size_t maxMem)
@@ -30,31 +56,120 @@ namespace pilib
 		if (allowedMem <= 0)
 			allowedMem = (size_t)(0.85 * itl2::memorySize());
 
-		cout << "Using " << bytesToString((double)allowedMem) << " RAM per task." << endl;
+		cout << "Using " << bytesToString((double)allowedMem) << " RAM in total." << endl;
+	}
+
+	size_t LocalDistributor::parallelJobLimit() const
+	{
+		if (maxParallelJobs > 0)
+			return maxParallelJobs;
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+
+	size_t LocalDistributor::jobMemoryLimit() const
+	{
+		// Blocks are made smaller for parallel processing only if the user has explicitly asked for it.
+		// Jobs run in this process are run one at a time, so they can always use all the memory.
+		if (maxParallelJobs > 0 && !inProcess)
+			return std::max<size_t>(1, allowedMem / maxParallelJobs);
+		return allowedMem;
+	}
+
+	size_t LocalDistributor::jobSlots() const
+	{
+		// If the memory requirement of the jobs is not known, they might use all the allowed memory.
+		size_t jobMem = jobMemoryEstimate();
+		if (jobMem <= 0)
+			return 1;
+
+		return std::clamp<size_t>(allowedMem / jobMem, 1, parallelJobLimit());
+	}
+
+	int LocalDistributor::threadsPerJob(size_t slots)
+	{
+		return std::max(1, omp_get_max_threads() / (int)slots);
+	}
+
+	size_t LocalDistributor::runningJobCount() const
+	{
+		size_t count = 0;
+		for (const auto& f : outputs)
+		{
+			if (f.wait_for(chrono::seconds(0)) != future_status::ready)
+				count++;
+		}
+		return count;
 	}
 
 	void LocalDistributor::submitJob(const string& piCode, JobType jobType)
 	{
+		size_t slots = jobSlots();
+
+		// Wait until there is a free slot.
+		while (runningJobCount() >= slots)
+		{
+			for (const auto& f : outputs)
+			{
+				if (f.wait_for(chrono::milliseconds(50)) != future_status::ready)
+					break;
+			}
+		}
+
+		// Echoing the output of multiple concurrent jobs to the console would only produce a mess,
+		// so the output is shown only if the jobs are run sequentially.
+		bool showOutput = slots <= 1;
+
+		// Divide the processors between the concurrently running job processes, which inherit the environment of this process.
+		// The slot count does not change before waitForJobs, so the variable is set only before the first job is started,
+		// and it is never modified while other threads might be starting processes.
+		if (outputs.empty())
+			setEnvironmentVariable("OMP_NUM_THREADS", itl2::toString(threadsPerJob(slots)));
+
 		// Write the code to (temporary) file
+		string scriptFile = "pi2_local_job_" + itl2::toString(submittedCount) + ".txt";
 		{
-			ofstream f("pi2_local_job.txt");
+			ofstream f(scriptFile);
 			f << piCode << endl;
 			f << "print(Everything done.)" << endl;
 		}
+		submittedCount++;
 
-		string output = execute(getJobPiCommand(), "pi2_local_job.txt", true);
-
-		outputs.push_back(output);
+		string cmd = getJobPiCommand();
+		outputs.push_back(std::async(std::launch::async, [cmd, scriptFile, showOutput]()
+			{
+				try
+				{
+					return execute(cmd, scriptFile, showOutput);
+				}
+				catch (const ITLException& e)
+				{
+					return string("Error: ") + e.message();
+				}
+			}));
+		scriptFiles.push_back(scriptFile);
 	}
 
 	vector<string> LocalDistributor::waitForJobs()
 	{
-		// Do not wait as the jobs have already finished (they are run sequentially on submit).
+		// Collect outputs in submission order.
+		vector<string> result;
+		result.reserve(outputs.size());
+		for (size_t n = 0; n < outputs.size(); n++)
+		{
+			result.push_back(outputs[n].get());
+			fs::remove(scriptFiles[n]);
+		}
+
+		outputs.clear();
+		scriptFiles.clear();
+		submittedCount = 0;
+
+		setEnvironmentVariable("OMP_NUM_THREADS", originalOmpNumThreads);
 
 		ostringstream msg;
-		for(size_t n = 0; n < outputs.size(); n++)
+		for(size_t n = 0; n < result.size(); n++)
 		{
-			string line = lastLine(outputs[n]);
+			string line = lastLine(result[n]);
 
 			if (startsWith(line, "Error"))
 			{
@@ -70,8 +185,6 @@ namespace pilib
 		if (s.length() > 0)
 			throw ITLException(s.substr(0, s.length() - 1));
 
-		vector<string> result = outputs;
-		outputs.clear();
 		return result;
 	}
 
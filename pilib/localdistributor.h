@@ -2,10 +2,16 @@
 
 #include "distributor.h"
 
+#include <future>
+
 namespace pilib
 {
 	/**
-	Runs tasks sequentially on the local computer.
+	Runs tasks on the local computer.
+	Multiple tasks are run concurrently in separate processes if their estimated memory requirement allows it.
+	Alternatively, the tasks generated from delayed commands can be run one after another inside the current process
+	(see Distributor::runsJobsInProcess). That avoids starting a new pi2 process for each task and transferring the image blocks
+	through job scripts, but a crash in a task terminates the whole process.
 	*/
 	class LocalDistributor : public Distributor
 	{
@@ -13,22 +19,83 @@ namespace pilib
 		size_t allowedMem;
 
 		/**
-		Stores output of each subprocess that has been run since last call to waitForJobs.
+		Maximum number of jobs to run concurrently.
+		Zero corresponds to the number of processors in the computer, without making the blocks smaller to run more jobs concurrently.
+		*/
+		size_t maxParallelJobs;
+
+		/**
+		Set to true to run jobs generated from delayed commands in the current process instead of separate pi2 processes.
+		*/
+		bool inProcess;
+
+		/**
+		Number of jobs submitted since last call to waitForJobs.
+		Used to generate unique job script file names.
+		*/
+		size_t submittedCount;
+
+		/**
+		Output of each subprocess that has been started since last call to waitForJobs, in submission order.
 		*/
-		std::vector<std::string> outputs;
+		std::vector<std::future<std::string> > outputs;
+
+		/**
+		Names of job script files corresponding to items in outputs list.
+		*/
+		std::vector<std::string> scriptFiles;
+
+		/**
+		Value of OMP_NUM_THREADS environment variable when the distributor was created.
+		*/
+		std::string originalOmpNumThreads;
+
+		/**
+		Gets the maximum number of jobs to run concurrently.
+		*/
+		size_t parallelJobLimit() const;
+
+		/**
+		Determines how many jobs can be run concurrently, based on the amount of allowed memory and on the
+		estimated memory requirement of each job.
+		*/
+		size_t jobSlots() const;
+
+		/**
+		Calculates the number of OpenMP threads available for each job when given number of jobs are run concurrently.
+		*/
+		static int threadsPerJob(size_t slots);
+
+		/**
+		Counts jobs that have not finished yet.
+		*/
+		size_t runningJobCount() const;
 
 	public:
 		LocalDistributor(PISystem* system);
 
+		virtual ~LocalDistributor();
+
 		virtual void submitJob(const std::string& piCode, JobType jobType) override;
 
 		virtual std::vector<std::string> waitForJobs() override;
 
+		virtual bool runsJobsInProcess() const override
+		{
+			return inProcess;
+		}
+
 		virtual size_t allowedMemory() const override
 		{
 			return allowedMem;
 		}
 
 		virtual void allowedMemory(size_t maxMem) override;
+
+		/**
+		If max_parallel_jobs has been set, divides the allowed memory between that many jobs so that the jobs can be run in parallel.
+		Otherwise returns allowedMemory(), and the count of concurrent jobs is determined from the memory requirement of the jobs only.
+		*/
+		virtual size_t jobMemoryLimit() const override;
 	};
 }
@@ -20,6 +20,7 @@ namespace pilib
 
 		ADD_REAL(FloodFillBlockCommand);
 		ADD_REAL(FloodFillCommand);
+		CommandList::add<FloodFillNN5Command>();
 
 		ADD_REAL(NormalizeZCommand);
 
@@ -604,7 +604,8 @@ namespace pilib
 				CommandArgument<coord_t>(ParameterDirection::In, "height", "Height of the output region."),
 				CommandArgument<coord_t>(ParameterDirection::In, "depth", "Depth of the output region."),
 				CommandArgument<bool>(ParameterDirection::In, "normalize", "Set to true to make mean gray value of images the same in the overlapping region.", true),
-				CommandArgument<bool>(ParameterDirection::In, "mask max circle", "Set to true to use only data in the maximum inscribed circle in each xy-slice of the input image.", false)
+				CommandArgument<bool>(ParameterDirection::In, "mask max circle", "Set to true to use only data in the maximum inscribed circle in each xy-slice of the input image.", false),
+				CommandArgument<coord_t>(ParameterDirection::In, "shift field step", "The displacement field is interpolated from the displacement grid to a dense field that has one point per this many pixels, and linearly interpolated from that field to each pixel. Set to 1 to interpolate the displacement exactly at each pixel, but note that the dense field then requires 12 bytes of memory per output pixel. Larger values are faster and use less memory, but the displacements are only approximate.", 4)
 			},
 			blockMatchSeeAlso())
 		{
@@ -630,12 +631,13 @@ namespace pilib
 			coord_t d = pop<coord_t>(args);
 			bool normalize = pop<bool>(args);
 			bool maxCircle = pop<bool>(args);
+			coord_t fieldStep = pop<coord_t>(args);
 
 			Vec3c pos(x, y, z);
 			Vec3c size(w, h, d);
 
 			//stitchVer2<pixel_t>(indexFile, pos, size, output, normalize);
-			stitchVer3<pixel_t>(indexFile, pos, size, output, nullptr, normalize, maxCircle);
+			stitchVer3<pixel_t>(indexFile, pos, size, output, nullptr, normalize, maxCircle, fieldStep);
 		}
 	};
 
@@ -656,7 +658,8 @@ namespace pilib
 				CommandArgument<coord_t>(ParameterDirection::In, "height", "Height of the output region."),
 				CommandArgument<coord_t>(ParameterDirection::In, "depth", "Depth of the output region."),
 				CommandArgument<bool>(ParameterDirection::In, "normalize", "Set to true to make mean gray value of images the same in the overlapping region.", true),
-				CommandArgument<bool>(ParameterDirection::In, "mask max circle", "Set to true to use only data in the maximum inscribed circle in each xy-slice of the input image.", false)
+				CommandArgument<bool>(ParameterDirection::In, "mask max circle", "Set to true to use only data in the maximum inscribed circle in each xy-slice of the input image.", false),
+				CommandArgument<coord_t>(ParameterDirection::In, "shift field step", "The displacement field is interpolated from the displacement grid to a dense field that has one point per this many pixels, and linearly interpolated from that field to each pixel. Set to 1 to interpolate the displacement exactly at each pixel, but note that the dense field then requires 12 bytes of memory per output pixel. Larger values are faster and use less memory, but the displacements are only approximate.", 4)
 			},
 			blockMatchSeeAlso())
 		{
@@ -682,11 +685,12 @@ namespace pilib
 			coord_t d = pop<coord_t>(args);
 			bool normalize = pop<bool>(args);
 			bool maxCircle = pop<bool>(args);
+			coord_t fieldStep = pop<coord_t>(args);
 
 			Vec3c pos(x, y, z);
 			Vec3c size(w, h, d);
 
-			stitchVer3<pixel_t>(indexFile, pos, size, output, &goodness, normalize, maxCircle);
+			stitchVer3<pixel_t>(indexFile, pos, size, output, &goodness, normalize, maxCircle, fieldStep);
 		}
 	};
 
@@ -1011,6 +1015,64 @@ namespace pilib
 	};
 
 
+	/**
+	Functor that flood fills an NN5 dataset of given pixel data type.
+	*/
+	template<typename pixel_t> struct FloodFillNN5
+	{
+		static void run(const string& filename, const Vec3c& startPoint, double fillValue, Connectivity connectivity, size_t cacheSize)
+		{
+			NN5Accessor<pixel_t> accessor(filename, false, cacheSize);
+			pixel_t color = pixelRound<pixel_t>(fillValue);
+			floodfill(accessor, startPoint, color, color, connectivity);
+		}
+	};
+
+	template<> struct FloodFillNN5<complex32_t>
+	{
+		static void run(const string& filename, const Vec3c& startPoint, double fillValue, Connectivity connectivity, size_t cacheSize)
+		{
+			throw ITLException("Flood fill is not supported for complex datasets.");
+		}
+	};
+
+	class FloodFillNN5Command : public Command
+	{
+	protected:
+		friend class CommandList;
+
+		FloodFillNN5Command() : Command("floodfillnn5", "Performs flood fill directly in an NN5 dataset that does not need to fit into the memory. Fills start point and all its neighbours and their neighbours etc. recursively as long as the color of the pixel to be filled equals color of the start point. The dataset is accessed through a cache of decoded chunks, and modified chunks are written back to the dataset when they are removed from the cache or when the fill is finished. The dataset must be in the native byte order of the host computer.",
+			{
+				CommandArgument<string>(ParameterDirection::In, "filename", "Name (and path) of the NN5 dataset to process."),
+				CommandArgument<Vec3c>(ParameterDirection::In, "start point", "Starting point for the fill."),
+				CommandArgument<double>(ParameterDirection::In, "fill value", "Fill color."),
+				CommandArgument<Connectivity>(ParameterDirection::In, "connectivity", string("Connectivity of the region to fill. ") + connectivityHelp(), Connectivity::AllNeighbours),
+				CommandArgument<size_t>(ParameterDirection::In, "cache size", "Maximum amount of memory used for cached chunks of the dataset, in megabytes. At least one chunk is always cached.", 1024),
+			},
+			"floodfill, writenn5, readnn5block")
+		{
+		}
+
+	public:
+		virtual void run(vector<ParamVariant>& args) const override
+		{
+			string filename = pop<string>(args);
+			Vec3c startPoint = pop<Vec3c>(args);
+			double fillValue = pop<double>(args);
+			Connectivity connectivity = pop<Connectivity>(args);
+			size_t cacheSize = pop<size_t>(args);
+
+			Vec3c dimensions;
+			ImageDataType dt;
+			string reason;
+			if (!nn5::getInfo(filename, dimensions, dt, reason))
+				throw ParseException(string("Unable to read NN5 dataset: ") + filename + ". " + reason);
+
+			pick<FloodFillNN5>(dt, filename, startPoint, fillValue, connectivity, cacheSize * 1024 * 1024);
+		}
+	};
+
+
 
 
 
@@ -1112,7 +1174,8 @@ namespace pilib
 
 		virtual void run(Image<pixel_t>& in, std::vector<ParamVariant>& args) const override
 		{
-			itl2::internals::cannyPart2(in);
+			size_t changed = itl2::internals::cannyPart2(in);
+			jobOutput() << changed << " pixels changed." << std::endl;
 		}
 
 		virtual Vec3c calculateOverlap(const std::vector<ParamVariant>& args) const override
@@ -1207,7 +1270,7 @@ namespace pilib
 			Connectivity connectivity = pop<Connectivity>(args);
 
 			size_t changed = grow(in, pixelRound<pixel_t>(src), pixelRound<pixel_t>(target), connectivity);
-			std::cout << std::endl << changed << " pixels changed." << std::endl;
+			jobOutput() << std::endl << changed << " pixels changed." << std::endl;
 		}
 
 		virtual Vec3c getMargin(const std::vector<ParamVariant>& args) const override
@@ -1302,7 +1365,7 @@ namespace pilib
 			Connectivity connectivity = pop<Connectivity>(args);
 
 			size_t changed = growAll(in, pixelRound<pixel_t>(allowed), pixelRound<pixel_t>(bg), connectivity);
-			std::cout << std::endl << changed << " pixels changed." << std::endl;
+			jobOutput() << std::endl << changed << " pixels changed." << std::endl;
 		}
 
 		virtual Vec3c getMargin(const std::vector<ParamVariant>& args) const override
@@ -4,6 +4,7 @@
 #include "pilibutilities.h"
 
 #include <random>
+#include <streambuf>
 #include "filesystem.h"
 
 using namespace itl2;
@@ -38,6 +39,64 @@ namespace pilib
 	}
 
 
+	namespace
+	{
+		/**
+		Output of the job that is being run in the current thread, or nullptr.
+		*/
+		thread_local string* currentJobOutput = nullptr;
+
+		/**
+		Stream buffer that writes to std::cout and to the output of the job that is being run in the current thread.
+		*/
+		class JobOutputBuffer : public std::streambuf
+		{
+		protected:
+			virtual int overflow(int c) override
+			{
+				if (c != traits_type::eof())
+				{
+					char ch = (char)c;
+					xsputn(&ch, 1);
+				}
+				return traits_type::not_eof(c);
+			}
+
+			virtual std::streamsize xsputn(const char* s, std::streamsize n) override
+			{
+				if (currentJobOutput)
+					currentJobOutput->append(s, (size_t)n);
+				cout.write(s, n);
+				return n;
+			}
+
+			virtual int sync() override
+			{
+				cout.flush();
+				return 0;
+			}
+		};
+	}
+
+	ostream& jobOutput()
+	{
+		thread_local JobOutputBuffer buffer;
+		thread_local ostream stream(&buffer);
+		return stream;
+	}
+
+	JobOutputCapture::JobOutputCapture(string& output) : previous(currentJobOutput)
+	{
+		jobOutput().flush();
+		currentJobOutput = &output;
+	}
+
+	JobOutputCapture::~JobOutputCapture()
+	{
+		jobOutput().flush();
+		currentJobOutput = previous;
+	}
+
 	namespace
 	{
 		std::mt19937 gen((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
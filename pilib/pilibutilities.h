@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <string>
+#include <iostream>
 
 namespace pilib
 {
@@ -22,6 +23,31 @@ namespace pilib
 	*/
 	size_t parseTotalCount(const std::vector<std::string>& list, std::string suffix);
 
+	/**
+	Gets the stream where commands should print results that are parsed from the job output in distributed processing,
+	e.g. the count of changed pixels.
+	The stream writes to std::cout, and while a JobOutputCapture object exists in the current thread, also to the output of the job.
+	*/
+	std::ostream& jobOutput();
+
+	/**
+	Collects everything printed to jobOutput() in the current thread to the given string while this object exists.
+	Used to capture the output of jobs that are run in the current process without replacing the stream buffer of std::cout.
+	*/
+	class JobOutputCapture
+	{
+	private:
+		std::string* previous;
+
+	public:
+		JobOutputCapture(std::string& output);
+
+		~JobOutputCapture();
+
+		JobOutputCapture(const JobOutputCapture&) = delete;
+		JobOutputCapture& operator=(const JobOutputCapture&) = delete;
+	};
+
 	/**
 	Creates name for temporary file and deletes it if it exists.
 	@param purpose This string is added to the file name to identify it among other temporary files.
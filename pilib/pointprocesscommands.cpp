@@ -23,6 +23,7 @@ namespace pilib
 		ADD_REAL(FloorCommand);
 
 		ADD_REAL(ReplaceCommand);
+		ADD_REAL(PointOpsCommand);
 
 
 		CommandList::add<ConjugateComplexCommand>();
@@ -4,6 +4,7 @@
 #include "commandsbase.h"
 #include "distributable.h"
 #include "pointprocess.h"
+#include "pointpipeline.h"
 #include "math/mathutils.h"
 #include "misc.h"
 #include "autothreshold.h"
@@ -68,6 +69,27 @@ namespace pilib
 		}
 	};
 
+	/**
+	Builds point operation string of form name(x1, x2, ...) for a point process command whose
+	arguments after the image are all real numbers.
+	*/
+	inline std::string pointOperationString(const std::string& name, const std::vector<ParamVariant>& args)
+	{
+		std::string s = name;
+		if (args.size() > 1)
+		{
+			s += "(";
+			for (size_t n = 1; n < args.size(); n++)
+			{
+				if (n > 1)
+					s += ", ";
+				s += itl2::toString(std::get<double>(args[n]));
+			}
+			s += ")";
+		}
+		return s;
+	}
+
 	/**
 	Base class for point process commands that need input and output image.
 	*/
@@ -170,6 +192,11 @@ namespace pilib
 		{ \
 			itl2:: funcname (img); \
 		} \
+	\
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override \
+		{ \
+			return #commandname; \
+		} \
 	}; \
 
 #define DEF_MATH_SINGLE_REAL(classname, commandname, help) DEF_MATH_SINGLE_REAL2(classname, commandname, help, commandname)	
@@ -241,6 +268,11 @@ namespace pilib
 			double param = pop<double>(args);
 			itl2::setValue(img, param);
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("set", args);
+		}
 	};
 
 
@@ -265,6 +297,11 @@ namespace pilib
 			double max = pop<double>(args);
 			thresholdRange(img, Vec2d(min, max));
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("thresholdrange", args);
+		}
 	};
 
 	template<typename pixel_t> class DoubleThresholdCommand : public InPlacePointProcess<pixel_t>
@@ -289,6 +326,11 @@ namespace pilib
 			std::vector<pixel_t> v = { pixelRound<pixel_t>(t1), pixelRound<pixel_t>(t2) };
 			multiThreshold(img, v);
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("doublethreshold", args);
+		}
 	};
 
 	template<typename pixel_t> class ThresholdPeriodicCommand : public InPlacePointProcess<pixel_t>
@@ -316,6 +358,11 @@ namespace pilib
 			double max = pop<double>(args);
 			thresholdPeriodic(img, Vec4d(pmin, pmax, min, max));
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("thresholdperiodic", args);
+		}
 	};
 
 
@@ -347,6 +394,11 @@ namespace pilib
 			double omax = pop<double>(args);
 			linearMap(img, Vec4d(imin, imax, omin, omax));
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("linmap", args);
+		}
 	};
 
 	template<typename pixel_t> class ReplaceCommand : public InPlacePointProcess<pixel_t>
@@ -370,6 +422,38 @@ namespace pilib
 			double b = pop<double>(args);
 			replace(img, Vec2<pixel_t>(pixelRound<pixel_t>(a), pixelRound<pixel_t>(b)));
 		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return pointOperationString("replace", args);
+		}
+	};
+
+	template<typename pixel_t> class PointOpsCommand : public InPlacePointProcess<pixel_t>
+	{
+	protected:
+		friend class CommandList;
+
+		PointOpsCommand() : InPlacePointProcess<pixel_t>("pointops", "Runs a sequence of point operations on the image in a single pass over the pixel data. This is faster than running the corresponding commands one after another, as the image data is transferred through the memory only once. Consecutive point operation commands are combined automatically in distributed processing mode.",
+			{
+				CommandArgument<string>(ParameterDirection::In, "operations", "The operations to perform, separated by | character, e.g. 'add(10) | multiply(2) | neglog | threshold(0.5)'. Supported operations are add, subtract, invsubtract, multiply, divide, pow, max, min, set, threshold, thresholdrange, doublethreshold, replace, linmap, thresholdperiodic, swapbyteorder, negate, abs, exponentiate, square, squareroot, log, neglog, log10, sin, cos, tan, inv, round, ceil, and floor. Their parameters are given in parentheses, and they have the same meaning than in the corresponding commands.")
+			},
+			"add, subtract, multiply, divide, threshold, linmap")
+		{
+
+		}
+
+	public:
+		virtual void run(Image<pixel_t>& img, std::vector<ParamVariant>& args) const override
+		{
+			string operations = pop<string>(args);
+			pointOperations(img, operations);
+		}
+
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override
+		{
+			return std::get<string>(args[1]);
+		}
 	};
 
 
@@ -473,6 +557,11 @@ namespace pilib
 			double param = pop<double>(args); \
 			itl2:: commandname (img, param); \
 		} \
+	\
+		virtual std::string getPointOperation(const std::vector<ParamVariant>& args) const override \
+		{ \
+			return pointOperationString(#commandname, args); \
+		} \
 	};
 
 	DEF_MATH_DUAL(Add, add, "Adds two images. Output is placed to the first image. The operation is performed using saturation arithmetic.", "Adds and image and a constant. The operation is performed using saturation arithmetic.", "Constant to add to the image.")
@@ -8,6 +8,7 @@
 #include "overlapdistributable.h"
 #include "commandlist.h"
 #include "distributedtempimage.h"
+#include "pilibutilities.h"
 
 #include <string>
 
@@ -112,8 +113,8 @@ namespace pilib
 			out(0) = res;																					\
 			if(print)																						\
 			{																								\
-				std::cout << #funcname << " = " << out(0) << std::endl;										\
-				std::cout << "count = " << in.pixelCount() << std::endl;									\
+				jobOutput() << #funcname << " = " << out(0) << std::endl;										\
+				jobOutput() << "count = " << in.pixelCount() << std::endl;									\
 			}																								\
 		}																									\
 																											\
@@ -410,8 +411,8 @@ namespace pilib
 			
 			if(print)																						
 			{																								
-				std::cout << "maskedmean = " << res << std::endl;												
-				std::cout << "count = " << count << std::endl;												
+				jobOutput() << "maskedmean = " << res << std::endl;												
+				jobOutput() << "count = " << count << std::endl;												
 			}																								
 		}																									
 																											
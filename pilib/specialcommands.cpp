@@ -23,6 +23,7 @@ namespace pilib
 		CommandList::add<MaxMemoryCommand>();
 		CommandList::add<MaxJobsCommand>();
 		CommandList::add<ChunkSizeCommand>();
+		CommandList::add<NN5IOConcurrencyCommand>();
 		CommandList::add<DelayingCommand>();
 		CommandList::add<PrintTaskScriptsCommand>();
 		CommandList::add<EchoCommandsCommand>();
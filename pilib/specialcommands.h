@@ -860,6 +860,27 @@ namespace pilib
 	};
 
 
+	class NN5IOConcurrencyCommand : virtual public Command, public TrivialDistributable
+	{
+	protected:
+		friend class CommandList;
+
+		NN5IOConcurrencyCommand() : Command("nn5ioconcurrency", "Sets the maximum number of NN5 dataset chunks that are read or written concurrently by this pi2 process. Decrease the value if the storage system performs poorly with many concurrent file operations, e.g. on network file systems. In distributed processing, the setting does not affect the jobs that run in separate processes.",
+			{
+				CommandArgument<size_t>(ParameterDirection::In, "max concurrent chunks", "Maximum number of chunks that are read or written concurrently. Specify zero to use the number of threads used in processing.", 0)
+			},
+			"chunksize, writenn5, readnn5block")
+		{
+		}
+
+	public:
+		virtual void run(vector<ParamVariant>& args) const override
+		{
+			nn5::setIOConcurrency(pop<size_t>(args));
+		}
+	};
+
+
 	class DelayingCommand : virtual public Command, public TrivialDistributable
 	{
 	protected:
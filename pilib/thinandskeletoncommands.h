@@ -29,7 +29,7 @@ namespace pilib
 	protected:
 		friend class CommandList;
 
-		SurfaceThinCommand() : OverlapDistributable<OneImageInPlaceCommand<pixel_t> >("surfacethin", "Thins one layer of pixels from the foreground of the image. Positive pixels are assumed to belong to the foreground. Run iteratively to calculate a surface skeleton. " + skeleDistributionNote(),
+		SurfaceThinCommand() : OverlapDistributable<OneImageInPlaceCommand<pixel_t> >("surfacethin", "Thins one layer of pixels from the foreground of the image. All nonzero pixels are assumed to belong to the foreground. The image does not need to be binary, but all nonzero values (also negative ones) are treated the same way. Run iteratively to calculate a surface skeleton. " + skeleDistributionNote(),
 			{
 				CommandArgument<bool>(ParameterDirection::In, "retain surfaces", "Set to false to allow thinning of surfaces to lines if the surface does not surround a cavity.", true)
 			},
@@ -42,7 +42,7 @@ namespace pilib
 		{
 			bool retainSurfaces = pop<bool>(args);
 			size_t changed = thin(in, retainSurfaces);
-			std::cout << std::endl << changed << " pixels removed." << std::endl;
+			jobOutput() << std::endl << changed << " pixels removed." << std::endl;
 		}
 
 		virtual Vec3c calculateOverlap(const vector<ParamVariant>& args) const override
@@ -68,7 +68,7 @@ namespace pilib
 	protected:
 		friend class CommandList;
 
-		LineThinCommand() : OverlapDistributable<OneImageInPlaceCommand<pixel_t> >("linethin", "Thins one layer of pixels from the foreground of the image. Positive pixels are assumed to belong to the foreground. Run iteratively to calculate a line skeleton. " + skeleDistributionNote(),
+		LineThinCommand() : OverlapDistributable<OneImageInPlaceCommand<pixel_t> >("linethin", "Thins one layer of pixels from the foreground of the image. All nonzero pixels are assumed to belong to the foreground. The image does not need to be binary, but all nonzero values (also negative ones) are treated the same way. Run iteratively to calculate a line skeleton. " + skeleDistributionNote(),
 			{},
 			skeleSeeAlso())
 		{
@@ -78,7 +78,7 @@ namespace pilib
 		virtual void run(Image<pixel_t>& in, vector<ParamVariant>& args) const override
 		{
 			size_t changed = lineThin(in);
-			std::cout << std::endl << changed << " pixels removed." << std::endl;
+			jobOutput() << std::endl << changed << " pixels removed." << std::endl;
 		}
 
 		virtual Vec3c calculateOverlap(const vector<ParamVariant>& args) const override
@@ -174,7 +174,7 @@ namespace pilib
 	protected:
 		friend class CommandList;
 
-		SurfaceSkeletonCommand() : IterableDistributable<SurfaceThinCommand<pixel_t>, OneImageInPlaceCommand<pixel_t> >("surfaceskeleton", "Calculates skeleton of the foreground of the given image. Positive pixels are assumed to belong to the foreground. The skeleton may contain both lines and plates. " + skeleDistributionNote(),
+		SurfaceSkeletonCommand() : IterableDistributable<SurfaceThinCommand<pixel_t>, OneImageInPlaceCommand<pixel_t> >("surfaceskeleton", "Calculates skeleton of the foreground of the given image. All nonzero pixels are assumed to belong to the foreground. The image does not need to be binary, but all nonzero values (also negative ones) are treated the same way. The skeleton may contain both lines and plates. " + skeleDistributionNote(),
 			{
 				CommandArgument<bool>(ParameterDirection::In, "retain surfaces", "Set to false to allow thinning of surfaces to lines if the surface does not surround a cavity.", true)
 			},
@@ -195,7 +195,7 @@ namespace pilib
 	protected:
 		friend class CommandList;
 
-		LineSkeletonCommand() : IterableDistributable<LineThinCommand<pixel_t>, OneImageInPlaceCommand<pixel_t> >("lineskeleton", "Calculates skeleton of the foreground of the given image. Positive pixels are assumed to belong to the foreground. The skeleton contains only lines (no plates). " + skeleDistributionNote(),
+		LineSkeletonCommand() : IterableDistributable<LineThinCommand<pixel_t>, OneImageInPlaceCommand<pixel_t> >("lineskeleton", "Calculates skeleton of the foreground of the given image. All nonzero pixels are assumed to belong to the foreground. The image does not need to be binary, but all nonzero values (also negative ones) are treated the same way. The skeleton contains only lines (no plates). " + skeleDistributionNote(),
 			{},
 			skeleSeeAlso())
 		{
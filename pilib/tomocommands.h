@@ -103,16 +103,57 @@ namespace pilib
 #if defined(USE_OPENCL)
 				backprojectOpenCL(in, sets, out);
 #else
-				backproject(in, sets, out);
+				backprojectBlocked(in, sets, out);
 #endif
 			}
 			else
 			{
-				backproject(in, sets, out);
+				backprojectBlocked(in, sets, out);
 			}
 		}
 	};
 
+	class FBPStreamingCommand : public Command
+	{
+	protected:
+		friend class CommandList;
+
+		FBPStreamingCommand() : Command("fbpstreaming", "Performs preprocessing and filtered backprojection of transmission projections stored in a .raw file, for datasets that do not fit into the memory. "
+			"The projections are preprocessed in batches as in fbppreprocess, and the preprocessed projections are stored in a temporary file. "
+			"The reconstruction is then calculated one slab of slices at a time as in fbp, reading only the projection rows needed for each slab. "
+			"Disk input and output are overlapped with processing. This command is experimental and may change in the near future.",
+			{
+				CommandArgument<std::string>(ParameterDirection::In, "input file", "Name of .raw file containing the transmission projections. The pixel data type must be float32."),
+				CommandArgument<std::string>(ParameterDirection::In, "output file", "Template of the output file name. The dimensions of the reconstruction are appended to the name, and the temporary file is named [output file]_preprocessed_[dimensions].raw."),
+				CommandArgument<std::string>(ParameterDirection::In, "reconstruction settings", "Settings for the reconstruction. If this string contains only a name of an existing file, the settings are read from that file. Otherwise, the string is treated as contents of the settings file.", ""),
+				CommandArgument<double>(ParameterDirection::In, "maximum memory", "Approximate maximum amount of memory used for projection and output buffers, in gigabytes.", 16.0)
+			},
+			"fbppreprocess, fbp")
+		{
+		}
+
+	public:
+		virtual void run(std::vector<ParamVariant>& args) const override
+		{
+			std::string inFile = pop<std::string>(args);
+			std::string outFile = pop<std::string>(args);
+			std::string settings = pop<std::string>(args);
+			double maxMemory = pop<double>(args);
+
+			if (maxMemory <= 0)
+				throw ITLException("Maximum memory must be positive.");
+
+			if (fs::exists(settings))
+			{
+				settings = readText(settings, true);
+			}
+
+			RecSettings sets = fromString<RecSettings>(settings);
+
+			fbpStreaming(inFile, outFile, sets, (size_t)(maxMemory * 1024 * 1024 * 1024));
+		}
+	};
+
 	class CreateFBPFilterCommand : public Command
 	{
 	protected:
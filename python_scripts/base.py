@@ -25,6 +25,9 @@ cluster = ""
 # Maximum image dimension to use while stitching. 2500 corresponds to ~120 GB memory requirement.
 max_block_size = 2500
 
+# Spacing of the points where the displacement field is evaluated exactly while stitching.
+shift_field_step = 4
+
 
 
 def is_use_cluster():
@@ -56,6 +59,7 @@ def read_global_settings(config):
     global pi_path
     global cluster
     global max_block_size
+    global shift_field_step
 
     # Path to pi2 program. By default directory of running script.
     pi_path = os.path.dirname(os.path.realpath(__file__))
@@ -72,6 +76,9 @@ def read_global_settings(config):
     # Maximum stitching block size
     max_block_size = get(config, 'max_block_size', max_block_size)
 
+    # Displacement field interpolation step
+    shift_field_step = get(config, 'shift_field_step', shift_field_step)
+
 
 
 
@@ -1574,7 +1581,7 @@ def run_stitching(comp, sample_name, normalize, max_circle, global_optimization,
                 if not create_goodness_file:
                     pi_script = (f"echo;"
                                  f"newlikefile(outimg, {first_file_name}, Unknown, 1, 1, 1);"
-                                 f"stitch_ver2(outimg, {index_file}, {xstart}, {ystart}, {zstart}, {curr_width}, {curr_height}, {curr_depth}, {normalize}, {max_circle});"
+                                 f"stitch_ver2(outimg, {index_file}, {xstart}, {ystart}, {zstart}, {curr_width}, {curr_height}, {curr_depth}, {normalize}, {max_circle}, {shift_field_step});"
                                  f"writerawblock(outimg, {out_file}, [{xstart - minx}, {ystart - miny}, {zstart - minz}], [{out_width}, {out_height}, {out_depth}]);"
                                  f"newimage(marker, uint8, 1, 1, 1);"
                                  f"writetif(marker, {out_template}_{jobs_started}_done);"
@@ -1583,7 +1590,7 @@ def run_stitching(comp, sample_name, normalize, max_circle, global_optimization,
                     pi_script = (f"echo;"
                              f"newlikefile(outimg, {first_file_name}, Unknown, 1, 1, 1);"
                              f"newlikefile(goodnessimg, {first_file_name}, Unknown, 1, 1, 1);"
-                             f"stitch_ver3(outimg, goodnessimg, {index_file}, {xstart}, {ystart}, {zstart}, {curr_width}, {curr_height}, {curr_depth}, {normalize}, {max_circle});"
+                             f"stitch_ver3(outimg, goodnessimg, {index_file}, {xstart}, {ystart}, {zstart}, {curr_width}, {curr_height}, {curr_depth}, {normalize}, {max_circle}, {shift_field_step});"
                              f"writerawblock(outimg, {out_file}, [{xstart - minx}, {ystart - miny}, {zstart - minz}], [{out_width}, {out_height}, {out_depth}]);"
                              f"writerawblock(goodnessimg, {out_goodness_file}, [{xstart - minx}, {ystart - miny}, {zstart - minz}], [{out_width}, {out_height}, {out_depth}]);"
                              f"newimage(marker, uint8, 1, 1, 1);"
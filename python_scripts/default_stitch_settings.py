@@ -111,10 +111,17 @@ cluster = {cluster_name}
 
 
 # Maximum size of image block that is processed in one process is max_block_size^3.
-# Set to such a value that (2 * pixel_size_in_bytes + 4) * max_block_size^3 < available memory in bytes.
+# Set to such a value that (2 * pixel_size_in_bytes + 4 + 12 / shift_field_step^3) * max_block_size^3 < available memory in bytes.
 max_block_size = 2500
 
 
+# The displacement field is evaluated exactly at every shift_field_step:th pixel and
+# linearly interpolated between those points.
+# Set to 1 to evaluate the displacement exactly at each pixel. That requires 12 additional
+# bytes of memory per pixel in the processed block, so max_block_size must be decreased accordingly.
+shift_field_step = 4
+
+
 
 
 [positions]